@@ -0,0 +1,984 @@
+#include "BVH.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+//Half the surface area, the factor of two cancels in every ratio the heuristic uses
+static float HalfArea(const float* min, const float* max)
+{
+	float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+	if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+		return 0.0f;
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static float NodeArea(const BVHNode& n)
+{
+	float min[] = { n.minx, n.miny, n.minz };
+	float max[] = { n.maxx, n.maxy, n.maxz };
+	return HalfArea(min, max);
+}
+
+static void ResetBounds(float* min, float* max)
+{
+	min[0] = min[1] = min[2] = FLT_MAX;
+	max[0] = max[1] = max[2] = -FLT_MAX;
+}
+
+static void GrowBounds(float* min, float* max, const float* otherMin, const float* otherMax)
+{
+	for (int a = 0; a < 3; a++)
+	{
+		min[a] = (std::min)(min[a], otherMin[a]);
+		max[a] = (std::max)(max[a], otherMax[a]);
+	}
+}
+
+static void GrowBounds(float* min, float* max, const Triangle& t)
+{
+	const TriangleVertex* v[] = { &t.v1, &t.v2, &t.v3 };
+	for (const TriangleVertex* vert : v)
+	{
+		float p[] = { vert->posx, vert->posy, vert->posz };
+		GrowBounds(min, max, p, p);
+	}
+}
+
+static void GrowBounds(float* min, float* max, const Sphere& s)
+{
+	float lo[] = { s.posx - s.radius, s.posy - s.radius, s.posz - s.radius };
+	float hi[] = { s.posx + s.radius, s.posy + s.radius, s.posz + s.radius };
+	GrowBounds(min, max, lo, hi);
+}
+
+//Spatial splits clip triangles, spheres can only be split by object
+static const Triangle* ClippableTriangles(const Triangle* triangles)
+{
+	return triangles;
+}
+
+static const Triangle* ClippableTriangles(const Sphere*)
+{
+	return nullptr;
+}
+
+static void SetNodeBounds(BVHNode& n, const float* min, const float* max)
+{
+	n.minx = min[0]; n.miny = min[1]; n.minz = min[2];
+	n.maxx = max[0]; n.maxy = max[1]; n.maxz = max[2];
+}
+
+const char* GetBVHNodeOrderName(BVHNodeOrder order)
+{
+	switch (order)
+	{
+	case BVH_ORDER_BREADTH_FIRST:
+		return "breadth first";
+	case BVH_ORDER_DEPTH_FIRST:
+		return "depth first";
+	case BVH_ORDER_TREELETS:
+		return "treelets";
+	default:
+		return "unknown";
+	}
+}
+
+BVH::BVH()
+{
+}
+
+BVH::~BVH()
+{
+}
+
+void BVH::Build(const Triangle * triangles, unsigned first, unsigned count, const BVHBuildSettings & settings)
+{
+	PROFILE_ZONE("BVH::Build");
+	_spheres = false;
+	_Build(triangles, first, count, settings);
+}
+
+void BVH::Build(const Sphere * spheres, unsigned first, unsigned count, const BVHBuildSettings & settings)
+{
+	PROFILE_ZONE("BVH::Build");
+	_spheres = true;
+	_Build(spheres, first, count, settings);
+}
+
+template<typename Primitive>
+void BVH::_Build(const Primitive * primitives, unsigned first, unsigned count, const BVHBuildSettings & settings)
+{
+	_settings = settings;
+	_settings.binCount = (std::max)(2U, _settings.binCount);
+	_first = first;
+	_count = count;
+	_nodes.clear();
+	_parents.clear();
+	_leaves.clear();
+	_triangleIndices.clear();
+	_buildCost = _cost = 0.0f;
+	if (count == 0)
+		return;
+
+	std::vector<BuildPrimitive> buildPrimitives(count);
+	float rootMin[3], rootMax[3];
+	ResetBounds(rootMin, rootMax);
+	for (unsigned i = 0; i < count; i++)
+	{
+		BuildPrimitive& p = buildPrimitives[i];
+		ResetBounds(p.min, p.max);
+		GrowBounds(p.min, p.max, primitives[first + i]);
+		for (int a = 0; a < 3; a++)
+			p.centroid[a] = (p.min[a] + p.max[a]) * 0.5f;
+		p.triangle = first + i;
+		GrowBounds(rootMin, rootMax, p.min, p.max);
+	}
+
+	_buildTriangles = ClippableTriangles(primitives);
+	_spatialSplitsLeft = _buildTriangles ? (size_t)(count * (std::max)(0.0f, _settings.spatialSplitBudget)) : 0;
+	_minSpatialOverlap = _settings.spatialSplitOverlap * HalfArea(rootMin, rootMax);
+	_triangleIndices.reserve(count + _spatialSplitsLeft);
+	_nodes.push_back(BVHNode());
+	_parents.push_back(-1);
+	_Split(0, buildPrimitives, 0);
+	_buildTriangles = nullptr;
+
+	if (_settings.restructureSeconds > 0.0)
+		Restructure(_settings.restructureSeconds);
+	else
+		Reorder(_settings.nodeOrder);
+	_buildCost = _cost = ComputeSAHCost();
+	if (_triangleIndices.size() > count)
+	{
+		//A refit bounds whole triangles rather than the clipped parts a spatial split kept,
+		//so the rebuild heuristic has to compare against the cost of a refit of the fresh tree
+		std::vector<BVHNode> clipped = _nodes;
+		_buildCost = _Refit(primitives);
+		_nodes.swap(clipped);
+		_cost = ComputeSAHCost();
+	}
+}
+
+void BVH::_MakeLeaf(int node, const std::vector<BuildPrimitive>& primitives)
+{
+	_nodes[node].leftFirst = (int)_triangleIndices.size();
+	_nodes[node].count = (int)primitives.size();
+	for (const BuildPrimitive& p : primitives)
+		_triangleIndices.push_back(p.triangle);
+	_leaves.push_back(node);
+}
+
+//Bounds of the part of t between lo and hi along axis, cut down to the bounds its reference had so far.
+//The part is convex, so its bounds are those of the pieces of the three edges inside the slab.
+static bool ClipTriangleBounds(const Triangle& t, int axis, float lo, float hi, const float* refMin, const float* refMax, float* min, float* max)
+{
+	const float v[3][3] = { { t.v1.posx, t.v1.posy, t.v1.posz }, { t.v2.posx, t.v2.posy, t.v2.posz }, { t.v3.posx, t.v3.posy, t.v3.posz } };
+	ResetBounds(min, max);
+	for (int i = 0; i < 3; i++)
+	{
+		const float* a = v[i];
+		const float* b = v[i == 2 ? 0 : i + 1];
+		float d[] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float t0 = 0.0f, t1 = 1.0f;
+		if (d[axis] != 0.0f)
+		{
+			float rcp = 1.0f / d[axis];
+			float ta = (lo - a[axis]) * rcp, tb = (hi - a[axis]) * rcp;
+			t0 = (std::max)(t0, (std::min)(ta, tb));
+			t1 = (std::min)(t1, (std::max)(ta, tb));
+		}
+		else if (a[axis] < lo || a[axis] > hi)
+			continue;
+		if (t0 > t1)
+			continue;
+		float p0[] = { a[0] + d[0] * t0, a[1] + d[1] * t0, a[2] + d[2] * t0 };
+		float p1[] = { a[0] + d[0] * t1, a[1] + d[1] * t1, a[2] + d[2] * t1 };
+		GrowBounds(min, max, p0, p0);
+		GrowBounds(min, max, p1, p1);
+	}
+	min[axis] = (std::max)(min[axis], lo);
+	max[axis] = (std::min)(max[axis], hi);
+	for (int a = 0; a < 3; a++)
+	{
+		min[a] = (std::max)(min[a], refMin[a]);
+		max[a] = (std::min)(max[a], refMax[a]);
+		if (min[a] > max[a])
+			return false;
+	}
+	return true;
+}
+
+void BVH::_Split(int node, std::vector<BuildPrimitive>& primitives, unsigned depth)
+{
+	float min[3], max[3], centroidMin[3], centroidMax[3];
+	ResetBounds(min, max);
+	ResetBounds(centroidMin, centroidMax);
+	for (const BuildPrimitive& p : primitives)
+	{
+		GrowBounds(min, max, p.min, p.max);
+		GrowBounds(centroidMin, centroidMax, p.centroid, p.centroid);
+	}
+	SetNodeBounds(_nodes[node], min, max);
+
+	unsigned count = (unsigned)primitives.size();
+	if (count == 1 || depth >= BVH_MAX_DEPTH)
+	{
+		_MakeLeaf(node, primitives);
+		return;
+	}
+
+	//Object split: bin the centroids along every axis and sweep the bin boundaries for the cheapest split
+	const unsigned binCount = _settings.binCount;
+	struct Bin
+	{
+		float min[3];
+		float max[3];
+		unsigned count;   //Object bins count the references in them,
+		unsigned exits;   //spatial bins the ones starting (count) and ending (exits) in them
+	};
+	std::vector<Bin> bins(binCount);
+	std::vector<Bin> right(binCount); //right[b] covers the bins after boundary b
+
+	float nodeArea = (std::max)(HalfArea(min, max), FLT_MIN);
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	unsigned bestBin = 0;
+	float overlapMin[3], overlapMax[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+			continue;
+		float scale = binCount * (1.0f - 1e-5f) / extent;
+		for (Bin& b : bins)
+		{
+			ResetBounds(b.min, b.max);
+			b.count = 0;
+		}
+		for (const BuildPrimitive& p : primitives)
+		{
+			unsigned b = (std::min)(binCount - 1, (unsigned)((p.centroid[axis] - centroidMin[axis]) * scale));
+			GrowBounds(bins[b].min, bins[b].max, p.min, p.max);
+			bins[b].count++;
+		}
+
+		Bin acc;
+		ResetBounds(acc.min, acc.max);
+		acc.count = 0;
+		for (unsigned b = binCount - 1; b > 0; b--)
+		{
+			GrowBounds(acc.min, acc.max, bins[b].min, bins[b].max);
+			acc.count += bins[b].count;
+			right[b - 1] = acc;
+		}
+		ResetBounds(acc.min, acc.max);
+		acc.count = 0;
+		for (unsigned b = 0; b + 1 < binCount; b++)
+		{
+			GrowBounds(acc.min, acc.max, bins[b].min, bins[b].max);
+			acc.count += bins[b].count;
+			if (acc.count == 0 || right[b].count == 0)
+				continue;
+			float cost = _settings.traversalCost + _settings.intersectionCost *
+				(HalfArea(acc.min, acc.max) * acc.count + HalfArea(right[b].min, right[b].max) * right[b].count) / nodeArea;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+				for (int a = 0; a < 3; a++)
+				{
+					overlapMin[a] = (std::max)(acc.min[a], right[b].min[a]);
+					overlapMax[a] = (std::min)(acc.max[a], right[b].max[a]);
+				}
+			}
+		}
+	}
+
+	//Spatial split: only worth a look where the children of the best object split overlap a lot,
+	//which is where big triangles end up. Bins are laid over the node bounds and every reference is
+	//clipped into each bin it crosses, so a child only grows around the part of a triangle inside it.
+	//Clipping dominates the build time, so only the longest axis of the node is tried.
+	bool spatial = false;
+	unsigned spatialCopies = 0;
+	if (_spatialSplitsLeft > 0 && (bestAxis < 0 || HalfArea(overlapMin, overlapMax) > _minSpatialOverlap))
+	{
+		int axis = max[0] - min[0] > max[1] - min[1] ? 0 : 1;
+		axis = max[2] - min[2] > max[axis] - min[axis] ? 2 : axis;
+		float extent = max[axis] - min[axis];
+		if (extent > 0.0f)
+		{
+			float binWidth = extent / binCount;
+			for (Bin& b : bins)
+			{
+				ResetBounds(b.min, b.max);
+				b.count = b.exits = 0;
+			}
+			for (const BuildPrimitive& p : primitives)
+			{
+				unsigned first = (std::min)(binCount - 1, (unsigned)((std::max)(0.0f, p.min[axis] - min[axis]) / binWidth));
+				unsigned last = (std::min)(binCount - 1, (unsigned)((std::max)(0.0f, p.max[axis] - min[axis]) / binWidth));
+				for (unsigned b = first; b <= last; b++)
+				{
+					float lo = min[axis] + b * binWidth;
+					float hi = b + 1 == binCount ? max[axis] : lo + binWidth;
+					float clipMin[3], clipMax[3];
+					if (first == last)
+						GrowBounds(bins[b].min, bins[b].max, p.min, p.max);
+					else if (ClipTriangleBounds(_buildTriangles[p.triangle], axis, lo, hi, p.min, p.max, clipMin, clipMax))
+						GrowBounds(bins[b].min, bins[b].max, clipMin, clipMax);
+				}
+				bins[first].count++;
+				bins[last].exits++;
+			}
+
+			Bin acc;
+			ResetBounds(acc.min, acc.max);
+			acc.exits = 0;
+			for (unsigned b = binCount - 1; b > 0; b--)
+			{
+				GrowBounds(acc.min, acc.max, bins[b].min, bins[b].max);
+				acc.exits += bins[b].exits;
+				right[b - 1] = acc;
+			}
+			ResetBounds(acc.min, acc.max);
+			acc.count = 0;
+			for (unsigned b = 0; b + 1 < binCount; b++)
+			{
+				GrowBounds(acc.min, acc.max, bins[b].min, bins[b].max);
+				acc.count += bins[b].count;
+				unsigned copies = acc.count + right[b].exits - count;
+				if (acc.count == 0 || right[b].exits == 0 || copies > _spatialSplitsLeft)
+					continue;
+				float cost = _settings.traversalCost + _settings.intersectionCost *
+					(HalfArea(acc.min, acc.max) * acc.count + HalfArea(right[b].min, right[b].max) * right[b].exits) / nodeArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+					spatial = true;
+					spatialCopies = copies;
+				}
+			}
+		}
+	}
+
+	float leafCost = _settings.intersectionCost * count;
+	if (count <= _settings.maxLeafSize && (bestAxis < 0 || bestCost >= leafCost))
+	{
+		_MakeLeaf(node, primitives);
+		return;
+	}
+
+	std::vector<BuildPrimitive> left, rightPrimitives;
+	if (spatial)
+	{
+		float binWidth = (max[bestAxis] - min[bestAxis]) / binCount;
+		float plane = min[bestAxis] + (bestBin + 1) * binWidth;
+		_spatialSplitsLeft -= spatialCopies;
+		for (const BuildPrimitive& p : primitives)
+		{
+			unsigned first = (std::min)(binCount - 1, (unsigned)((std::max)(0.0f, p.min[bestAxis] - min[bestAxis]) / binWidth));
+			unsigned last = (std::min)(binCount - 1, (unsigned)((std::max)(0.0f, p.max[bestAxis] - min[bestAxis]) / binWidth));
+			if (last <= bestBin)
+				left.push_back(p);
+			else if (first > bestBin)
+				rightPrimitives.push_back(p);
+			else
+			{
+				//Straddles the plane, each side keeps a reference bounded by its own part of the triangle
+				BuildPrimitive clipped = p;
+				if (ClipTriangleBounds(_buildTriangles[p.triangle], bestAxis, -FLT_MAX, plane, p.min, p.max, clipped.min, clipped.max))
+					left.push_back(clipped);
+				if (ClipTriangleBounds(_buildTriangles[p.triangle], bestAxis, plane, FLT_MAX, p.min, p.max, clipped.min, clipped.max))
+					rightPrimitives.push_back(clipped);
+			}
+		}
+		for (std::vector<BuildPrimitive>* side : { &left, &rightPrimitives })
+			for (BuildPrimitive& p : *side)
+				for (int a = 0; a < 3; a++)
+					p.centroid[a] = (p.min[a] + p.max[a]) * 0.5f;
+	}
+	else if (bestAxis >= 0)
+	{
+		float scale = binCount * (1.0f - 1e-5f) / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		float lo = centroidMin[bestAxis];
+		for (const BuildPrimitive& p : primitives)
+		{
+			bool isLeft = (std::min)(binCount - 1, (unsigned)((p.centroid[bestAxis] - lo) * scale)) <= bestBin;
+			(isLeft ? left : rightPrimitives).push_back(p);
+		}
+	}
+	//Every centroid in the same spot, any split is as good as another.
+	//Clipping can also lose a sliver of a reference and empty one side.
+	if (left.empty() || rightPrimitives.empty())
+	{
+		left.assign(primitives.begin(), primitives.begin() + count / 2);
+		rightPrimitives.assign(primitives.begin() + count / 2, primitives.end());
+	}
+	//The references of this node are not needed anymore, free them before going deeper
+	std::vector<BuildPrimitive>().swap(primitives);
+
+	int leftNode = (int)_nodes.size();
+	_nodes[node].leftFirst = leftNode;
+	_nodes[node].count = 0;
+	_nodes.resize(_nodes.size() + 2);
+	_parents.push_back(node);
+	_parents.push_back(node);
+	_Split(leftNode, left, depth + 1);
+	_Split(leftNode + 1, rightPrimitives, depth + 1);
+}
+
+float BVH::Refit(const Triangle * triangles)
+{
+	PROFILE_ZONE("BVH::Refit");
+	return _Refit(triangles);
+}
+
+float BVH::Refit(const Sphere * spheres)
+{
+	PROFILE_ZONE("BVH::Refit");
+	return _Refit(spheres);
+}
+
+template<typename Primitive>
+float BVH::_Refit(const Primitive * primitives)
+{
+	if (_nodes.empty())
+		return 0.0f;
+
+	//Every worker refits a share of the leaves and walks up from each. Of the two children of an
+	//inner node the one that arrives second computes its bounds, so every node is written exactly once
+	//and only after both children are final. The sah sums are gathered on the way.
+	std::unique_ptr<std::atomic<int>[]> arrivals(new std::atomic<int>[_nodes.size()]());
+	std::vector<double> innerArea(GetWorkerCount(), 0.0);
+	std::vector<double> leafArea(GetWorkerCount(), 0.0);
+	ParallelFor(_leaves.size(), BVH_REFIT_CHUNK, [&](size_t begin, size_t end, unsigned worker)
+	{
+		double inner = 0.0, leaf = 0.0;
+		for (size_t l = begin; l < end; l++)
+		{
+			int index = _leaves[l];
+			BVHNode& node = _nodes[index];
+			float min[3], max[3];
+			ResetBounds(min, max);
+			for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+				GrowBounds(min, max, primitives[_triangleIndices[i]]);
+			SetNodeBounds(node, min, max);
+			leaf += (double)HalfArea(min, max) * node.count;
+
+			for (int parent = _parents[index]; parent >= 0; parent = _parents[parent])
+			{
+				if (arrivals[parent].fetch_add(1, std::memory_order_acq_rel) == 0)
+					break;
+				BVHNode& p = _nodes[parent];
+				const BVHNode& a = _nodes[p.leftFirst];
+				const BVHNode& b = _nodes[p.leftFirst + 1];
+				p.minx = (std::min)(a.minx, b.minx); p.miny = (std::min)(a.miny, b.miny); p.minz = (std::min)(a.minz, b.minz);
+				p.maxx = (std::max)(a.maxx, b.maxx); p.maxy = (std::max)(a.maxy, b.maxy); p.maxz = (std::max)(a.maxz, b.maxz);
+				inner += NodeArea(p);
+			}
+		}
+		innerArea[worker] += inner;
+		leafArea[worker] += leaf;
+	});
+
+	double inner = 0.0, leaf = 0.0;
+	for (size_t w = 0; w < innerArea.size(); w++)
+	{
+		inner += innerArea[w];
+		leaf += leafArea[w];
+	}
+	float rootArea = NodeArea(_nodes[0]);
+	_cost = rootArea > 0.0f ? (float)((_settings.traversalCost * inner + _settings.intersectionCost * leaf) / rootArea) : 0.0f;
+	return _cost;
+}
+
+bool BVH::RefitOrRebuild(const Triangle * triangles)
+{
+	Refit(triangles);
+	if (_buildCost <= 0.0f || _cost <= _buildCost * _settings.rebuildThreshold)
+		return false;
+	PROFILE_COUNTER("BVH rebuilds", 1.0);
+	Build(triangles, _first, _count, _settings);
+	return true;
+}
+
+bool BVH::RefitOrRebuild(const Sphere * spheres)
+{
+	Refit(spheres);
+	if (_buildCost <= 0.0f || _cost <= _buildCost * _settings.rebuildThreshold)
+		return false;
+	PROFILE_COUNTER("BVH rebuilds", 1.0);
+	Build(spheres, _first, _count, _settings);
+	return true;
+}
+
+//The tree Restructure works on, with explicit children instead of sibling pairs so any two nodes can become siblings
+struct RestructureTree
+{
+	std::vector<BVHNode>& nodes; //Only the bounds of inner nodes are kept up to date
+	std::vector<int>& parents;
+	std::vector<int> left;
+	std::vector<int> right;
+	std::vector<float> cost;     //Sah cost of the subtree, not yet divided by the root area
+	std::vector<int> height;
+	std::vector<int> depth;      //As of the start of the round, ancestors of a node only change after it
+	float traversalCost;
+	float intersectionCost;
+
+	RestructureTree(std::vector<BVHNode>& n, std::vector<int>& p) : nodes(n), parents(p) {}
+
+	void Update(int node)
+	{
+		cost[node] = traversalCost * NodeArea(nodes[node]) + cost[left[node]] + cost[right[node]];
+		height[node] = 1 + (std::max)(height[left[node]], height[right[node]]);
+	}
+};
+
+//Bounds, cost and the best split of every subset of the leaves of one treelet
+struct Treelet
+{
+	int leaves[BVH_TREELET_LEAVES];
+	int inner[BVH_TREELET_LEAVES - 1]; //The treelet root first
+	unsigned leafCount;
+	unsigned innerCount;
+	float min[1 << BVH_TREELET_LEAVES][3];
+	float max[1 << BVH_TREELET_LEAVES][3];
+	float cost[1 << BVH_TREELET_LEAVES];
+	int height[1 << BVH_TREELET_LEAVES];
+	unsigned split[1 << BVH_TREELET_LEAVES];
+	unsigned nextInner;
+
+	//Reuses the inner nodes of the old topology for the new one
+	int Emit(RestructureTree& tree, unsigned set)
+	{
+		if ((set & (set - 1)) == 0)
+		{
+			unsigned leaf = 0;
+			while (!(set >> leaf & 1))
+				leaf++;
+			return leaves[leaf];
+		}
+		int node = inner[nextInner++];
+		int l = Emit(tree, split[set]);
+		int r = Emit(tree, set ^ split[set]);
+		tree.left[node] = l;
+		tree.right[node] = r;
+		tree.parents[l] = tree.parents[r] = node;
+		SetNodeBounds(tree.nodes[node], min[set], max[set]);
+		tree.cost[node] = cost[set];
+		tree.height[node] = height[set];
+		return node;
+	}
+};
+
+static void RestructureTreelet(RestructureTree& tree, int root)
+{
+	Treelet t;
+	t.leaves[0] = tree.left[root];
+	t.leaves[1] = tree.right[root];
+	t.inner[0] = root;
+	t.leafCount = 2;
+	t.innerCount = 1;
+	//Opening the biggest leaf first gathers the nodes a restructure can gain the most on
+	while (t.leafCount < BVH_TREELET_LEAVES)
+	{
+		int open = -1;
+		float openArea = -1.0f;
+		for (unsigned i = 0; i < t.leafCount; i++)
+		{
+			int node = t.leaves[i];
+			if (tree.left[node] >= 0 && NodeArea(tree.nodes[node]) > openArea)
+			{
+				open = (int)i;
+				openArea = NodeArea(tree.nodes[node]);
+			}
+		}
+		if (open < 0)
+			break;
+		int node = t.leaves[open];
+		t.inner[t.innerCount++] = node;
+		t.leaves[open] = tree.left[node];
+		t.leaves[t.leafCount++] = tree.right[node];
+	}
+	tree.Update(root);
+	if (t.leafCount < 3)
+		return;
+
+	//Every proper subset of a set is smaller than it, so walking the sets upwards finds the parts solved already
+	unsigned all = (1U << t.leafCount) - 1;
+	for (unsigned set = 1; set <= all; set++)
+	{
+		unsigned low = set & (0U - set);
+		if (set == low)
+		{
+			unsigned leaf = 0;
+			while (!(set >> leaf & 1))
+				leaf++;
+			const BVHNode& n = tree.nodes[t.leaves[leaf]];
+			float min[] = { n.minx, n.miny, n.minz };
+			float max[] = { n.maxx, n.maxy, n.maxz };
+			ResetBounds(t.min[set], t.max[set]);
+			GrowBounds(t.min[set], t.max[set], min, max);
+			t.cost[set] = tree.cost[t.leaves[leaf]];
+			t.height[set] = tree.height[t.leaves[leaf]];
+			continue;
+		}
+		memcpy(t.min[set], t.min[set ^ low], sizeof(t.min[set]));
+		memcpy(t.max[set], t.max[set ^ low], sizeof(t.max[set]));
+		GrowBounds(t.min[set], t.max[set], t.min[low], t.max[low]);
+
+		//Each split once, with the lowest leaf always on the same side
+		float best = FLT_MAX;
+		for (unsigned part = (set - 1) & set; part; part = (part - 1) & set)
+		{
+			if (!(part & low))
+				continue;
+			float c = t.cost[part] + t.cost[set ^ part];
+			if (c < best)
+			{
+				best = c;
+				t.split[set] = part;
+			}
+		}
+		t.cost[set] = tree.traversalCost * HalfArea(t.min[set], t.max[set]) + best;
+		t.height[set] = 1 + (std::max)(t.height[t.split[set]], t.height[set ^ t.split[set]]);
+	}
+
+	//Taller is fine as long as the traversal stacks still fit the deepest leaf
+	if (t.cost[all] < tree.cost[root] * 0.9999f && tree.depth[root] + t.height[all] <= BVH_MAX_DEPTH)
+	{
+		t.nextInner = 0;
+		t.Emit(tree, all);
+	}
+}
+
+float BVH::Restructure(double seconds)
+{
+	PROFILE_ZONE("BVH::Restructure");
+	auto start = std::chrono::steady_clock::now();
+	auto outOfTime = [&]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= seconds; };
+
+	RestructureTree tree(_nodes, _parents);
+	tree.traversalCost = _settings.traversalCost;
+	tree.intersectionCost = _settings.intersectionCost;
+	tree.left.assign(_nodes.size(), -1);
+	tree.right.assign(_nodes.size(), -1);
+	tree.cost.assign(_nodes.size(), 0.0f);
+	tree.height.assign(_nodes.size(), 0);
+	tree.depth.assign(_nodes.size(), 0);
+
+	//Children come after their parent in a depth first order, so walking it backwards visits them first
+	std::vector<int> order;
+	std::vector<int> stack(1, 0);
+	while (!stack.empty() && _nodes.size() > 1)
+	{
+		int node = stack.back();
+		stack.pop_back();
+		order.push_back(node);
+		if (_nodes[node].count > 0)
+			continue;
+		tree.left[node] = _nodes[node].leftFirst;
+		tree.right[node] = _nodes[node].leftFirst + 1;
+		stack.push_back(tree.left[node]);
+		stack.push_back(tree.right[node]);
+	}
+	for (size_t i = order.size(); i-- > 0;)
+	{
+		int node = order[i];
+		if (tree.left[node] >= 0)
+			tree.Update(node);
+		else
+			tree.cost[node] = tree.intersectionCost * NodeArea(_nodes[node]) * _nodes[node].count;
+	}
+
+	while (!order.empty() && !outOfTime())
+	{
+		for (int node : order)
+			if (tree.left[node] >= 0)
+				tree.depth[tree.left[node]] = tree.depth[tree.right[node]] = tree.depth[node] + 1;
+
+		//Like Refit, the second child to arrive at a node restructures the treelet under it. Treelets being
+		//worked on at the same time never share nodes, as each lies within the subtree its root owns.
+		float before = tree.cost[0];
+		std::unique_ptr<std::atomic<int>[]> arrivals(new std::atomic<int>[_nodes.size()]());
+		ParallelFor(_leaves.size(), BVH_REFIT_CHUNK, [&](size_t begin, size_t end, unsigned)
+		{
+			for (size_t l = begin; l < end; l++)
+			{
+				for (int parent = _parents[_leaves[l]]; parent >= 0; parent = _parents[parent])
+				{
+					if (arrivals[parent].fetch_add(1, std::memory_order_acq_rel) == 0)
+						break;
+					if (outOfTime())
+						tree.Update(parent);
+					else
+						RestructureTreelet(tree, parent);
+				}
+			}
+		});
+		PROFILE_COUNTER("BVH restructure rounds", 1.0);
+		if (tree.cost[0] > before * (1.0f - BVH_RESTRUCTURE_MIN_GAIN))
+			break;
+
+		order.clear();
+		stack.assign(1, 0);
+		while (!stack.empty())
+		{
+			int node = stack.back();
+			stack.pop_back();
+			order.push_back(node);
+			if (tree.left[node] >= 0)
+			{
+				stack.push_back(tree.left[node]);
+				stack.push_back(tree.right[node]);
+			}
+		}
+	}
+
+	//Back to sibling pairs, Reorder puts them where they belong
+	if (!order.empty())
+	{
+		std::vector<BVHNode> nodes(1, _nodes[0]);
+		std::vector<int> parents(1, -1);
+		std::vector<int> oldIndex(1, 0);
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			int old = oldIndex[i];
+			if (tree.left[old] < 0)
+				continue;
+			nodes[i].leftFirst = (int)nodes.size();
+			for (int child : { tree.left[old], tree.right[old] })
+			{
+				nodes.push_back(_nodes[child]);
+				parents.push_back((int)i);
+				oldIndex.push_back(child);
+			}
+		}
+		_nodes.swap(nodes);
+		_parents.swap(parents);
+	}
+	Reorder(_settings.nodeOrder);
+	_cost = ComputeSAHCost();
+	return _cost;
+}
+
+void BVH::Reorder(BVHNodeOrder order)
+{
+	PROFILE_ZONE("BVH::Reorder");
+	if (_nodes.size() < 3)
+	{
+		//A single leaf still gets the padding below, it keeps the roots after it in the scene tables on even indices
+		if (_nodes.size() == 1)
+		{
+			BVHNode pad = _nodes[0];
+			pad.maxx = pad.minx;
+			pad.maxy = pad.miny;
+			pad.maxz = pad.minz;
+			pad.leftFirst = 0;
+			pad.count = 0;
+			_nodes.push_back(pad);
+			_parents.push_back(-1);
+		}
+		return;
+	}
+
+	//Pick the order of the sibling pairs by the old index of their parent, the bigger child goes first
+	//for the orders that care, a ray is more likely to hit it and the traversal tries the first child first
+	std::vector<int> pairs;
+	pairs.reserve(_nodes.size() / 2);
+	auto isInner = [&](int node) { return _nodes[node].count == 0; };
+	auto hotFirst = [&](int node) { return NodeArea(_nodes[_nodes[node].leftFirst + 1]) > NodeArea(_nodes[_nodes[node].leftFirst]); };
+	std::vector<bool> swapped(_nodes.size(), false);
+	if (order == BVH_ORDER_BREADTH_FIRST)
+	{
+		pairs.push_back(0);
+		for (size_t i = 0; i < pairs.size(); i++)
+		{
+			int left = _nodes[pairs[i]].leftFirst;
+			for (int child = left; child < left + 2; child++)
+				if (isInner(child))
+					pairs.push_back(child);
+		}
+	}
+	else if (order == BVH_ORDER_DEPTH_FIRST)
+	{
+		std::vector<int> stack(1, 0);
+		while (!stack.empty())
+		{
+			int node = stack.back();
+			stack.pop_back();
+			pairs.push_back(node);
+			swapped[node] = hotFirst(node);
+			int hot = _nodes[node].leftFirst + (swapped[node] ? 1 : 0);
+			int cold = _nodes[node].leftFirst + (swapped[node] ? 0 : 1);
+			if (isInner(cold))
+				stack.push_back(cold);
+			if (isInner(hot))
+				stack.push_back(hot);
+		}
+	}
+	else
+	{
+		//Each treelet grows from its root by the biggest node whose children are not placed yet,
+		//what is left over when it is full starts the next treelets, biggest first
+		std::vector<int> roots(1, 0);
+		std::vector<int> frontier;
+		while (!roots.empty())
+		{
+			frontier.assign(1, roots.back());
+			roots.pop_back();
+			for (unsigned placed = 0; placed < BVH_TREELET_PAIRS && !frontier.empty(); placed++)
+			{
+				size_t best = 0;
+				for (size_t f = 1; f < frontier.size(); f++)
+					if (NodeArea(_nodes[frontier[f]]) > NodeArea(_nodes[frontier[best]]))
+						best = f;
+				int node = frontier[best];
+				frontier[best] = frontier.back();
+				frontier.pop_back();
+				pairs.push_back(node);
+				swapped[node] = hotFirst(node);
+				for (int child = _nodes[node].leftFirst; child < _nodes[node].leftFirst + 2; child++)
+					if (isInner(child))
+						frontier.push_back(child);
+			}
+			std::sort(frontier.begin(), frontier.end(), [&](int a, int b) { return NodeArea(_nodes[a]) < NodeArea(_nodes[b]); });
+			roots.insert(roots.end(), frontier.begin(), frontier.end());
+		}
+	}
+
+	//The root is followed by an unreachable empty node so every pair starts at an even index and shares
+	//one 64 byte line when the table is aligned, the gpu buffers are and so is every mesh root in the scene tables
+	std::vector<int> newIndex(_nodes.size(), -1);
+	newIndex[0] = 0;
+	for (size_t p = 0; p < pairs.size(); p++)
+	{
+		int left = _nodes[pairs[p]].leftFirst;
+		newIndex[left] = (int)(p * 2 + (swapped[pairs[p]] ? 3 : 2));
+		newIndex[left + 1] = (int)(p * 2 + (swapped[pairs[p]] ? 2 : 3));
+	}
+	std::vector<BVHNode> nodes(pairs.size() * 2 + 2);
+	std::vector<int> parents(nodes.size(), -1);
+	BVHNode& pad = nodes[1];
+	pad.minx = pad.maxx = _nodes[0].minx;
+	pad.miny = pad.maxy = _nodes[0].miny;
+	pad.minz = pad.maxz = _nodes[0].minz;
+	for (size_t i = 0; i < _nodes.size(); i++)
+	{
+		if (newIndex[i] < 0)
+			continue; //The padding of an earlier reorder
+		BVHNode& n = nodes[newIndex[i]];
+		n = _nodes[i];
+		if (n.count == 0)
+			n.leftFirst = (std::min)(newIndex[n.leftFirst], newIndex[n.leftFirst + 1]);
+		parents[newIndex[i]] = _parents[i] < 0 ? -1 : newIndex[_parents[i]];
+	}
+
+	//Leaves in memory order read the index table front to back
+	std::vector<uint32_t> triangleIndices;
+	triangleIndices.reserve(_triangleIndices.size());
+	_leaves.clear();
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].count == 0)
+			continue;
+		int first = nodes[i].leftFirst;
+		nodes[i].leftFirst = (int)triangleIndices.size();
+		triangleIndices.insert(triangleIndices.end(), _triangleIndices.begin() + first, _triangleIndices.begin() + first + nodes[i].count);
+		_leaves.push_back((int)i);
+	}
+	_nodes.swap(nodes);
+	_parents.swap(parents);
+	_triangleIndices.swap(triangleIndices);
+}
+
+void BVH::SortTriangles(Triangle * triangles)
+{
+	PROFILE_ZONE("BVH::SortTriangles");
+	if (_spheres)
+		return;
+	//A triangle in several leaves after a spatial split goes where it is referenced first
+	std::vector<int> newIndex(_count, -1);
+	std::vector<Triangle> sorted;
+	sorted.reserve(_count);
+	for (uint32_t& t : _triangleIndices)
+	{
+		unsigned local = t - _first;
+		if (newIndex[local] < 0)
+		{
+			newIndex[local] = (int)sorted.size();
+			sorted.push_back(triangles[t]);
+		}
+		t = _first + newIndex[local];
+	}
+	//Clipping can drop a sliver of a triangle everywhere, keep it in the range all the same
+	for (unsigned i = 0; i < _count; i++)
+		if (newIndex[i] < 0)
+			sorted.push_back(triangles[_first + i]);
+	std::copy(sorted.begin(), sorted.end(), triangles + _first);
+}
+
+float BVH::ComputeSAHCost() const
+{
+	if (_nodes.empty())
+		return 0.0f;
+	double inner = 0.0, leaf = 0.0;
+	for (const BVHNode& n : _nodes)
+	{
+		if (n.count > 0)
+			leaf += (double)NodeArea(n) * n.count;
+		else
+			inner += NodeArea(n);
+	}
+	float rootArea = NodeArea(_nodes[0]);
+	return rootArea > 0.0f ? (float)((_settings.traversalCost * inner + _settings.intersectionCost * leaf) / rootArea) : 0.0f;
+}
+
+float BVH::GetBuildSAHCost() const
+{
+	return _buildCost;
+}
+
+float BVH::GetSAHCost() const
+{
+	return _cost;
+}
+
+const std::vector<BVHNode>& BVH::GetNodes() const
+{
+	return _nodes;
+}
+
+const std::vector<uint32_t>& BVH::GetTriangleIndices() const
+{
+	return _triangleIndices;
+}
+
+unsigned BVH::GetFirstTriangle() const
+{
+	return _first;
+}
+
+unsigned BVH::GetTriangleCount() const
+{
+	return _count;
+}
+
+void BVH::WriteNodes(BVHNode * nodes, unsigned nodeOffset, unsigned indexOffset) const
+{
+	for (size_t i = 0; i < _nodes.size(); i++)
+	{
+		nodes[i] = _nodes[i];
+		nodes[i].leftFirst += (int)(_nodes[i].count > 0 ? indexOffset : nodeOffset);
+		if (_spheres)
+			nodes[i].count = -nodes[i].count;
+	}
+}
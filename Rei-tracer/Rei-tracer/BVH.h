@@ -0,0 +1,129 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <stdint.h>
+#include <vector>
+#include "Structs.h"
+
+//Deeper nodes are made leaves whatever their size, the traversal stacks hold BVH_MAX_DEPTH + 1 entries
+#define BVH_MAX_DEPTH 48
+//Leaves handed to one refit worker at least, smaller refits stay on the calling thread
+#define BVH_REFIT_CHUNK 256
+
+//Leaves of the treelets Restructure rebuilds, the best topology over them is searched among all 2^n subsets
+#define BVH_TREELET_LEAVES 7
+#define BVH_RESTRUCTURE_MIN_GAIN 0.01f
+
+//Sibling pairs laid out in this many consecutive pairs per treelet, 4 KB of nodes
+#define BVH_TREELET_PAIRS 64
+
+//Where Build puts the nodes in memory. Siblings always stay next to each other and after their parent.
+enum BVHNodeOrder
+{
+	BVH_ORDER_BREADTH_FIRST, //Level by level, the way the octrees were laid out
+	BVH_ORDER_DEPTH_FIRST,   //Each pair followed by the subtree of its bigger child, which also comes first in the pair
+	BVH_ORDER_TREELETS,      //The pairs most likely to be visited together grouped into blocks of BVH_TREELET_PAIRS
+	BVH_ORDER_COUNT
+};
+
+const char* GetBVHNodeOrderName(BVHNodeOrder order);
+
+struct BVHBuildSettings
+{
+	unsigned maxLeafSize = 8;       //Bigger nodes are always split, smaller ones only when the sah says it pays off
+	unsigned binCount = 16;         //Candidate split planes per axis are binCount - 1
+	float traversalCost = 1.0f;     //Cost of visiting a node relative to...
+	float intersectionCost = 1.0f;  //...testing one triangle
+	float rebuildThreshold = 1.5f;  //RefitOrRebuild rebuilds once the sah cost grew past this factor of the cost after the build
+	float spatialSplitBudget = 0.25f;  //Spatial splits may add up to this fraction of the triangle count as extra references, 0 turns them off
+	float spatialSplitOverlap = 1e-5f; //Spatial splits are only tried where the best object split leaves children overlapping
+	                                   //by more than this fraction of the root's surface area
+	BVHNodeOrder nodeOrder = BVH_ORDER_TREELETS;
+	double restructureSeconds = 0.0;   //Build spends up to this long in Restructure, for trees that live long enough to pay it back
+};
+
+//Binary bounding volume hierarchy over one range of triangles, built with the binned surface area heuristic.
+//Where big triangles make the children overlap the builder also tries spatial splits (SBVH), which put a
+//triangle in both children with each bounding only its own part, so it is no longer tested at every level above.
+//Node and index links are local to the bvh, WriteNodes moves them into a table shared by several meshes.
+//The triangles themselves are never reordered, leaves refer to them through the triangle index table,
+//which holds a triangle once per leaf it was split into.
+//A bvh can also be built over spheres, which are only split by object. Its leaves index the sphere array
+//instead and WriteNodes stores their counts negated, so the traversal knows which intersector a leaf needs.
+class BVH
+{
+public:
+	BVH();
+	~BVH();
+
+	//Builds over triangles [first, first + count) of the array
+	void Build(const Triangle* triangles, unsigned first, unsigned count, const BVHBuildSettings& settings = BVHBuildSettings());
+	void Build(const Sphere* spheres, unsigned first, unsigned count, const BVHBuildSettings& settings = BVHBuildSettings());
+	//Recomputes every bound bottom-up after the triangles moved, keeping the topology. O(n), spread over
+	//the worker threads. Returns the sah cost of the refit tree.
+	float Refit(const Triangle* triangles);
+	float Refit(const Sphere* spheres);
+	//Refits, and rebuilds from scratch once refitting has degraded the tree past settings.rebuildThreshold.
+	//Returns true if it rebuilt, the node count may have changed then.
+	bool RefitOrRebuild(const Triangle* triangles);
+	bool RefitOrRebuild(const Sphere* spheres);
+	//Lowers the sah cost of the tree in place by treelet restructuring (Karras and Aila, TRBVH). Walking up from the leaves
+	//on the worker threads, every node grows a treelet by opening its biggest descendants until it has BVH_TREELET_LEAVES
+	//leaves and rebuilds it with the cheapest topology over them. Rounds repeat until seconds have passed or a round
+	//gains less than BVH_RESTRUCTURE_MIN_GAIN. Leaves stay as they are. Returns the new sah cost.
+	float Restructure(double seconds);
+	//Moves the nodes into another order and the triangle index table into the order of the leaves
+	void Reorder(BVHNodeOrder order);
+	//Sorts the triangles of the bvh in the array into the order the leaves reference them and points the leaves at
+	//the new places, so a leaf reads its triangles from consecutive memory. Build never moves triangles, only call
+	//this where nothing else is indexed per triangle within the range, like the meshes of a scene. Does nothing for spheres.
+	void SortTriangles(Triangle* triangles);
+
+	//Expected cost of a random ray through the tree: traversal and intersection cost weighted by the
+	//probability of hitting each node, which is its surface area relative to the root
+	float ComputeSAHCost() const;
+	//Cost right after the last Build and after the last Build or Refit
+	float GetBuildSAHCost() const;
+	float GetSAHCost() const;
+
+	const std::vector<BVHNode>& GetNodes() const;
+	const std::vector<uint32_t>& GetTriangleIndices() const;
+	unsigned GetFirstTriangle() const;
+	unsigned GetTriangleCount() const;
+	//Copies the nodes with inner links moved by nodeOffset and leaf links by indexOffset
+	void WriteNodes(BVHNode* nodes, unsigned nodeOffset, unsigned indexOffset) const;
+
+private:
+	struct BuildPrimitive
+	{
+		float min[3];
+		float max[3];
+		float centroid[3];
+		uint32_t triangle;
+	};
+
+	BVHBuildSettings _settings;
+	unsigned _first = 0;
+	unsigned _count = 0;
+	std::vector<BVHNode> _nodes;
+	std::vector<uint32_t> _triangleIndices;
+	std::vector<int> _parents; //-1 for the root
+	std::vector<int> _leaves;
+	bool _spheres = false;
+	float _buildCost = 0.0f;
+	float _cost = 0.0f;
+
+	//Only valid during Build
+	const Triangle* _buildTriangles = nullptr;
+	size_t _spatialSplitsLeft = 0;
+	float _minSpatialOverlap = 0.0f;
+
+	template<typename Primitive>
+	void _Build(const Primitive* primitives, unsigned first, unsigned count, const BVHBuildSettings& settings);
+	template<typename Primitive>
+	float _Refit(const Primitive* primitives);
+	void _Split(int node, std::vector<BuildPrimitive>& primitives, unsigned depth);
+	void _MakeLeaf(int node, const std::vector<BuildPrimitive>& primitives);
+};
+
+#endif
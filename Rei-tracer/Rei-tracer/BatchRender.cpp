@@ -0,0 +1,240 @@
+#include "BatchRender.h"
+#include "Core.h"
+#include "ImageWriter.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace VectorMath;
+
+//frame.png becomes frame_0003.png
+static std::string FrameFilename(const std::string& output, unsigned frame, unsigned frameCount)
+{
+	if (frameCount <= 1)
+		return output;
+	size_t dot = output.find_last_of('.');
+	std::stringstream ss;
+	ss << output.substr(0, dot) << "_" << std::setw(4) << std::setfill('0') << frame;
+	if (dot != std::string::npos)
+		ss << output.substr(dot);
+	return ss.str();
+}
+
+static bool HasExtension(const std::string& filename, const std::string& extension)
+{
+	std::string end = filename.substr(filename.find_last_of('.') + 1);
+	std::transform(end.begin(), end.end(), end.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+	return end == extension;
+}
+
+int RunBatchRender(const RenderSettings & settings)
+{
+	PROFILE_ZONE("RunBatchRender");
+	Core* core = Core::GetInstance();
+	IGraphics* graphics = core->GetGraphics();
+	CameraManager* cam = core->GetCameraManager();
+	IWindow* window = core->GetWindow();
+
+	Scene scene;
+	scene.SetTriangleTest(settings.triangleTest);
+	scene.SetBVHLayout(settings.bvhLayout);
+	if (!scene.Load(settings.scene))
+	{
+		std::cerr << "Failed to load scene \"" << settings.scene << "\"" << std::endl;
+		return 1;
+	}
+	scene.Upload(graphics);
+	graphics->SetBounceCount(settings.bounces);
+	graphics->SetToneMapping(settings.toneMap);
+	graphics->SetAccumulation(settings.passes > 1);
+	graphics->SetSamplesPerPixel(settings.samples);
+	graphics->SetTemporal(settings.temporal);
+	//Only the last pass of a frame is shown, so the ones before it skip the denoiser
+	DenoiseSettings accumulateOnly = settings.denoise;
+	accumulateOnly.enabled = false;
+	if (settings.linear && (IsFrameStream(settings.output) || !HasExtension(settings.output, "exr")))
+	{
+		std::cerr << "Linear output has to go to an .exr file" << std::endl;
+		return 1;
+	}
+
+	Camera c = scene.GetCamera((float)window->GetWidth() / (float)window->GetHeight());
+	unsigned id = cam->AddCamera(c.position.x, c.position.y, c.position.z, c.forward.x, c.forward.y, c.forward.z,
+		c.fov, c.aspectRatio, c.up.x, c.up.y, c.up.z, c.nearPlane, c.farPlane);
+	cam->SetActiveCamera(id);
+	const CameraPath& path = scene.GetCameraPath();
+
+	IFrameSink* sink = nullptr;
+	if (IsFrameStream(settings.output))
+	{
+		FrameSinkSettings streamSettings = settings.stream;
+		streamSettings.target = settings.output;
+		sink = CreateFrameSink(streamSettings, window->GetWidth(), window->GetHeight());
+		if (!sink)
+		{
+			std::cerr << "Failed to open the frame stream \"" << settings.output << "\"" << std::endl;
+			return 1;
+		}
+	}
+
+	//Two frames in flight, one being encoded while the other renders
+	std::vector<uint8_t> frames[2];
+	std::vector<float> linearFrames[2];
+	std::thread encoder;
+	bool encoded = true;
+	double renderMs = 0.0;
+	double denoiseMs = 0.0;
+	double encodeMs = 0.0;
+	int result = 0;
+	for (unsigned i = 0; i < settings.frames; i++)
+	{
+		//A single frame keeps the default camera of the scene, like the golden images
+		if (settings.frames > 1)
+		{
+			Float3 pos, target;
+			path.Evaluate((float)i / (float)settings.frames, pos, target);
+			cam->SetCameraPosition(pos.x, pos.y, pos.z);
+			cam->LookAt(target.x, target.y, target.z);
+		}
+
+		std::vector<uint8_t>& rgba = frames[i % 2];
+		unsigned width = 0, height = 0;
+		std::vector<float>& rgbw = linearFrames[i % 2];
+		auto start = std::chrono::steady_clock::now();
+		if (!settings.temporal.enabled)
+			graphics->ResetAccumulation();
+		graphics->SetDenoise(accumulateOnly);
+		for (unsigned pass = 1; pass < settings.passes; pass++)
+			graphics->Draw();
+		graphics->SetDenoise(settings.denoise);
+		bool rendered = graphics->RenderToMemory(rgba, width, height);
+		denoiseMs += graphics->GetLastDenoiseTime();
+		if (rendered && settings.linear)
+			rendered = graphics->ReadBackAccumulation(rgbw, width, height);
+		renderMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() - graphics->GetLastDenoiseTime();
+		if (encoder.joinable())
+			encoder.join();
+		if (!encoded)
+			result = 1;
+		if (!rendered)
+		{
+			std::cerr << "Failed to read back frame " << i << std::endl;
+			delete sink;
+			return 1;
+		}
+
+		//The sink has its own writer thread, the time here is only what the renderer waited for it
+		if (sink)
+		{
+			auto submitStart = std::chrono::steady_clock::now();
+			bool submitted = sink->Submit(rgba.data());
+			encodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+			if (!submitted)
+			{
+				std::cerr << "The frame stream was closed after " << i << " frames" << std::endl;
+				result = 1;
+				break;
+			}
+			continue;
+		}
+
+		std::string filename = FrameFilename(settings.output, i, settings.frames);
+		bool linear = settings.linear;
+		encoder = std::thread([&rgba, &rgbw, &encoded, &encodeMs, filename, width, height, linear]()
+		{
+			auto encodeStart = std::chrono::steady_clock::now();
+			encoded = linear ? WriteEXR(filename, rgbw.data(), width, height, true) : WriteImage(filename, rgba.data(), width, height);
+			encodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - encodeStart).count();
+			if (!encoded)
+				std::cerr << "Failed to write " << filename << std::endl;
+		});
+	}
+	if (encoder.joinable())
+		encoder.join();
+	if (!encoded)
+		result = 1;
+	uint64_t dropped = 0;
+	if (sink)
+	{
+		if (!sink->Finish())
+			result = 1;
+		dropped = sink->GetDroppedFrames();
+		delete sink;
+	}
+
+	unsigned frameCount = (std::max)(1U, settings.frames);
+	std::cout << std::fixed << std::setprecision(2) << settings.frames << " frames";
+	if (settings.passes > 1)
+		std::cout << " of " << settings.passes << " passes";
+	if (settings.samples < MAX_SAMPLES_PER_PIXEL)
+		std::cout << " at " << settings.samples << " spp";
+	if (settings.temporal.enabled)
+		std::cout << " with temporal reprojection";
+	std::cout << ", render " << renderMs / frameCount
+		<< " ms, ";
+	if (settings.denoise.enabled)
+		std::cout << "denoise " << denoiseMs / frameCount << " ms, ";
+	std::cout << "encode " << encodeMs / frameCount << " ms per frame";
+	if (dropped)
+		std::cout << ", " << dropped << " dropped";
+	std::cout << std::endl;
+	return result;
+}
+
+int RunMerge(const std::string & output, const std::vector<std::string>& inputs, const ToneMapSettings & toneMap)
+{
+	PROFILE_ZONE("RunMerge");
+	std::vector<float> sum;
+	std::vector<float> rgbw;
+	unsigned width = 0, height = 0;
+	for (const std::string& input : inputs)
+	{
+		unsigned w = 0, h = 0;
+		if (!ReadEXR(input, rgbw, w, h))
+		{
+			std::cerr << "Failed to read " << input << std::endl;
+			return 1;
+		}
+		if (sum.empty())
+		{
+			width = w;
+			height = h;
+			sum.assign(rgbw.size(), 0.0f);
+		}
+		else if (w != width || h != height)
+		{
+			std::cerr << input << " is " << w << "x" << h << ", not " << width << "x" << height << " like the others" << std::endl;
+			return 1;
+		}
+		//The files hold sums with the frame count in alpha, so adding every channel is the whole merge
+		for (size_t i = 0; i < sum.size(); i++)
+			sum[i] += rgbw[i];
+	}
+	if (sum.empty())
+	{
+		std::cerr << "Nothing to merge" << std::endl;
+		return 1;
+	}
+
+	bool written;
+	if (HasExtension(output, "exr"))
+		written = WriteEXR(output, sum.data(), width, height, true);
+	else
+	{
+		std::vector<uint8_t> rgba((size_t)width * height * 4);
+		ToneMap(sum.data(), width, height, toneMap, rgba.data());
+		written = WriteImage(output, rgba.data(), width, height);
+	}
+	if (!written)
+	{
+		std::cerr << "Failed to write " << output << std::endl;
+		return 1;
+	}
+	std::cout << "Merged " << inputs.size() << " renders into " << output << std::endl;
+	return 0;
+}
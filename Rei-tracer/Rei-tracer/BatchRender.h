@@ -0,0 +1,38 @@
+#ifndef _BATCH_RENDER_H_
+#define _BATCH_RENDER_H_
+
+#include <string>
+#include <vector>
+#include "Scene.h"
+#include "ToneMap.h"
+#include "IGraphics.h"
+#include "FrameSink.h"
+
+struct RenderSettings
+{
+	std::string scene = "room";
+	std::string output = "frame.png"; //.ppm, .png or .exr. With more than one frame the number goes before the extension.
+	                                  //Targets IsFrameStream accepts stream every frame through an IFrameSink instead.
+	unsigned frames = 1;              //Spread evenly along the camera path of the scene
+	unsigned bounces = 1;
+	unsigned passes = 1;              //Jittered frames accumulated into every output frame
+	unsigned samples = MAX_SAMPLES_PER_PIXEL; //Rays per pixel and pass
+	DenoiseSettings denoise;
+	TemporalSettings temporal;        //Carries the history from frame to frame, the passes of a frame add to it
+	ToneMapSettings toneMap;
+	bool linear = false;              //Write the float accumulation sums with the frame count in alpha instead of the
+	                                  //tone mapped frame. Needs an .exr output, the files are what RunMerge adds up.
+	TriangleTest triangleTest = SCENE_TRIANGLE_TEST;
+	BVHLayout bvhLayout = SCENE_BVH_LAYOUT;
+	FrameSinkSettings stream;         //The target is taken from output
+};
+
+//Renders the frames into memory through the already initialized Core and writes each one to a file.
+//A frame is encoded on its own thread while the next one renders, the render, denoise and encode times
+//are printed at the end. Streams only count the time Submit waited as encode time. Returns the process exit code.
+int RunBatchRender(const RenderSettings& settings);
+//Adds up linear renders of the same view, from other passes, runs or machines, and writes the sum. An .exr output
+//stays linear so it can be merged again, anything else is tone mapped. Does not need the Core.
+int RunMerge(const std::string& output, const std::vector<std::string>& inputs, const ToneMapSettings& toneMap);
+
+#endif
@@ -0,0 +1,160 @@
+#include "Benchmark.h"
+#include "Core.h"
+#include "Scene.h"
+#include "Profiler.h"
+#include "RayKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment (lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace VectorMath;
+
+TimingSummary SummarizeTimings(std::vector<double> samples)
+{
+	TimingSummary summary;
+	if (samples.empty())
+		return summary;
+
+	std::sort(samples.begin(), samples.end());
+	double sum = 0.0;
+	for (double s : samples)
+		sum += s;
+	auto percentile = [&samples](double p)
+	{
+		size_t rank = (size_t)std::ceil(p * samples.size());
+		return samples[(std::min)(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+	};
+	summary.mean = sum / samples.size();
+	summary.p50 = percentile(0.50);
+	summary.p95 = percentile(0.95);
+	summary.p99 = percentile(0.99);
+	summary.min = samples.front();
+	summary.max = samples.back();
+	return summary;
+}
+
+uint64_t GetPeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return (uint64_t)pmc.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return (uint64_t)usage.ru_maxrss * 1024; //kilobytes on linux
+	return 0;
+#endif
+}
+
+static void WriteSummary(std::ostream& out, const char* name, const TimingSummary& s)
+{
+	out << "  \"" << name << "\": { \"mean\": " << s.mean << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95
+		<< ", \"p99\": " << s.p99 << ", \"min\": " << s.min << ", \"max\": " << s.max << " },\n";
+}
+
+int RunBenchmark(const BenchmarkSettings & settings)
+{
+	PROFILE_ZONE("RunBenchmark");
+	Core* core = Core::GetInstance();
+	IGraphics* graphics = core->GetGraphics();
+	CameraManager* cam = core->GetCameraManager();
+	IWindow* window = core->GetWindow();
+
+	Scene scene;
+	scene.SetTriangleTest(settings.triangleTest);
+	scene.SetBVHLayout(settings.bvhLayout);
+	if (!scene.Load(settings.scene))
+	{
+		std::cerr << "Failed to load scene \"" << settings.scene << "\"" << std::endl;
+		return 1;
+	}
+	scene.Upload(graphics);
+	graphics->SetBounceCount(settings.bounces);
+
+	Camera c = scene.GetCamera((float)window->GetWidth() / (float)window->GetHeight());
+	unsigned id = cam->AddCamera(c.position.x, c.position.y, c.position.z, c.forward.x, c.forward.y, c.forward.z,
+		c.fov, c.aspectRatio, c.up.x, c.up.y, c.up.z, c.nearPlane, c.farPlane);
+	cam->SetActiveCamera(id);
+	const CameraPath& path = scene.GetCameraPath();
+
+	std::vector<double> frameTimes;
+	std::vector<double> gpuTimes;
+	frameTimes.reserve(settings.frames);
+	gpuTimes.reserve(settings.frames);
+	uint64_t totalRays = 0;
+	//Without the ray counters only the camera rays can be known up front, 9 samples per pixel and bounce
+	const uint64_t estimatedRays = (uint64_t)window->GetWidth() * window->GetHeight() * 9 * (settings.bounces + 1);
+
+	for (unsigned i = 0; i < settings.warmupFrames + settings.frames; i++)
+	{
+		float t = i < settings.warmupFrames ? 0.0f : (float)(i - settings.warmupFrames) / (float)settings.frames;
+		Float3 pos, target;
+		path.Evaluate(t, pos, target);
+		cam->SetCameraPosition(pos.x, pos.y, pos.z);
+		cam->LookAt(target.x, target.y, target.z);
+
+		auto start = std::chrono::steady_clock::now();
+		core->Update();
+		auto end = std::chrono::steady_clock::now();
+
+		if (i < settings.warmupFrames)
+			continue;
+		frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		gpuTimes.push_back(graphics->GetLastFrameTime());
+#if RAY_STATS_ENABLED
+		totalRays += graphics->GetRayStats().TotalRays();
+#else
+		totalRays += estimatedRays;
+#endif
+	}
+
+	TimingSummary frame = SummarizeTimings(frameTimes);
+	TimingSummary gpu = SummarizeTimings(gpuTimes);
+	double gpuSeconds = 0.0;
+	for (double g : gpuTimes)
+		gpuSeconds += g / 1000.0;
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(4);
+	ss << "{\n";
+	ss << "  \"scene\": \"" << settings.scene << "\",\n";
+	ss << "  \"width\": " << window->GetWidth() << ",\n";
+	ss << "  \"height\": " << window->GetHeight() << ",\n";
+	ss << "  \"triangles\": " << scene.GetTriangleCount() << ",\n";
+	ss << "  \"frames\": " << settings.frames << ",\n";
+	ss << "  \"warmupFrames\": " << settings.warmupFrames << ",\n";
+	ss << "  \"bounces\": " << settings.bounces << ",\n";
+	ss << "  \"triangleTest\": \"" << GetTriangleTestName(settings.triangleTest) << "\",\n";
+	ss << "  \"bvhLayout\": \"" << GetBVHLayoutName(settings.bvhLayout) << "\",\n";
+	WriteSummary(ss, "frameTimeMs", frame);
+	WriteSummary(ss, "gpuTimeMs", gpu);
+	ss << "  \"raysPerFrame\": " << (settings.frames ? totalRays / settings.frames : 0) << ",\n";
+	ss << "  \"raysMeasured\": " << (RAY_STATS_ENABLED ? "true" : "false") << ",\n";
+	ss << "  \"mraysPerSecond\": " << (gpuSeconds > 0.0 ? totalRays / gpuSeconds / 1000000.0 : 0.0) << ",\n";
+	ss << "  \"peakRssBytes\": " << GetPeakMemoryUsage() << "\n";
+	ss << "}\n";
+
+	std::cout << ss.str();
+	std::ofstream fout(settings.output);
+	if (!fout)
+	{
+		std::cerr << "Could not write " << settings.output << std::endl;
+		return 1;
+	}
+	fout << ss.str();
+	return 0;
+}
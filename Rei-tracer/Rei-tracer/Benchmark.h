@@ -0,0 +1,40 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "Scene.h"
+
+struct BenchmarkSettings
+{
+	std::string scene = "room";
+	unsigned frames = 600;
+	unsigned warmupFrames = 30; //Rendered but not measured
+	unsigned bounces = 0;
+	TriangleTest triangleTest = SCENE_TRIANGLE_TEST;
+	BVHLayout bvhLayout = SCENE_BVH_LAYOUT;
+	std::string output = "benchmark.json";
+};
+
+struct TimingSummary
+{
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+};
+
+//Nearest rank percentiles over the samples
+TimingSummary SummarizeTimings(std::vector<double> samples);
+//Peak resident set size of the process in bytes, 0 if unknown
+uint64_t GetPeakMemoryUsage();
+
+//Loads the scene into the already initialized Core and flies the active camera along the scene's
+//camera path, one fixed step per frame, so every run renders exactly the same frames.
+//Writes the report as json to settings.output and stdout. Returns the process exit code.
+int RunBenchmark(const BenchmarkSettings& settings);
+
+#endif
@@ -0,0 +1,9 @@
+//ClipSlab of RayKernels.h against the SIMD wrapper, included ahead of the other kernels that test boxes.
+//Lanes where the ray runs in a plane of the slab have NaN in t1 or t2 and keep their interval, the same as
+//the scalar test, whatever the Min and Max of the instruction set return for NaN.
+static inline void ClipSlab(VFloat t1, VFloat t2, VFloat& tmin, VFloat& tmax)
+{
+	VMask ordered = Ge(t1, t1) & Ge(t2, t2);
+	tmin = Select(ordered, Max(tmin, Min(t1, t2)), tmin);
+	tmax = Select(ordered, Min(tmax, Max(t1, t2)), tmax);
+}
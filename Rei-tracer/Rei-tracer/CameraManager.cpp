@@ -1,7 +1,8 @@
 #include "CameraManager.h"
 #include "Core.h"
+#include <cmath>
 
-using namespace DirectX;
+using namespace VectorMath;
 
 CameraManager::CameraManager()
 {
@@ -10,15 +11,15 @@ CameraManager::CameraManager()
 	float width = (float)core->GetWindow()->GetWidth();
 	float height = (float)core->GetWindow()->GetHeight();
 	float aspectRatio = width / height;
-	float fov = 85.0f * 180.0f / XM_PI;
+	float fov = 85.0f * 180.0f / MATH_PI;
 	Camera defaultCam;
 	defaultCam.aspectRatio = aspectRatio;
 	defaultCam.fov = fov;
-	defaultCam.forward = XMFLOAT3(0.0f, 0.0f, 1.0f);
-	defaultCam.up = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	defaultCam.forward = Float3(0.0f, 0.0f, 1.0f);
+	defaultCam.up = Float3(0.0f, 1.0f, 0.0f);
 	defaultCam.nearPlane = 0.1f;
 	defaultCam.farPlane = 60.0f;
-	defaultCam.position = XMFLOAT3(0.0f, 0.0f, -11.0f);
+	defaultCam.position = Float3(0.0f, 0.0f, -11.0f);
 	_cameras.push_back(defaultCam);
 
 }
@@ -30,9 +31,9 @@ CameraManager::~CameraManager()
 unsigned CameraManager::AddCamera(float posX, float posY, float posZ, float dirX, float dirY, float dirZ, float fov, float aspectRatio, float upX, float upY, float upZ, float nearPlane, float farPlane)
 {
 	Camera cam;
-	cam.position = XMFLOAT3(posX, posY, posZ);
-	cam.forward = XMFLOAT3(dirX, dirY, dirZ);
-	cam.up = XMFLOAT3(upX, upY, upZ);
+	cam.position = Float3(posX, posY, posZ);
+	cam.forward = Float3(dirX, dirY, dirZ);
+	cam.up = Float3(upX, upY, upZ);
 	cam.fov = fov;
 	cam.aspectRatio = aspectRatio;
 	cam.farPlane = farPlane;
@@ -67,67 +68,88 @@ void CameraManager::SetActiveCamera(unsigned id)
 	_activeCamera = id;
 }
 
+//The rays of main in Shaders/raytracer.hlsl go through forward * far + right * nx * far / tan(fov / 2) - up * ny * far / aspectRatio
+//for nx and ny in [-0.5, 0.5] across the screen, with right = up x forward and neither normalized. The view keeps that basis
+//as it is, and the projection maps it to [-1, 1] with x scaled by 2 tan(fov / 2) and y by 2 aspectRatio instead of the
+//cot(fov / 2) / aspectRatio and cot(fov / 2) of MatrixPerspectiveFovLH, so points project onto the pixels that trace them.
+static Matrix TracerView(const Camera& camera)
+{
+	Float3 right = camera.GetRight();
+	const Float3& up = camera.up;
+	const Float3& forward = camera.forward;
+	const Float3& pos = camera.position;
+	Matrix cameraToWorld = MatrixSet(right.x, right.y, right.z, 0.0f, up.x, up.y, up.z, 0.0f,
+		forward.x, forward.y, forward.z, 0.0f, pos.x, pos.y, pos.z, 1.0f);
+	return MatrixInverse(nullptr, cameraToWorld);
+}
+
+static Matrix TracerProj(const Camera& camera)
+{
+	float width = 2.0f * std::tan(0.5f * camera.fov);
+	float height = 2.0f * camera.aspectRatio;
+	float range = camera.farPlane / (camera.farPlane - camera.nearPlane);
+	return MatrixSet(width, 0.0f, 0.0f, 0.0f, 0.0f, height, 0.0f, 0.0f, 0.0f, 0.0f, range, 1.0f, 0.0f, 0.0f, -range * camera.nearPlane, 0.0f);
+}
+
 void CameraManager::FillPerFrameBuffer(PerFrameBuffer& pfb, int cameraID)
 {
 	if (cameraID == -1)
 		cameraID = _activeCamera;
 
-	XMVECTOR pos = XMLoadFloat3(&_cameras[cameraID].position);
-	XMVECTOR dir = XMLoadFloat3(&_cameras[cameraID].forward);
-	XMVECTOR up = XMLoadFloat3(&_cameras[cameraID].up);
-	XMMATRIX view = XMMatrixLookToLH(pos, dir, up);
-	XMMATRIX proj = XMMatrixPerspectiveFovLH(_cameras[cameraID].fov, _cameras[cameraID].aspectRatio, _cameras[cameraID].nearPlane, _cameras[cameraID].farPlane);
+	Vector pos = LoadFloat3(&_cameras[cameraID].position);
+	Matrix view = TracerView(_cameras[cameraID]);
+	Matrix proj = TracerProj(_cameras[cameraID]);
 
-	XMStoreFloat4x4(&pfb.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&pfb.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&pfb.InvView, XMMatrixTranspose(XMMatrixInverse(nullptr, view)));
-	XMStoreFloat4x4(&pfb.ViewProj, XMMatrixTranspose(view * proj));
-	XMStoreFloat4x4(&pfb.InvViewProj, XMMatrixTranspose(XMMatrixInverse(nullptr, view * proj)));
-	XMStoreFloat4x4(&pfb.InvProj, XMMatrixTranspose(XMMatrixInverse(nullptr,proj)));
-	XMStoreFloat4(&pfb.CamPos, pos);
+	StoreFloat4x4(&pfb.View, MatrixTranspose(view));
+	StoreFloat4x4(&pfb.Proj, MatrixTranspose(proj));
+	StoreFloat4x4(&pfb.InvView, MatrixTranspose(MatrixInverse(nullptr, view)));
+	StoreFloat4x4(&pfb.ViewProj, MatrixTranspose(view * proj));
+	StoreFloat4x4(&pfb.InvViewProj, MatrixTranspose(MatrixInverse(nullptr, view * proj)));
+	StoreFloat4x4(&pfb.InvProj, MatrixTranspose(MatrixInverse(nullptr,proj)));
+	StoreFloat4(&pfb.CamPos, pos);
 }
 
 void CameraManager::RotateActiveCamera(float degX, float degY, float degZ)
 {
-	float radX = degX * 180.0f / XM_PI;
-	float radY = degY * 180.0f / XM_PI;
-	float radZ = degZ * 180.0f / XM_PI;
+	float radX = degX * 180.0f / MATH_PI;
+	float radY = degY * 180.0f / MATH_PI;
+	float radZ = degZ * 180.0f / MATH_PI;
 
-	XMMATRIX rot = XMMatrixRotationRollPitchYaw(radX, radY, radZ);
-	XMVECTOR dir = XMLoadFloat3(&_cameras[_activeCamera].forward);
-	XMVECTOR up = XMLoadFloat3(&_cameras[_activeCamera].up);
-	XMStoreFloat3(&_cameras[_activeCamera].forward, XMVector3Transform(dir,rot));
-	XMStoreFloat3(&_cameras[_activeCamera].up, XMVector3Transform(up, rot));
+	Matrix rot = MatrixRotationRollPitchYaw(radX, radY, radZ);
+	Vector dir = LoadFloat3(&_cameras[_activeCamera].forward);
+	Vector up = LoadFloat3(&_cameras[_activeCamera].up);
+	StoreFloat3(&_cameras[_activeCamera].forward, Vector3Transform(dir,rot));
+	StoreFloat3(&_cameras[_activeCamera].up, Vector3Transform(up, rot));
 
 }
 
 void CameraManager::RotatePitch(float degrees)
 {
-	XMVECTOR horizontal = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
-	XMVECTOR vertical = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	XMVECTOR up = XMLoadFloat3(&_cameras[_activeCamera].up);
+	Vector horizontal = VectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+	Vector vertical = VectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	Vector up = LoadFloat3(&_cameras[_activeCamera].up);
 	
-	XMVECTOR forward = XMLoadFloat3(&_cameras[_activeCamera].forward);
-	XMVECTOR r = XMVector3Cross(up, forward);
+	Vector forward = LoadFloat3(&_cameras[_activeCamera].forward);
+	Vector r = Vector3Cross(up, forward);
 
-	float rad = degrees * 180.0f / XM_PI;
-	XMMATRIX rot = XMMatrixRotationAxis(r, rad);
-	up = XMVector3Transform(up, rot);
-	forward = XMVector3Transform(forward, rot);
-	XMStoreFloat3(&_cameras[_activeCamera].up, up);
-	XMStoreFloat3(&_cameras[_activeCamera].forward, forward);
+	float rad = degrees * 180.0f / MATH_PI;
+	Matrix rot = MatrixRotationAxis(r, rad);
+	up = Vector3Transform(up, rot);
+	forward = Vector3Transform(forward, rot);
+	StoreFloat3(&_cameras[_activeCamera].up, up);
+	StoreFloat3(&_cameras[_activeCamera].forward, forward);
 }
 
 void CameraManager::RotateYaw(float degrees)
 {
-	float rad = degrees * 180.0f / XM_PI;
-	XMVECTOR up = XMLoadFloat3(&_cameras[_activeCamera].up);
-	XMVECTOR forward = XMLoadFloat3(&_cameras[_activeCamera].forward);
-	XMMATRIX rot = XMMatrixRotationY(rad);
-	up = XMVector3Transform(up, rot);
-	forward = XMVector3Transform(forward, rot);
-	XMStoreFloat3(&_cameras[_activeCamera].up, up);
-	XMStoreFloat3(&_cameras[_activeCamera].forward, forward);
+	float rad = degrees * 180.0f / MATH_PI;
+	Vector up = LoadFloat3(&_cameras[_activeCamera].up);
+	Vector forward = LoadFloat3(&_cameras[_activeCamera].forward);
+	Matrix rot = MatrixRotationY(rad);
+	up = Vector3Transform(up, rot);
+	forward = Vector3Transform(forward, rot);
+	StoreFloat3(&_cameras[_activeCamera].up, up);
+	StoreFloat3(&_cameras[_activeCamera].forward, forward);
 	
 }
 
@@ -147,12 +169,12 @@ void CameraManager::MoveForward(float amount)
 
 void CameraManager::MoveRight(float amount)
 {
-	XMVECTOR up = XMLoadFloat3(&_cameras[_activeCamera].up);
-	XMVECTOR forward = XMLoadFloat3(&_cameras[_activeCamera].forward);
-	XMVECTOR r = XMVector3Cross(up, forward);
-	_cameras[_activeCamera].position.x += amount * XMVectorGetX(r);
-	_cameras[_activeCamera].position.y += amount * XMVectorGetY(r);
-	_cameras[_activeCamera].position.z += amount * XMVectorGetZ(r);
+	Vector up = LoadFloat3(&_cameras[_activeCamera].up);
+	Vector forward = LoadFloat3(&_cameras[_activeCamera].forward);
+	Vector r = Vector3Cross(up, forward);
+	_cameras[_activeCamera].position.x += amount * VectorGetX(r);
+	_cameras[_activeCamera].position.y += amount * VectorGetY(r);
+	_cameras[_activeCamera].position.z += amount * VectorGetZ(r);
 }
 
 void CameraManager::MoveUp(float amount)
@@ -164,7 +186,24 @@ void CameraManager::MoveUp(float amount)
 
 void CameraManager::SetCameraPosition(float posX, float posY, float posZ)
 {
-	_cameras[_activeCamera].position = XMFLOAT3(posX, posY, posZ);
+	_cameras[_activeCamera].position = Float3(posX, posY, posZ);
+}
+
+void CameraManager::LookAt(float targetX, float targetY, float targetZ)
+{
+	Vector pos = LoadFloat3(&_cameras[_activeCamera].position);
+	Vector forward = Vector3Normalize(VectorSet(targetX, targetY, targetZ, 0.0f) - pos);
+	//Looking straight up or down the world y axis leaves no right vector, so the camera keeps the up it already
+	//has, and world z is the last resort if that runs along forward too.
+	Vector right = Vector3Cross(VectorSet(0.0f, 1.0f, 0.0f, 0.0f), forward);
+	if (VectorGetX(Vector3Dot(right, right)) < 1e-6f)
+		right = Vector3Cross(LoadFloat3(&_cameras[_activeCamera].up), forward);
+	if (VectorGetX(Vector3Dot(right, right)) < 1e-6f)
+		right = Vector3Cross(VectorSet(0.0f, 0.0f, 1.0f, 0.0f), forward);
+	right = Vector3Normalize(right);
+	Vector up = Vector3Cross(forward, right);
+	StoreFloat3(&_cameras[_activeCamera].forward, forward);
+	StoreFloat3(&_cameras[_activeCamera].up, up);
 }
 
 float CameraManager::GetFarPlaneDistance() const
@@ -172,18 +211,12 @@ float CameraManager::GetFarPlaneDistance() const
 	return _cameras[_activeCamera].farPlane;
 }
 
-DirectX::XMMATRIX CameraManager::GetView() const
+VectorMath::Matrix CameraManager::GetView() const
 {
-	return XMMatrixLookToLH(XMLoadFloat3(&_cameras[_activeCamera].position),
-		XMLoadFloat3(&_cameras[_activeCamera].forward),
-			XMLoadFloat3(&_cameras[_activeCamera].up));
-
+	return TracerView(_cameras[_activeCamera]);
 }
 
-DirectX::XMMATRIX CameraManager::GetProj() const
+VectorMath::Matrix CameraManager::GetProj() const
 {
-	return XMMatrixPerspectiveFovLH(_cameras[_activeCamera].fov,
-		_cameras[_activeCamera].aspectRatio,
-		_cameras[_activeCamera].nearPlane,
-		_cameras[_activeCamera].farPlane);
+	return TracerProj(_cameras[_activeCamera]);
 }
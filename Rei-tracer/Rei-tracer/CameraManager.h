@@ -1,7 +1,7 @@
 #ifndef _CAMERA_MANAGER_H_
 #define _CAMERA_MANAGER_H_
 
-#include <DirectXMath.h>
+#include "VectorMath.h"
 #include <vector>
 #include "Structs.h"
 
@@ -20,6 +20,7 @@ public:
 	unsigned CycleActiveCamera();
 	Camera GetActiveCamera()const;
 	void SetActiveCamera(unsigned id);
+	//The matrices project world positions onto the pixels whose rays hit them, see TracerView in the .cpp
 	void FillPerFrameBuffer(PerFrameBuffer& pfb, int cameraID = -1);
 	void RotateActiveCamera(float degX, float degY, float degZ);
 	void RotatePitch(float degrees);
@@ -29,9 +30,11 @@ public:
 	void MoveRight(float amount);
 	void MoveUp(float amount);
 	void SetCameraPosition(float posX, float posY, float posZ);
+	//Points the active camera at the target, keeping it level with the world y axis
+	void LookAt(float targetX, float targetY, float targetZ);
 	float GetFarPlaneDistance() const;
-	DirectX::XMMATRIX GetView() const;
-	DirectX::XMMATRIX GetProj() const;
+	VectorMath::Matrix GetView() const;
+	VectorMath::Matrix GetProj() const;
 private:
 	std::vector<Camera> _cameras;
 	int _activeCamera;
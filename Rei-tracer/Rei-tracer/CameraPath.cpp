@@ -0,0 +1,55 @@
+#include "CameraPath.h"
+#include <cmath>
+
+using namespace VectorMath;
+
+void CameraPath::AddPoint(const VectorMath::Float3 & position, const VectorMath::Float3 & target)
+{
+	_positions.push_back(position);
+	_targets.push_back(target);
+}
+
+void CameraPath::Evaluate(float t, VectorMath::Float3 & position, VectorMath::Float3 & target) const
+{
+	size_t count = _positions.size();
+	if (count == 0)
+		return;
+	if (count == 1)
+	{
+		position = _positions[0];
+		target = _targets[0];
+		return;
+	}
+
+	t = t - std::floor(t);
+	float segment = t * count;
+	size_t i1 = (size_t)segment % count;
+	size_t i0 = (i1 + count - 1) % count;
+	size_t i2 = (i1 + 1) % count;
+	size_t i3 = (i1 + 2) % count;
+	float local = segment - std::floor(segment);
+
+	StoreFloat3(&position, VectorCatmullRom(LoadFloat3(&_positions[i0]), LoadFloat3(&_positions[i1]),
+		LoadFloat3(&_positions[i2]), LoadFloat3(&_positions[i3]), local));
+	StoreFloat3(&target, VectorCatmullRom(LoadFloat3(&_targets[i0]), LoadFloat3(&_targets[i1]),
+		LoadFloat3(&_targets[i2]), LoadFloat3(&_targets[i3]), local));
+}
+
+size_t CameraPath::GetPointCount() const
+{
+	return _positions.size();
+}
+
+CameraPath CameraPath::Orbit(const VectorMath::Float3 & target, float radiusX, float radiusZ, float height, float heightVariation, unsigned points)
+{
+	CameraPath path;
+	for (unsigned i = 0; i < points; i++)
+	{
+		float angle = MATH_2PI * i / points;
+		Float3 pos(target.x + radiusX * std::cos(angle),
+			height + heightVariation * std::sin(angle * 2.0f),
+			target.z + radiusZ * std::sin(angle));
+		path.AddPoint(pos, target);
+	}
+	return path;
+}
@@ -0,0 +1,28 @@
+#ifndef _CAMERA_PATH_H_
+#define _CAMERA_PATH_H_
+
+#include "VectorMath.h"
+#include <vector>
+
+//A closed Catmull-Rom spline through camera positions, each with a point to look at.
+//Evaluating it only depends on t, so the same t always gives the same camera.
+class CameraPath
+{
+public:
+	CameraPath() {};
+	~CameraPath() {};
+
+	void AddPoint(const VectorMath::Float3& position, const VectorMath::Float3& target);
+	//t in [0, 1] covers the whole loop once
+	void Evaluate(float t, VectorMath::Float3& position, VectorMath::Float3& target) const;
+	size_t GetPointCount() const;
+
+	//Control points on an ellipse around target, bobbing up and down by heightVariation
+	static CameraPath Orbit(const VectorMath::Float3& target, float radiusX, float radiusZ, float height, float heightVariation, unsigned points = 8);
+
+private:
+	std::vector<VectorMath::Float3> _positions;
+	std::vector<VectorMath::Float3> _targets;
+};
+
+#endif
@@ -1,7 +1,15 @@
 #include "Core.h"
 #include "Macros.h"
+#include "Profiler.h"
+#include "OffscreenTarget.h"
+#include "CpuGraphics.h"
+#if REI_WINDOWED
+#include "Window.h"
+#include "Direct3D11.h"
+#endif
 #include <exception>
 #include <map>
+#include <stdio.h>
 
 Core* Core::_instance = nullptr;
 
@@ -11,6 +19,7 @@ Core::Core()
 	_graphics = nullptr;
 	_cameraManager = nullptr;
 	_timer = nullptr;
+	_inputManager = nullptr;
 }
 Core::~Core()
 {
@@ -36,26 +45,51 @@ void Core::ShutDown()
 	SAFE_DELETE(Core::GetInstance()->_inputManager);
 	delete _instance;
 	_instance = nullptr;
+#if PROFILER_ENABLED
+	Profiler* profiler = Profiler::GetInstance();
+	if (profiler->IsRecording() && !profiler->WriteChromeTrace(profiler->GetTraceFile()))
+		printf("Failed to write %s\n", profiler->GetTraceFile().c_str());
+	Profiler::ShutDown();
+#endif
 }
 
-void Core::Init(uint32_t width, uint32_t height, bool fullscreen)
+#if REI_WINDOWED
+void Core::Init(uint32_t width, uint32_t height, bool fullscreen, bool hidden)
 {
-	_window = new Window(width, height, false);
+	PROFILE_ZONE("Core::Init");
+	_window = new Window(width, height, false, hidden);
 	_graphics = new Direct3D11();
 	_cameraManager = new CameraManager();
 	_timer = new Timer();
 	_inputManager = new InputManager();
+}
+#else
+void Core::Init(uint32_t width, uint32_t height, bool, bool)
+{
+	InitHeadless(width, height);
+}
+#endif
 
+void Core::InitHeadless(uint32_t width, uint32_t height)
+{
+	PROFILE_ZONE("Core::InitHeadless");
+	//The backend and the camera manager read the size from the window, so it comes first
+	_window = new OffscreenTarget(width, height);
+	_graphics = new CpuGraphics();
+	_cameraManager = new CameraManager();
+	_timer = new Timer();
 }
 
 void Core::Update()
 {
-	_inputManager->Update();
+	PROFILE_ZONE("Frame");
+	if (_inputManager)
+		_inputManager->Update();
 	_timer->Update();
 	_graphics->Draw();
 }
 
-Window * Core::GetWindow() const
+IWindow * Core::GetWindow() const
 {
 	return _window;
 }
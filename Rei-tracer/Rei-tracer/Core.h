@@ -1,9 +1,9 @@
 #ifndef _CORE_H_
 #define _CORE_H_
-#include <SDL.h>
 #include <vector>
-#include "Window.h"
-#include "Direct3D11.h"
+#include "Platform.h"
+#include "IWindow.h"
+#include "IGraphics.h"
 #include "CameraManager.h"
 #include "Timer.h"
 #include "InputManager.h"
@@ -15,7 +15,7 @@ private:
 	Core();
 	~Core();
 	static Core* _instance;
-	Window* _window;
+	IWindow* _window;
 	IGraphics* _graphics;
 	CameraManager* _cameraManager;
 	InputManager* _inputManager;
@@ -26,13 +26,17 @@ public:
 	static void CreateInstance();
 	static Core* GetInstance();
 	static void ShutDown();
-	void Init(uint32_t width, uint32_t height, bool fullscreen);
+	//An SDL window with Direct3D11, or InitHeadless in builds without them
+	void Init(uint32_t width, uint32_t height, bool fullscreen, bool hidden = false);
+	//An OffscreenTarget with the cpu backend and no InputManager, runs without a display server
+	void InitHeadless(uint32_t width, uint32_t height);
 	void Update();
 
-	Window* GetWindow() const;
+	IWindow* GetWindow() const;
 	IGraphics* GetGraphics() const;
 	CameraManager* GetCameraManager() const;
 	Timer* GetTimer() const;
+	//nullptr after InitHeadless
 	InputManager* GetInputManager() const;
 
 
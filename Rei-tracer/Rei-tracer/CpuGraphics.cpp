@@ -0,0 +1,848 @@
+#include "CpuGraphics.h"
+#include "Core.h"
+#include "ImageReader.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdio.h>
+
+//Same counters as STAT_ADD in the shader, compiled out unless RAY_STATS_ENABLED is set
+#if RAY_STATS_ENABLED
+#define CPU_STAT_ADD(stats, counter, n) (stats).counter += (n)
+#else
+#define CPU_STAT_ADD(stats, counter, n) ((void)0)
+#endif
+
+static inline Vec3 Mul(const Vec3& a, const Vec3& b) { return MakeVec3(a.x * b.x, a.y * b.y, a.z * b.z); }
+static inline float Length(const Vec3& a) { return std::sqrt(Dot(a, a)); }
+
+//Returns -1 on a miss
+static float RayVSPlaneDistance(const Plane& p, const Ray& r)
+{
+	Vec3 normal = MakeVec3(p.x, p.y, p.z);
+	float facing = Dot(normal, r.d);
+	if (facing > -0.0001f)
+		return -1.0f; //Parallel or seen from behind
+	float t = (p.d - Dot(normal, r.o)) / facing;
+	Vec3 hit = r.o + r.d * t;
+	if (t <= 0.0f || hit.x < p.minx || hit.y < p.miny || hit.z < p.minz || hit.x > p.maxx || hit.y > p.maxy || hit.z > p.maxz)
+		return -1.0f;
+	return t;
+}
+
+CpuGraphics::CpuGraphics()
+{
+	//Material 0 is the untextured default
+	_materials.push_back({ -1, -1 });
+}
+
+CpuGraphics::~CpuGraphics()
+{
+}
+
+void CpuGraphics::IncreaseBounceCount()
+{
+	_bounceCount = (std::min)(10, _bounceCount + 1);
+}
+
+void CpuGraphics::DecreaseBounceCount()
+{
+	_bounceCount = (std::max)(0, _bounceCount - 1);
+}
+
+void CpuGraphics::SetBounceCount(unsigned bounces)
+{
+	_bounceCount = (int)(std::min)(10U, bounces);
+}
+
+void CpuGraphics::SetTriangleTest(TriangleTest test)
+{
+	_triangleTest = test;
+	for (size_t i = 0; i < _triangles.size(); i++)
+		_precomputedTriangles[i] = PrecomputeTriangle(_triangles[i], _triangleTest);
+	_wideBVHDirty |= _bvhLayout == BVH_LAYOUT_BINARY_BLOCKS;
+}
+
+void CpuGraphics::SetBVHLayout(BVHLayout layout)
+{
+	if (layout == _bvhLayout)
+		return;
+	_bvhLayout = layout;
+	_wideBVHDirty = true;
+}
+
+void CpuGraphics::SetTriangles(Triangle * triangles, size_t count)
+{
+	_triangles.assign(triangles, triangles + count);
+	_precomputedTriangles.resize(count);
+	for (size_t i = 0; i < count; i++)
+		_precomputedTriangles[i] = PrecomputeTriangle(_triangles[i], _triangleTest);
+	_wideBVHDirty |= _bvhLayout == BVH_LAYOUT_BINARY_BLOCKS;
+	//A new set of triangles starts out untextured, PrepareTextures assigns the materials again
+	_triangleMaterials.clear();
+}
+
+void CpuGraphics::SetSpheres(Sphere * spheres, size_t count)
+{
+	_spheres.assign(spheres, spheres + count);
+}
+
+void CpuGraphics::SetPlanes(Plane * planes, size_t count)
+{
+	_planes.assign(planes, planes + count);
+}
+
+void CpuGraphics::SetPointLights(PointLight * pointlights, size_t count)
+{
+	_pointLights.assign(pointlights, pointlights + count);
+}
+
+void CpuGraphics::SetSpotLights(SpotLight * spotlights, size_t count)
+{
+	_spotLights.assign(spotlights, spotlights + count);
+}
+
+void CpuGraphics::SetMeshPartitions(BVHNode * nodes, size_t nodeCount, uint32_t * triangleIndices, size_t triangleIndexCount, MeshIndices * meshes, size_t meshCount)
+{
+	_bvhNodes.assign(nodes, nodes + nodeCount);
+	_triangleIndices.assign(triangleIndices, triangleIndices + triangleIndexCount);
+	_meshIndices.assign(meshes, meshes + meshCount);
+	//The sphere bvh is the one whose leaves have negative counts
+	_triangleMeshes.clear();
+	_sphereMeshes.clear();
+	for (const MeshIndices& mesh : _meshIndices)
+	{
+		bool spheres = false;
+		for (int n = mesh.rootPartition; n >= 0 && n < mesh.rootPartition + mesh.partitionCount && !spheres; n++)
+			spheres = _bvhNodes[n].count < 0;
+		(spheres ? _sphereMeshes : _triangleMeshes).push_back(mesh);
+	}
+	_wideBVHDirty = true;
+}
+
+void CpuGraphics::UpdateTriangles(size_t first, size_t count, const Triangle * triangles)
+{
+	if (first >= _triangles.size())
+		return;
+	count = (std::min)(count, _triangles.size() - first);
+	std::copy(triangles, triangles + count, _triangles.begin() + first);
+	for (size_t i = first; i < first + count; i++)
+		_precomputedTriangles[i] = PrecomputeTriangle(_triangles[i], _triangleTest);
+	//The blocks hold copies of the triangles, an animated mesh packs them again every frame
+	_wideBVHDirty |= _bvhLayout == BVH_LAYOUT_BINARY_BLOCKS;
+}
+
+void CpuGraphics::UpdateMeshPartitions(size_t first, size_t count, const BVHNode * nodes)
+{
+	if (first >= _bvhNodes.size())
+		return;
+	count = (std::min)(count, _bvhNodes.size() - first);
+	std::copy(nodes, nodes + count, _bvhNodes.begin() + first);
+	//Refitting the spheres every frame leaves the collapsed triangle meshes alone
+	for (const MeshIndices& mesh : _triangleMeshes)
+	{
+		if (mesh.rootPartition >= 0 && (size_t)mesh.rootPartition < first + count && first < (size_t)(mesh.rootPartition + mesh.partitionCount))
+			_wideBVHDirty = true;
+	}
+}
+
+void CpuGraphics::UpdateSphere(size_t index, const Sphere & sphere)
+{
+	if (index < _spheres.size())
+		_spheres[index] = sphere;
+}
+
+void CpuGraphics::UpdatePointLight(size_t index, const PointLight & light)
+{
+	if (index < _pointLights.size())
+		_pointLights[index] = light;
+}
+
+void CpuGraphics::UpdateSpotLight(size_t index, const SpotLight & light)
+{
+	if (index < _spotLights.size())
+		_spotLights[index] = light;
+}
+
+int CpuGraphics::_LoadTexture(const std::string & filename)
+{
+	auto got = _textureIndices.find(filename);
+	if (got != _textureIndices.end())
+		return got->second;
+
+	PROFILE_ZONE("Texture decode");
+	std::vector<uint8_t> rgba;
+	CpuTexture texture;
+	if (!ReadImage(filename, rgba, texture.width, texture.height) || texture.width == 0 || texture.height == 0)
+	{
+		//A missing texture is not fatal, the gpu renders it untextured too
+		_textureIndices[filename] = -1;
+		return -1;
+	}
+	size_t pixels = (size_t)texture.width * texture.height;
+	texture.rgb.resize(pixels * 3);
+	for (size_t i = 0; i < pixels; i++)
+	{
+		for (size_t c = 0; c < 3; c++)
+			texture.rgb[i * 3 + c] = rgba[i * 4 + c] / 255.0f;
+	}
+	_textures.push_back(texture);
+	int index = (int)_textures.size() - 1;
+	_textureIndices[filename] = index;
+	return index;
+}
+
+unsigned CpuGraphics::_FindOrAddMaterial(int diffuseIndex, int normalIndex)
+{
+	for (unsigned i = 0; i < _materials.size(); i++)
+	{
+		if (_materials[i].diffuseIndex == diffuseIndex && _materials[i].normalIndex == normalIndex)
+			return i;
+	}
+	_materials.push_back({ diffuseIndex, normalIndex });
+	return (unsigned)_materials.size() - 1;
+}
+
+void CpuGraphics::PrepareTextures(unsigned indexStart, unsigned indexEnd, const std::string & filenameDiffuse, const std::string & filenameNormal)
+{
+	uint32_t material = _FindOrAddMaterial(_LoadTexture(filenameDiffuse), _LoadTexture(filenameNormal));
+	//Inclusive range, later calls overwrite earlier ones like on the gpu
+	if (_triangleMaterials.size() < (size_t)indexEnd + 1)
+		_triangleMaterials.resize((size_t)indexEnd + 1, 0);
+	std::fill(_triangleMaterials.begin() + indexStart, _triangleMaterials.begin() + indexEnd + 1, material);
+}
+
+void CpuGraphics::PreparePlaneTextures(unsigned indexStart, unsigned indexEnd, const std::string & filenameDiffuse, const std::string & filenameNormal)
+{
+	if (indexStart >= _planes.size())
+		return;
+	indexEnd = (std::min)(indexEnd, (unsigned)_planes.size() - 1);
+	int material = (int)_FindOrAddMaterial(_LoadTexture(filenameDiffuse), _LoadTexture(filenameNormal));
+	for (unsigned i = indexStart; i <= indexEnd; i++)
+		_planes[i].material = material;
+}
+
+void CpuGraphics::SetTextures()
+{
+	//Nothing to upload, only the material table gets its final size
+	if (_triangleMaterials.size() < _triangles.size())
+		_triangleMaterials.resize(_triangles.size(), 0);
+}
+
+Vec3 CpuGraphics::_Sample(int texture, float u, float v) const
+{
+	//Linear filtering between the four nearest texel centers, wrapping at the edges
+	const CpuTexture& t = _textures[texture];
+	float x = u * t.width - 0.5f;
+	float y = v * t.height - 0.5f;
+	float x0 = std::floor(x);
+	float y0 = std::floor(y);
+	float fx = x - x0;
+	float fy = y - y0;
+	auto wrap = [](float c, unsigned size)
+	{
+		long i = (long)c % (long)size;
+		return (unsigned)(i < 0 ? i + (long)size : i);
+	};
+	unsigned xs[2] = { wrap(x0, t.width), wrap(x0 + 1.0f, t.width) };
+	unsigned ys[2] = { wrap(y0, t.height), wrap(y0 + 1.0f, t.height) };
+	float weights[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+	Vec3 color = MakeVec3(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 4; i++)
+	{
+		const float* texel = &t.rgb[((size_t)ys[i / 2] * t.width + xs[i % 2]) * 3];
+		color = color + MakeVec3(texel[0], texel[1], texel[2]) * weights[i];
+	}
+	return color;
+}
+
+void CpuGraphics::_UpdateWideBVH()
+{
+	if (!_wideBVHDirty)
+		return;
+	_wideBVHDirty = false;
+	if (_bvhLayout == BVH_LAYOUT_BINARY)
+		return;
+	if (_bvhLayout == BVH_LAYOUT_BINARY_BLOCKS)
+	{
+		PROFILE_ZONE("Pack triangle blocks");
+		_triangleBlocks.Set(TRIANGLE_BLOCK_BVH_WIDTH, _triangleTest, _triangles.data(), _bvhNodes.data(), _bvhNodes.size(), _triangleIndices.data(),
+			_triangleMeshes.data(), _triangleMeshes.size());
+		return;
+	}
+	PROFILE_ZONE("Collapse bvh");
+	_wideBVH.Set(_bvhLayout, _bvhNodes.data(), _bvhNodes.size(), _triangleIndices.data(), _triangleIndices.size(),
+		_triangleMeshes.data(), _triangleMeshes.size());
+}
+
+void CpuGraphics::_TraverseBVH(const Ray & r, const Vec3 & rcpDir, Hit & hit, RayStats & stats) const
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	const Triangle* triangles = _triangles.data();
+	const PrecomputedTriangle* precomputed = _precomputedTriangles.data();
+	auto setTriangleHit = [&](int index, float ttt, float bu, float bv)
+	{
+		const Triangle& t = triangles[index];
+		float bw = 1.0f - bv - bu;
+		hit.dist = ttt;
+		hit.u = bu * t.v2.u + bv * t.v3.u + bw * t.v1.u;
+		hit.v = bu * t.v2.v + bv * t.v3.v + bw * t.v1.v;
+		hit.normal = Normalize(MakeVec3(t.v2.norx, t.v2.nory, t.v2.norz) * bu + MakeVec3(t.v3.norx, t.v3.nory, t.v3.norz) * bv
+			+ MakeVec3(t.v1.norx, t.v1.nory, t.v1.norz) * bw);
+		//The shader normalizes all four components of the tangent together
+		Vec3 tangent = MakeVec3(t.v2.tanx, t.v2.tany, t.v2.tanz) * bu + MakeVec3(t.v3.tanx, t.v3.tany, t.v3.tanz) * bv
+			+ MakeVec3(t.v1.tanx, t.v1.tany, t.v1.tanz) * bw;
+		float handedness = t.v2.handedness * bu + t.v3.handedness * bv + t.v1.handedness * bw;
+		float rcpLength = 1.0f / std::sqrt(Dot(tangent, tangent) + handedness * handedness);
+		hit.tangent = tangent * rcpLength;
+		hit.handedness = handedness * rcpLength;
+		hit.triangleIndex = index;
+	};
+	auto triangleHit = [&](int index)
+	{
+		CPU_STAT_ADD(stats, triangleTests, 1);
+		float bu = 0.0f, bv = 0.0f;
+		float ttt = RayVSSelectedTriangle(_triangleTest, triangles, precomputed, index, r, wr, bu, bv);
+		if (IsCloserHit(ttt, index, hit.dist, hit.triangleIndex))
+			setTriangleHit(index, ttt, bu, bv);
+	};
+
+	const std::vector<MeshIndices>* meshes = &_meshIndices;
+	if (_bvhLayout != BVH_LAYOUT_BINARY)
+	{
+		//The wide and block kernels only return the closest triangle, its attributes are interpolated once here
+		float dist = hit.dist, bu = 0.0f, bv = 0.0f;
+		int index = _bvhLayout == BVH_LAYOUT_BINARY_BLOCKS ? TraverseBVH(r, rcpDir, _triangleBlocks, dist, bu, bv, &stats)
+			: TraverseBVH(r, rcpDir, _triangleTest, triangles, precomputed, _wideBVH, dist, bu, bv, &stats);
+		if (index >= 0)
+			setTriangleHit(index, dist, bu, bv);
+		meshes = &_sphereMeshes;
+	}
+
+	for (const MeshIndices& mesh : *meshes)
+	{
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = _bvhNodes[stack[--stackPtr]];
+				CPU_STAT_ADD(stats, nodeVisits, 1);
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+					triangleHit((int)_triangleIndices[c]);
+				for (int c = node.leftFirst; c < node.leftFirst - node.count; c++)
+				{
+					CPU_STAT_ADD(stats, sphereTests, 1);
+					float previous = hit.dist;
+					RayVSSphere(_spheres[_triangleIndices[c]], r, hit.dist, hit.normal);
+					if (hit.dist < previous)
+						hit.triangleIndex = -1; //Spheres have no material
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+				triangleHit(j);
+		}
+	}
+}
+
+bool CpuGraphics::_TraverseBVHForShadows(const Ray & r, const Vec3 & rcpDir, float dist, RayStats & stats) const
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	auto occludes = [&](int index)
+	{
+		CPU_STAT_ADD(stats, triangleTests, 1);
+		float bu = 0.0f, bv = 0.0f;
+		float comp = RayVSSelectedTriangle(_triangleTest, _triangles.data(), _precomputedTriangles.data(), index, r, wr, bu, bv);
+		return comp < dist && comp > 0.0f;
+	};
+
+	const std::vector<MeshIndices>* meshes = &_meshIndices;
+	if (_bvhLayout == BVH_LAYOUT_BINARY_BLOCKS)
+	{
+		if (TraverseBVHForShadows(r, rcpDir, dist, _triangleBlocks, &stats))
+			return true;
+		meshes = &_sphereMeshes;
+	}
+	else if (_bvhLayout != BVH_LAYOUT_BINARY)
+	{
+		if (TraverseBVHForShadows(r, rcpDir, dist, _triangleTest, _triangles.data(), _precomputedTriangles.data(), _wideBVH, &stats))
+			return true;
+		meshes = &_sphereMeshes;
+	}
+
+	for (const MeshIndices& mesh : *meshes)
+	{
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = _bvhNodes[stack[--stackPtr]];
+				CPU_STAT_ADD(stats, nodeVisits, 1);
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+				{
+					if (occludes((int)_triangleIndices[c]))
+						return true;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst - node.count; c++)
+				{
+					CPU_STAT_ADD(stats, sphereTests, 1);
+					float comp = RayVSSphereDistance(_spheres[_triangleIndices[c]], r);
+					if (comp < dist && comp > 0.0f)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				if (occludes(j))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+void CpuGraphics::_IntersectPlanes(const Ray & r, Hit & hit) const
+{
+	for (size_t i = 0; i < _planes.size(); i++)
+	{
+		float t = RayVSPlaneDistance(_planes[i], r);
+		if (t > 0.0f && (t < hit.dist || hit.dist < 0.0f))
+		{
+			hit.dist = t;
+			hit.planeIndex = (int)i;
+			hit.normal = MakeVec3(_planes[i].x, _planes[i].y, _planes[i].z);
+		}
+	}
+}
+
+bool CpuGraphics::_PlanesOcclude(const Ray & r, float dist) const
+{
+	for (const Plane& p : _planes)
+	{
+		float t = RayVSPlaneDistance(p, r);
+		if (t > 0.0f && t < dist)
+			return true;
+	}
+	return false;
+}
+
+void CpuGraphics::_PointLightContribution(const Vec3 & rayOrigin, const Vec3 & origin, const Vec3 & normal, const PointLight & light, Vec3 & specular, Vec3 & diffuse, RayStats & stats) const
+{
+	Vec3 position = MakeVec3(light.posx, light.posy, light.posz);
+	Vec3 toLight = position - origin;
+	float dist = Length(toLight);
+	toLight = toLight * (1.0f / dist);
+	float NdL = Dot(toLight, normal);
+	if (NdL < 0.0f)
+		return;
+
+	CPU_STAT_ADD(stats, shadowRays, 1);
+	Ray r;
+	r.d = toLight;
+	r.o = origin + r.d * 0.0001f;
+	if (_PlanesOcclude(r, dist) || _TraverseBVHForShadows(r, Reciprocal(r.d), dist, stats))
+		return;
+
+	Vec3 color = MakeVec3(light.red, light.green, light.blue);
+	float divby = (dist / light.range) + 1.0f;
+	float attenuation = light.intensity / (divby * divby);
+	diffuse = diffuse + color * (NdL * attenuation);
+	Vec3 halfVector = Normalize(toLight + Normalize(rayOrigin - origin));
+	float NdH = Dot(normal, halfVector);
+	if (NdH > 0.0f)
+		specular = specular + color * (std::pow(NdH, 6.0f) * attenuation);
+}
+
+void CpuGraphics::_SpotLightContribution(const Vec3 & rayOrigin, const Vec3 & origin, const Vec3 & normal, const SpotLight & light, Vec3 & specular, Vec3 & diffuse, RayStats & stats) const
+{
+	Vec3 position = MakeVec3(light.posx, light.posy, light.posz);
+	Vec3 toLight = position - origin;
+	float dist = Length(toLight);
+	toLight = toLight * (1.0f / dist);
+	float NdL = Dot(toLight, normal);
+	if (NdL < 0.0f)
+		return;
+
+	CPU_STAT_ADD(stats, shadowRays, 1);
+	Ray r;
+	r.d = toLight;
+	r.o = origin + r.d * 0.0001f;
+	if (_PlanesOcclude(r, dist) || _TraverseBVHForShadows(r, Reciprocal(r.d), dist, stats))
+		return;
+
+	Vec3 color = MakeVec3(light.red, light.green, light.blue);
+	float divby = (dist / light.range) + 1.0f;
+	float facing = (std::max)(Dot(toLight * -1.0f, MakeVec3(light.dirx, light.diry, light.dirz)), 0.0f);
+	float attenuation = std::pow(facing, light.cone) * light.intensity / (divby * divby);
+	if (attenuation > 0.0f)
+	{
+		diffuse = diffuse + color * (NdL * attenuation);
+		Vec3 halfVector = Normalize(toLight + Normalize(rayOrigin - origin));
+		float NdH = Dot(normal, halfVector);
+		if (NdH > 0.0f)
+			specular = specular + color * (std::pow(NdH, 6.0f) * attenuation);
+		diffuse = diffuse + MakeVec3(attenuation, attenuation, attenuation);
+	}
+}
+
+Vec3 CpuGraphics::_TracePixel(const CameraRays & cam, unsigned x, unsigned y, RayStats & stats, float* normalDepth, float* albedo) const
+{
+	//Up to nine rays spread over the pixel, each bouncing off mirror-like surfaces, exactly like the shader
+	static const float offsets[9][2] = { { -1, 1 }, { 0, 1 }, { 1, 1 }, { -1, 0 }, { 0, 0 }, { 1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+	Vec3 rayPos = cam.position + cam.direction * cam.fardist;
+	float nx = (x - cam.width / 2.0f) / cam.width + cam.jitterX / cam.width;
+	float ny = (y - cam.height / 2.0f) / cam.height + cam.jitterY / cam.height;
+	float dx = 0.5f / cam.width;
+	float dy = 0.5f / cam.height;
+	Vec3 fovCorrection = cam.right * (cam.fardist / std::tan(cam.fov / 2.0f));
+	Vec3 aspectCorrection = cam.up * -(cam.fardist / cam.aspectratio);
+
+	Vec3 accumulatedDiff = MakeVec3(0.0f, 0.0f, 0.0f);
+	Vec3 accumulatedSpec = MakeVec3(0.0f, 0.0f, 0.0f);
+	Vec3 guideNormal = MakeVec3(0.0f, 0.0f, 0.0f);
+	Vec3 guideAlbedo = MakeVec3(0.0f, 0.0f, 0.0f);
+	float guideDepth = 0.0f;
+	int hits = 0;
+	int samples = 0;
+	for (int sample = 0; sample < MAX_SAMPLES_PER_PIXEL; sample++)
+	{
+		if (!(_sampleMask & (1U << sample)))
+			continue;
+		samples++;
+		Vec3 farplane = rayPos + fovCorrection * (nx + offsets[sample][0] * dx) + aspectCorrection * (ny + offsets[sample][1] * dy);
+		Ray r;
+		r.o = cam.position;
+		r.d = Normalize(farplane - cam.position);
+		for (int bounces = 0; bounces < _bounceCount + 1; bounces++)
+		{
+			if (bounces == 0)
+				CPU_STAT_ADD(stats, primaryRays, 1);
+			else
+				CPU_STAT_ADD(stats, bounceRays, 1);
+			Hit hit;
+			hit.normal = r.d;
+			_TraverseBVH(r, Reciprocal(r.d), hit, stats);
+			_IntersectPlanes(r, hit);
+			if (hit.dist < 0.0f)
+				break;
+
+			Vec3 point = r.o + r.d * hit.dist;
+			Vec3 normal = hit.normal;
+			int materialIndex = -1;
+			if (hit.planeIndex >= 0)
+			{
+				const Plane& plane = _planes[hit.planeIndex];
+				materialIndex = plane.material;
+				hit.u = Dot(MakeVec3(plane.ux, plane.uy, plane.uz), point) + plane.uOffset;
+				hit.v = Dot(MakeVec3(plane.vx, plane.vy, plane.vz), point) + plane.vOffset;
+				hit.tangent = Normalize(MakeVec3(plane.ux, plane.uy, plane.uz));
+				hit.handedness = 1.0f;
+			}
+			else if (hit.triangleIndex >= 0)
+				materialIndex = hit.triangleIndex < (int)_triangleMaterials.size() ? (int)_triangleMaterials[hit.triangleIndex] : 0;
+
+			Vec3 texColor = MakeVec3(1.0f, 1.0f, 1.0f);
+			if (materialIndex >= 0 && materialIndex < (int)_materials.size())
+			{
+				const MeshMaterial& material = _materials[materialIndex];
+				if (material.diffuseIndex >= 0)
+					texColor = _Sample(material.diffuseIndex, hit.u, hit.v);
+				if (material.normalIndex >= 0)
+				{
+					Vec3 sampled = _Sample(material.normalIndex, hit.u, hit.v) * 2.0f - MakeVec3(1.0f, 1.0f, 1.0f);
+					Vec3 bitangent = Cross(normal, hit.tangent) * hit.handedness;
+					normal = Normalize(normal * sampled.x + bitangent * sampled.y + hit.tangent * sampled.z);
+				}
+			}
+
+			if (bounces == 0)
+			{
+				guideNormal = guideNormal + normal;
+				guideAlbedo = guideAlbedo + texColor;
+				guideDepth += hit.dist;
+				hits++;
+			}
+
+			Vec3 ldiffuse = MakeVec3(0.0f, 0.0f, 0.0f);
+			Vec3 lspec = MakeVec3(0.0f, 0.0f, 0.0f);
+			for (const PointLight& light : _pointLights)
+				_PointLightContribution(r.o, point, normal, light, lspec, ldiffuse, stats);
+			for (const SpotLight& light : _spotLights)
+				_SpotLightContribution(r.o, point, normal, light, lspec, ldiffuse, stats);
+
+			float falloff = std::pow(0.8f, (float)(bounces + 1)) / (bounces + 1);
+			accumulatedDiff = accumulatedDiff + Mul(ldiffuse * falloff, texColor);
+			accumulatedSpec = accumulatedSpec + Mul(lspec * falloff, texColor);
+
+			r.d = Normalize(r.d - normal * (2.0f * Dot(r.d, normal)));
+			r.o = point + r.d * 0.0001f;
+		}
+	}
+	if (normalDepth)
+	{
+		//Misses count as black albedo like they count as black radiance, but leave the depth alone
+		float length = Length(guideNormal);
+		Vec3 n = length > 0.0f ? guideNormal * (1.0f / length) : guideNormal;
+		Vec3 a = guideAlbedo * (1.0f / samples);
+		normalDepth[0] = n.x;
+		normalDepth[1] = n.y;
+		normalDepth[2] = n.z;
+		normalDepth[3] = hits ? guideDepth / hits : 0.0f;
+		albedo[0] = a.x;
+		albedo[1] = a.y;
+		albedo[2] = a.z;
+		albedo[3] = 1.0f;
+	}
+	return (accumulatedDiff + accumulatedSpec) * (1.0f / samples);
+}
+
+void CpuGraphics::Draw()
+{
+	PROFILE_ZONE("Draw");
+	_UpdateWideBVH();
+	const Core* core = Core::GetInstance();
+	IWindow* window = core->GetWindow();
+	Camera camera = core->GetCameraManager()->GetActiveCamera();
+	VectorMath::Float3 right = camera.GetRight();
+
+	CameraRays cam;
+	cam.position = MakeVec3(camera.position.x, camera.position.y, camera.position.z);
+	cam.direction = MakeVec3(camera.forward.x, camera.forward.y, camera.forward.z);
+	cam.up = MakeVec3(camera.up.x, camera.up.y, camera.up.z);
+	cam.right = MakeVec3(right.x, right.y, right.z);
+	cam.fardist = camera.farPlane;
+	cam.aspectratio = camera.aspectRatio;
+	cam.fov = camera.fov;
+	cam.width = window->GetWidth();
+	cam.height = window->GetHeight();
+
+	size_t pixelCount = (size_t)cam.width * cam.height;
+	_frame.resize(pixelCount * 4);
+	bool temporal = _temporalSettings.enabled;
+	//With temporal reprojection the history carries the earlier frames, the accumulation buffer only gets the new one
+	if (!_accumulate || temporal || _accumulation.size() != pixelCount * 4)
+	{
+		_accumulation.resize(pixelCount * 4);
+		_accumulatedFrames = 0;
+	}
+	GetAccumulationJitter(temporal ? _temporalFrames % TEMPORAL_JITTER_PHASES : _accumulatedFrames, cam.jitterX, cam.jitterY);
+	bool add = _accumulatedFrames > 0;
+	bool denoise = _denoiseSettings.enabled;
+	bool guides = denoise || temporal;
+	if (guides)
+	{
+		_normalDepth.resize(pixelCount * 4);
+		_albedo.resize(pixelCount * 4);
+	}
+	if (denoise)
+		_denoised.resize(pixelCount * 4);
+#if RAY_STATS_ENABLED
+	_rayStatsPixels.resize(pixelCount);
+#endif
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		PROFILE_ZONE("Render rows");
+		ParallelFor(cam.height, 1, [&](size_t begin, size_t end, unsigned)
+		{
+			for (size_t y = begin; y < end; y++)
+			{
+				for (unsigned x = 0; x < cam.width; x++)
+				{
+					RayStats stats = {};
+					size_t pixel = y * cam.width + x;
+					Vec3 color = _TracePixel(cam, x, (unsigned)y, stats, guides ? &_normalDepth[pixel * 4] : nullptr, guides ? &_albedo[pixel * 4] : nullptr);
+					float* sum = &_accumulation[pixel * 4];
+					if (!add)
+						sum[0] = sum[1] = sum[2] = sum[3] = 0.0f;
+					sum[0] += color.x;
+					sum[1] += color.y;
+					sum[2] += color.z;
+					sum[3] += 1.0f;
+#if RAY_STATS_ENABLED
+					_rayStatsPixels[pixel] = stats;
+#endif
+				}
+			}
+		});
+	}
+	_accumulatedFrames++;
+	const float* radiance = _accumulation.data();
+	if (temporal)
+	{
+		PerFrameBuffer view;
+		core->GetCameraManager()->FillPerFrameBuffer(view);
+		_resolved.resize(pixelCount * 4);
+		if (_historyValid && _history.size() == pixelCount * 4)
+			TemporalReproject(_history.data(), _historyNormalDepth.data(), _historyView, _accumulation.data(), _normalDepth.data(), view, cam.width, cam.height, _temporalSettings, _resolved.data());
+		else
+			_resolved = _accumulation;
+		_history.swap(_resolved);
+		_historyNormalDepth = _normalDepth;
+		_historyView = view;
+		_historyValid = true;
+		_temporalFrames++;
+		radiance = _history.data();
+	}
+	_lastDenoiseTime = 0.0;
+	if (denoise)
+	{
+		auto denoiseStart = std::chrono::steady_clock::now();
+		Denoise(radiance, _normalDepth.data(), _albedo.data(), cam.width, cam.height, _denoiseSettings, _denoised.data());
+		_lastDenoiseTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - denoiseStart).count();
+		PROFILE_COUNTER("CPU denoise time (ms)", _lastDenoiseTime);
+		radiance = _denoised.data();
+	}
+	ToneMap(radiance, cam.width, cam.height, _toneMapSettings, _frame.data());
+	_lastFrameTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() - _lastDenoiseTime;
+	PROFILE_COUNTER("CPU trace time (ms)", _lastFrameTime);
+#if RAY_STATS_ENABLED
+	_rayStats = AccumulateRayStats(&_rayStatsPixels[0], _rayStatsPixels.size());
+#endif
+
+	_titleTime += _lastFrameTime;
+	_titleFrames++;
+	if (_titleFrames > 10)
+	{
+		std::stringstream ss;
+		ss << "Avg frametime: " << _titleTime / _titleFrames;
+		window->SetTitle(ss.str());
+		printf("%.2f\n", _titleTime / _titleFrames);
+#if RAY_STATS_ENABLED
+		printf("rays: %llu primary, %llu bounce, %llu shadow | tests: %llu nodes, %llu triangles, %llu spheres\n",
+			_rayStats.primaryRays, _rayStats.bounceRays, _rayStats.shadowRays,
+			_rayStats.nodeVisits, _rayStats.triangleTests, _rayStats.sphereTests);
+#endif
+		_titleTime = 0.0;
+		_titleFrames = 0;
+	}
+
+	_frameCaptured = _frameCapture;
+	PROFILE_ZONE("Present");
+	window->Present(_frame.data());
+}
+
+void CpuGraphics::SetAccumulation(bool enabled)
+{
+	_accumulate = enabled;
+	_accumulatedFrames = 0;
+}
+
+void CpuGraphics::ResetAccumulation()
+{
+	_accumulatedFrames = 0;
+	_historyValid = false;
+	_temporalFrames = 0;
+}
+
+void CpuGraphics::SetToneMapping(const ToneMapSettings & settings)
+{
+	_toneMapSettings = settings;
+}
+
+bool CpuGraphics::ReadBackAccumulation(std::vector<float>& rgbw, unsigned & width, unsigned & height)
+{
+	if (_accumulatedFrames == 0)
+		return false;
+	const IWindow* window = Core::GetInstance()->GetWindow();
+	width = window->GetWidth();
+	height = window->GetHeight();
+	rgbw = _temporalSettings.enabled && _historyValid ? _history : _accumulation;
+	return true;
+}
+
+void CpuGraphics::SetSamplesPerPixel(unsigned samples)
+{
+	_sampleMask = GetSampleMask(samples);
+}
+
+void CpuGraphics::SetTemporal(const TemporalSettings & settings)
+{
+	_temporalSettings = settings;
+	_historyValid = false;
+	_temporalFrames = 0;
+}
+
+void CpuGraphics::SetDenoise(const DenoiseSettings & settings)
+{
+	_denoiseSettings = settings;
+}
+
+double CpuGraphics::GetLastDenoiseTime() const
+{
+	return _lastDenoiseTime;
+}
+
+double CpuGraphics::GetLastFrameTime() const
+{
+	return _lastFrameTime;
+}
+
+FrameRayStats CpuGraphics::GetRayStats() const
+{
+	return _rayStats;
+}
+
+#if RAY_STATS_ENABLED
+bool CpuGraphics::DumpRayStatsHeatmap(const std::string & filename, RayStatCounter counter)
+{
+	const IWindow* window = Core::GetInstance()->GetWindow();
+	if (_rayStatsPixels.empty())
+		return false;
+	return WriteRayStatsHeatmap(filename, &_rayStatsPixels[0], window->GetWidth(), window->GetHeight(), counter);
+}
+#else
+bool CpuGraphics::DumpRayStatsHeatmap(const std::string &, RayStatCounter)
+{
+	return false;
+}
+#endif
+
+void CpuGraphics::SetFrameCapture(bool enabled)
+{
+	_frameCapture = enabled;
+	_frameCaptured = false;
+}
+
+bool CpuGraphics::ReadBackFrame(std::vector<uint8_t>& rgba, unsigned & width, unsigned & height)
+{
+	if (!_frameCaptured)
+		return false;
+	const IWindow* window = Core::GetInstance()->GetWindow();
+	width = window->GetWidth();
+	height = window->GetHeight();
+	rgba = _frame;
+	return true;
+}
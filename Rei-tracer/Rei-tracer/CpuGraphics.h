@@ -0,0 +1,163 @@
+#ifndef _CPU_GRAPHICS_H_
+#define _CPU_GRAPHICS_H_
+
+#include <vector>
+#include <unordered_map>
+#include "Structs.h"
+#include "IGraphics.h"
+#include "RayKernels.h"
+#include "WideBVH.h"
+
+//Decoded to floats at load time, sampled bilinearly with wrapping like the gpu sampler
+struct CpuTexture
+{
+	unsigned width = 0;
+	unsigned height = 0;
+	std::vector<float> rgb;
+};
+
+//The graphics interface without a gpu: Draw runs main of Shaders/raytracer.hlsl for every pixel on the
+//worker threads, with the scene kept in the same tables the shader reads, and presents the frame to the window.
+//Textures are decoded by ImageReader instead of WIC, png, jpeg and binary ppm. Materials whose files
+//fail to load render untextured like a missing texture does on the gpu.
+class CpuGraphics : public IGraphics
+{
+public:
+	CpuGraphics();
+	virtual ~CpuGraphics();
+
+	virtual void IncreaseBounceCount();
+	virtual void DecreaseBounceCount();
+	virtual void SetBounceCount(unsigned bounces);
+	virtual void SetTriangleTest(TriangleTest test);
+	virtual void SetBVHLayout(BVHLayout layout);
+	virtual void SetTriangles(Triangle* triangles, size_t count);
+	virtual void SetSpheres(Sphere* spheres, size_t count);
+	virtual void SetPlanes(Plane* planes, size_t count);
+	virtual void SetPointLights(PointLight* pointlights, size_t count);
+	virtual void SetSpotLights(SpotLight* spotlights, size_t count);
+	virtual void SetMeshPartitions(BVHNode* nodes, size_t nodeCount, uint32_t* triangleIndices, size_t triangleIndexCount, MeshIndices* meshes, size_t meshCount);
+	virtual void UpdateTriangles(size_t first, size_t count, const Triangle* triangles);
+	virtual void UpdateMeshPartitions(size_t first, size_t count, const BVHNode* nodes);
+	virtual void UpdateSphere(size_t index, const Sphere& sphere);
+	virtual void UpdatePointLight(size_t index, const PointLight& light);
+	virtual void UpdateSpotLight(size_t index, const SpotLight& light);
+	virtual void PrepareTextures(unsigned indexStart, unsigned indexEnd, const std::string& filenameDiffuse, const std::string& filenameNormal);
+	virtual void PreparePlaneTextures(unsigned indexStart, unsigned indexEnd, const std::string& filenameDiffuse, const std::string& filenameNormal);
+	virtual void SetTextures();
+	virtual void Draw();
+	virtual void SetAccumulation(bool enabled);
+	virtual void ResetAccumulation();
+	virtual void SetToneMapping(const ToneMapSettings& settings);
+	virtual bool ReadBackAccumulation(std::vector<float>& rgbw, unsigned& width, unsigned& height);
+	virtual void SetSamplesPerPixel(unsigned samples);
+	virtual void SetDenoise(const DenoiseSettings& settings);
+	virtual void SetTemporal(const TemporalSettings& settings);
+	virtual double GetLastDenoiseTime() const;
+	//Wall clock time of the last Draw in milliseconds
+	virtual double GetLastFrameTime() const;
+	virtual FrameRayStats GetRayStats() const;
+	virtual bool DumpRayStatsHeatmap(const std::string& filename, RayStatCounter counter = RAYSTAT_COST);
+	virtual void SetFrameCapture(bool enabled);
+	virtual bool ReadBackFrame(std::vector<uint8_t>& rgba, unsigned& width, unsigned& height);
+
+private:
+	//What the shader gets in its camera constant buffer
+	struct CameraRays
+	{
+		Vec3 position;
+		Vec3 direction;
+		Vec3 up;
+		Vec3 right;
+		float fardist;
+		float aspectratio;
+		float fov;
+		unsigned width;
+		unsigned height;
+		float jitterX;
+		float jitterY;
+	};
+
+	//The closest hit of TraverseBVH and IntersectPlanes
+	struct Hit
+	{
+		float dist = 9999.0f;
+		float u = 0.0f;
+		float v = 0.0f;
+		int triangleIndex = -1;
+		int planeIndex = -1;
+		Vec3 normal;
+		Vec3 tangent;
+		float handedness = 0.0f;
+	};
+
+	int _LoadTexture(const std::string& filename);
+	unsigned _FindOrAddMaterial(int diffuseIndex, int normalIndex);
+	Vec3 _Sample(int texture, float u, float v) const;
+
+	//Collapses the triangle meshes into _bvhLayout again if the layout or their nodes changed since the last Draw,
+	//for BVH_LAYOUT_BINARY_BLOCKS also if their triangles or the triangle test did
+	void _UpdateWideBVH();
+	void _TraverseBVH(const Ray& r, const Vec3& rcpDir, Hit& hit, RayStats& stats) const;
+	bool _TraverseBVHForShadows(const Ray& r, const Vec3& rcpDir, float dist, RayStats& stats) const;
+	void _IntersectPlanes(const Ray& r, Hit& hit) const;
+	bool _PlanesOcclude(const Ray& r, float dist) const;
+	void _PointLightContribution(const Vec3& rayOrigin, const Vec3& origin, const Vec3& normal, const PointLight& light, Vec3& specular, Vec3& diffuse, RayStats& stats) const;
+	void _SpotLightContribution(const Vec3& rayOrigin, const Vec3& origin, const Vec3& normal, const SpotLight& light, Vec3& specular, Vec3& diffuse, RayStats& stats) const;
+	//Writes the first hit guides of Denoise to normalDepth and albedo unless they are null
+	Vec3 _TracePixel(const CameraRays& cam, unsigned x, unsigned y, RayStats& stats, float* normalDepth, float* albedo) const;
+
+	std::vector<Sphere> _spheres;
+	std::vector<Plane> _planes;
+	std::vector<Triangle> _triangles;
+	std::vector<PrecomputedTriangle> _precomputedTriangles; //What _triangleTest reads of _triangles
+	std::vector<PointLight> _pointLights;
+	std::vector<SpotLight> _spotLights;
+	std::vector<BVHNode> _bvhNodes;
+	std::vector<uint32_t> _triangleIndices;
+	std::vector<MeshIndices> _meshIndices;
+	//The wide and block kernels only know triangle leaves, so the sphere bvh is walked in the binary tables whatever the layout.
+	//The node visit and triangle test counters only see the binary traversal.
+	BVHLayout _bvhLayout = BVH_LAYOUT_BINARY;
+	std::vector<MeshIndices> _triangleMeshes;
+	std::vector<MeshIndices> _sphereMeshes;
+	WideBVH _wideBVH; //_triangleMeshes in _bvhLayout, only used for the wide layouts
+	TriangleBlocks _triangleBlocks; //_triangleMeshes for BVH_LAYOUT_BINARY_BLOCKS
+	bool _wideBVHDirty = false;
+
+	std::vector<MeshMaterial> _materials;
+	std::vector<uint32_t> _triangleMaterials;
+	std::unordered_map<std::string, int> _textureIndices;
+	std::vector<CpuTexture> _textures;
+
+	int _bounceCount = 0;
+	TriangleTest _triangleTest = TRIANGLE_TEST_MOLLER_TRUMBORE;
+	unsigned _sampleMask = GetSampleMask(MAX_SAMPLES_PER_PIXEL);
+
+	std::vector<float> _accumulation; //Linear rgb sums with the frame count in w
+	bool _accumulate = false;
+	unsigned _accumulatedFrames = 0;   //0 makes the next Draw overwrite instead of add
+	ToneMapSettings _toneMapSettings;
+	DenoiseSettings _denoiseSettings;
+	std::vector<float> _normalDepth;  //Denoise guides of the last Draw, only kept up to date while denoising
+	std::vector<float> _albedo;
+	std::vector<float> _denoised;
+	double _lastDenoiseTime = 0.0;
+	TemporalSettings _temporalSettings;
+	std::vector<float> _history;             //What the last Draw resolved to, sums like _accumulation
+	std::vector<float> _historyNormalDepth;  //The guides _history was traced with
+	std::vector<float> _resolved;
+	PerFrameBuffer _historyView;
+	bool _historyValid = false;
+	unsigned _temporalFrames = 0;            //Frames since the history started, picks the jitter
+	std::vector<uint8_t> _frame;
+	double _lastFrameTime = 0.0;
+	bool _frameCapture = false;
+	bool _frameCaptured = false;
+	FrameRayStats _rayStats;
+	std::vector<RayStats> _rayStatsPixels;
+	unsigned _titleFrames = 0;
+	double _titleTime = 0.0;
+};
+
+#endif
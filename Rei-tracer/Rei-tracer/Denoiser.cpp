@@ -0,0 +1,130 @@
+#include "Denoiser.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "VectorMath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace VectorMath;
+
+#define DENOISE_ALBEDO_EPSILON 0.001f //Keeps the demodulation finite on black texels
+
+static inline float HorizontalSum(Vector v)
+{
+	return VectorGetX(v) + VectorGetY(v) + VectorGetZ(v) + VectorGetW(v);
+}
+
+//One pass of the 5x5 B3 spline kernel with its taps step pixels apart. Taps that missed everything are left out,
+//the rest are weighted down by one exponential of their summed, scaled squared guide and color differences.
+static void FilterPass(const Float4* in, const Float4* normalDepth, const Float4* albedo, unsigned width, unsigned height,
+	unsigned step, float sigmaColor, const DenoiseSettings& settings, Float4* out)
+{
+	static const float kernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+	float invColor = 1.0f / (sigmaColor * sigmaColor);
+	float invNormal = 1.0f / (settings.sigmaNormal * settings.sigmaNormal);
+	float invAlbedo = 1.0f / (settings.sigmaAlbedo * settings.sigmaAlbedo);
+	Vector colorScale = VectorSet(invColor, invColor, invColor, 0.0f);
+	Vector albedoScale = VectorSet(invAlbedo, invAlbedo, invAlbedo, 0.0f);
+	//The depth tolerance grows with the distance of the tap in pixels
+	float invTapDistance2[3][3];
+	for (int dy = 0; dy < 3; dy++)
+	{
+		for (int dx = 0; dx < 3; dx++)
+			invTapDistance2[dy][dx] = dx + dy > 0 ? 1.0f / ((dx * dx + dy * dy) * (float)step * (float)step) : 0.0f;
+	}
+
+	ParallelFor(height, 4, [&](size_t begin, size_t end, unsigned)
+	{
+		for (size_t y = begin; y < end; y++)
+		{
+			for (unsigned x = 0; x < width; x++)
+			{
+				size_t p = y * width + x;
+				Vector cp = LoadFloat4(&in[p]);
+				Vector ndp = LoadFloat4(&normalDepth[p]);
+				float depth = VectorGetW(ndp);
+				if (depth <= 0.0f)
+				{
+					StoreFloat4(&out[p], cp);
+					continue;
+				}
+				Vector ap = LoadFloat4(&albedo[p]);
+				float invDepth = 1.0f / (settings.sigmaDepth * depth);
+				invDepth *= invDepth;
+
+				float weightSum = kernel[0] * kernel[0];
+				Vector sum = cp * weightSum;
+				for (int dy = -2; dy <= 2; dy++)
+				{
+					long long qy = (long long)y + dy * (long long)step;
+					if (qy < 0 || qy >= (long long)height)
+						continue;
+					for (int dx = -2; dx <= 2; dx++)
+					{
+						long long qx = (long long)x + dx * (long long)step;
+						if (qx < 0 || qx >= (long long)width || (dx == 0 && dy == 0))
+							continue;
+						size_t q = (size_t)qy * width + (size_t)qx;
+						Vector ndq = LoadFloat4(&normalDepth[q]);
+						if (VectorGetW(ndq) <= 0.0f)
+							continue;
+						Vector cq = LoadFloat4(&in[q]);
+						Vector dc = cp - cq;
+						Vector dn = ndp - ndq;
+						Vector da = ap - LoadFloat4(&albedo[q]);
+						float depthScale = invDepth * invTapDistance2[std::abs(dy)][std::abs(dx)];
+						Vector normalDepthScale = VectorSet(invNormal, invNormal, invNormal, depthScale);
+						Vector exponent = VectorMultiplyAdd(dc * dc, colorScale, VectorMultiplyAdd(dn * dn, normalDepthScale, da * da * albedoScale));
+						float weight = kernel[std::abs(dx)] * kernel[std::abs(dy)] * std::exp(-HorizontalSum(exponent));
+						sum = VectorMultiplyAdd(cq, VectorReplicate(weight), sum);
+						weightSum += weight;
+					}
+				}
+				StoreFloat4(&out[p], sum * (1.0f / weightSum));
+			}
+		}
+	});
+}
+
+void Denoise(const float * rgbw, const float * normalDepth, const float * albedo, unsigned width, unsigned height,
+	const DenoiseSettings & settings, float * out)
+{
+	PROFILE_ZONE("Denoise");
+	size_t pixelCount = (size_t)width * height;
+	const Float4* sums = (const Float4*)rgbw;
+	const Float4* guides = (const Float4*)normalDepth;
+	const Float4* albedos = (const Float4*)albedo;
+	std::vector<Float4> illumination(pixelCount);
+	std::vector<Float4> filtered(pixelCount);
+	Vector epsilon = VectorReplicate(DENOISE_ALBEDO_EPSILON);
+
+	ParallelFor(height, 16, [&](size_t begin, size_t end, unsigned)
+	{
+		for (size_t i = begin * width; i < end * width; i++)
+		{
+			Vector sum = LoadFloat4(&sums[i]);
+			float weight = VectorGetW(sum);
+			Vector radiance = weight > 0.0f ? sum * (1.0f / weight) : VectorReplicate(0.0f);
+			StoreFloat4(&illumination[i], radiance / VectorMax(LoadFloat4(&albedos[i]), epsilon));
+		}
+	});
+
+	unsigned iterations = (std::min)(settings.iterations, (unsigned)DENOISE_MAX_ITERATIONS);
+	for (unsigned i = 0; i < iterations; i++)
+	{
+		//Later passes reach further and only smooth what is left, so they get stricter about color
+		FilterPass(illumination.data(), guides, albedos, width, height, 1U << i, settings.sigmaColor / (float)(1U << i), settings, filtered.data());
+		illumination.swap(filtered);
+	}
+
+	ParallelFor(height, 16, [&](size_t begin, size_t end, unsigned)
+	{
+		for (size_t i = begin * width; i < end * width; i++)
+		{
+			Vector radiance = LoadFloat4(&illumination[i]) * VectorMax(LoadFloat4(&albedos[i]), epsilon);
+			StoreFloat4((Float4*)&out[i * 4], radiance);
+			out[i * 4 + 3] = 1.0f;
+		}
+	});
+}
@@ -0,0 +1,30 @@
+#ifndef _DENOISER_H_
+#define _DENOISER_H_
+
+#include <vector>
+
+#define DENOISE_MAX_ITERATIONS 16 //The taps are 2^15 pixels apart by then, further than any frame reaches
+
+struct DenoiseSettings
+{
+	//The tracer has no random sampling, so what one or two samples per pixel get wrong is aliasing that a single
+	//pass evens out best, more passes mostly blur. They are for sources of noise that spread further.
+	bool enabled = false;
+	unsigned iterations = 1;    //Passes of the 5x5 kernel, the tap spacing doubles every pass. At most DENOISE_MAX_ITERATIONS.
+	float sigmaColor = 0.75f;   //Illumination difference that drops a tap to 1/e, halved every pass
+	float sigmaNormal = 0.6f;   //Same for the length of the normal difference
+	float sigmaDepth = 0.05f;   //Same for the depth difference, relative to the depth and per pixel of distance
+	float sigmaAlbedo = 0.2f;
+};
+
+//Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) over the average radiance of an accumulation buffer.
+//The tracers write the guides from the first hit of every pixel, averaged over its samples:
+//normalDepth holds the shading normal in xyz and the hit distance in w, with w = 0 where every sample missed,
+//albedo holds the diffuse texture color in rgb. The radiance is divided by the albedo before filtering and
+//multiplied back after, so texture detail survives however far the kernel reaches.
+//rgbw holds sums with the frame count in w, out gets the filtered radiance with w = 1, ready for ToneMap.
+//Rows are spread over the worker threads and every pixel is one VectorMath vector.
+void Denoise(const float* rgbw, const float* normalDepth, const float* albedo, unsigned width, unsigned height,
+	const DenoiseSettings& settings, float* out);
+
+#endif
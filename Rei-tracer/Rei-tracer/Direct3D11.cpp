@@ -1,6 +1,8 @@
 #include "Direct3D11.h"
 #include "Core.h"
 #include "Structs.h"
+#include "Profiler.h"
+#include "RayKernels.h"
 #include <exception>
 #include "DirectXTK\DDSTextureLoader.h"
 #include "DirectXTK\WICTextureLoader.h"
@@ -8,13 +10,16 @@
 #include <sstream>
 #include <DirectXMath.h>
 #include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <chrono>
 
 using namespace DirectX;
 
 Direct3D11::Direct3D11()
 {
 	const Core* core = Core::GetInstance();
-	const Window* window = core->GetWindow();
+	const IWindow* window = core->GetWindow();
 
 	DXGI_SWAP_CHAIN_DESC scd;
 	ZeroMemory(&scd, sizeof(scd));
@@ -25,7 +30,7 @@ Direct3D11::Direct3D11()
 	scd.BufferDesc.RefreshRate.Numerator = 60;
 	scd.BufferDesc.RefreshRate.Denominator = 1;
 	scd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT | DXGI_USAGE_UNORDERED_ACCESS;
-	scd.OutputWindow = core->GetWindow()->GetHandle();
+	scd.OutputWindow = (HWND)core->GetWindow()->GetNativeHandle();
 	scd.SampleDesc.Count = 1; 
 	scd.SampleDesc.Quality = 0;
 	scd.Windowed = TRUE; 
@@ -44,22 +49,39 @@ Direct3D11::Direct3D11()
 	_timer = new D3D11Timer(_device, _deviceContext);
 
 	_computeWrap = new ComputeWrap(_device, _deviceContext);
+#if RAY_STATS_ENABLED
+	D3D10_SHADER_MACRO defines[] = { { "RAY_STATS", "1" }, { NULL, NULL } };
+	_computeShader = _computeWrap->CreateComputeShader(L"Shaders/raytracer.hlsl", NULL, "main", defines);
+	_rayStatsBuffer = _computeWrap->CreateBuffer(STRUCTURED_BUFFER, sizeof(RayStats), window->GetWidth() * window->GetHeight(), false, true, nullptr, true);
+	_rayStatsPixels.resize(window->GetWidth() * window->GetHeight());
+#else
 	_computeShader = _computeWrap->CreateComputeShader(L"Shaders/raytracer.hlsl", NULL, "main", NULL);
+#endif
+	_toneMapShader = _computeWrap->CreateComputeShader(L"Shaders/tonemap.hlsl", NULL, "main", NULL);
+	_accumulationBuffer = _computeWrap->CreateBuffer(STRUCTURED_BUFFER, sizeof(float) * 4, window->GetWidth() * window->GetHeight(), true, true, nullptr, true);
+	_normalDepthBuffer = _computeWrap->CreateBuffer(STRUCTURED_BUFFER, sizeof(float) * 4, window->GetWidth() * window->GetHeight(), false, true, nullptr, true);
+	_albedoBuffer = _computeWrap->CreateBuffer(STRUCTURED_BUFFER, sizeof(float) * 4, window->GetWidth() * window->GetHeight(), false, true, nullptr, true);
+	_resolvedBuffer = _computeWrap->CreateBuffer(STRUCTURED_BUFFER, sizeof(float) * 4, window->GetWidth() * window->GetHeight(), true, false, nullptr);
 	
 	_CreateSamplerState();
 	_CreateViewPort();
 	_CreateConstantBuffers();
-	_CreateStructuredBuffer(&_structuredBuffers[SB_SPHERES], sizeof(Sphere), 10);
-	_CreateStructuredBuffer(&_structuredBuffers[SB_TRIANGLES], sizeof(Triangle), MAX_TRIANGLES);
-	_triangles.reserve(MAX_TRIANGLES);
-	_CreateStructuredBuffer(&_structuredBuffers[SB_POINTLIGHTS], sizeof(PointLight), MAX_POINTLIGHTS);
-	_CreateStructuredBuffer(&_structuredBuffers[SB_SPOTLIGHTS], sizeof(SpotLight), MAX_SPOTLIGHTS);
-	_CreateStructuredBuffer(&_structuredBuffers[SB_TEXTUREOFFSETS], sizeof(TextureOffset), MAX_MESHTEXTURES);
-	_CreateStructuredBuffer(&_structuredBuffers[SB_MESHPARTITIONS], sizeof(OctNode), (MAX_OCTNODES_PER_MESH) * MAX_MESHES);
-	_CreateStructuredBuffer(&_structuredBuffers[SB_MESHINDICES], sizeof(MeshIndices), MAX_MESHES);
-	
-
-	_rawTextureData = new uint8_t[256U * 256U * 4U * MAX_MESHTEXTURES * 2U];
+	//The scene buffers start out with room for one element and grow with the content uploaded to them
+	_CreateStructuredBuffer(&_structuredBuffers[SB_SPHERES], sizeof(Sphere), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_TRIANGLES], sizeof(Triangle), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_POINTLIGHTS], sizeof(PointLight), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_SPOTLIGHTS], sizeof(SpotLight), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_MESHPARTITIONS], sizeof(BVHNode), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_MESHINDICES], sizeof(MeshIndices), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_TRIANGLEINDICES], sizeof(uint32_t), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_PLANES], sizeof(Plane), 1);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_PRECOMPUTEDTRIANGLES], sizeof(PrecomputedTriangle), 1);
+
+	//Material 0 is the untextured default every triangle starts out with
+	_materials.push_back({ -1, -1 });
+	uint32_t defaultMaterial = 0;
+	_CreateStructuredBuffer(&_structuredBuffers[SB_MATERIALS], sizeof(MeshMaterial), 1, false, false, &_materials[0]);
+	_CreateStructuredBuffer(&_structuredBuffers[SB_TRIANGLEMATERIALS], sizeof(uint32_t), 1, false, false, &defaultMaterial);
 	//Triangle ray test
 	//XMVECTOR v1 = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
 	//XMVECTOR v2 = XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f);
@@ -93,6 +115,14 @@ Direct3D11::~Direct3D11()
 	delete _timer;
 	delete _computeWrap;
 	delete _computeShader;
+	delete _toneMapShader;
+	delete _accumulationBuffer;
+	delete _normalDepthBuffer;
+	delete _albedoBuffer;
+	delete _resolvedBuffer;
+#if RAY_STATS_ENABLED
+	delete _rayStatsBuffer;
+#endif
 
 	for (auto &i : _samplerStates)
 	{
@@ -107,6 +137,7 @@ Direct3D11::~Direct3D11()
 		SAFE_DELETE(i);
 	}
 
+	SAFE_RELEASE(_captureTexture);
 	SAFE_RELEASE(_backBufferUAV);
 	SAFE_RELEASE(_swapChain);
 
@@ -120,19 +151,45 @@ Direct3D11::~Direct3D11()
 			//DebugLog::PrintToConsole("Unreleased com objects: %d", refCount);
 		}
 	}
-	delete _rawTextureData;
-
 }
 
 
-void Direct3D11::_CreateWICTexture(const std::string & filename)
+int Direct3D11::_LoadTexture(const std::string & filename)
 {
-	if (_textureIndices.size() == MAX_MESHTEXTURES)
-		throw std::exception("Cannot create more textures");
+	auto got = _textureIndices.find(filename);
+	if (got != _textureIndices.end())
+		return (int)got->second;
+
+	if (filename.size() <= 3)
+		return -1;
+	std::string fileend = filename.substr(filename.size() - 3);
+	if (fileend != "png" && fileend != "jpg")
+		return -1;
+
+	PROFILE_ZONE("Texture decode");
+	//Every texture gets its own slice in the texture array, so the raw data just grows by one slice
+	unsigned texindex = (unsigned)_textureIndices.size();
+	_rawTextureData.resize((texindex + 1) * TEXTURE_BYTESIZE);
 	std::wstring name(filename.begin(), filename.end());
-	uint8_t* destination = _rawTextureData + (_textureIndices.size() * TEXTURE_BYTESIZE);
-	AppendTextureData(destination, _device, name.c_str());
+	if (FAILED(AppendTextureData(&_rawTextureData[texindex * TEXTURE_BYTESIZE], _device, name.c_str())))
+	{
+		_rawTextureData.resize(texindex * TEXTURE_BYTESIZE);
+		return -1;
+	}
+	_textureIndices[filename] = texindex;
+	return (int)texindex;
+}
 
+unsigned Direct3D11::_FindOrAddMaterial(int diffuseIndex, int normalIndex)
+{
+	//Only a handful of materials per scene, and this only runs at scene build time
+	for (unsigned i = 0; i < _materials.size(); i++)
+	{
+		if (_materials[i].diffuseIndex == diffuseIndex && _materials[i].normalIndex == normalIndex)
+			return i;
+	}
+	_materials.push_back({ diffuseIndex, normalIndex });
+	return (unsigned)_materials.size() - 1;
 }
 
 void Direct3D11::_Map(ID3D11Resource * resource, void * data, uint32_t stride, uint32_t count, D3D11_MAP mapType, UINT flags)
@@ -145,12 +202,36 @@ void Direct3D11::_Map(ID3D11Resource * resource, void * data, uint32_t stride, u
 
 void Direct3D11::Draw()
 {
+	PROFILE_ZONE("Draw");
 	const Core* core = Core::GetInstance();
 	float clearColor[] = { 0.0f,0.0f,0.0f,0.0f };
 
-	ID3D11UnorderedAccessView* uav[] = { _backBufferUAV };
+#if RAY_STATS_ENABLED
+	ID3D11UnorderedAccessView* uav[] = { _accumulationBuffer->GetUnorderedAccessView(), _rayStatsBuffer->GetUnorderedAccessView() };
+	_deviceContext->CSSetUnorderedAccessViews(0, 2, uav, NULL);
+#else
+	ID3D11UnorderedAccessView* uav[] = { _accumulationBuffer->GetUnorderedAccessView() };
 	_deviceContext->CSSetUnorderedAccessViews(0, 1, uav, NULL);
+#endif
+
+	ID3D11UnorderedAccessView* guides[] = { _normalDepthBuffer->GetUnorderedAccessView(), _albedoBuffer->GetUnorderedAccessView() };
+	_deviceContext->CSSetUnorderedAccessViews(2, 2, guides, NULL);
+
+	_UploadDirtyRanges();
 
+	bool temporal = _temporalSettings.enabled;
+	bool postProcess = temporal || _denoiseSettings.enabled;
+	//With temporal reprojection the history carries the earlier frames, the accumulation buffer only gets the new one
+	if (!_accumulate || temporal)
+		_accumulatedFrames = 0;
+	int32_t accumulate = _accumulatedFrames > 0 ? 1 : 0;
+	int32_t writeGuides = postProcess ? 1 : 0;
+	if (_computeConstants.gAccumulate != accumulate || _computeConstants.gWriteGuides != writeGuides)
+	{
+		_computeConstants.gAccumulate = accumulate;
+		_computeConstants.gWriteGuides = writeGuides;
+		_computeConstantsUpdated = true;
+	}
 	if (_computeConstantsUpdated)
 	{
 		_Map(_constantBuffers[ConstantBuffers::CB_COMPUTECONSTANTS], &_computeConstants, sizeof(ComputeConstants), 1, D3D11_MAP_WRITE_DISCARD, 0);
@@ -169,6 +250,7 @@ void Direct3D11::Draw()
 	ccam.width = core->GetWindow()->GetWidth();
 	ccam.fov = cam.fov;
 	ccam.aspectratio = cam.aspectRatio;
+	GetAccumulationJitter(temporal ? _temporalFrames % TEMPORAL_JITTER_PHASES : _accumulatedFrames, ccam.jitterX, ccam.jitterY);
 
 	_Map(_constantBuffers[ConstantBuffers::CB_COMPUTECAMERA], &ccam, sizeof(ccam), 1, D3D11_MAP_WRITE_DISCARD, 0);
 	
@@ -178,11 +260,15 @@ void Direct3D11::Draw()
 	_deviceContext->CSSetShaderResources(0, 1, &(_structuredBuffers[StructuredBuffers::SB_SPHERES]->srv));
 	_deviceContext->CSSetShaderResources(1, 1, &(_structuredBuffers[StructuredBuffers::SB_TRIANGLES]->srv));
 	_deviceContext->CSSetShaderResources(2, 1, &(_structuredBuffers[StructuredBuffers::SB_POINTLIGHTS]->srv));
-	_deviceContext->CSSetShaderResources(3, 1, &(_structuredBuffers[StructuredBuffers::SB_TEXTUREOFFSETS]->srv));
+	_deviceContext->CSSetShaderResources(3, 1, &(_structuredBuffers[StructuredBuffers::SB_MATERIALS]->srv));
 	_deviceContext->CSSetShaderResources(4, 1, &_textureArray);
 	_deviceContext->CSSetShaderResources(5, 1, &(_structuredBuffers[StructuredBuffers::SB_SPOTLIGHTS]->srv));
 	_deviceContext->CSSetShaderResources(6, 1, &(_structuredBuffers[StructuredBuffers::SB_MESHINDICES]->srv));
 	_deviceContext->CSSetShaderResources(7, 1, &(_structuredBuffers[StructuredBuffers::SB_MESHPARTITIONS]->srv));
+	_deviceContext->CSSetShaderResources(8, 1, &(_structuredBuffers[StructuredBuffers::SB_TRIANGLEMATERIALS]->srv));
+	_deviceContext->CSSetShaderResources(9, 1, &(_structuredBuffers[StructuredBuffers::SB_TRIANGLEINDICES]->srv));
+	_deviceContext->CSSetShaderResources(10, 1, &(_structuredBuffers[StructuredBuffers::SB_PLANES]->srv));
+	_deviceContext->CSSetShaderResources(11, 1, &(_structuredBuffers[StructuredBuffers::SB_PRECOMPUTEDTRIANGLES]->srv));
 
 	_deviceContext->CSSetSamplers(0, 1, &_samplerStates[Samplers::LINEAR]);
 
@@ -191,15 +277,55 @@ void Direct3D11::Draw()
 	_deviceContext->CSSetConstantBuffers(1, 1, &(_constantBuffers[ConstantBuffers::CB_COMPUTECONSTANTS]));
 	
 	_computeShader->Set();
-	_timer->Start();
-	const int threadDim = 32;
-	_deviceContext->Dispatch((ccam.width / threadDim) + ((ccam.width % threadDim) ? 1 : 0), (ccam.height / threadDim) + ((ccam.height % threadDim) ? 1 : 0), 1);
-	_timer->Stop();
-	_computeShader->Unset();
-	_timer->GetTime();
+	double gpuTime;
+	{
+		//Every 32x32 thread group traces one tile, GetTime blocks until the gpu has finished all of them
+		PROFILE_ZONE("Render tiles");
+		_timer->Start();
+		const int threadDim = 32;
+		_deviceContext->Dispatch((ccam.width / threadDim) + ((ccam.width % threadDim) ? 1 : 0), (ccam.height / threadDim) + ((ccam.height % threadDim) ? 1 : 0), 1);
+		_timer->Stop();
+		_computeShader->Unset();
+		gpuTime = _timer->GetTime();
+	}
+	_accumulatedFrames++;
+	//The accumulation buffer goes from uav to srv, so it has to be unbound before the tone map pass reads it
+	ID3D11UnorderedAccessView* nullUAV[] = { nullptr, nullptr, nullptr, nullptr };
+	_deviceContext->CSSetUnorderedAccessViews(0, 4, nullUAV, NULL);
+	_lastDenoiseTime = 0.0;
+	if (postProcess)
+		_PostProcess(ccam.width, ccam.height);
+	{
+		PROFILE_ZONE("Tone map");
+		ToneMapConstants constants = {};
+		constants.width = ccam.width;
+		constants.height = ccam.height;
+		constants.op = _toneMapSettings.op;
+		constants.exposure = _toneMapSettings.exposure;
+		constants.srgb = _toneMapSettings.srgb ? 1 : 0;
+		_Map(_constantBuffers[ConstantBuffers::CB_TONEMAP], &constants, sizeof(constants), 1, D3D11_MAP_WRITE_DISCARD, 0);
+
+		ID3D11ShaderResourceView* srv = (postProcess ? _resolvedBuffer : _accumulationBuffer)->GetResourceView();
+		_deviceContext->CSSetShaderResources(0, 1, &srv);
+		_deviceContext->CSSetUnorderedAccessViews(0, 1, &_backBufferUAV, NULL);
+		_deviceContext->CSSetConstantBuffers(0, 1, &_constantBuffers[ConstantBuffers::CB_TONEMAP]);
+		_toneMapShader->Set();
+		const int threadDim = 32;
+		_deviceContext->Dispatch((ccam.width + threadDim - 1) / threadDim, (ccam.height + threadDim - 1) / threadDim, 1);
+		_toneMapShader->Unset();
+
+		ID3D11ShaderResourceView* nullSRV[] = { nullptr };
+		_deviceContext->CSSetShaderResources(0, 1, nullSRV);
+		_deviceContext->CSSetUnorderedAccessViews(0, 1, nullUAV, NULL);
+	}
+	PROFILE_COUNTER("GPU trace time (ms)", gpuTime);
+	_lastFrameTime = gpuTime;
+#if RAY_STATS_ENABLED
+	_ReadBackRayStats();
+#endif
 	static int frames = 0;
 	static float acc = 0.0f;
-	acc += _timer->GetTime();
+	acc += (float)gpuTime;
 	frames++;
 	if (frames > 10)
 	{
@@ -207,17 +333,215 @@ void Direct3D11::Draw()
 		ss << "Avg frametime: " << acc / frames;
 		Core::GetInstance()->GetWindow()->SetTitle(ss.str());
 		printf("%.2f\n", acc / frames);
+#if RAY_STATS_ENABLED
+		printf("rays: %llu primary, %llu bounce, %llu shadow | tests: %llu nodes, %llu triangles, %llu spheres\n",
+			_rayStats.primaryRays, _rayStats.bounceRays, _rayStats.shadowRays,
+			_rayStats.nodeVisits, _rayStats.triangleTests, _rayStats.sphereTests);
+#endif
 		acc = 0.0f;
 		frames = 0;
 	}
 	
 
 	frames++;
+	if (_captureTexture)
+	{
+		//The backbuffer is undefined after Present, so the copy has to be made before
+		ID3D11Texture2D* backbuffer = nullptr;
+		_swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backbuffer);
+		_deviceContext->CopyResource(_captureTexture, backbuffer);
+		SAFE_RELEASE(backbuffer);
+		_frameCaptured = true;
+	}
+	PROFILE_ZONE("Present");
 	if (FAILED(_swapChain->Present(0, 0)))
 		return;
 }
 
 
+#if RAY_STATS_ENABLED
+void Direct3D11::_ReadBackRayStats()
+{
+	PROFILE_ZONE("Read back ray stats");
+	_rayStatsBuffer->CopyToStaging();
+	RayStats* pixels = _rayStatsBuffer->Map<RayStats>();
+	if (!pixels)
+		return;
+	memcpy(&_rayStatsPixels[0], pixels, sizeof(RayStats) * _rayStatsPixels.size());
+	_rayStatsBuffer->Unmap();
+	_rayStats = AccumulateRayStats(&_rayStatsPixels[0], _rayStatsPixels.size());
+}
+#endif
+
+double Direct3D11::GetLastFrameTime() const
+{
+	return _lastFrameTime;
+}
+
+FrameRayStats Direct3D11::GetRayStats() const
+{
+	return _rayStats;
+}
+
+bool Direct3D11::DumpRayStatsHeatmap(const std::string & filename, RayStatCounter counter)
+{
+#if RAY_STATS_ENABLED
+	const IWindow* window = Core::GetInstance()->GetWindow();
+	return WriteRayStatsHeatmap(filename, &_rayStatsPixels[0], window->GetWidth(), window->GetHeight(), counter);
+#else
+	return false;
+#endif
+}
+
+void Direct3D11::SetFrameCapture(bool enabled)
+{
+	_frameCaptured = false;
+	SAFE_RELEASE(_captureTexture);
+	if (!enabled)
+		return;
+
+	ID3D11Texture2D* backbuffer = nullptr;
+	_swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backbuffer);
+	D3D11_TEXTURE2D_DESC desc;
+	backbuffer->GetDesc(&desc);
+	SAFE_RELEASE(backbuffer);
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+	if (FAILED(_device->CreateTexture2D(&desc, nullptr, &_captureTexture)))
+		throw std::exception("Failed to create frame capture texture");
+}
+
+bool Direct3D11::ReadBackFrame(std::vector<uint8_t>& rgba, unsigned & width, unsigned & height)
+{
+	PROFILE_ZONE("Read back frame");
+	if (!_captureTexture || !_frameCaptured)
+		return false;
+	D3D11_TEXTURE2D_DESC desc;
+	_captureTexture->GetDesc(&desc);
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(_deviceContext->Map(_captureTexture, 0, D3D11_MAP_READ, 0, &mapped)))
+		return false;
+	width = desc.Width;
+	height = desc.Height;
+	rgba.resize((size_t)width * height * 4);
+	for (unsigned y = 0; y < height; y++)
+		memcpy(&rgba[(size_t)y * width * 4], (const uint8_t*)mapped.pData + (size_t)y * mapped.RowPitch, (size_t)width * 4);
+	_deviceContext->Unmap(_captureTexture, 0);
+	return true;
+}
+
+void Direct3D11::SetAccumulation(bool enabled)
+{
+	_accumulate = enabled;
+	_accumulatedFrames = 0;
+}
+
+void Direct3D11::ResetAccumulation()
+{
+	_accumulatedFrames = 0;
+	_historyValid = false;
+	_temporalFrames = 0;
+}
+
+void Direct3D11::SetToneMapping(const ToneMapSettings & settings)
+{
+	_toneMapSettings = settings;
+}
+
+bool Direct3D11::ReadBackAccumulation(std::vector<float>& rgbw, unsigned & width, unsigned & height)
+{
+	PROFILE_ZONE("Read back accumulation");
+	const IWindow* window = Core::GetInstance()->GetWindow();
+	if (_accumulatedFrames == 0)
+		return false;
+	width = window->GetWidth();
+	height = window->GetHeight();
+	if (_temporalSettings.enabled && _historyValid)
+	{
+		rgbw = _history;
+		return true;
+	}
+	return _ReadBackPixels(_accumulationBuffer, rgbw);
+}
+
+bool Direct3D11::_ReadBackPixels(ComputeBuffer * buffer, std::vector<float>& pixels)
+{
+	const IWindow* window = Core::GetInstance()->GetWindow();
+	buffer->CopyToStaging();
+	float* mapped = buffer->Map<float>();
+	if (!mapped)
+		return false;
+	pixels.assign(mapped, mapped + (size_t)window->GetWidth() * window->GetHeight() * 4);
+	buffer->Unmap();
+	return true;
+}
+
+void Direct3D11::_PostProcess(unsigned width, unsigned height)
+{
+	PROFILE_ZONE("Post process");
+	//Both passes run on the cpu, so this waits for the trace and stalls the gpu until the result is back.
+	//The denoise time covers the copies as well, and the reprojection when both are on.
+	auto start = std::chrono::steady_clock::now();
+	bool denoise = _denoiseSettings.enabled;
+	if (!_ReadBackPixels(_accumulationBuffer, _accumulationPixels) || !_ReadBackPixels(_normalDepthBuffer, _normalDepthPixels) ||
+		(denoise && !_ReadBackPixels(_albedoBuffer, _albedoPixels)))
+		return;
+	const std::vector<float>* radiance = &_accumulationPixels;
+	if (_temporalSettings.enabled)
+	{
+		PerFrameBuffer view;
+		Core::GetInstance()->GetCameraManager()->FillPerFrameBuffer(view);
+		_resolvedPixels.resize(_accumulationPixels.size());
+		if (_historyValid && _history.size() == _accumulationPixels.size())
+			TemporalReproject(_history.data(), _historyNormalDepth.data(), _historyView, _accumulationPixels.data(), _normalDepthPixels.data(), view, width, height, _temporalSettings, _resolvedPixels.data());
+		else
+			_resolvedPixels = _accumulationPixels;
+		_history.swap(_resolvedPixels);
+		_historyNormalDepth = _normalDepthPixels;
+		_historyView = view;
+		_historyValid = true;
+		_temporalFrames++;
+		radiance = &_history;
+	}
+	if (denoise)
+	{
+		_resolvedPixels.resize(radiance->size());
+		Denoise(radiance->data(), _normalDepthPixels.data(), _albedoPixels.data(), width, height, _denoiseSettings, _resolvedPixels.data());
+		radiance = &_resolvedPixels;
+	}
+	_deviceContext->UpdateSubresource(_resolvedBuffer->GetResource(), 0, nullptr, radiance->data(), 0, 0);
+	if (denoise)
+	{
+		_lastDenoiseTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		PROFILE_COUNTER("CPU denoise time (ms)", _lastDenoiseTime);
+	}
+}
+
+void Direct3D11::SetSamplesPerPixel(unsigned samples)
+{
+	_computeConstants.gSampleMask = GetSampleMask(samples);
+	_computeConstantsUpdated = true;
+}
+
+void Direct3D11::SetDenoise(const DenoiseSettings & settings)
+{
+	_denoiseSettings = settings;
+}
+
+void Direct3D11::SetTemporal(const TemporalSettings & settings)
+{
+	_temporalSettings = settings;
+	_historyValid = false;
+	_temporalFrames = 0;
+}
+
+double Direct3D11::GetLastDenoiseTime() const
+{
+	return _lastDenoiseTime;
+}
+
 void Direct3D11::IncreaseBounceCount()
 {
 	_computeConstants.gBounceCounts = min(10, _computeConstants.gBounceCounts + 1);
@@ -238,148 +562,208 @@ void Direct3D11::SetBounceCount(unsigned bounces)
 
 void Direct3D11::SetPointLights(PointLight * pointlights, size_t count)
 {
-	ID3D11Resource* resource = nullptr;
-	_structuredBuffers[SB_POINTLIGHTS]->srv->GetResource(&resource);
-	_Map(resource, pointlights, _structuredBuffers[SB_POINTLIGHTS]->stride, min(_structuredBuffers[SB_POINTLIGHTS]->count, (uint32_t)count), D3D11_MAP_WRITE_DISCARD, 0);
-	SAFE_RELEASE(resource);
-	_computeConstants.gPointLightCount = min(_structuredBuffers[SB_POINTLIGHTS]->count, (uint32_t)count);
+	_pointLights.assign(pointlights, pointlights + count);
+	_ReserveStructuredBuffer(SB_POINTLIGHTS, count);
+	_dirtyRanges[SB_POINTLIGHTS].Add(0, count);
+	_computeConstants.gPointLightCount = (uint32_t)count;
 	_computeConstantsUpdated = true;
 }
 
 void Direct3D11::SetSpotLights(SpotLight * spotlights, size_t count)
 {
-	ID3D11Resource* resource = nullptr;
-	_structuredBuffers[SB_SPOTLIGHTS]->srv->GetResource(&resource);
-	_Map(resource, spotlights, _structuredBuffers[SB_SPOTLIGHTS]->stride, min(_structuredBuffers[SB_SPOTLIGHTS]->count, (uint32_t)count), D3D11_MAP_WRITE_DISCARD, 0);
-	SAFE_RELEASE(resource);
-	_computeConstants.gSpotLightCount = min(_structuredBuffers[SB_SPOTLIGHTS]->count, (uint32_t)count);
+	_spotLights.assign(spotlights, spotlights + count);
+	_ReserveStructuredBuffer(SB_SPOTLIGHTS, count);
+	_dirtyRanges[SB_SPOTLIGHTS].Add(0, count);
+	_computeConstants.gSpotLightCount = (int32_t)count;
 	_computeConstantsUpdated = true;
 }
 
+void Direct3D11::SetTriangleTest(TriangleTest test)
+{
+	_triangleTest = test;
+	for (size_t i = 0; i < _triangles.size(); i++)
+		_precomputedTriangles[i] = PrecomputeTriangle(_triangles[i], _triangleTest);
+	_dirtyRanges[SB_PRECOMPUTEDTRIANGLES].Add(0, _precomputedTriangles.size());
+	_computeConstants.gTriangleTest = test;
+	_computeConstantsUpdated = true;
+}
+
+void Direct3D11::SetBVHLayout(BVHLayout layout)
+{
+	//The shader only walks the binary BVHNode tables
+}
+
 void Direct3D11::SetTriangles(Triangle * triangles, size_t count)
 {
-	ID3D11Resource* resource = nullptr;
-	_structuredBuffers[SB_TRIANGLES]->srv->GetResource(&resource);
-	_Map(resource, triangles, _structuredBuffers[SB_TRIANGLES]->stride, min(_structuredBuffers[SB_TRIANGLES]->count, (uint32_t)count), D3D11_MAP_WRITE_DISCARD, 0);
-	SAFE_RELEASE(resource);
-	_computeConstants.gTriangleCount = min(_structuredBuffers[SB_TRIANGLES]->count, (uint32_t)count);
+	_triangles.assign(triangles, triangles + count);
+	_ReserveStructuredBuffer(SB_TRIANGLES, count);
+	_dirtyRanges[SB_TRIANGLES].Add(0, count);
+	_precomputedTriangles.resize(count);
+	for (size_t i = 0; i < count; i++)
+		_precomputedTriangles[i] = PrecomputeTriangle(_triangles[i], _triangleTest);
+	_ReserveStructuredBuffer(SB_PRECOMPUTEDTRIANGLES, count);
+	_dirtyRanges[SB_PRECOMPUTEDTRIANGLES].Add(0, count);
+	_computeConstants.gTriangleCount = (uint32_t)count;
 	_computeConstantsUpdated = true;
+	//A new set of triangles starts out untextured, PrepareTextures assigns the materials again
+	_triangleMaterials.clear();
 }
 
 void Direct3D11::SetSpheres(Sphere * spheres, size_t count)
 {
-	ID3D11Resource* resource = nullptr;
-	_structuredBuffers[SB_SPHERES]->srv->GetResource(&resource);
-	_Map(resource, spheres, _structuredBuffers[SB_SPHERES]->stride, min(_structuredBuffers[SB_SPHERES]->count, (uint32_t)count), D3D11_MAP_WRITE_DISCARD, 0);
-	SAFE_RELEASE(resource);
-	_computeConstants.gSphereCount = (int)min(_structuredBuffers[SB_SPHERES]->count, count);
+	_spheres.assign(spheres, spheres + count);
+	_ReserveStructuredBuffer(SB_SPHERES, count);
+	_dirtyRanges[SB_SPHERES].Add(0, count);
+	_computeConstants.gSphereCount = (uint32_t)count;
 	_computeConstantsUpdated = true;
 }
 
-void Direct3D11::SetMeshPartitions(OctNode * nodes, MeshIndices * indices, size_t nodeCount, size_t indexCount)
+void Direct3D11::SetPlanes(Plane * planes, size_t count)
 {
-	ID3D11Resource* resource = nullptr;
-	_structuredBuffers[SB_MESHPARTITIONS]->srv->GetResource(&resource);
-	_Map(resource, nodes, _structuredBuffers[SB_MESHPARTITIONS]->stride, min(_structuredBuffers[SB_MESHPARTITIONS]->count, (uint32_t)nodeCount), D3D11_MAP_WRITE_DISCARD, 0);
-	SAFE_RELEASE(resource);
-	_computeConstants.gPartitionCount = nodeCount;
+	_planes.assign(planes, planes + count);
+	_ReserveStructuredBuffer(SB_PLANES, count);
+	_dirtyRanges[SB_PLANES].Add(0, count);
+	_computeConstants.gPlaneCount = (int32_t)count;
+	_computeConstantsUpdated = true;
+}
+
+void Direct3D11::SetMeshPartitions(BVHNode * nodes, size_t nodeCount, uint32_t * triangleIndices, size_t triangleIndexCount, MeshIndices * meshes, size_t meshCount)
+{
+	_bvhNodes.assign(nodes, nodes + nodeCount);
+	_ReserveStructuredBuffer(SB_MESHPARTITIONS, nodeCount);
+	_dirtyRanges[SB_MESHPARTITIONS].Add(0, nodeCount);
+	_computeConstants.gPartitionCount = (int32_t)nodeCount;
+
+	_triangleIndices.assign(triangleIndices, triangleIndices + triangleIndexCount);
+	_ReserveStructuredBuffer(SB_TRIANGLEINDICES, triangleIndexCount);
+	_dirtyRanges[SB_TRIANGLEINDICES].Add(0, triangleIndexCount);
 
-	resource = nullptr;
-	_structuredBuffers[SB_MESHINDICES]->srv->GetResource(&resource);
-	_Map(resource, indices, _structuredBuffers[SB_MESHINDICES]->stride, min(_structuredBuffers[SB_MESHINDICES]->count, (uint32_t)indexCount), D3D11_MAP_WRITE_DISCARD, 0);
-	SAFE_RELEASE(resource);
-	_computeConstants.gMeshIndexCount = indexCount;
+	_meshIndices.assign(meshes, meshes + meshCount);
+	_ReserveStructuredBuffer(SB_MESHINDICES, meshCount);
+	_dirtyRanges[SB_MESHINDICES].Add(0, meshCount);
+	_computeConstants.gMeshIndexCount = (int32_t)meshCount;
 
 	_computeConstantsUpdated = true;
 
 }
 
-void Direct3D11::PrepareTextures(unsigned indexStart, unsigned indexEnd, const std::string & filenameDiffuse, const std::string& filenameNormal)
+void Direct3D11::UpdateTriangles(size_t first, size_t count, const Triangle * triangles)
 {
-	bool diffuse = true;
-	bool normal = true;
-	auto got = _textureIndices.find(filenameDiffuse);
-	if (got == _textureIndices.end())
-	{
-		std::string fileend = filenameDiffuse.substr(filenameDiffuse.size() - 3);
-		if (fileend == "png" || fileend == "jpg")
-		{
-			_CreateWICTexture(filenameDiffuse);
-			size_t texindex = _textureIndices.size();
-			_textureIndices[filenameDiffuse] = (unsigned)texindex;
-		}
-		else
-			diffuse = false;
-	}
+	if (first >= _triangles.size())
+		return;
+	count = (std::min)(count, _triangles.size() - first);
+	std::copy(triangles, triangles + count, _triangles.begin() + first);
+	_dirtyRanges[SB_TRIANGLES].Add(first, count);
+	for (size_t i = first; i < first + count; i++)
+		_precomputedTriangles[i] = PrecomputeTriangle(_triangles[i], _triangleTest);
+	_dirtyRanges[SB_PRECOMPUTEDTRIANGLES].Add(first, count);
+}
 
-	auto got2 = _textureIndices.find(filenameNormal);
-	if (got2 == _textureIndices.end())
-	{
-		if (filenameNormal.size() > 3)
-		{
-			std::string fileend = filenameNormal.substr(filenameNormal.size() - 3);
-			if (fileend == "png" || fileend == "jpg")
-			{
-				_CreateWICTexture(filenameNormal);
-				size_t texindex = _textureIndices.size();
-				_textureIndices[filenameNormal] = (unsigned)texindex;
-			}
-		}
-		else
-			normal = false;
-	}
-	//IF we cant create the textures, we set the index to -1 in the buffer supplied to the gpu
+void Direct3D11::UpdateMeshPartitions(size_t first, size_t count, const BVHNode * nodes)
+{
+	if (first >= _bvhNodes.size())
+		return;
+	count = (std::min)(count, _bvhNodes.size() - first);
+	std::copy(nodes, nodes + count, _bvhNodes.begin() + first);
+	_dirtyRanges[SB_MESHPARTITIONS].Add(first, count);
+}
 
-	//Check for exisiting entry
-	bool found = false;
-	for (auto& i : _triangleTextureOffsets)
-	{
-		if (i.begin == indexStart && i.end == indexEnd)
-		{
-			if (diffuse)
-				i.diffuseIndex = _textureIndices[filenameDiffuse];
-			else
-				i.diffuseIndex = -1;
-			if (normal)
-				i.normalIndex = _textureIndices[filenameNormal];
-			else
-				i.normalIndex = -1;
-			found = true;
-			break;
-		}
-		//Check for invalid ranges, we cant have overlap
-		else if ((indexStart < i.begin && indexEnd > i.begin) || (indexStart > i.begin && indexStart < i.end) || (indexStart == i.begin && indexEnd != i.end))
-		{
-			throw std::exception("Invalid range of triangles for texture. Conflicts with previous range.");
-		}
-	}
-	if (!found)
-	{
-		TextureOffset to;
-		to.begin = indexStart;
-		to.end = indexEnd;
-		if (diffuse)
-			to.diffuseIndex = _textureIndices[filenameDiffuse];
-		else
-			to.diffuseIndex = -1;
-		if (normal)
-			to.normalIndex = _textureIndices[filenameNormal];
-		else
-			to.normalIndex = -1;
+void Direct3D11::UpdateSphere(size_t index, const Sphere & sphere)
+{
+	if (index >= _spheres.size())
+		return;
+	_spheres[index] = sphere;
+	_dirtyRanges[SB_SPHERES].Add(index, 1);
+}
 
-		_triangleTextureOffsets.push_back(to);
-	}
+void Direct3D11::UpdatePointLight(size_t index, const PointLight & light)
+{
+	if (index >= _pointLights.size())
+		return;
+	_pointLights[index] = light;
+	_dirtyRanges[SB_POINTLIGHTS].Add(index, 1);
+}
+
+void Direct3D11::UpdateSpotLight(size_t index, const SpotLight & light)
+{
+	if (index >= _spotLights.size())
+		return;
+	_spotLights[index] = light;
+	_dirtyRanges[SB_SPOTLIGHTS].Add(index, 1);
+}
+
+void Direct3D11::_UploadRange(StructuredBuffers type, const void * data, DirtyRange & range)
+{
+	if (range.Empty())
+		return;
+	unsigned stride = _structuredBuffers[type]->stride;
+	D3D11_BOX box = { (UINT)(range.begin * stride), 0, 0, (UINT)(range.end * stride), 1, 1 };
+	_deviceContext->UpdateSubresource(_structuredBuffers[type]->buffer, 0, &box, (const uint8_t*)data + range.begin * stride, 0, 0);
+	PROFILE_COUNTER("Scene bytes uploaded", (double)(range.end - range.begin) * stride);
+	range.Clear();
+}
+
+void Direct3D11::_UploadDirtyRanges()
+{
+	PROFILE_ZONE("Upload dirty ranges");
+	_UploadRange(SB_SPHERES, _spheres.data(), _dirtyRanges[SB_SPHERES]);
+	_UploadRange(SB_PLANES, _planes.data(), _dirtyRanges[SB_PLANES]);
+	_UploadRange(SB_TRIANGLES, _triangles.data(), _dirtyRanges[SB_TRIANGLES]);
+	_UploadRange(SB_PRECOMPUTEDTRIANGLES, _precomputedTriangles.data(), _dirtyRanges[SB_PRECOMPUTEDTRIANGLES]);
+	_UploadRange(SB_POINTLIGHTS, _pointLights.data(), _dirtyRanges[SB_POINTLIGHTS]);
+	_UploadRange(SB_SPOTLIGHTS, _spotLights.data(), _dirtyRanges[SB_SPOTLIGHTS]);
+	_UploadRange(SB_MESHPARTITIONS, _bvhNodes.data(), _dirtyRanges[SB_MESHPARTITIONS]);
+	_UploadRange(SB_TRIANGLEINDICES, _triangleIndices.data(), _dirtyRanges[SB_TRIANGLEINDICES]);
+	_UploadRange(SB_MESHINDICES, _meshIndices.data(), _dirtyRanges[SB_MESHINDICES]);
+}
+
+void Direct3D11::PrepareTextures(unsigned indexStart, unsigned indexEnd, const std::string & filenameDiffuse, const std::string& filenameNormal)
+{
+	//IF we cant create the textures, the index is set to -1 in the material supplied to the gpu
+	int diffuse = _LoadTexture(filenameDiffuse);
+	int normal = _LoadTexture(filenameNormal);
+	uint32_t material = _FindOrAddMaterial(diffuse, normal);
+
+	//The range is inclusive. Triangles not covered by any range keep the default material
+	//and a later call simply overwrites the material of the triangles it covers.
+	if (_triangleMaterials.size() < (size_t)indexEnd + 1)
+		_triangleMaterials.resize((size_t)indexEnd + 1, 0);
+	std::fill(_triangleMaterials.begin() + indexStart, _triangleMaterials.begin() + indexEnd + 1, material);
+
+	_computeConstants.gMaterialCount = (uint32_t)_materials.size();
+	_computeConstantsUpdated = true;
+}
+
+void Direct3D11::PreparePlaneTextures(unsigned indexStart, unsigned indexEnd, const std::string & filenameDiffuse, const std::string & filenameNormal)
+{
+	if (indexStart >= _planes.size())
+		return;
+	indexEnd = (std::min)(indexEnd, (unsigned)_planes.size() - 1);
+	int material = (int)_FindOrAddMaterial(_LoadTexture(filenameDiffuse), _LoadTexture(filenameNormal));
+	for (unsigned i = indexStart; i <= indexEnd; i++)
+		_planes[i].material = material;
+	_dirtyRanges[SB_PLANES].Add(indexStart, indexEnd - indexStart + 1);
 
-	_computeConstants.gTextureCount = (int)_triangleTextureOffsets.size();
+	_computeConstants.gMaterialCount = (uint32_t)_materials.size();
 	_computeConstantsUpdated = true;
 }
 
 void Direct3D11::SetTextures()
 {
-	ID3D11Resource* resource = nullptr;
-	_structuredBuffers[SB_TEXTUREOFFSETS]->srv->GetResource(&resource);
-	_Map(resource, &_triangleTextureOffsets[0], _structuredBuffers[SB_TEXTUREOFFSETS]->stride, min(_structuredBuffers[SB_TEXTUREOFFSETS]->count, (uint32_t)_triangleTextureOffsets.size()), D3D11_MAP_WRITE_DISCARD, 0);
-	SAFE_RELEASE(resource);
+	PROFILE_ZONE("Upload textures");
+	//The material tables only change at scene build time, so they are recreated as immutable buffers of the exact size
+	if (_triangleMaterials.size() < _computeConstants.gTriangleCount)
+		_triangleMaterials.resize(_computeConstants.gTriangleCount, 0);
+	if (_triangleMaterials.empty())
+		_triangleMaterials.push_back(0);
+	delete _structuredBuffers[SB_MATERIALS];
+	_CreateStructuredBuffer(&_structuredBuffers[SB_MATERIALS], sizeof(MeshMaterial), (unsigned)_materials.size(), false, false, &_materials[0]);
+	delete _structuredBuffers[SB_TRIANGLEMATERIALS];
+	_CreateStructuredBuffer(&_structuredBuffers[SB_TRIANGLEMATERIALS], sizeof(uint32_t), (unsigned)_triangleMaterials.size(), false, false, &_triangleMaterials[0]);
+
+	if (_textureIndices.empty())
+		return;
+	SAFE_RELEASE(_textureArray);
 
 	HRESULT hr;
 	D3D11_TEXTURE2D_DESC desc;
@@ -422,11 +806,8 @@ void Direct3D11::SetTextures()
 			SRVDesc.Texture2DArray.FirstArraySlice = 0;
 
 			hr = _device->CreateShaderResourceView(tex, &SRVDesc, &_textureArray);
-			if (FAILED(hr))
-			{
-				tex->Release();
-			}
 		}
+		tex->Release();
 
 	}
 	delete[] initData;
@@ -489,7 +870,40 @@ void Direct3D11::_CreateConstantBuffers()
 	bd.ByteWidth = sizeof(ComputeCamera);
 	_device->CreateBuffer(&bd, nullptr, &_constantBuffers[CB_COMPUTECAMERA]);
 
+	bd.ByteWidth = sizeof(ToneMapConstants);
+	_device->CreateBuffer(&bd, nullptr, &_constantBuffers[CB_TONEMAP]);
+
+
+}
 
+void Direct3D11::_ReserveStructuredBuffer(StructuredBuffers type, size_t count)
+{
+	StructuredBuffer*& buffer = _structuredBuffers[type];
+	if (count <= buffer->count)
+		return;
+
+	//Doubling keeps the number of reallocations logarithmic while a scene grows over many uploads.
+	//If the doubled size is more than the device allows we settle for exactly what was asked for.
+	unsigned stride = buffer->stride;
+	size_t capacity = (std::max)(count, (size_t)buffer->count * 2);
+	if ((uint64_t)capacity * stride > UINT_MAX)
+		capacity = count;
+	if ((uint64_t)capacity * stride > UINT_MAX)
+		throw std::exception("Structured buffer too large");
+	//The old buffer stays in its slot until the new one exists, so a throw leaves the previous size usable
+	StructuredBuffer* grown = nullptr;
+	try
+	{
+		_CreateStructuredBuffer(&grown, stride, (unsigned)capacity);
+	}
+	catch (const std::exception&)
+	{
+		if (capacity == count)
+			throw;
+		_CreateStructuredBuffer(&grown, stride, (unsigned)count);
+	}
+	delete buffer;
+	buffer = grown;
 }
 
 void Direct3D11::_CreateStructuredBuffer(StructuredBuffer ** buffer, unsigned int stride, unsigned int count, bool CPUWrite, bool GPUWrite, void * initdata)
@@ -501,9 +915,10 @@ void Direct3D11::_CreateStructuredBuffer(StructuredBuffer ** buffer, unsigned in
 
 	if (CPUWrite && !GPUWrite)
 	{
-		bd.Usage = D3D11_USAGE_DYNAMIC;
+		//Written with UpdateSubresource, which unlike a discarding Map can replace just a range
+		bd.Usage = D3D11_USAGE_DEFAULT;
 		bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bd.CPUAccessFlags = 0;
 	}
 	else if (GPUWrite && !CPUWrite)
 	{
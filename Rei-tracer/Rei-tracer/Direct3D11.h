@@ -4,12 +4,6 @@
 #define GBUFFER_COUNT 4
 #define SAFE_RELEASE(x) {if(x){ x->Release(); x = nullptr;}};
 #define MAX_INSTANCES 32 //If you change this, also change it in InstancedStaticMeshVS.hlsl
-#define MAX_TRIANGLES 8192
-#define MAX_MESHTEXTURES 8
-#define MAX_POINTLIGHTS 10
-#define MAX_SPOTLIGHTS 10
-#define MAX_OCTNODES_PER_MESH 1+8+64+512
-#define MAX_MESHES 10
 
 #define TEXTURE_DIMENSION 256U
 #define TEXTURE_BYTESIZE 256U * 256U * 4U
@@ -35,6 +29,7 @@ enum ConstantBuffers
 	CB_LIGHTBUFFER,
 	CB_COMPUTECONSTANTS,
 	CB_COMPUTECAMERA,
+	CB_TONEMAP,
 	CB_COUNT
 };
 
@@ -59,7 +54,7 @@ struct StructuredBuffer
 	ID3D11UnorderedAccessView* uav = nullptr;
 
 	unsigned int stride = 0;
-	unsigned int count = 0;
+	unsigned int count = 0; //Capacity in elements, the shader is told how many are in use
 	~StructuredBuffer()
 	{
 		SAFE_RELEASE(buffer);
@@ -74,26 +69,46 @@ struct ComputeConstants
 	uint32_t gTriangleCount = 0;
 	uint32_t gPointLightCount = 0;
 	int32_t gBounceCounts = 0;
-	uint32_t gTextureCount = 0;
+	uint32_t gMaterialCount = 0;
 	int32_t gSpotLightCount = 0;
 	int32_t gMeshIndexCount = 0;
 	int32_t gPartitionCount = 0;
+	int32_t gPlaneCount = 0;
+	int32_t gTriangleTest = TRIANGLE_TEST_MOLLER_TRUMBORE;
+	int32_t gAccumulate = 0;
+	uint32_t gSampleMask = 0x1ff;
+	int32_t gWriteGuides = 0;
+	int32_t pad1 = 0;
+	int32_t pad2 = 0;
+	int32_t pad3 = 0;
 };
 
 struct ComputeCamera
 {
-	DirectX::XMFLOAT3 position;
+	VectorMath::Float3 position;
 	float fardist;
-	DirectX::XMFLOAT3 direction;
+	VectorMath::Float3 direction;
 	float neardist;
-	DirectX::XMFLOAT3 up;
+	VectorMath::Float3 up;
 	float aspectratio;
-	DirectX::XMFLOAT3 right;
+	VectorMath::Float3 right;
 	float fov;
 	int width;//Technically not based on camera
 	int height;
-	float pad0;
-	float pad1;
+	float jitterX;//GetAccumulationJitter of the frame
+	float jitterY;
+};
+
+struct ToneMapConstants
+{
+	uint32_t width;
+	uint32_t height;
+	int32_t op;
+	float exposure;
+	int32_t srgb;
+	int32_t pad0;
+	int32_t pad1;
+	int32_t pad2;
 };
 
 enum StructuredBuffers
@@ -101,23 +116,37 @@ enum StructuredBuffers
 	SB_SPHERES,
 	SB_TRIANGLES,
 	SB_POINTLIGHTS,
-	SB_TEXTUREOFFSETS,
+	SB_MATERIALS,
 	SB_SPOTLIGHTS,
 	SB_MESHPARTITIONS,
 	SB_MESHINDICES,
+	SB_TRIANGLEMATERIALS,
+	SB_TRIANGLEINDICES,
+	SB_PLANES,
+	SB_PRECOMPUTEDTRIANGLES,
 	SB_COUNT
 };
 
-struct TextureOffset
+//Elements [begin, end) of a structured buffer that changed since the last upload
+struct DirtyRange
 {
-	unsigned begin;
-	unsigned end;
-	int diffuseIndex;
-	int normalIndex;
+	size_t begin = 0;
+	size_t end = 0;
+
+	bool Empty() const { return begin >= end; }
+	void Add(size_t first, size_t count)
+	{
+		if (count == 0)
+			return;
+		begin = Empty() ? first : (first < begin ? first : begin);
+		end = first + count > end ? first + count : end;
+	}
+	void Clear() { begin = end = 0; }
 };
 
 
 
+
 class Direct3D11 : public IGraphics
 {
 private:
@@ -128,6 +157,11 @@ private:
 
 	ComputeWrap*						_computeWrap = nullptr;
 	ComputeShader*						_computeShader = nullptr;
+	ComputeShader*						_toneMapShader = nullptr;
+	ComputeBuffer*						_accumulationBuffer = nullptr; //float4 per pixel, radiance sums with the frame count in w
+	ComputeBuffer*						_normalDepthBuffer = nullptr; //Denoise guides, only written while denoising or reprojecting
+	ComputeBuffer*						_albedoBuffer = nullptr;
+	ComputeBuffer*						_resolvedBuffer = nullptr; //What the tone map pass reads instead while denoising or reprojecting
 
 	D3D11Timer*							_timer = nullptr;
 	
@@ -142,18 +176,35 @@ private:
 	void _CreateConstantBuffers();
 
 	void _CreateStructuredBuffer(StructuredBuffer** buffer, unsigned int stride, unsigned int count, bool CPUWrite = true, bool GPUWrite = false, void* initdata = nullptr);
-
-	void _CreateWICTexture(const std::string& filename);
+	//Grows a cpu written structured buffer so it holds at least count elements. The old contents are not kept.
+	void _ReserveStructuredBuffer(StructuredBuffers type, size_t count);
+	//Copies the dirty range of every scene buffer from its cpu copy, called at the start of Draw
+	void _UploadDirtyRanges();
+	void _UploadRange(StructuredBuffers type, const void* data, DirtyRange& range);
+
+	int _LoadTexture(const std::string& filename);
+	unsigned _FindOrAddMaterial(int diffuseIndex, int normalIndex);
 	
 	void _Map(ID3D11Resource* resource, void* data, uint32_t stride, uint32_t count, D3D11_MAP mapType, UINT flags);
 		
+	//Cpu copies of the scene buffers, the Update functions change these and mark the range dirty
 	std::vector<Sphere> _spheres;
 	std::vector<Plane> _planes;
 	std::vector<Triangle> _triangles;
-	std::vector<TextureOffset> _triangleTextureOffsets;
+	std::vector<PrecomputedTriangle> _precomputedTriangles; //What _triangleTest reads of _triangles
+	std::vector<PointLight> _pointLights;
+	std::vector<SpotLight> _spotLights;
+	std::vector<BVHNode> _bvhNodes;
+	std::vector<uint32_t> _triangleIndices;
+	std::vector<MeshIndices> _meshIndices;
+	DirtyRange _dirtyRanges[StructuredBuffers::SB_COUNT];
+
+	std::vector<MeshMaterial> _materials;
+	std::vector<uint32_t> _triangleMaterials;
 
 
 	unsigned _bounceCount = 0;
+	TriangleTest _triangleTest = TRIANGLE_TEST_MOLLER_TRUMBORE;
 
 	std::unordered_map<std::string, unsigned> _textureIndices;
 	ID3D11ShaderResourceView* _textureArray = nullptr;
@@ -161,7 +212,37 @@ private:
 	bool _computeConstantsUpdated = false;
 	ComputeConstants _computeConstants;
 
-	uint8_t* _rawTextureData;
+	std::vector<uint8_t> _rawTextureData;
+
+	double _lastFrameTime = 0.0;
+	ID3D11Texture2D* _captureTexture = nullptr; //Staging copy of the backbuffer, only while capturing
+	bool _frameCaptured = false;
+	FrameRayStats _rayStats;
+	bool _accumulate = false;
+	unsigned _accumulatedFrames = 0;
+	ToneMapSettings _toneMapSettings;
+	DenoiseSettings _denoiseSettings;
+	double _lastDenoiseTime = 0.0;
+	TemporalSettings _temporalSettings;
+	std::vector<float> _accumulationPixels; //Cpu copies of the buffers the denoiser and the reprojection work on
+	std::vector<float> _normalDepthPixels;
+	std::vector<float> _albedoPixels;
+	std::vector<float> _resolvedPixels;
+	std::vector<float> _history;            //What the last frame resolved to, kept on the cpu between frames
+	std::vector<float> _historyNormalDepth;
+	PerFrameBuffer _historyView;
+	bool _historyValid = false;
+	unsigned _temporalFrames = 0;
+	//Copies a float4 per pixel buffer through its staging buffer
+	bool _ReadBackPixels(ComputeBuffer* buffer, std::vector<float>& pixels);
+	//Reads back the accumulation and the guides, reprojects the history onto them and denoises the result, as far as
+	//those are enabled, and uploads it to _resolvedBuffer
+	void _PostProcess(unsigned width, unsigned height);
+#if RAY_STATS_ENABLED
+	ComputeBuffer* _rayStatsBuffer = nullptr;
+	std::vector<RayStats> _rayStatsPixels;
+	void _ReadBackRayStats();
+#endif
 
 public:
 	Direct3D11();
@@ -174,6 +255,14 @@ public:
 
 	//Inherited from graphics interface
 	virtual void Draw();
+	virtual void SetAccumulation(bool enabled);
+	virtual void ResetAccumulation();
+	virtual void SetToneMapping(const ToneMapSettings& settings);
+	virtual bool ReadBackAccumulation(std::vector<float>& rgbw, unsigned& width, unsigned& height);
+	virtual void SetSamplesPerPixel(unsigned samples);
+	virtual void SetDenoise(const DenoiseSettings& settings);
+	virtual void SetTemporal(const TemporalSettings& settings);
+	virtual double GetLastDenoiseTime() const;
 
 	//virtual void AddTriangleList(Triangle* triangles, size_t count);
 	virtual void IncreaseBounceCount();
@@ -181,11 +270,25 @@ public:
 	virtual void SetBounceCount(unsigned bounces);
 	virtual void SetPointLights(PointLight* pointlights, size_t count);
 	virtual void SetSpotLights(SpotLight* spotlights, size_t count);
+	virtual void SetTriangleTest(TriangleTest test);
+	virtual void SetBVHLayout(BVHLayout layout);
 	virtual void SetTriangles(Triangle* triangles, size_t count);
 	virtual void SetSpheres(Sphere* spheres, size_t count);
-	virtual void SetMeshPartitions(OctNode* nodes, MeshIndices* indices, size_t nodeCount, size_t indexCount);
+	virtual void SetPlanes(Plane* planes, size_t count);
+	virtual void SetMeshPartitions(BVHNode* nodes, size_t nodeCount, uint32_t* triangleIndices, size_t triangleIndexCount, MeshIndices* meshes, size_t meshCount);
+	virtual void UpdateTriangles(size_t first, size_t count, const Triangle* triangles);
+	virtual void UpdateMeshPartitions(size_t first, size_t count, const BVHNode* nodes);
+	virtual void UpdateSphere(size_t index, const Sphere& sphere);
+	virtual void UpdatePointLight(size_t index, const PointLight& light);
+	virtual void UpdateSpotLight(size_t index, const SpotLight& light);
 	virtual void PrepareTextures(unsigned indexStart, unsigned indexEnd, const std::string& filenameDiffuse, const std::string& filenameNormal );
+	virtual void PreparePlaneTextures(unsigned indexStart, unsigned indexEnd, const std::string& filenameDiffuse, const std::string& filenameNormal);
 	virtual void SetTextures();
+	virtual double GetLastFrameTime() const;
+	virtual FrameRayStats GetRayStats() const;
+	virtual bool DumpRayStatsHeatmap(const std::string& filename, RayStatCounter counter = RAYSTAT_COST);
+	virtual void SetFrameCapture(bool enabled);
+	virtual bool ReadBackFrame(std::vector<uint8_t>& rgba, unsigned& width, unsigned& height);
 
 	
 };
@@ -0,0 +1,445 @@
+#include "FrameSink.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#include <stdio.h>
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(FrameRingHeader) <= FRAME_RING_HEADER_SIZE, "The ring header overlaps the first slot");
+
+static bool WriteAll(int fd, const uint8_t* data, size_t size)
+{
+	while (size)
+	{
+#ifdef _WIN32
+		int written = _write(fd, data, (unsigned)(std::min)(size, (size_t)1 << 30));
+#else
+		ssize_t written = write(fd, data, size);
+#endif
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false; //Also a closed pipe, SIGPIPE is ignored while a sink is open
+		data += written;
+		size -= (size_t)written;
+	}
+	return true;
+}
+
+static void CloseFd(int fd)
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+//rgba to the planes of a 4:4:4 bt.601 video range frame, the integer approximation every encoder uses
+static void PackY4M(const uint8_t* rgba, size_t pixels, uint8_t* out)
+{
+	uint8_t* y = out;
+	uint8_t* cb = out + pixels;
+	uint8_t* cr = out + pixels * 2;
+	for (size_t i = 0; i < pixels; i++)
+	{
+		int r = rgba[i * 4 + 0], g = rgba[i * 4 + 1], b = rgba[i * 4 + 2];
+		y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		cb[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		cr[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+}
+
+static void PackRGB(const uint8_t* rgba, size_t pixels, uint8_t* out)
+{
+	for (size_t i = 0; i < pixels; i++)
+		memcpy(out + i * 3, rgba + i * 4, 3);
+}
+
+//Frames go through a ring of queueFrames copies to a thread that converts and writes them,
+//so the renderer only waits when the consumer is a whole queue behind
+class PipeFrameSink : public IFrameSink
+{
+public:
+	PipeFrameSink(int fd, bool ownsFd, FrameFormat format, const FrameSinkSettings& settings, unsigned width, unsigned height);
+	virtual ~PipeFrameSink();
+
+	virtual bool Submit(const uint8_t* rgba);
+	virtual bool Finish();
+	virtual uint64_t GetDroppedFrames() const;
+
+private:
+	void _WriterLoop();
+
+	int _fd;
+	bool _ownsFd;
+	FrameFormat _format;
+	unsigned _fps;
+	unsigned _width;
+	unsigned _height;
+	bool _dropWhenFull;
+
+	std::vector<std::vector<uint8_t>> _slots;
+	size_t _head = 0; //Oldest queued frame
+	size_t _queued = 0;
+	bool _stopping = false;
+	std::atomic<bool> _failed;
+	uint64_t _dropped = 0;
+	std::mutex _mutex;
+	std::condition_variable _notEmpty;
+	std::condition_variable _notFull;
+	std::thread _writer;
+#ifndef _WIN32
+	void (*_previousSigpipe)(int) = SIG_DFL; //Put back once the sink is destroyed
+#endif
+};
+
+PipeFrameSink::PipeFrameSink(int fd, bool ownsFd, FrameFormat format, const FrameSinkSettings& settings, unsigned width, unsigned height)
+{
+	_fd = fd;
+	_ownsFd = ownsFd;
+	_format = format;
+	_fps = (std::max)(1U, settings.fps);
+	_width = width;
+	_height = height;
+	_dropWhenFull = settings.dropWhenFull;
+	_failed = false;
+	_slots.resize((std::max)(1U, settings.queueFrames), std::vector<uint8_t>((size_t)width * height * 4));
+#ifndef _WIN32
+	_previousSigpipe = signal(SIGPIPE, SIG_IGN);
+#endif
+	_writer = std::thread(&PipeFrameSink::_WriterLoop, this);
+}
+
+PipeFrameSink::~PipeFrameSink()
+{
+	Finish();
+	if (_ownsFd)
+		CloseFd(_fd);
+#ifndef _WIN32
+	if (_previousSigpipe != SIG_ERR)
+		signal(SIGPIPE, _previousSigpipe);
+#endif
+}
+
+bool PipeFrameSink::Submit(const uint8_t * rgba)
+{
+	PROFILE_ZONE("PipeFrameSink::Submit");
+	if (_failed)
+		return false;
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (_queued == _slots.size())
+	{
+		if (_dropWhenFull)
+		{
+			_dropped++;
+			return true;
+		}
+		_notFull.wait(lock, [this]() { return _queued < _slots.size(); });
+	}
+	//The writer only touches the slot at _head while it is queued, so the free one at the tail is ours
+	std::vector<uint8_t>& slot = _slots[(_head + _queued) % _slots.size()];
+	memcpy(slot.data(), rgba, slot.size());
+	_queued++;
+	_notEmpty.notify_one();
+	return !_failed;
+}
+
+bool PipeFrameSink::Finish()
+{
+	if (_writer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_notEmpty.notify_one();
+		_writer.join();
+	}
+	return !_failed;
+}
+
+uint64_t PipeFrameSink::GetDroppedFrames() const
+{
+	return _dropped;
+}
+
+void PipeFrameSink::_WriterLoop()
+{
+	PROFILE_THREAD_NAME("Frame sink");
+	size_t pixels = (size_t)_width * _height;
+	std::vector<uint8_t> packed;
+	if (_format == FRAME_FORMAT_Y4M)
+	{
+		std::stringstream ss;
+		ss << "YUV4MPEG2 W" << _width << " H" << _height << " F" << _fps << ":1 Ip A1:1 C444\n";
+		std::string header = ss.str();
+		if (!WriteAll(_fd, (const uint8_t*)header.data(), header.size()))
+			_failed = true;
+		const char frameTag[] = "FRAME\n";
+		packed.assign(frameTag, frameTag + 6);
+		packed.resize(6 + pixels * 3);
+	}
+	else
+		packed.resize(pixels * 3);
+
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_notEmpty.wait(lock, [this]() { return _queued > 0 || _stopping; });
+		if (_queued == 0)
+			break;
+		const std::vector<uint8_t>& frame = _slots[_head];
+		lock.unlock();
+
+		//After a failed write the queue is still drained so Submit never waits on a dead consumer
+		if (!_failed)
+		{
+			PROFILE_ZONE("Write frame");
+			if (_format == FRAME_FORMAT_Y4M)
+				PackY4M(frame.data(), pixels, packed.data() + 6);
+			else
+				PackRGB(frame.data(), pixels, packed.data());
+			if (!WriteAll(_fd, packed.data(), packed.size()))
+				_failed = true;
+		}
+
+		lock.lock();
+		_head = (_head + 1) % _slots.size();
+		_queued--;
+		_notFull.notify_one();
+	}
+}
+
+//The slots live in memory the consumer maps too, frames are packed to rgb straight into them.
+//Nothing is queued on this side, a full ring drops the frame or waits for the consumer to move read.
+//A consumer that never attaches or dies stops moving read, after consumerTimeoutMs of that Submit and Finish fail.
+class SharedMemoryFrameSink : public IFrameSink
+{
+public:
+	SharedMemoryFrameSink(const std::string& name, const FrameSinkSettings& settings, unsigned width, unsigned height);
+	virtual ~SharedMemoryFrameSink();
+
+	bool IsOpen() const;
+	virtual bool Submit(const uint8_t* rgba);
+	virtual bool Finish();
+	virtual uint64_t GetDroppedFrames() const;
+
+private:
+	std::string _name;
+	size_t _size = 0;
+	void* _memory = nullptr;
+#ifdef _WIN32
+	HANDLE _mapping = nullptr;
+#endif
+	FrameRingHeader* _header = nullptr;
+	bool _dropWhenFull;
+	std::chrono::milliseconds _consumerTimeout;
+	bool _consumerGone = false;
+	uint64_t _dropped = 0;
+
+	//Waits until at most frames written ones are left unread. False if read stood still for the timeout,
+	//from then on the consumer is taken as gone and nothing waits for it anymore.
+	bool _WaitForConsumer(uint64_t frames);
+};
+
+SharedMemoryFrameSink::SharedMemoryFrameSink(const std::string& name, const FrameSinkSettings& settings, unsigned width, unsigned height)
+{
+	_dropWhenFull = settings.dropWhenFull;
+	_consumerTimeout = std::chrono::milliseconds(settings.consumerTimeoutMs);
+	uint32_t slotCount = (std::max)(1U, settings.queueFrames);
+	uint64_t slotSize = (uint64_t)width * height * 3;
+	_size = (size_t)(FRAME_RING_HEADER_SIZE + slotSize * slotCount);
+
+#ifdef _WIN32
+	_name = "Local\\" + name;
+	_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)_size >> 32), (DWORD)_size, _name.c_str());
+	if (!_mapping)
+		return;
+	_memory = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, _size);
+#else
+	_name = "/" + name;
+	int fd = shm_open(_name.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0)
+		return;
+	if (ftruncate(fd, (off_t)_size) == 0)
+	{
+		_memory = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (_memory == MAP_FAILED)
+			_memory = nullptr;
+	}
+	close(fd);
+#endif
+	if (!_memory)
+		return;
+
+	_header = new (_memory) FrameRingHeader;
+	memcpy(_header->magic, FRAME_RING_MAGIC, sizeof(_header->magic));
+	_header->version = FRAME_RING_VERSION;
+	_header->width = width;
+	_header->height = height;
+	_header->slotCount = slotCount;
+	_header->slotSize = slotSize;
+	_header->written.store(0);
+	_header->read.store(0);
+	_header->finished.store(0);
+}
+
+SharedMemoryFrameSink::~SharedMemoryFrameSink()
+{
+#ifdef _WIN32
+	if (_memory)
+		UnmapViewOfFile(_memory);
+	if (_mapping)
+		CloseHandle(_mapping);
+#else
+	//Consumers that have it mapped keep it until they unmap, new ones can no longer open it
+	if (_memory)
+		munmap(_memory, _size);
+	shm_unlink(_name.c_str());
+#endif
+}
+
+bool SharedMemoryFrameSink::IsOpen() const
+{
+	return _header != nullptr;
+}
+
+bool SharedMemoryFrameSink::_WaitForConsumer(uint64_t frames)
+{
+	if (_consumerGone)
+		return false;
+	//read moving is the consumer's heartbeat, the wait only gives up after it stood still for the whole timeout
+	uint64_t read = _header->read.load(std::memory_order_acquire);
+	auto lastProgress = std::chrono::steady_clock::now();
+	while (_header->written.load(std::memory_order_relaxed) - read > frames)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		uint64_t current = _header->read.load(std::memory_order_acquire);
+		if (current != read)
+		{
+			read = current;
+			lastProgress = std::chrono::steady_clock::now();
+		}
+		else if (std::chrono::steady_clock::now() - lastProgress > _consumerTimeout)
+		{
+			_consumerGone = true;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SharedMemoryFrameSink::Submit(const uint8_t * rgba)
+{
+	PROFILE_ZONE("SharedMemoryFrameSink::Submit");
+	uint64_t frame = _header->written.load(std::memory_order_relaxed);
+	if (frame - _header->read.load(std::memory_order_acquire) >= _header->slotCount)
+	{
+		if (_dropWhenFull)
+		{
+			_dropped++;
+			return true;
+		}
+		if (!_WaitForConsumer(_header->slotCount - 1))
+			return false;
+	}
+	uint8_t* slot = (uint8_t*)_memory + FRAME_RING_HEADER_SIZE + (frame % _header->slotCount) * _header->slotSize;
+	PackRGB(rgba, (size_t)_header->width * _header->height, slot);
+	_header->written.store(frame + 1, std::memory_order_release);
+	return true;
+}
+
+bool SharedMemoryFrameSink::Finish()
+{
+	PROFILE_ZONE("SharedMemoryFrameSink::Finish");
+	_header->finished.store(1, std::memory_order_release);
+	return _WaitForConsumer(0);
+}
+
+uint64_t SharedMemoryFrameSink::GetDroppedFrames() const
+{
+	return _dropped;
+}
+
+static bool EndsWith(const std::string& s, const char* suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+bool IsFrameStream(const std::string & target)
+{
+	return target == "-" || target.compare(0, 3, "fd:") == 0 || target.compare(0, 4, "shm:") == 0 ||
+		EndsWith(target, ".y4m") || EndsWith(target, ".rgb");
+}
+
+IFrameSink * CreateFrameSink(const FrameSinkSettings & settings, unsigned width, unsigned height)
+{
+	const std::string& target = settings.target;
+	if (target.compare(0, 4, "shm:") == 0)
+	{
+		SharedMemoryFrameSink* sink = new SharedMemoryFrameSink(target.substr(4), settings, width, height);
+		if (sink->IsOpen())
+			return sink;
+		delete sink;
+		return nullptr;
+	}
+
+	FrameFormat format = EndsWith(target, ".rgb") ? FRAME_FORMAT_RGB : settings.format;
+	int fd = -1;
+	bool ownsFd = true;
+	if (target == "-")
+	{
+		//The frames get the real stdout and everything printed from here on goes to stderr instead,
+		//so log lines can't end up in the middle of the video
+#ifdef _WIN32
+		fflush(stdout);
+		fd = _dup(1);
+		_dup2(2, 1);
+		_setmode(fd, _O_BINARY);
+#else
+		fflush(stdout);
+		fd = dup(1);
+		dup2(2, 1);
+#endif
+	}
+	else if (target.compare(0, 3, "fd:") == 0)
+	{
+		fd = atoi(target.c_str() + 3);
+		ownsFd = false;
+#ifdef _WIN32
+		_setmode(fd, _O_BINARY);
+#endif
+	}
+	else
+	{
+#ifdef _WIN32
+		fd = _open(target.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+	}
+	if (fd < 0)
+		return nullptr;
+	return new PipeFrameSink(fd, ownsFd, format, settings, width, height);
+}
@@ -0,0 +1,66 @@
+#ifndef _FRAME_SINK_H_
+#define _FRAME_SINK_H_
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+#define FRAME_RING_MAGIC "REIRING"
+#define FRAME_RING_VERSION 2
+#define FRAME_RING_HEADER_SIZE 128 //Slots start here, each is width * height * 3 bytes of rgb
+
+enum FrameFormat
+{
+	FRAME_FORMAT_Y4M, //YUV4MPEG2 with 4:4:4 bt.601 video range, what ffmpeg -i - takes without options
+	FRAME_FORMAT_RGB, //Tightly packed rgb24, ffmpeg -f rawvideo -pix_fmt rgb24 -s <w>x<h> -i -
+	FRAME_FORMAT_COUNT
+};
+
+struct FrameSinkSettings
+{
+	std::string target;           //"-" for stdout, "fd:<n>", "shm:<name>", or a file or named pipe
+	FrameFormat format = FRAME_FORMAT_Y4M; //Ignored by the shared memory ring, which always holds rgb
+	unsigned queueFrames = 4;     //Frames buffered between the renderer and the consumer
+	bool dropWhenFull = false;    //Drop frames instead of waiting for a consumer that falls behind
+	unsigned consumerTimeoutMs = 10000; //How long the shared memory ring waits on a consumer that reads nothing before giving up on it
+	unsigned fps = 30;            //Only written to the y4m header
+};
+
+//The start of a shared memory ring. The renderer fills slot written % slotCount and then increments written,
+//the consumer reads slot read % slotCount while read < written and increments read when done with it.
+//A slot is never overwritten before the consumer has moved read past it.
+//finished is set once written will not change anymore, so the consumer can stop after reading up to it.
+struct FrameRingHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t slotCount;
+	uint64_t slotSize;
+	std::atomic<uint64_t> written;
+	std::atomic<uint64_t> read;
+	std::atomic<uint32_t> finished;
+};
+
+//Where RunBatchRender sends frames when they go somewhere else than one image file each
+class IFrameSink
+{
+public:
+	IFrameSink() {};
+	virtual ~IFrameSink() {};
+
+	//Copies the frame, tightly packed 8 bit rgba of the size the sink was created with. Waits while the queue
+	//is full unless dropWhenFull is set. Returns false once the consumer has gone away.
+	virtual bool Submit(const uint8_t* rgba) = 0;
+	//Waits until every queued frame has been handed to the consumer
+	virtual bool Finish() = 0;
+	virtual uint64_t GetDroppedFrames() const = 0;
+};
+
+//True for the targets that stream instead of being an image file: "-", "fd:<n>", "shm:<name>", *.y4m and *.rgb
+bool IsFrameStream(const std::string& target);
+//Files ending in .rgb are raw regardless of settings.format. Returns nullptr if the target could not be opened.
+IFrameSink* CreateFrameSink(const FrameSinkSettings& settings, unsigned width, unsigned height);
+
+#endif
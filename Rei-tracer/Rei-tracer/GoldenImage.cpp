@@ -0,0 +1,176 @@
+#include "GoldenImage.h"
+#include "Core.h"
+#include "Scene.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+ImageDifference CompareImages(const uint8_t * a, const uint8_t * b, unsigned width, unsigned height)
+{
+	ImageDifference result;
+	double squaredError = 0.0;
+	size_t pixels = (size_t)width * height;
+	for (size_t i = 0; i < pixels; i++)
+	{
+		bool differs = false;
+		for (int c = 0; c < 3; c++)
+		{
+			int d = std::abs((int)a[i * 3 + c] - (int)b[i * 3 + c]);
+			squaredError += (double)(d * d);
+			result.maxError = (std::max)(result.maxError, (unsigned)d);
+			differs |= d != 0;
+		}
+		result.differingPixels += differs ? 1 : 0;
+	}
+	double mse = pixels ? squaredError / (pixels * 3) : 0.0;
+	result.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+	return result;
+}
+
+void MakeDifferenceImage(const uint8_t * a, const uint8_t * b, unsigned width, unsigned height, std::vector<uint8_t>& diff)
+{
+	diff.resize((size_t)width * height * 3);
+	for (size_t i = 0; i < diff.size(); i++)
+		diff[i] = (uint8_t)(std::min)(255, std::abs((int)a[i] - (int)b[i]) * 8);
+}
+
+//Skips whitespace and # comments between the header fields
+static bool ReadPPMValue(std::istream& in, unsigned& value)
+{
+	while (in)
+	{
+		int c = in.peek();
+		if (c == '#')
+			in.ignore((std::numeric_limits<std::streamsize>::max)(), '\n');
+		else if (std::isspace(c))
+			in.get();
+		else
+			break;
+	}
+	return (bool)(in >> value);
+}
+
+bool ReadPPM(const std::string & filename, std::vector<uint8_t>& rgb, unsigned & width, unsigned & height)
+{
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+	std::string magic;
+	fin >> magic;
+	unsigned maxValue = 0;
+	if (magic != "P6" || !ReadPPMValue(fin, width) || !ReadPPMValue(fin, height) || !ReadPPMValue(fin, maxValue) || maxValue != 255)
+		return false;
+	fin.get(); //The single whitespace before the pixels
+	rgb.resize((size_t)width * height * 3);
+	fin.read((char*)rgb.data(), rgb.size());
+	return fin.gcount() == (std::streamsize)rgb.size();
+}
+
+bool WritePPM(const std::string & filename, const uint8_t * rgb, unsigned width, unsigned height)
+{
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout)
+		return false;
+	fout << "P6\n" << width << " " << height << "\n255\n";
+	fout.write((const char*)rgb, (size_t)width * height * 3);
+	return (bool)fout;
+}
+
+//Draws the scene from its default camera and returns the last frame as rgb
+static bool RenderScene(const Scene& scene, const GoldenSettings& settings, std::vector<uint8_t>& rgb, unsigned& width, unsigned& height)
+{
+	Core* core = Core::GetInstance();
+	IGraphics* graphics = core->GetGraphics();
+	CameraManager* cam = core->GetCameraManager();
+	IWindow* window = core->GetWindow();
+
+	scene.Upload(graphics);
+	graphics->SetBounceCount(settings.bounces);
+
+	Camera c = scene.GetCamera((float)window->GetWidth() / (float)window->GetHeight());
+	unsigned id = cam->AddCamera(c.position.x, c.position.y, c.position.z, c.forward.x, c.forward.y, c.forward.z,
+		c.fov, c.aspectRatio, c.up.x, c.up.y, c.up.z, c.nearPlane, c.farPlane);
+	cam->SetActiveCamera(id);
+
+	graphics->SetFrameCapture(true);
+	for (unsigned i = 0; i < (std::max)(1U, settings.frames); i++)
+		core->Update();
+	std::vector<uint8_t> rgba;
+	bool captured = graphics->ReadBackFrame(rgba, width, height);
+	graphics->SetFrameCapture(false);
+	if (!captured)
+		return false;
+
+	rgb.resize((size_t)width * height * 3);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		rgb[i * 3 + 0] = rgba[i * 4 + 0];
+		rgb[i * 3 + 1] = rgba[i * 4 + 1];
+		rgb[i * 3 + 2] = rgba[i * 4 + 2];
+	}
+	return true;
+}
+
+int RunGoldenTests(const GoldenSettings & settings)
+{
+	PROFILE_ZONE("RunGoldenTests");
+	int failures = 0;
+	std::cout << std::left << std::setw(10) << "scene" << std::right << std::setw(10) << "psnr" << std::setw(10) << "maxerr"
+		<< std::setw(12) << "pixels" << "  result" << std::endl;
+	std::cout << std::fixed << std::setprecision(2);
+
+	for (const std::string& name : Scene::GetSceneNames())
+	{
+		std::string golden = settings.directory + "/" + name + ".ppm";
+		Scene scene;
+		std::vector<uint8_t> actual;
+		unsigned width = 0, height = 0;
+		if (!scene.Load(name) || !RenderScene(scene, settings, actual, width, height))
+		{
+			std::cout << std::left << std::setw(10) << name << "  FAILED to render" << std::endl;
+			failures++;
+			continue;
+		}
+
+		if (settings.update)
+		{
+			bool written = WritePPM(golden, &actual[0], width, height);
+			std::cout << std::left << std::setw(10) << name << "  " << (written ? "updated " : "FAILED to write ") << golden << std::endl;
+			failures += written ? 0 : 1;
+			continue;
+		}
+
+		std::vector<uint8_t> expected;
+		unsigned goldenWidth = 0, goldenHeight = 0;
+		if (!ReadPPM(golden, expected, goldenWidth, goldenHeight) || goldenWidth != width || goldenHeight != height)
+		{
+			std::cout << std::left << std::setw(10) << name << "  FAILED, no golden image of " << width << "x" << height << " at " << golden << std::endl;
+			WritePPM(settings.directory + "/" + name + ".actual.ppm", &actual[0], width, height);
+			failures++;
+			continue;
+		}
+
+		ImageDifference d = CompareImages(&actual[0], &expected[0], width, height);
+		bool passed = d.psnr >= settings.minPsnr && d.maxError <= settings.maxError;
+		std::cout << std::left << std::setw(10) << name << std::right << std::setw(10) << d.psnr << std::setw(10) << d.maxError
+			<< std::setw(12) << d.differingPixels << "  " << (passed ? "ok" : "FAILED") << std::endl;
+		if (!passed)
+		{
+			std::vector<uint8_t> diff;
+			MakeDifferenceImage(&actual[0], &expected[0], width, height, diff);
+			WritePPM(settings.directory + "/" + name + ".actual.ppm", &actual[0], width, height);
+			WritePPM(settings.directory + "/" + name + ".diff.ppm", &diff[0], width, height);
+			failures++;
+		}
+	}
+
+	if (failures)
+		std::cerr << failures << " golden image test(s) failed" << std::endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef _GOLDEN_IMAGE_H_
+#define _GOLDEN_IMAGE_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct GoldenSettings
+{
+	std::string directory = "golden"; //Holds <scene>.ppm for every reference scene
+	bool update = false;               //Write the rendered frames as the new goldens instead of comparing
+	unsigned bounces = 1;
+	unsigned frames = 2;               //Frames drawn before the capture
+	double minPsnr = 40.0;             //dB over all rgb channels
+	unsigned maxError = 32;            //Largest allowed difference of a single channel, 0-255
+};
+
+struct ImageDifference
+{
+	double psnr = 0.0;     //Infinite for identical images
+	unsigned maxError = 0;
+	size_t differingPixels = 0;
+};
+
+//Both images are tightly packed 8 bit rgb
+ImageDifference CompareImages(const uint8_t* a, const uint8_t* b, unsigned width, unsigned height);
+//Writes |a - b| scaled up so small differences are visible
+void MakeDifferenceImage(const uint8_t* a, const uint8_t* b, unsigned width, unsigned height, std::vector<uint8_t>& diff);
+
+//Binary (P6) ppm with 8 bit channels
+bool ReadPPM(const std::string& filename, std::vector<uint8_t>& rgb, unsigned& width, unsigned& height);
+bool WritePPM(const std::string& filename, const uint8_t* rgb, unsigned width, unsigned height);
+
+//Renders every scene from Scene::GetSceneNames at fixed settings through the Core and compares it with its
+//golden image. The goldens are cpu renders, so the Core has to come from InitHeadless. A failing scene also gets
+//<scene>.actual.ppm and <scene>.diff.ppm next to the golden. Returns the process exit code, non zero if any scene
+//regressed or had no golden.
+int RunGoldenTests(const GoldenSettings& settings);
+
+#endif
@@ -0,0 +1,115 @@
+#include "HardwareCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+
+static int OpenCounter(HardwareCounter counter)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	switch (counter)
+	{
+	case HW_L1D_READ_MISSES:
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	case HW_CACHE_REFERENCES:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_REFERENCES;
+		break;
+	case HW_CACHE_MISSES:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		break;
+	default:
+		return -1;
+	}
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+const char* GetHardwareCounterName(HardwareCounter counter)
+{
+	switch (counter)
+	{
+	case HW_L1D_READ_MISSES:
+		return "L1D read misses";
+	case HW_CACHE_REFERENCES:
+		return "LLC references";
+	case HW_CACHE_MISSES:
+		return "LLC misses";
+	default:
+		return "unknown";
+	}
+}
+
+HardwareCounters::HardwareCounters()
+{
+	for (int i = 0; i < HW_COUNTER_COUNT; i++)
+	{
+#ifdef __linux__
+		_fds[i] = OpenCounter((HardwareCounter)i);
+#else
+		_fds[i] = -1;
+#endif
+		_values[i] = 0;
+	}
+}
+
+HardwareCounters::~HardwareCounters()
+{
+#ifdef __linux__
+	for (int fd : _fds)
+	{
+		if (fd >= 0)
+			close(fd);
+	}
+#endif
+}
+
+bool HardwareCounters::IsAvailable(HardwareCounter counter) const
+{
+	return _fds[counter] >= 0;
+}
+
+void HardwareCounters::Start()
+{
+#ifdef __linux__
+	for (int fd : _fds)
+	{
+		if (fd < 0)
+			continue;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+void HardwareCounters::Stop()
+{
+	for (int i = 0; i < HW_COUNTER_COUNT; i++)
+	{
+		_values[i] = 0;
+#ifdef __linux__
+		if (_fds[i] < 0)
+			continue;
+		ioctl(_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+		uint64_t value = 0;
+		if (read(_fds[i], &value, sizeof(value)) == sizeof(value))
+			_values[i] = value;
+#endif
+	}
+}
+
+uint64_t HardwareCounters::Get(HardwareCounter counter) const
+{
+	return _values[counter];
+}
@@ -0,0 +1,40 @@
+#ifndef _HARDWARE_COUNTERS_H_
+#define _HARDWARE_COUNTERS_H_
+
+#include <stdint.h>
+
+enum HardwareCounter
+{
+	HW_L1D_READ_MISSES,
+	HW_CACHE_REFERENCES, //Last level cache
+	HW_CACHE_MISSES,
+	HW_COUNTER_COUNT
+};
+
+const char* GetHardwareCounterName(HardwareCounter counter);
+
+//Cpu performance counters of the calling thread, user mode only.
+//Read through perf events on Linux. Windows only exposes them to drivers, so there every counter is unavailable,
+//as it is on Linux when perf_event_paranoid or a virtual machine without a PMU keeps them closed.
+class HardwareCounters
+{
+public:
+	HardwareCounters();
+	~HardwareCounters();
+
+	bool IsAvailable(HardwareCounter counter) const;
+	//Zeroes and starts every available counter
+	void Start();
+	void Stop();
+	//Count between the last Start and Stop, 0 for unavailable counters
+	uint64_t Get(HardwareCounter counter) const;
+
+private:
+	int _fds[HW_COUNTER_COUNT];
+	uint64_t _values[HW_COUNTER_COUNT];
+
+	HardwareCounters(const HardwareCounters& other);
+	HardwareCounters& operator=(const HardwareCounters& other);
+};
+
+#endif
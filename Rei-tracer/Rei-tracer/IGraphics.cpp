@@ -1,3 +1,53 @@
 #include "IGraphics.h"
+#include <algorithm>
 
+static float Halton(unsigned index, unsigned base)
+{
+	float result = 0.0f;
+	float f = 1.0f;
+	while (index > 0)
+	{
+		f /= base;
+		result += f * (index % base);
+		index /= base;
+	}
+	return result;
+}
 
+void GetAccumulationJitter(unsigned frame, float & x, float & y)
+{
+	x = 0.0f;
+	y = 0.0f;
+	if (frame == 0)
+		return;
+	x = (Halton(frame, 2) - 0.5f) * 0.5f;
+	y = (Halton(frame, 3) - 0.5f) * 0.5f;
+}
+
+unsigned GetSampleMask(unsigned samples)
+{
+	//Row major, 4 is the center
+	static const unsigned masks[MAX_SAMPLES_PER_PIXEL + 1] =
+	{
+		0x010,           //Never used, 0 is clamped to 1
+		0x010,           //Center
+		0x101,           //Upper left, lower right
+		0x111,           //Diagonal
+		0x145,           //Corners
+		0x155,
+		0x1c7,           //Corners, upper and lower middle
+		0x1d7,
+		0x1ef,           //Everything but the center
+		0x1ff
+	};
+	return masks[(std::min)((std::max)(samples, 1U), (unsigned)MAX_SAMPLES_PER_PIXEL)];
+}
+
+bool IGraphics::RenderToMemory(std::vector<uint8_t>& rgba, unsigned & width, unsigned & height)
+{
+	SetFrameCapture(true);
+	Draw();
+	bool captured = ReadBackFrame(rgba, width, height);
+	SetFrameCapture(false);
+	return captured;
+}
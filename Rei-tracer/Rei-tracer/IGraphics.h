@@ -1,6 +1,19 @@
 #ifndef _IGRAPHICS_H_
 #define _IGRAPHICS_H_
 #include "Structs.h"
+#include "RayStats.h"
+#include "ToneMap.h"
+#include "Denoiser.h"
+#include "Temporal.h"
+
+#define MAX_SAMPLES_PER_PIXEL 9 //The 3x3 grid of rays the tracers spread over every pixel
+
+//Subpixel offset of the sample grid for the frame-th accumulated frame, in pixels. Zero for frame 0, so a
+//single frame is traced exactly like before, then the Halton (2, 3) sequence over the half pixel between grid points.
+void GetAccumulationJitter(unsigned frame, float& x, float& y);
+//Which rays of the 3x3 grid, bit i for ray i in row major order, are traced for the given samples per pixel.
+//Picks points spread over the pixel, the corners before the edges, and the center when the count is odd.
+unsigned GetSampleMask(unsigned samples);
 
 class IGraphics
 {
@@ -11,14 +24,67 @@ public:
 	virtual void IncreaseBounceCount() = 0;
 	virtual void DecreaseBounceCount() = 0;
 	virtual void SetBounceCount(unsigned bounces) = 0;
+	//How rays are tested against the triangles, TRIANGLE_TEST_MOLLER_TRUMBORE until set
+	virtual void SetTriangleTest(TriangleTest test) = 0;
+	//How the cpu traversal lays out the bvhs given to SetMeshPartitions, BVH_LAYOUT_BINARY until set.
+	//Only a hint, a backend that traverses the binary tables itself ignores it.
+	virtual void SetBVHLayout(BVHLayout layout) = 0;
 	virtual void SetTriangles(Triangle* triangles, size_t count) = 0;
 	virtual void SetSpheres(Sphere* spheres, size_t count) = 0;
+	virtual void SetPlanes(Plane* planes, size_t count) = 0;
 	virtual void SetPointLights(PointLight* pointlights, size_t count) = 0;
 	virtual void SetSpotLights(SpotLight* spotlights, size_t count) = 0;
-	virtual void SetMeshPartitions(OctNode* nodes, MeshIndices* indices, size_t nodeCount, size_t indexCount) = 0;
+	//The bvh nodes of every mesh in one table, the leaves index triangleIndices, and the meshes pointing into both
+	virtual void SetMeshPartitions(BVHNode* nodes, size_t nodeCount, uint32_t* triangleIndices, size_t triangleIndexCount, MeshIndices* meshes, size_t meshCount) = 0;
+	//Overwrite part of what the matching Set call uploaded, the count stays the same. Changes are collected
+	//and only the dirty range of each buffer is copied to the gpu at the next Draw.
+	//Moving triangles leaves the bvh nodes alone, refit them and pass the result to UpdateMeshPartitions.
+	virtual void UpdateTriangles(size_t first, size_t count, const Triangle* triangles) = 0;
+	virtual void UpdateMeshPartitions(size_t first, size_t count, const BVHNode* nodes) = 0;
+	virtual void UpdateSphere(size_t index, const Sphere& sphere) = 0;
+	virtual void UpdatePointLight(size_t index, const PointLight& light) = 0;
+	virtual void UpdateSpotLight(size_t index, const SpotLight& light) = 0;
+	//Assigns a material to the triangles [indexStart, indexEnd]. Later calls overwrite earlier ones.
 	virtual void PrepareTextures(unsigned indexStart, unsigned indexEnd, const std::string& filenameDiffuse, const std::string& filenameNormal) = 0;
+	//Same for the planes [indexStart, indexEnd], call it after SetPlanes
+	virtual void PreparePlaneTextures(unsigned indexStart, unsigned indexEnd, const std::string& filenameDiffuse, const std::string& filenameNormal) = 0;
+	//Uploads the textures and the per triangle material table. Call once the scene is built.
 	virtual void SetTextures() = 0;
 	virtual void Draw() = 0;
+	//Draw adds its linear radiance, unclamped, to a float accumulation buffer with the frame count in w,
+	//and a separate pass tone maps that buffer to the 8 bit frame. With accumulation off, the default,
+	//every Draw starts the buffer over. With it on only ResetAccumulation does, so the frames of a still
+	//camera add up, and every frame after the first shifts the sample grid by GetAccumulationJitter.
+	virtual void SetAccumulation(bool enabled) = 0;
+	virtual void ResetAccumulation() = 0;
+	virtual void SetToneMapping(const ToneMapSettings& settings) = 0;
+	//Copies the accumulation buffer as it was after the last Draw, or the history it resolved to with temporal
+	//reprojection on. Buffers of the same view rendered in other runs or on other machines merge exactly by adding them.
+	virtual bool ReadBackAccumulation(std::vector<float>& rgbw, unsigned& width, unsigned& height) = 0;
+	//Rays per pixel and frame, clamped to [1, MAX_SAMPLES_PER_PIXEL]. All of them by default.
+	virtual void SetSamplesPerPixel(unsigned samples) = 0;
+	//While enabled Draw also writes the first hit guides, and the average radiance is run through Denoise on
+	//the cpu before it is tone mapped. The accumulation buffer itself stays noisy.
+	virtual void SetDenoise(const DenoiseSettings& settings) = 0;
+	//Cpu time of the denoiser in the last Draw in milliseconds, including any copies to and from the gpu.
+	//Not part of GetLastFrameTime.
+	virtual double GetLastDenoiseTime() const = 0;
+	//While enabled every Draw traces a new frame with the next sample grid offset of GetAccumulationJitter, and adds
+	//the result of the frame before, reprojected with TemporalReproject, before denoising and tone mapping. This
+	//takes the place of accumulation. ResetAccumulation and any change of the settings drop the history.
+	virtual void SetTemporal(const TemporalSettings& settings) = 0;
+	//Gpu time of the last Draw in milliseconds
+	virtual double GetLastFrameTime() const = 0;
+	//Counters of the last drawn frame. Always zero unless RAY_STATS_ENABLED is set.
+	virtual FrameRayStats GetRayStats() const = 0;
+	virtual bool DumpRayStatsHeatmap(const std::string& filename, RayStatCounter counter = RAYSTAT_COST) = 0;
+	//While enabled every Draw keeps a copy of the frame it rendered for ReadBackFrame
+	virtual void SetFrameCapture(bool enabled) = 0;
+	//Copies the last captured frame as tightly packed 8 bit rgba. Returns false if nothing has been captured.
+	virtual bool ReadBackFrame(std::vector<uint8_t>& rgba, unsigned& width, unsigned& height) = 0;
+	//Draws one frame and returns it like ReadBackFrame does, for writing frames to files instead of looking at them.
+	//Turns frame capture off again afterwards.
+	virtual bool RenderToMemory(std::vector<uint8_t>& rgba, unsigned& width, unsigned& height);
 	//CreateBuffer(Resource* ) is too generic to work. Depending on what kind of buffers/shader resource views need to be created
 	//"Resource" needs to be able to hold a lot of different data structures which makes a fucking mess.
 //	virtual void CreateMeshBuffers(const SM_GUID& guid, MeshData::Vertex* vertices, uint32_t numVertices, uint32_t* indices, uint32_t indexCount) = 0;
@@ -0,0 +1,30 @@
+#ifndef _IWINDOW_H_
+#define _IWINDOW_H_
+
+#include <stdint.h>
+#include <string>
+
+//Where frames end up, either a real window or an offscreen framebuffer
+class IWindow
+{
+public:
+	IWindow() {};
+	virtual ~IWindow() {};
+
+	virtual uint32_t GetWidth() const = 0;
+	virtual uint32_t GetHeight() const = 0;
+	virtual bool GetWindowedMode() const = 0;
+	//The HWND on Windows, nullptr without a window
+	virtual void* GetNativeHandle() const = 0;
+
+	virtual void SetTitle(const std::string& title) = 0;
+
+	virtual void LockMouseToScreen(bool lock) = 0;
+	virtual void ToggleLockMouseToScreen() = 0;
+
+	//Shows a frame rendered on the cpu, tightly packed 8 bit rgba of GetWidth x GetHeight.
+	//Backends with a swap chain of their own present through it instead.
+	virtual void Present(const uint8_t* rgba) = 0;
+};
+
+#endif
@@ -0,0 +1,817 @@
+#include "ImageReader.h"
+#include "GoldenImage.h"
+#include "Png.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+#define HUFFMAN_MAX_BITS 16
+#define HUFFMAN_MAX_SYMBOLS 288
+//Larger images are refused before anything is allocated for them, it is also the largest texture Direct3D11 takes
+#define IMAGE_MAX_DIMENSION 16384
+
+//Canonical huffman code as deflate and jpeg both store it: the number of codes of every length and the
+//symbols ordered by code. Decoding walks one bit per length, which is plenty for loading textures once.
+struct CanonicalHuffman
+{
+	uint16_t counts[HUFFMAN_MAX_BITS + 1];
+	uint16_t symbols[HUFFMAN_MAX_SYMBOLS];
+};
+
+//Codes from their lengths in symbol order, deflate's way of storing a table. False for an oversubscribed set.
+static bool BuildHuffman(const uint8_t* lengths, unsigned count, CanonicalHuffman& h)
+{
+	memset(h.counts, 0, sizeof(h.counts));
+	for (unsigned s = 0; s < count; s++)
+		h.counts[lengths[s]]++;
+	int left = 1;
+	for (unsigned len = 1; len <= HUFFMAN_MAX_BITS; len++)
+	{
+		left = (left << 1) - h.counts[len];
+		if (left < 0)
+			return false;
+	}
+	uint16_t offsets[HUFFMAN_MAX_BITS + 1];
+	offsets[1] = 0;
+	for (unsigned len = 1; len < HUFFMAN_MAX_BITS; len++)
+		offsets[len + 1] = offsets[len] + h.counts[len];
+	for (unsigned s = 0; s < count; s++)
+	{
+		if (lengths[s])
+			h.symbols[offsets[lengths[s]]++] = (uint16_t)s;
+	}
+	return true;
+}
+
+//reader.ReadBit returns the next bit of the code, or -1 past the end of the data
+template<typename BitReader>
+static int DecodeSymbol(BitReader& reader, const CanonicalHuffman& h)
+{
+	int code = 0, first = 0, index = 0;
+	for (unsigned len = 1; len <= HUFFMAN_MAX_BITS; len++)
+	{
+		int bit = reader.ReadBit();
+		if (bit < 0)
+			return -1;
+		code |= bit;
+		int count = h.counts[len];
+		if (code - count < first)
+			return h.symbols[index + (code - first)];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+//Deflate packs its bits starting at the least significant one
+struct DeflateBitReader
+{
+	const uint8_t* data;
+	size_t size;
+	size_t pos = 0;
+	unsigned bit = 0;
+
+	int ReadBit()
+	{
+		if (pos >= size)
+			return -1;
+		int value = (data[pos] >> bit) & 1;
+		if (++bit == 8)
+		{
+			bit = 0;
+			pos++;
+		}
+		return value;
+	}
+	int ReadBits(unsigned count)
+	{
+		int value = 0;
+		for (unsigned i = 0; i < count; i++)
+		{
+			int b = ReadBit();
+			if (b < 0)
+				return -1;
+			value |= b << i;
+		}
+		return value;
+	}
+	void AlignToByte()
+	{
+		if (bit)
+		{
+			bit = 0;
+			pos++;
+		}
+	}
+};
+
+static bool InflateBlock(DeflateBitReader& reader, const CanonicalHuffman& literals, const CanonicalHuffman& distances, std::vector<uint8_t>& out)
+{
+	while (true)
+	{
+		int symbol = DecodeSymbol(reader, literals);
+		if (symbol < 0)
+			return false;
+		if (symbol < 256)
+		{
+			out.push_back((uint8_t)symbol);
+			continue;
+		}
+		if (symbol == 256)
+			return true;
+		symbol -= 257;
+		if (symbol >= 29)
+			return false;
+		int extra = reader.ReadBits(gLengthExtra[symbol]);
+		int distanceSymbol = DecodeSymbol(reader, distances);
+		if (extra < 0 || distanceSymbol < 0 || distanceSymbol >= 30)
+			return false;
+		int distanceExtra = reader.ReadBits(gDistanceExtra[distanceSymbol]);
+		if (distanceExtra < 0)
+			return false;
+		size_t length = gLengthBase[symbol] + extra;
+		size_t distance = gDistanceBase[distanceSymbol] + distanceExtra;
+		if (distance > out.size())
+			return false;
+		//Byte by byte, the match may overlap what it copies
+		size_t from = out.size() - distance;
+		for (size_t i = 0; i < length; i++)
+			out.push_back(out[from + i]);
+	}
+}
+
+//A whole zlib stream, the checksum is not verified
+static bool Inflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+	if (size < 2 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20))
+		return false;
+	DeflateBitReader reader = { data + 2, size - 2 };
+
+	CanonicalHuffman fixedLiterals, fixedDistances;
+	uint8_t lengths[HUFFMAN_MAX_SYMBOLS + 32];
+	for (unsigned s = 0; s < 288; s++)
+		lengths[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+	BuildHuffman(lengths, 288, fixedLiterals);
+	std::fill(lengths, lengths + 30, (uint8_t)5);
+	BuildHuffman(lengths, 30, fixedDistances);
+
+	int last = 0;
+	while (!last)
+	{
+		last = reader.ReadBit();
+		int type = reader.ReadBits(2);
+		if (last < 0 || type < 0)
+			return false;
+		if (type == 0)
+		{
+			reader.AlignToByte();
+			if (reader.pos + 4 > reader.size)
+				return false;
+			size_t length = reader.data[reader.pos] | (reader.data[reader.pos + 1] << 8);
+			size_t complement = reader.data[reader.pos + 2] | (reader.data[reader.pos + 3] << 8);
+			reader.pos += 4;
+			if ((length ^ 0xFFFF) != complement || reader.pos + length > reader.size)
+				return false;
+			out.insert(out.end(), reader.data + reader.pos, reader.data + reader.pos + length);
+			reader.pos += length;
+		}
+		else if (type == 1)
+		{
+			if (!InflateBlock(reader, fixedLiterals, fixedDistances, out))
+				return false;
+		}
+		else if (type == 2)
+		{
+			static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+			int literalCount = reader.ReadBits(5);
+			int distanceCount = reader.ReadBits(5);
+			int codeLengthCount = reader.ReadBits(4);
+			if (literalCount < 0 || distanceCount < 0 || codeLengthCount < 0)
+				return false;
+			literalCount += 257;
+			distanceCount += 1;
+			codeLengthCount += 4;
+			uint8_t codeLengths[19] = {};
+			for (int i = 0; i < codeLengthCount; i++)
+			{
+				int length = reader.ReadBits(3);
+				if (length < 0)
+					return false;
+				codeLengths[order[i]] = (uint8_t)length;
+			}
+			CanonicalHuffman codeLengthCode;
+			if (!BuildHuffman(codeLengths, 19, codeLengthCode))
+				return false;
+			//The literal and distance lengths are one sequence, repeats may cross from one to the other
+			int total = literalCount + distanceCount;
+			for (int i = 0; i < total;)
+			{
+				int symbol = DecodeSymbol(reader, codeLengthCode);
+				if (symbol < 0)
+					return false;
+				if (symbol < 16)
+				{
+					lengths[i++] = (uint8_t)symbol;
+					continue;
+				}
+				int repeat;
+				uint8_t value = 0;
+				if (symbol == 16)
+				{
+					if (i == 0)
+						return false;
+					value = lengths[i - 1];
+					repeat = reader.ReadBits(2) + 3;
+				}
+				else if (symbol == 17)
+					repeat = reader.ReadBits(3) + 3;
+				else
+					repeat = reader.ReadBits(7) + 11;
+				if (repeat < 3 || i + repeat > total)
+					return false;
+				std::fill(lengths + i, lengths + i + repeat, value);
+				i += repeat;
+			}
+			CanonicalHuffman literals, distances;
+			if (lengths[256] == 0 || !BuildHuffman(lengths, literalCount, literals) || !BuildHuffman(lengths + literalCount, distanceCount, distances))
+				return false;
+			if (!InflateBlock(reader, literals, distances, out))
+				return false;
+		}
+		else
+			return false;
+	}
+	return true;
+}
+
+static uint32_t ReadBigEndian32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool DecodePNG(const uint8_t * data, size_t size, std::vector<uint8_t>& rgba, unsigned & width, unsigned & height)
+{
+	PROFILE_ZONE("DecodePNG");
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (size < 8 || memcmp(data, signature, 8) != 0)
+		return false;
+
+	unsigned bitDepth = 0, colorType = 0;
+	bool headerSeen = false;
+	std::vector<uint8_t> compressed;
+	uint8_t palette[256][4];
+	unsigned paletteSize = 0;
+	for (unsigned i = 0; i < 256; i++)
+		palette[i][0] = palette[i][1] = palette[i][2] = 0, palette[i][3] = 255;
+	int transparent[3] = { -1, -1, -1 }; //The color tRNS makes transparent for gray and rgb images
+
+	//Chunks are length, type, data and a crc that is not checked
+	size_t pos = 8;
+	while (pos + 12 <= size)
+	{
+		size_t length = ReadBigEndian32(&data[pos]);
+		const uint8_t* type = &data[pos + 4];
+		const uint8_t* chunk = &data[pos + 8];
+		if (length > size - pos - 12)
+			return false;
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			if (length < 13)
+				return false;
+			width = ReadBigEndian32(chunk);
+			height = ReadBigEndian32(chunk + 4);
+			bitDepth = chunk[8];
+			colorType = chunk[9];
+			//Compression and filter method 0 are the only ones defined, interlacing is not supported
+			if (chunk[10] != 0 || chunk[11] != 0 || chunk[12] != 0)
+				return false;
+			headerSeen = true;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			paletteSize = (unsigned)(std::min)(length / 3, (size_t)256);
+			for (unsigned i = 0; i < paletteSize; i++)
+				memcpy(palette[i], chunk + i * 3, 3);
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (colorType == 3)
+			{
+				for (size_t i = 0; i < (std::min)(length, (size_t)256); i++)
+					palette[i][3] = chunk[i];
+			}
+			else
+			{
+				for (size_t i = 0; i < 3 && i * 2 + 1 < length; i++)
+					transparent[i] = (chunk[i * 2] << 8) | chunk[i * 2 + 1];
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		else if (memcmp(type, "IEND", 4) == 0)
+			break;
+		pos += length + 12;
+	}
+
+	unsigned channels;
+	switch (colorType)
+	{
+	case 0: channels = 1; break;
+	case 2: channels = 3; break;
+	case 3: channels = 1; break;
+	case 4: channels = 2; break;
+	case 6: channels = 4; break;
+	default: return false;
+	}
+	bool validDepth = bitDepth == 8 || (bitDepth == 16 && colorType != 3) || ((bitDepth == 1 || bitDepth == 2 || bitDepth == 4) && (colorType == 0 || colorType == 3));
+	if (!headerSeen || !validDepth || width == 0 || height == 0 || (colorType == 3 && paletteSize == 0))
+		return false;
+	if (width > IMAGE_MAX_DIMENSION || height > IMAGE_MAX_DIMENSION)
+		return false;
+	//The header is not trusted with the allocation before the image data could actually inflate to its size
+	size_t stride = ((size_t)width * channels * bitDepth + 7) / 8;
+	if ((stride + 1) * height > compressed.size() * DEFLATE_MAX_RATIO)
+		return false;
+
+	std::vector<uint8_t> raw;
+	raw.reserve((stride + 1) * height);
+	if (!Inflate(compressed.data(), compressed.size(), raw))
+		return false;
+	size_t bytesPerPixel = (std::max)((size_t)1, (size_t)channels * bitDepth / 8);
+	if (raw.size() < (stride + 1) * height)
+		return false;
+
+	//Undo the filters in place, every row starts with its filter type
+	std::vector<uint8_t> pixels(stride * height);
+	for (unsigned y = 0; y < height; y++)
+	{
+		const uint8_t* in = &raw[y * (stride + 1) + 1];
+		uint8_t* row = &pixels[y * stride];
+		const uint8_t* up = y > 0 ? row - stride : nullptr;
+		uint8_t filter = raw[y * (stride + 1)];
+		for (size_t i = 0; i < stride; i++)
+		{
+			int a = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+			int b = up ? up[i] : 0;
+			int c = up && i >= bytesPerPixel ? up[i - bytesPerPixel] : 0;
+			switch (filter)
+			{
+			case 0: row[i] = in[i]; break;
+			case 1: row[i] = (uint8_t)(in[i] + a); break;
+			case 2: row[i] = (uint8_t)(in[i] + b); break;
+			case 3: row[i] = (uint8_t)(in[i] + ((a + b) >> 1)); break;
+			case 4: row[i] = (uint8_t)(in[i] + Paeth(a, b, c)); break;
+			default: return false;
+			}
+		}
+	}
+
+	rgba.resize((size_t)width * height * 4);
+	for (unsigned y = 0; y < height; y++)
+	{
+		const uint8_t* row = &pixels[y * stride];
+		for (unsigned x = 0; x < width; x++)
+		{
+			//Every sample scaled to 16 bits first, so the transparent color compares at the file's depth
+			unsigned samples[4];
+			for (unsigned c = 0; c < channels; c++)
+			{
+				size_t index = (size_t)x * channels + c;
+				if (bitDepth == 16)
+					samples[c] = (row[index * 2] << 8) | row[index * 2 + 1];
+				else if (bitDepth == 8)
+					samples[c] = row[index];
+				else
+				{
+					size_t bit = index * bitDepth;
+					samples[c] = (row[bit / 8] >> (8 - bitDepth - bit % 8)) & ((1U << bitDepth) - 1);
+				}
+			}
+			uint8_t* out = &rgba[((size_t)y * width + x) * 4];
+			if (colorType == 3)
+			{
+				memcpy(out, palette[samples[0] < paletteSize ? samples[0] : 0], 4);
+				continue;
+			}
+			unsigned maxValue = (1U << bitDepth) - 1;
+			auto to8 = [&](unsigned v) { return (uint8_t)(v * 255 / maxValue); };
+			bool isTransparent = transparent[0] >= 0;
+			if (colorType == 0 || colorType == 4)
+			{
+				out[0] = out[1] = out[2] = to8(samples[0]);
+				out[3] = colorType == 4 ? to8(samples[1]) : 255;
+				isTransparent = isTransparent && colorType == 0 && (int)samples[0] == transparent[0];
+			}
+			else
+			{
+				out[0] = to8(samples[0]);
+				out[1] = to8(samples[1]);
+				out[2] = to8(samples[2]);
+				out[3] = colorType == 6 ? to8(samples[3]) : 255;
+				isTransparent = isTransparent && colorType == 2 && (int)samples[0] == transparent[0] &&
+					(int)samples[1] == transparent[1] && (int)samples[2] == transparent[2];
+			}
+			if (isTransparent)
+				out[3] = 0;
+		}
+	}
+	return true;
+}
+
+//Jpeg reads its bits starting at the most significant one, with a 0 byte stuffed after every 0xFF of data.
+//At a marker it stops and returns -1, the restart markers are stepped over by Restart.
+struct JpegBitReader
+{
+	const uint8_t* data;
+	size_t size;
+	size_t pos = 0;
+	unsigned byte = 0;
+	unsigned bitsLeft = 0;
+
+	int ReadBit()
+	{
+		if (bitsLeft == 0)
+		{
+			if (pos >= size)
+				return -1;
+			if (data[pos] == 0xFF)
+			{
+				if (pos + 1 >= size || data[pos + 1] != 0)
+					return -1;
+				byte = 0xFF;
+				pos += 2;
+			}
+			else
+				byte = data[pos++];
+			bitsLeft = 8;
+		}
+		bitsLeft--;
+		return (byte >> bitsLeft) & 1;
+	}
+	int ReadBits(unsigned count)
+	{
+		int value = 0;
+		for (unsigned i = 0; i < count; i++)
+		{
+			int b = ReadBit();
+			if (b < 0)
+				return -1;
+			value = (value << 1) | b;
+		}
+		return value;
+	}
+	//Drops the bits left of the current byte and steps over the RSTn marker that has to follow
+	bool Restart()
+	{
+		bitsLeft = 0;
+		if (pos + 1 >= size || data[pos] != 0xFF || data[pos + 1] < 0xD0 || data[pos + 1] > 0xD7)
+			return false;
+		pos += 2;
+		return true;
+	}
+};
+
+//The value of a coefficient from its magnitude category and the bits that follow
+static int ExtendSign(int bits, unsigned category)
+{
+	return bits < (1 << (category - 1)) ? bits - (1 << category) + 1 : bits;
+}
+
+struct JpegComponent
+{
+	unsigned id;
+	unsigned h, v;            //Sampling factors
+	unsigned quantTable;
+	unsigned dcTable, acTable;
+	int dcPrediction;
+	unsigned blocksPerLine;   //Blocks of the padded plane, whole MCUs in both directions
+	unsigned blocksPerColumn;
+	std::vector<uint8_t> plane;
+};
+
+//Separable float inverse DCT of one 8x8 block of dequantized coefficients in natural order, level shifted
+static void InverseDCT(const float* coefficients, uint8_t* out, size_t stride)
+{
+	static float cosines[8][8];
+	static bool initialized = false;
+	if (!initialized)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			for (int u = 0; u < 8; u++)
+				cosines[x][u] = (u == 0 ? std::sqrt(0.125f) : 0.5f) * std::cos((2 * x + 1) * u * 3.14159265358979f / 16.0f);
+		}
+		initialized = true;
+	}
+	float rows[64];
+	for (int v = 0; v < 8; v++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			float sum = 0.0f;
+			for (int u = 0; u < 8; u++)
+				sum += cosines[x][u] * coefficients[v * 8 + u];
+			rows[v * 8 + x] = sum;
+		}
+	}
+	for (int x = 0; x < 8; x++)
+	{
+		for (int y = 0; y < 8; y++)
+		{
+			float sum = 0.0f;
+			for (int v = 0; v < 8; v++)
+				sum += cosines[y][v] * rows[v * 8 + x];
+			int value = (int)std::lround(sum + 128.0f);
+			out[y * stride + x] = (uint8_t)(std::min)(255, (std::max)(0, value));
+		}
+	}
+}
+
+bool DecodeJPEG(const uint8_t * data, size_t size, std::vector<uint8_t>& rgba, unsigned & width, unsigned & height)
+{
+	PROFILE_ZONE("DecodeJPEG");
+	static const uint8_t zigzag[64] = { 0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21,
+		28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+	if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+		return false;
+
+	uint16_t quantTables[4][64] = {};   //In zigzag order like the coefficients arrive
+	CanonicalHuffman huffmanTables[8];  //DC tables 0-3, then AC tables 0-3
+	std::vector<JpegComponent> components;
+	unsigned maxH = 1, maxV = 1, mcusPerLine = 0, mcusPerColumn = 0;
+	unsigned restartInterval = 0;
+	bool frameSeen = false;
+
+	size_t pos = 2;
+	while (pos + 4 <= size)
+	{
+		if (data[pos] != 0xFF)
+			return false;
+		uint8_t marker = data[pos + 1];
+		if (marker == 0xFF)
+		{
+			pos++; //Fill byte
+			continue;
+		}
+		if (marker == 0xD9)
+			break;
+		size_t length = (data[pos + 2] << 8) | data[pos + 3];
+		if (length < 2 || pos + 2 + length > size)
+			return false;
+		const uint8_t* segment = &data[pos + 4];
+		size_t segmentSize = length - 2;
+		pos += 2 + length;
+
+		if (marker == 0xDB)
+		{
+			for (size_t i = 0; i < segmentSize;)
+			{
+				unsigned precision = segment[i] >> 4, id = segment[i] & 3;
+				i++;
+				if (i + (precision ? 128 : 64) > segmentSize)
+					return false;
+				for (unsigned k = 0; k < 64; k++)
+					quantTables[id][k] = precision ? (uint16_t)((segment[i + k * 2] << 8) | segment[i + k * 2 + 1]) : segment[i + k];
+				i += precision ? 128 : 64;
+			}
+		}
+		else if (marker == 0xC4)
+		{
+			for (size_t i = 0; i < segmentSize;)
+			{
+				if (i + 17 > segmentSize)
+					return false;
+				unsigned tableClass = segment[i] >> 4, id = segment[i] & 3;
+				CanonicalHuffman& h = huffmanTables[(tableClass ? 4 : 0) + id];
+				h.counts[0] = 0;
+				unsigned total = 0;
+				for (unsigned len = 1; len <= 16; len++)
+				{
+					h.counts[len] = segment[i + len];
+					total += h.counts[len];
+				}
+				i += 17;
+				if (total > 256 || i + total > segmentSize)
+					return false;
+				for (unsigned s = 0; s < total; s++)
+					h.symbols[s] = segment[i + s];
+				i += total;
+			}
+		}
+		else if (marker == 0xDD)
+		{
+			if (segmentSize < 2)
+				return false;
+			restartInterval = (segment[0] << 8) | segment[1];
+		}
+		else if (marker == 0xC0 || marker == 0xC1)
+		{
+			if (segmentSize < 6 || segment[0] != 8)
+				return false;
+			height = (segment[1] << 8) | segment[2];
+			width = (segment[3] << 8) | segment[4];
+			unsigned count = segment[5];
+			if (width == 0 || height == 0 || (count != 1 && count != 3) || segmentSize < 6 + count * 3)
+				return false;
+			if (width > IMAGE_MAX_DIMENSION || height > IMAGE_MAX_DIMENSION)
+				return false;
+			components.resize(count);
+			for (unsigned c = 0; c < count; c++)
+			{
+				JpegComponent& component = components[c];
+				component.id = segment[6 + c * 3];
+				component.h = segment[7 + c * 3] >> 4;
+				component.v = segment[7 + c * 3] & 15;
+				component.quantTable = segment[8 + c * 3] & 3;
+				if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4)
+					return false;
+				maxH = (std::max)(maxH, component.h);
+				maxV = (std::max)(maxV, component.v);
+			}
+			mcusPerLine = (width + 8 * maxH - 1) / (8 * maxH);
+			mcusPerColumn = (height + 8 * maxV - 1) / (8 * maxV);
+			for (JpegComponent& component : components)
+			{
+				component.blocksPerLine = mcusPerLine * component.h;
+				component.blocksPerColumn = mcusPerColumn * component.v;
+				component.plane.assign((size_t)component.blocksPerLine * 8 * component.blocksPerColumn * 8, 0);
+			}
+			frameSeen = true;
+		}
+		else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+			return false; //Progressive, lossless or arithmetic coded
+		else if (marker == 0xDA)
+		{
+			if (!frameSeen || segmentSize < 1)
+				return false;
+			unsigned count = segment[0];
+			if (count < 1 || segmentSize < 1 + count * 2)
+				return false;
+			std::vector<JpegComponent*> scan;
+			for (unsigned i = 0; i < count; i++)
+			{
+				unsigned id = segment[1 + i * 2];
+				auto found = std::find_if(components.begin(), components.end(), [id](const JpegComponent& c) { return c.id == id; });
+				if (found == components.end())
+					return false;
+				found->dcTable = segment[2 + i * 2] >> 4 & 3;
+				found->acTable = segment[2 + i * 2] & 3;
+				found->dcPrediction = 0;
+				scan.push_back(&*found);
+			}
+
+			JpegBitReader reader = { data + pos, size - pos };
+			//A scan of one component covers only its own blocks, not whole MCUs
+			bool interleaved = count > 1;
+			unsigned unitsPerLine = mcusPerLine, unitsPerColumn = mcusPerColumn;
+			if (!interleaved)
+			{
+				unitsPerLine = ((width * scan[0]->h + maxH - 1) / maxH + 7) / 8;
+				unitsPerColumn = ((height * scan[0]->v + maxV - 1) / maxV + 7) / 8;
+			}
+			unsigned units = unitsPerLine * unitsPerColumn;
+			float coefficients[64];
+			for (unsigned unit = 0; unit < units; unit++)
+			{
+				if (restartInterval && unit > 0 && unit % restartInterval == 0)
+				{
+					if (!reader.Restart())
+						return false;
+					for (JpegComponent* component : scan)
+						component->dcPrediction = 0;
+				}
+				unsigned unitX = unit % unitsPerLine, unitY = unit / unitsPerLine;
+				for (JpegComponent* component : scan)
+				{
+					unsigned blocksH = interleaved ? component->h : 1;
+					unsigned blocksV = interleaved ? component->v : 1;
+					const uint16_t* quant = quantTables[component->quantTable];
+					for (unsigned by = 0; by < blocksV; by++)
+					{
+						for (unsigned bx = 0; bx < blocksH; bx++)
+						{
+							std::fill(coefficients, coefficients + 64, 0.0f);
+							int category = DecodeSymbol(reader, huffmanTables[component->dcTable]);
+							if (category < 0 || category > 11)
+								return false;
+							if (category)
+							{
+								int bits = reader.ReadBits((unsigned)category);
+								if (bits < 0)
+									return false;
+								component->dcPrediction += ExtendSign(bits, (unsigned)category);
+							}
+							coefficients[0] = (float)(component->dcPrediction * quant[0]);
+							for (unsigned k = 1; k < 64;)
+							{
+								int symbol = DecodeSymbol(reader, huffmanTables[4 + component->acTable]);
+								if (symbol < 0)
+									return false;
+								unsigned run = (unsigned)symbol >> 4, bitCount = (unsigned)symbol & 15;
+								if (bitCount == 0)
+								{
+									if (run != 15)
+										break; //End of block
+									k += 16;
+									continue;
+								}
+								k += run;
+								if (k > 63)
+									return false;
+								int bits = reader.ReadBits(bitCount);
+								if (bits < 0)
+									return false;
+								coefficients[zigzag[k]] = (float)(ExtendSign(bits, bitCount) * quant[k]);
+								k++;
+							}
+							size_t blockX = (size_t)unitX * blocksH + bx;
+							size_t blockY = (size_t)unitY * blocksV + by;
+							size_t stride = (size_t)component->blocksPerLine * 8;
+							InverseDCT(coefficients, &component->plane[blockY * 8 * stride + blockX * 8], stride);
+						}
+					}
+				}
+			}
+			//Skip to the next marker that is not a restart marker
+			pos += reader.pos;
+			while (pos + 1 < size && !(data[pos] == 0xFF && data[pos + 1] != 0 && (data[pos + 1] < 0xD0 || data[pos + 1] > 0xD7)))
+				pos++;
+		}
+	}
+	if (!frameSeen)
+		return false;
+
+	//Chroma planes are upsampled with linear filtering between sample centers, like libjpeg's fancy upsampling
+	rgba.resize((size_t)width * height * 4);
+	std::vector<float> samples(components.size());
+	for (unsigned y = 0; y < height; y++)
+	{
+		for (unsigned x = 0; x < width; x++)
+		{
+			for (size_t c = 0; c < components.size(); c++)
+			{
+				const JpegComponent& component = components[c];
+				size_t stride = (size_t)component.blocksPerLine * 8;
+				if (component.h == maxH && component.v == maxV)
+				{
+					samples[c] = component.plane[y * stride + x];
+					continue;
+				}
+				unsigned planeWidth = (width * component.h + maxH - 1) / maxH;
+				unsigned planeHeight = (height * component.v + maxV - 1) / maxV;
+				float sx = (std::max)(0.0f, (x + 0.5f) * component.h / maxH - 0.5f);
+				float sy = (std::max)(0.0f, (y + 0.5f) * component.v / maxV - 0.5f);
+				unsigned x0 = (std::min)((unsigned)sx, planeWidth - 1), y0 = (std::min)((unsigned)sy, planeHeight - 1);
+				unsigned x1 = (std::min)(x0 + 1, planeWidth - 1), y1 = (std::min)(y0 + 1, planeHeight - 1);
+				float fx = sx - x0, fy = sy - y0;
+				const uint8_t* p = component.plane.data();
+				float top = p[y0 * stride + x0] * (1.0f - fx) + p[y0 * stride + x1] * fx;
+				float bottom = p[y1 * stride + x0] * (1.0f - fx) + p[y1 * stride + x1] * fx;
+				samples[c] = top * (1.0f - fy) + bottom * fy;
+			}
+			uint8_t* out = &rgba[((size_t)y * width + x) * 4];
+			if (components.size() == 1)
+			{
+				out[0] = out[1] = out[2] = (uint8_t)std::lround(samples[0]);
+			}
+			else
+			{
+				//JFIF YCbCr
+				float luma = samples[0], cb = samples[1] - 128.0f, cr = samples[2] - 128.0f;
+				float rgb[3] = { luma + 1.402f * cr, luma - 0.344136f * cb - 0.714136f * cr, luma + 1.772f * cb };
+				for (int i = 0; i < 3; i++)
+					out[i] = (uint8_t)(std::min)(255L, (std::max)(0L, std::lround(rgb[i])));
+			}
+			out[3] = 255;
+		}
+	}
+	return true;
+}
+
+bool ReadImage(const std::string & filename, std::vector<uint8_t>& rgba, unsigned & width, unsigned & height)
+{
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+	std::vector<uint8_t> file((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+	if (file.size() >= 8 && file[0] == 0x89 && file[1] == 'P')
+		return DecodePNG(file.data(), file.size(), rgba, width, height);
+	if (file.size() >= 2 && file[0] == 0xFF && file[1] == 0xD8)
+		return DecodeJPEG(file.data(), file.size(), rgba, width, height);
+
+	std::vector<uint8_t> rgb;
+	if (!ReadPPM(filename, rgb, width, height))
+		return false;
+	rgba.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		memcpy(&rgba[i * 4], &rgb[i * 3], 3);
+		rgba[i * 4 + 3] = 255;
+	}
+	return true;
+}
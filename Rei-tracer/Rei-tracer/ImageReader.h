@@ -0,0 +1,19 @@
+#ifndef _IMAGE_READER_H_
+#define _IMAGE_READER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//Decoders for the texture files the scenes reference, so they load without WIC. All of them return tightly
+//packed 8 bit rgba, top row first, with alpha 255 where the file has none.
+
+//Png of any color type and bit depth, except interlaced ones
+bool DecodePNG(const uint8_t* data, size_t size, std::vector<uint8_t>& rgba, unsigned& width, unsigned& height);
+//Baseline and extended huffman coded jpeg with 8 bit samples, grayscale or YCbCr at any chroma subsampling.
+//Progressive and arithmetic coded files are refused.
+bool DecodeJPEG(const uint8_t* data, size_t size, std::vector<uint8_t>& rgba, unsigned& width, unsigned& height);
+//Picks the decoder from the first bytes of the file, png, jpeg or binary ppm
+bool ReadImage(const std::string& filename, std::vector<uint8_t>& rgba, unsigned& width, unsigned& height);
+
+#endif
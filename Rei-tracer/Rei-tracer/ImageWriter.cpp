@@ -0,0 +1,674 @@
+#include "ImageWriter.h"
+#include "GoldenImage.h"
+#include "Parallel.h"
+#include "Png.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MAX_CHAIN 8 //Candidates looked at per position, more compresses better and slower
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define ADLER_BASE 65521U
+
+//The fixed huffman codes of deflate, stored bit reversed since deflate writes them starting at the most significant bit
+struct FixedHuffman
+{
+	uint16_t literalCodes[288];
+	uint8_t literalLengths[288];
+	uint8_t distanceCodes[30];
+	uint16_t lengthSymbols[DEFLATE_MAX_MATCH + 1]; //Match length to its length symbol
+	uint8_t distanceSymbols[DEFLATE_WINDOW + 1];   //Match distance to its distance symbol
+};
+
+static uint32_t ReverseBits(uint32_t code, unsigned length)
+{
+	uint32_t reversed = 0;
+	for (unsigned i = 0; i < length; i++)
+		reversed |= ((code >> i) & 1) << (length - 1 - i);
+	return reversed;
+}
+
+static FixedHuffman MakeFixedHuffman()
+{
+	FixedHuffman h;
+	for (unsigned s = 0; s < 288; s++)
+	{
+		unsigned code, length;
+		if (s < 144)
+			code = 0x30 + s, length = 8;
+		else if (s < 256)
+			code = 0x190 + (s - 144), length = 9;
+		else if (s < 280)
+			code = s - 256, length = 7;
+		else
+			code = 0xC0 + (s - 280), length = 8;
+		h.literalCodes[s] = (uint16_t)ReverseBits(code, length);
+		h.literalLengths[s] = (uint8_t)length;
+	}
+	for (unsigned s = 0; s < 30; s++)
+		h.distanceCodes[s] = (uint8_t)ReverseBits(s, 5);
+	//258 also fits the range of symbol 284, filling in order leaves it with 285 as deflate wants
+	for (unsigned s = 0; s < 29; s++)
+	{
+		for (unsigned l = gLengthBase[s]; l < gLengthBase[s] + (1U << gLengthExtra[s]) && l <= DEFLATE_MAX_MATCH; l++)
+			h.lengthSymbols[l] = (uint16_t)s;
+	}
+	for (unsigned s = 0; s < 30; s++)
+	{
+		for (unsigned d = gDistanceBase[s]; d < gDistanceBase[s] + (1U << gDistanceExtra[s]) && d <= DEFLATE_WINDOW; d++)
+			h.distanceSymbols[d] = (uint8_t)s;
+	}
+	return h;
+}
+
+static const FixedHuffman& GetFixedHuffman()
+{
+	static const FixedHuffman h = MakeFixedHuffman();
+	return h;
+}
+
+//Deflate writes its bits starting at the least significant bit of every byte
+struct BitWriter
+{
+	std::vector<uint8_t>& out;
+	uint64_t bits = 0;
+	unsigned count = 0;
+
+	BitWriter(std::vector<uint8_t>& out) : out(out) {}
+	void Write(uint32_t value, unsigned length)
+	{
+		bits |= (uint64_t)value << count;
+		count += length;
+		while (count >= 8)
+		{
+			out.push_back((uint8_t)bits);
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+	void Align()
+	{
+		if (count)
+			out.push_back((uint8_t)bits);
+		bits = 0;
+		count = 0;
+	}
+};
+
+static uint32_t Adler32(const uint8_t* data, size_t size)
+{
+	uint32_t a = 1, b = 0;
+	while (size)
+	{
+		//5552 is the most bytes that can be summed before b overflows
+		size_t n = (std::min)(size, (size_t)5552);
+		size -= n;
+		while (n--)
+		{
+			a += *data++;
+			b += a;
+		}
+		a %= ADLER_BASE;
+		b %= ADLER_BASE;
+	}
+	return (b << 16) | a;
+}
+
+//The adler32 of two buffers back to back from the adler32 of each, as adler32_combine does in zlib
+static uint32_t CombineAdler32(uint32_t first, uint32_t second, size_t secondSize)
+{
+	uint32_t rem = (uint32_t)(secondSize % ADLER_BASE);
+	uint32_t sum1 = first & 0xffff;
+	uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % ADLER_BASE);
+	sum1 += (second & 0xffff) + ADLER_BASE - 1;
+	sum2 += (first >> 16) + (second >> 16) + ADLER_BASE - rem;
+	if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+	if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+	if (sum2 >= ADLER_BASE * 2) sum2 -= ADLER_BASE * 2;
+	if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+	return (sum2 << 16) | sum1;
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+	static const struct CrcTable
+	{
+		uint32_t entries[256];
+		CrcTable()
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+				entries[n] = c;
+			}
+		}
+	} table;
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+//One fixed huffman block over data with greedy hash chain matching. A final block is padded to the
+//next byte, any other one is followed by an empty stored block which byte aligns it the way a zlib
+//sync flush does, so the next strip can be appended as is.
+static void DeflateStrip(const uint8_t* data, size_t size, bool final, std::vector<uint8_t>& out)
+{
+	const FixedHuffman& h = GetFixedHuffman();
+	BitWriter writer(out);
+	writer.Write(final ? 1 : 0, 1);
+	writer.Write(1, 2); //Fixed huffman codes
+
+	std::vector<int32_t> head(1 << DEFLATE_HASH_BITS, -1);
+	std::vector<int32_t> prev(size);
+	auto hash = [&](size_t i)
+	{
+		uint32_t v = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+		return (v * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+	};
+	auto insert = [&](size_t i)
+	{
+		if (i + DEFLATE_MIN_MATCH > size)
+			return;
+		uint32_t hv = hash(i);
+		prev[i] = head[hv];
+		head[hv] = (int32_t)i;
+	};
+
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t bestLength = 0;
+		size_t bestDistance = 0;
+		if (i + DEFLATE_MIN_MATCH <= size)
+		{
+			size_t maxLength = (std::min)((size_t)DEFLATE_MAX_MATCH, size - i);
+			int32_t candidate = head[hash(i)];
+			for (int chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0 && i - candidate <= DEFLATE_WINDOW; chain++)
+			{
+				const uint8_t* a = data + candidate;
+				const uint8_t* b = data + i;
+				size_t length = 0;
+				while (length < maxLength && a[length] == b[length])
+					length++;
+				if (length > bestLength)
+				{
+					bestLength = length;
+					bestDistance = i - candidate;
+					if (length == maxLength)
+						break;
+				}
+				candidate = prev[candidate];
+			}
+		}
+
+		if (bestLength >= DEFLATE_MIN_MATCH)
+		{
+			unsigned ls = h.lengthSymbols[bestLength];
+			writer.Write(h.literalCodes[257 + ls], h.literalLengths[257 + ls]);
+			writer.Write((uint32_t)(bestLength - gLengthBase[ls]), gLengthExtra[ls]);
+			unsigned ds = h.distanceSymbols[bestDistance];
+			writer.Write(h.distanceCodes[ds], 5);
+			writer.Write((uint32_t)(bestDistance - gDistanceBase[ds]), gDistanceExtra[ds]);
+			for (size_t k = 0; k < bestLength; k++)
+				insert(i + k);
+			i += bestLength;
+		}
+		else
+		{
+			writer.Write(h.literalCodes[data[i]], h.literalLengths[data[i]]);
+			insert(i);
+			i++;
+		}
+	}
+	writer.Write(h.literalCodes[256], h.literalLengths[256]); //End of block
+
+	if (!final)
+	{
+		writer.Write(0, 3); //Not final, stored
+		writer.Align();
+		const uint8_t empty[4] = { 0x00, 0x00, 0xff, 0xff };
+		out.insert(out.end(), empty, empty + 4);
+	}
+	writer.Align();
+}
+
+//Writes the filter type and the filtered row, picking the filter with the smallest sum of absolute
+//differences as the png specification suggests. previous is all zeroes for the first row.
+static void FilterRow(const uint8_t* row, const uint8_t* previous, size_t rowSize, uint8_t* out, std::vector<uint8_t>& scratch)
+{
+	const size_t bpp = 3;
+	scratch.resize(rowSize * 5);
+	uint64_t bestSum = ~0ULL;
+	int bestFilter = 0;
+	for (int filter = 0; filter < 5; filter++)
+	{
+		uint8_t* f = &scratch[filter * rowSize];
+		uint64_t sum = 0;
+		for (size_t x = 0; x < rowSize; x++)
+		{
+			int a = x >= bpp ? row[x - bpp] : 0;
+			int b = previous[x];
+			int c = x >= bpp ? previous[x - bpp] : 0;
+			int predicted = 0;
+			switch (filter)
+			{
+			case 1: predicted = a; break;
+			case 2: predicted = b; break;
+			case 3: predicted = (a + b) / 2; break;
+			case 4: predicted = Paeth(a, b, c); break;
+			}
+			f[x] = (uint8_t)(row[x] - predicted);
+			sum += (uint64_t)std::abs((int)(int8_t)f[x]);
+		}
+		if (sum < bestSum)
+		{
+			bestSum = sum;
+			bestFilter = filter;
+		}
+	}
+	out[0] = (uint8_t)bestFilter;
+	memcpy(out + 1, &scratch[bestFilter * rowSize], rowSize);
+}
+
+static void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back((uint8_t)(value >> 24));
+	out.push_back((uint8_t)(value >> 16));
+	out.push_back((uint8_t)(value >> 8));
+	out.push_back((uint8_t)value);
+}
+
+static void AppendChunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, size_t size)
+{
+	AppendBigEndian(png, (uint32_t)size);
+	size_t start = png.size();
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data, data + size);
+	AppendBigEndian(png, Crc32(&png[start], png.size() - start));
+}
+
+bool EncodePNG(const uint8_t * rgba, unsigned width, unsigned height, std::vector<uint8_t>& png)
+{
+	PROFILE_ZONE("EncodePNG");
+	if (width == 0 || height == 0)
+		return false;
+	size_t rowSize = (size_t)width * 3;
+	size_t stripCount = (height + PNG_STRIP_ROWS - 1) / PNG_STRIP_ROWS;
+	std::vector<std::vector<uint8_t>> compressed(stripCount);
+	std::vector<uint32_t> adlers(stripCount);
+
+	ParallelFor(stripCount, 1, [&](size_t begin, size_t end, unsigned)
+	{
+		std::vector<uint8_t> previous(rowSize, 0), row(rowSize), scratch, filtered;
+		for (size_t s = begin; s < end; s++)
+		{
+			unsigned firstRow = (unsigned)s * PNG_STRIP_ROWS;
+			unsigned lastRow = (std::min)(height, firstRow + PNG_STRIP_ROWS);
+			filtered.resize((rowSize + 1) * (lastRow - firstRow));
+			//The filters look at the unfiltered row above, which is in the image even for the first row of a strip
+			if (firstRow > 0)
+			{
+				const uint8_t* above = rgba + (size_t)(firstRow - 1) * width * 4;
+				for (unsigned x = 0; x < width; x++)
+					memcpy(&previous[x * 3], above + x * 4, 3);
+			}
+			else
+				std::fill(previous.begin(), previous.end(), (uint8_t)0);
+			for (unsigned y = firstRow; y < lastRow; y++)
+			{
+				const uint8_t* src = rgba + (size_t)y * width * 4;
+				for (unsigned x = 0; x < width; x++)
+					memcpy(&row[x * 3], src + x * 4, 3);
+				FilterRow(row.data(), previous.data(), rowSize, &filtered[(rowSize + 1) * (y - firstRow)], scratch);
+				row.swap(previous);
+			}
+			adlers[s] = Adler32(filtered.data(), filtered.size());
+			compressed[s].reserve(filtered.size() / 2);
+			DeflateStrip(filtered.data(), filtered.size(), s + 1 == stripCount, compressed[s]);
+		}
+	});
+
+	std::vector<uint8_t> zlib;
+	size_t zlibSize = 6;
+	for (const std::vector<uint8_t>& c : compressed)
+		zlibSize += c.size();
+	zlib.reserve(zlibSize);
+	zlib.push_back(0x78); //Deflate with a 32k window
+	zlib.push_back(0x01); //Fastest compression, makes the header a multiple of 31
+	uint32_t adler = 1;
+	for (size_t s = 0; s < stripCount; s++)
+	{
+		zlib.insert(zlib.end(), compressed[s].begin(), compressed[s].end());
+		unsigned rows = (std::min)(height - (unsigned)s * PNG_STRIP_ROWS, (unsigned)PNG_STRIP_ROWS);
+		adler = CombineAdler32(adler, adlers[s], (rowSize + 1) * rows);
+	}
+	AppendBigEndian(zlib, adler);
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	png.assign(signature, signature + 8);
+	png.reserve(zlib.size() + 64);
+	std::vector<uint8_t> header;
+	AppendBigEndian(header, width);
+	AppendBigEndian(header, height);
+	header.push_back(8); //Bits per channel
+	header.push_back(2); //Rgb
+	header.push_back(0); //Deflate
+	header.push_back(0); //Adaptive filtering
+	header.push_back(0); //Not interlaced
+	AppendChunk(png, "IHDR", header.data(), header.size());
+	AppendChunk(png, "IDAT", zlib.data(), zlib.size());
+	AppendChunk(png, "IEND", nullptr, 0);
+	return true;
+}
+
+bool WritePNG(const std::string & filename, const uint8_t * rgba, unsigned width, unsigned height)
+{
+	std::vector<uint8_t> png;
+	if (!EncodePNG(rgba, width, height, png))
+		return false;
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout)
+		return false;
+	fout.write((const char*)png.data(), png.size());
+	return (bool)fout;
+}
+
+//Rounds to the nearest half, ties to even. Too large values become infinity.
+static uint16_t FloatToHalf(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, 4);
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t absx = x & 0x7fffffff;
+	if (absx >= 0x7f800000)
+		return (uint16_t)(sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0)); //Infinity or nan
+	if (absx >= 0x477ff000)
+		return (uint16_t)(sign | 0x7c00); //Rounds past 65504
+	if (absx < 0x38800000)
+	{
+		//Subnormal, the mantissa counts steps of 2^-24
+		if (absx < 0x33000000)
+			return (uint16_t)sign;
+		uint32_t mantissa = (absx & 0x7fffff) | 0x800000;
+		unsigned shift = 126 - (absx >> 23);
+		uint32_t m = mantissa >> shift;
+		uint32_t rest = mantissa & ((1U << shift) - 1);
+		uint32_t halfway = 1U << (shift - 1);
+		if (rest > halfway || (rest == halfway && (m & 1)))
+			m++;
+		return (uint16_t)(sign | m);
+	}
+	uint32_t rounded = absx + 0x0fff + ((absx >> 13) & 1);
+	return (uint16_t)(sign | ((rounded - 0x38000000) >> 13));
+}
+
+static float HalfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	uint32_t x;
+	if (exponent == 0x1f)
+		x = sign | 0x7f800000 | (mantissa << 13); //Infinity or nan
+	else if (exponent != 0)
+		x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	else if (mantissa == 0)
+		x = sign;
+	else
+	{
+		//Subnormal, normalize the mantissa
+		exponent = 113;
+		while (!(mantissa & 0x400))
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	}
+	float f;
+	memcpy(&f, &x, 4);
+	return f;
+}
+
+static void AppendLittleEndian(std::vector<uint8_t>& out, uint64_t value, unsigned bytes)
+{
+	for (unsigned i = 0; i < bytes; i++)
+		out.push_back((uint8_t)(value >> (i * 8)));
+}
+
+static void AppendAttribute(std::vector<uint8_t>& out, const char* name, const char* type, const std::vector<uint8_t>& value)
+{
+	out.insert(out.end(), name, name + strlen(name) + 1);
+	out.insert(out.end(), type, type + strlen(type) + 1);
+	AppendLittleEndian(out, value.size(), 4);
+	out.insert(out.end(), value.begin(), value.end());
+}
+
+static uint64_t ReadLittleEndian(const uint8_t* data, unsigned bytes)
+{
+	uint64_t value = 0;
+	for (unsigned i = 0; i < bytes; i++)
+		value |= (uint64_t)data[i] << (i * 8);
+	return value;
+}
+
+bool WriteEXR(const std::string & filename, const float * rgba, unsigned width, unsigned height, bool fullFloat)
+{
+	PROFILE_ZONE("WriteEXR");
+	if (width == 0 || height == 0)
+		return false;
+
+	std::vector<uint8_t> exr;
+	AppendLittleEndian(exr, 20000630, 4); //Magic number
+	AppendLittleEndian(exr, 2, 4);        //Version 2, single part scanline
+
+	std::vector<uint8_t> value;
+	for (const char* channel : { "A", "B", "G", "R" }) //Channels are stored sorted by name
+	{
+		value.push_back((uint8_t)channel[0]);
+		value.push_back(0);
+		AppendLittleEndian(value, fullFloat ? 2 : 1, 4); //Float or half
+		AppendLittleEndian(value, 0, 4); //Not perceptually linear and three reserved bytes
+		AppendLittleEndian(value, 1, 4); //No subsampling in x or y
+		AppendLittleEndian(value, 1, 4);
+	}
+	value.push_back(0);
+	AppendAttribute(exr, "channels", "chlist", value);
+	AppendAttribute(exr, "compression", "compression", { 0 });
+	value.clear();
+	AppendLittleEndian(value, 0, 4);
+	AppendLittleEndian(value, 0, 4);
+	AppendLittleEndian(value, width - 1, 4);
+	AppendLittleEndian(value, height - 1, 4);
+	AppendAttribute(exr, "dataWindow", "box2i", value);
+	AppendAttribute(exr, "displayWindow", "box2i", value);
+	AppendAttribute(exr, "lineOrder", "lineOrder", { 0 }); //Increasing y
+	float one = 1.0f;
+	value.assign((const uint8_t*)&one, (const uint8_t*)&one + 4);
+	AppendAttribute(exr, "pixelAspectRatio", "float", value);
+	AppendAttribute(exr, "screenWindowWidth", "float", value);
+	AppendAttribute(exr, "screenWindowCenter", "v2f", std::vector<uint8_t>(8, 0));
+	exr.push_back(0); //End of the header
+
+	//The offset table points at every scanline, each one is its y, its size and then the row of every channel
+	size_t channelSize = fullFloat ? 4 : 2;
+	size_t lineSize = (size_t)width * 4 * channelSize;
+	size_t tableStart = exr.size();
+	size_t dataStart = tableStart + (size_t)height * 8;
+	for (unsigned y = 0; y < height; y++)
+		AppendLittleEndian(exr, dataStart + (size_t)y * (lineSize + 8), 8);
+	exr.resize(dataStart + (size_t)height * (lineSize + 8));
+
+	ParallelFor(height, 16, [&](size_t begin, size_t end, unsigned)
+	{
+		static const int channelOrder[4] = { 3, 2, 1, 0 }; //A, B, G, R out of rgba
+		for (size_t y = begin; y < end; y++)
+		{
+			uint8_t* line = &exr[dataStart + y * (lineSize + 8)];
+			uint32_t header[2] = { (uint32_t)y, (uint32_t)lineSize };
+			for (int i = 0; i < 8; i++)
+				line[i] = (uint8_t)(header[i / 4] >> ((i % 4) * 8));
+			uint8_t* pixels = line + 8;
+			const float* src = rgba + y * width * 4;
+			for (int c = 0; c < 4; c++)
+			{
+				for (unsigned x = 0; x < width; x++)
+				{
+					uint8_t* out = &pixels[(c * width + x) * channelSize];
+					float f = src[x * 4 + channelOrder[c]];
+					if (fullFloat)
+					{
+						uint32_t bits;
+						memcpy(&bits, &f, 4);
+						for (int i = 0; i < 4; i++)
+							out[i] = (uint8_t)(bits >> (i * 8));
+					}
+					else
+					{
+						uint16_t h = FloatToHalf(f);
+						out[0] = (uint8_t)h;
+						out[1] = (uint8_t)(h >> 8);
+					}
+				}
+			}
+		}
+	});
+
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout)
+		return false;
+	fout.write((const char*)exr.data(), exr.size());
+	return (bool)fout;
+}
+
+bool ReadEXR(const std::string & filename, std::vector<float>& rgba, unsigned & width, unsigned & height)
+{
+	PROFILE_ZONE("ReadEXR");
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+	std::vector<uint8_t> exr((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+	if (exr.size() < 8 || ReadLittleEndian(&exr[0], 4) != 20000630 || ReadLittleEndian(&exr[4], 4) != 2)
+		return false;
+
+	//Walk the attributes for the three WriteEXR makes that matter here, anything unexpected is refused
+	size_t pos = 8;
+	int pixelType = -1;
+	int64_t box[4] = { 0, 0, -1, -1 };
+	bool uncompressed = false;
+	unsigned channelCount = 0;
+	while (pos < exr.size() && exr[pos] != 0)
+	{
+		std::string name((const char*)&exr[pos], strnlen((const char*)&exr[pos], exr.size() - pos));
+		pos += name.size() + 1;
+		if (pos >= exr.size())
+			return false;
+		std::string type((const char*)&exr[pos], strnlen((const char*)&exr[pos], exr.size() - pos));
+		pos += type.size() + 1;
+		if (pos + 4 > exr.size())
+			return false;
+		size_t size = (size_t)ReadLittleEndian(&exr[pos], 4);
+		pos += 4;
+		if (pos + size > exr.size())
+			return false;
+		const uint8_t* value = &exr[pos];
+		if (name == "channels")
+		{
+			//Name, pixel type, linear flag and reserved, x and y sampling, repeated until an empty name
+			size_t c = 0;
+			while (c < size && value[c] != 0)
+			{
+				char channel = (char)value[c];
+				if (c + 18 > size || value[c + 1] != 0)
+					return false;
+				int channelType = (int)ReadLittleEndian(&value[c + 2], 4);
+				if ((pixelType != -1 && channelType != pixelType) || (channelType != 1 && channelType != 2))
+					return false;
+				if (channel != "ABGR"[channelCount])
+					return false;
+				pixelType = channelType;
+				channelCount++;
+				c += 18;
+			}
+		}
+		else if (name == "compression")
+			uncompressed = size == 1 && value[0] == 0;
+		else if (name == "dataWindow" && size == 16)
+		{
+			for (int i = 0; i < 4; i++)
+				box[i] = (int32_t)ReadLittleEndian(&value[i * 4], 4);
+		}
+		pos += size;
+	}
+	pos++;
+	if (!uncompressed || channelCount != 4 || box[0] != 0 || box[1] != 0 || box[2] < 0 || box[3] < 0)
+		return false;
+
+	width = (unsigned)(box[2] + 1);
+	height = (unsigned)(box[3] + 1);
+	size_t channelSize = pixelType == 2 ? 4 : 2;
+	size_t lineSize = (size_t)width * 4 * channelSize;
+	if (pos + (size_t)height * 8 > exr.size())
+		return false;
+	rgba.resize((size_t)width * height * 4);
+	static const int channelOrder[4] = { 3, 2, 1, 0 };
+	for (unsigned y = 0; y < height; y++)
+	{
+		size_t offset = (size_t)ReadLittleEndian(&exr[pos + (size_t)y * 8], 8);
+		if (offset + 8 + lineSize > exr.size() || ReadLittleEndian(&exr[offset], 4) != y || ReadLittleEndian(&exr[offset + 4], 4) != lineSize)
+			return false;
+		const uint8_t* pixels = &exr[offset + 8];
+		float* dst = &rgba[(size_t)y * width * 4];
+		for (int c = 0; c < 4; c++)
+		{
+			for (unsigned x = 0; x < width; x++)
+			{
+				const uint8_t* in = &pixels[(c * width + x) * channelSize];
+				float f;
+				if (channelSize == 4)
+				{
+					uint32_t bits = (uint32_t)ReadLittleEndian(in, 4);
+					memcpy(&f, &bits, 4);
+				}
+				else
+					f = HalfToFloat((uint16_t)ReadLittleEndian(in, 2));
+				dst[x * 4 + channelOrder[c]] = f;
+			}
+		}
+	}
+	return true;
+}
+
+bool WriteImage(const std::string & filename, const uint8_t * rgba, unsigned width, unsigned height)
+{
+	std::string extension = filename.substr(filename.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+	size_t pixels = (size_t)width * height;
+	if (extension == "png")
+		return WritePNG(filename, rgba, width, height);
+	if (extension == "exr")
+	{
+		std::vector<float> hdr(pixels * 4);
+		for (size_t i = 0; i < hdr.size(); i++)
+			hdr[i] = rgba[i] / 255.0f;
+		return WriteEXR(filename, hdr.data(), width, height);
+	}
+	if (extension == "ppm")
+	{
+		std::vector<uint8_t> rgb(pixels * 3);
+		for (size_t i = 0; i < pixels; i++)
+			memcpy(&rgb[i * 3], &rgba[i * 4], 3);
+		return WritePPM(filename, rgb.data(), width, height);
+	}
+	return false;
+}
@@ -0,0 +1,27 @@
+#ifndef _IMAGE_WRITER_H_
+#define _IMAGE_WRITER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//Rows per independently compressed png strip. Fixed instead of derived from the worker count so the
+//files come out byte for byte the same on every machine.
+#define PNG_STRIP_ROWS 32
+
+//Encoders for the frames ReadBackFrame and RenderToMemory return, all of them take tightly packed rgba.
+//Ppm and png drop the alpha channel.
+
+//8 bit rgb png. The rows are cut into strips that are filtered and deflated on the worker threads, each
+//strip ends on a byte boundary so the compressed strips are simply concatenated into one zlib stream.
+//Only the fixed huffman codes are used, which compresses about as well as zlib at its fastest levels.
+bool EncodePNG(const uint8_t* rgba, unsigned width, unsigned height, std::vector<uint8_t>& png);
+bool WritePNG(const std::string& filename, const uint8_t* rgba, unsigned width, unsigned height);
+//Uncompressed scanline OpenEXR with half float rgba, or 32 bit float for values that have to come back exactly
+bool WriteEXR(const std::string& filename, const float* rgba, unsigned width, unsigned height, bool fullFloat = false);
+//Reads back what WriteEXR writes, uncompressed scanline rgba of one pixel type, and refuses everything else
+bool ReadEXR(const std::string& filename, std::vector<float>& rgba, unsigned& width, unsigned& height);
+//Picks the format from the extension of filename, .ppm, .png or .exr. Exr gets the 8 bit channels as value / 255.
+bool WriteImage(const std::string& filename, const uint8_t* rgba, unsigned width, unsigned height);
+
+#endif
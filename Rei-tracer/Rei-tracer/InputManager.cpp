@@ -1,11 +1,16 @@
 #include "InputManager.h"
+#include "Platform.h"
 #include <unordered_map>
+#if REI_WINDOWED
 #include <SDL_events.h>
+#endif
 
 InputManager::InputManager()
 {
 	_curX = 0;
 	_curY = 0;
+	_relX = 0;
+	_relY = 0;
 }
 
 InputManager::~InputManager()
@@ -45,6 +50,7 @@ void InputManager::Update()
 	_pressedKeys.clear();
 	_relX = 0;
 	_relY = 0;
+#if REI_WINDOWED
 	SDL_Event ev;
 	while (SDL_PollEvent(&ev))
 	{
@@ -73,6 +79,7 @@ void InputManager::Update()
 			break;
 		}
 	}
+#endif
 	//SDL_GetMouseState(&_curX, &_curY);
 }
 
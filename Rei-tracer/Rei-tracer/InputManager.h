@@ -4,6 +4,9 @@
 #include "Structs.h"
 #include <unordered_map>
 #include <map>
+
+//Keyboard and mouse of the SDL window. Headless builds have no events, so nothing is ever pressed,
+//and Core::InitHeadless does not create one at all.
 class InputManager
 {
 public:
@@ -1,159 +1,267 @@
 #include "Core.h"
 #include <sstream>
-#include "OBJLoader.h"
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include "Scene.h"
+#include "Benchmark.h"
+#include "BatchRender.h"
+#include "MicroBenchmark.h"
+#include "GoldenImage.h"
+#include "RayKernels.h"
+#include "VectorMath.h"
+#include "Profiler.h"
+#include <stdio.h>
+#ifdef _MSC_VER
 #include <crtdbg.h>
-#include <DirectXMath.h>
+#endif
+#if REI_WINDOWED
+#include <SDL.h>
+#endif
 
-using namespace DirectX;
+using namespace VectorMath;
 
 void MovePointlight(PointLight& pl, float dt)
 {
-	XMVECTOR pos = XMVectorSet(pl.posx, pl.posy, pl.posz, 1.0f);
-	XMMATRIX rotate = XMMatrixRotationY(dt * 1.0f);
-	pos = XMVector3Transform(pos, rotate);
-	pl.posx = XMVectorGetX(pos);
-	pl.posy = XMVectorGetY(pos);
-	pl.posz = XMVectorGetZ(pos);
+	Vector pos = VectorSet(pl.posx, pl.posy, pl.posz, 1.0f);
+	Matrix rotate = MatrixRotationY(dt * 1.0f);
+	pos = Vector3Transform(pos, rotate);
+	pl.posx = VectorGetX(pos);
+	pl.posy = VectorGetY(pos);
+	pl.posz = VectorGetZ(pos);
 }
 
+//Usage: Rei-tracer [--benchmark <scene> [frames] [output.json]] [--microbench [output.json]]
+//                  [--golden [directory]] [--golden-update [directory]] [--scene <scene>]
+//                  [--triangle-test <moller|woop|watertight>] [--bvh-layout <bvh2|bvh4|bvh8|bvh8q|bvh2blocks>] [--headless]
+//                  [--render <scene> <output.ppm|png|exr> [frames]]
+//                  [--render <scene> <-|fd:n|shm:name|output.y4m|output.rgb> [frames]] [--raw] [--drop-frames]
+//                  [--passes <n>] [--tonemap <clamp|reinhard|aces>] [--exposure <f>] [--srgb] [--linear]
+//                  [--spp <1-9>] [--denoise [iterations]] [--temporal [max history]]
+//                  [--merge <output> <input.exr>...] [--trace <output.json>]
+//--headless renders on the cpu into an offscreen target, which is also what builds without a window get.
+//--golden always does, the goldens are cpu renders and Direct3D11 only gets within the tolerance of them by luck.
+//--trace records the profiler zones and writes them as a Chrome trace on exit, nothing is recorded without it.
 int main(int argc, char** argv)
 {
+#ifdef _MSC_VER
 	_CrtSetDbgFlag(_CRTDBG_LEAK_CHECK_DF | _CRTDBG_ALLOC_MEM_DF);
+#endif
+
+	bool benchmark = false;
+	BenchmarkSettings benchmarkSettings;
+	bool golden = false;
+	bool headless = false;
+	bool render = false;
+	RenderSettings renderSettings;
+	bool merge = false;
+	std::string mergeOutput;
+	std::vector<std::string> mergeInputs;
+	GoldenSettings goldenSettings;
+	std::string sceneName = "room";
+	TriangleTest triangleTest = SCENE_TRIANGLE_TEST;
+	BVHLayout bvhLayout = SCENE_BVH_LAYOUT;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--benchmark" && i + 1 < argc)
+		{
+			benchmark = true;
+			benchmarkSettings.scene = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				benchmarkSettings.frames = (unsigned)std::stoul(argv[++i]);
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				benchmarkSettings.output = argv[++i];
+		}
+		else if (arg == "--render" && i + 2 < argc)
+		{
+			render = true;
+			renderSettings.scene = argv[++i];
+			renderSettings.output = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				renderSettings.frames = (unsigned)std::stoul(argv[++i]);
+		}
+		else if (arg == "--passes" && i + 1 < argc)
+		{
+			renderSettings.passes = (std::max)(1U, (unsigned)std::stoul(argv[++i]));
+		}
+		else if (arg == "--tonemap" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			for (int t = 0; t < TONEMAP_COUNT; t++)
+			{
+				if (name == GetToneMapName((ToneMapOperator)t))
+					renderSettings.toneMap.op = (ToneMapOperator)t;
+			}
+		}
+		else if (arg == "--exposure" && i + 1 < argc)
+		{
+			renderSettings.toneMap.exposure = std::stof(argv[++i]);
+		}
+		else if (arg == "--srgb")
+		{
+			renderSettings.toneMap.srgb = true;
+		}
+		else if (arg == "--spp" && i + 1 < argc)
+		{
+			renderSettings.samples = (unsigned)std::stoul(argv[++i]);
+		}
+		else if (arg == "--denoise")
+		{
+			renderSettings.denoise.enabled = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				renderSettings.denoise.iterations = (unsigned)std::stoul(argv[++i]);
+		}
+		else if (arg == "--temporal")
+		{
+			renderSettings.temporal.enabled = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				renderSettings.temporal.maxHistory = (std::max)(1.0f, std::stof(argv[++i]));
+		}
+		else if (arg == "--linear")
+		{
+			renderSettings.linear = true;
+		}
+		else if (arg == "--merge" && i + 2 < argc)
+		{
+			merge = true;
+			mergeOutput = argv[++i];
+			while (i + 1 < argc && argv[i + 1][0] != '-')
+				mergeInputs.push_back(argv[++i]);
+		}
+		else if (arg == "--raw")
+		{
+			renderSettings.stream.format = FRAME_FORMAT_RGB;
+		}
+		else if (arg == "--drop-frames")
+		{
+			renderSettings.stream.dropWhenFull = true;
+		}
+		else if (arg == "--trace" && i + 1 < argc)
+		{
+#if PROFILER_ENABLED
+			Profiler::GetInstance()->SetTraceFile(argv[++i]);
+#else
+			printf("Built with PROFILER_ENABLED 0, no trace is written\n");
+			i++;
+#endif
+		}
+		else if (arg == "--microbench")
+		{
+			//Cpu only, runs without creating the window or device
+			MicroBenchmarkSettings microSettings;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				microSettings.output = argv[++i];
+			return RunMicroBenchmarks(microSettings);
+		}
+		else if (arg == "--golden" || arg == "--golden-update")
+		{
+			golden = true;
+			goldenSettings.update = arg == "--golden-update";
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				goldenSettings.directory = argv[++i];
+		}
+		else if (arg == "--headless")
+		{
+			headless = true;
+		}
+		else if (arg == "--scene" && i + 1 < argc)
+		{
+			sceneName = argv[++i];
+		}
+		else if (arg == "--triangle-test" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			for (int t = 0; t < TRIANGLE_TEST_COUNT; t++)
+			{
+				if (name == GetTriangleTestName((TriangleTest)t))
+					triangleTest = (TriangleTest)t;
+			}
+		}
+		else if (arg == "--bvh-layout" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)std::toupper((unsigned char)c); });
+			for (int l = 0; l < BVH_LAYOUT_COUNT; l++)
+			{
+				std::string layoutName = GetBVHLayoutName((BVHLayout)l);
+				std::transform(layoutName.begin(), layoutName.end(), layoutName.begin(), [](char c) { return (char)std::toupper((unsigned char)c); });
+				if (name == layoutName)
+					bvhLayout = (BVHLayout)l;
+			}
+		}
+	}
+
+	//Only files are involved, so the tone mapping flags can come before or after --merge
+	if (merge)
+		return RunMerge(mergeOutput, mergeInputs, renderSettings.toneMap);
 
 	Core::CreateInstance();
 	Core* core = Core::GetInstance();
-	core->Init(384, 384, false);
+	if (headless || golden)
+		core->InitHeadless(384, 384);
+	else
+		core->Init(384, 384, false, golden || render);
+
+	if (benchmark)
+	{
+		benchmarkSettings.triangleTest = triangleTest;
+		benchmarkSettings.bvhLayout = bvhLayout;
+		int result = RunBenchmark(benchmarkSettings);
+		Core::ShutDown();
+		return result;
+	}
+	if (render)
+	{
+		renderSettings.triangleTest = triangleTest;
+		renderSettings.bvhLayout = bvhLayout;
+		int result = RunBatchRender(renderSettings);
+		Core::ShutDown();
+		return result;
+	}
+	if (golden)
+	{
+		int result = RunGoldenTests(goldenSettings);
+		Core::ShutDown();
+		return result;
+	}
+
 	InputManager* input = core->GetInputManager();
+	if (!input)
+	{
+		printf("Nothing to show without a window, use --benchmark, --golden or --microbench\n");
+		Core::ShutDown();
+		return 1;
+	}
+#if REI_WINDOWED
 	IGraphics* graphics = core->GetGraphics();
 	CameraManager* cam = core->GetCameraManager();
-	Window* window = core->GetWindow();
+	IWindow* window = core->GetWindow();
 	Timer* timer = core->GetTimer();
 
-	cam->AddCamera(0.0f, 1.0f, 3.0f, 0.0f, 0.0f, -1.0f, 3.14f / 2.0f, (float)window->GetWidth() / (float)window->GetHeight(), 0.0f, 1.0f, 0.0f, 1.0f, 50.0f);
-	cam->CycleActiveCamera();
-
-	Sphere spheres[5];
-	spheres[0] = Sphere(-6.0f, 0.0f, -5.0f, 1.0f);
-	spheres[1] = Sphere(0.0f, 4.0f, -5.0f, 1.0f);
-	spheres[2] = Sphere(5.0f, -8.0f, -2.5f, 1.0f);
-	spheres[3] = Sphere(8.0f, -6.0f, -3.0f, 0.3f);
-	spheres[4] = Sphere(-5.0f, 5.0f, -5.0f, 1.0f);
-	graphics->SetSpheres(spheres, 5);
-
-	OBJLoader objLoader;
-#pragma region
-	Triangle* triangles = new Triangle[MAX_TRIANGLES];
-	//Floor
-	triangles[0] = Triangle(TriangleVertex(-10, -10, 10, 0,
-		0, 1, 0, 0,
-		1, 0, 0, 0),
-		TriangleVertex(40, -10, 10, 2,
-			0, 1, 0, 0,
-			1, 0, 0, 1),
-		TriangleVertex(-10, -10, -40, 0,
-			0, 1, 0, 1,
-			1, 0, 0, 0));
-	//Roof
-	triangles[1] = Triangle(TriangleVertex(-10, 10, 10, 0,
-		0, -1, 0, 0,
-		1, 0, 0, 0),
-		TriangleVertex(-10, 10, -100, 0,
-			0, -1, 0, 1,
-			1, 0, 0, 0),
-		TriangleVertex(100, 10, 10, 1,
-			0, -1, 0, 0,
-			1, 0, 0, 0));
-	//right wall
-	triangles[2] = Triangle(TriangleVertex(-10, -10, 10, 0,
-		1, 0, 0, 0,
-		1, 0, 0, 0),
-		TriangleVertex(-10, -10, -100, 1,
-			1, 0, 0, 0,
-			0, 1, 0, 0),
-		TriangleVertex(-10, 100, 10, 0,
-			1, 0, 0, 1,
-			0, 1, 0, 0));
-	//left wall
-	triangles[3] = Triangle(TriangleVertex(10, -10, 10, 0,
-		-1, 0, 0, 0,
-		1, 0, 0, 0),
-		TriangleVertex(10, 100, 10, 0,
-			-1, 0, 0, 1,
-			0, 1, 0, 0),
-		TriangleVertex(10, -10, -100, 1,
-			-1, 0, 0, 0,
-			0, 1, 0, 0)
-		);
-	//back wall
-	triangles[4] = Triangle(
-		TriangleVertex(-50, -10, -10, 0,
-			0, 0, 1, 0,
-			1, 0, 0, 0),
-		TriangleVertex(100, -10, -10, 1,
-			0, 0, 1, 0,
-			0, 1, 0, 0),
-		TriangleVertex(100, 100, -10, 0,
-			0, 0, 1, 1,
-			0, 1, 0, 0));
-	//Front wall
-	triangles[5] = Triangle(
-		TriangleVertex(100, -10, 10, 0,
-			0, 0, -1, 0,
-			-1, 0, 0, 0),
-		TriangleVertex(-100, -10, 10, 0,
-			0, 0, -1, 1,
-			-1, 0, 0, 0),
-		TriangleVertex(100, 100, 10, 1,
-			0, 0, -1, 0,
-			-1, 0, 0, 0));
-#pragma endregion
-	unsigned trianglesAdded = objLoader.LoadOBJ("cube.obj", &triangles[6], MAX_TRIANGLES - 6);
-	unsigned tadd2 = objLoader.LoadOBJ("sphere2.obj", &triangles[6 + trianglesAdded], MAX_TRIANGLES - 6 - trianglesAdded);
-
-	unsigned nodecount;
-	OctNode* tree = nullptr;
-	objLoader.PartitionMesh(&triangles[6 + trianglesAdded], tadd2, 6 + trianglesAdded, &tree, 1, nodecount, MAX_TRIANGLES - 6 - trianglesAdded - tadd2);
-
-	MeshIndices mi[2];
-	mi[0].lowerIndex = 0;
-	mi[0].upperIndex = 6 + trianglesAdded;
-	mi[0].rootPartition = -1;
-	mi[0].partitionCount = -1;
-	mi[1].lowerIndex = 6 + trianglesAdded;
-	mi[1].upperIndex = 6 + trianglesAdded + tadd2;
-	mi[1].rootPartition = 0;
-	mi[1].partitionCount = nodecount;
-
-	graphics->SetMeshPartitions(tree, mi, nodecount, 2);
-	
-	graphics->SetTriangles(triangles, 6 + trianglesAdded + tadd2);
-	graphics->PrepareTextures(0, 0, "ft_stone01_c.png", "ft_stone01_n.png");
-	graphics->PrepareTextures(6, 6 + trianglesAdded - 1, "ft_stone01_c.png", "ft_stone01_n.png");
-	graphics->PrepareTextures(6 + trianglesAdded, 6 + trianglesAdded + tadd2, "lunarrock_s.png", "lunarrock_n.png");
-	graphics->SetTextures();
+	Scene scene;
+	scene.SetTriangleTest(triangleTest);
+	scene.SetBVHLayout(bvhLayout);
+	if (!scene.Load(sceneName))
+	{
+		Core::ShutDown();
+		return 1;
+	}
+	scene.Upload(graphics);
 
+	Camera c = scene.GetCamera((float)window->GetWidth() / (float)window->GetHeight());
+	cam->AddCamera(c.position.x, c.position.y, c.position.z, c.forward.x, c.forward.y, c.forward.z,
+		c.fov, c.aspectRatio, c.up.x, c.up.y, c.up.z, c.nearPlane, c.farPlane);
+	cam->CycleActiveCamera();
 
-	int pointLightCount = 5;
-	PointLight pointlights[10];
-	pointlights[3] = PointLight(-5.0f, -9.0f, -0.0f, 0.33f, 1.0f, 1.0f, 1.0f, 15.0f);
-	pointlights[4] = PointLight(-3.0f, -7.0f, -0.0f, 0.33f, 0.3f, 0.8f, 1.0f, 15.0f);
-	pointlights[5] = PointLight(2.0f, -5.0f, -0.0f, 0.33f, 1.0f, 0.6f, 1.0f, 15.0f);
-	pointlights[6] = PointLight(4.0f, -3.0f, -0.0f, 0.33f, 0.5f, 0.9f, 1.0f, 15.0f);
-	pointlights[7] = PointLight(-9.0f, -1.0f, -0.0f, 0.33f, 0.8f, 0.2f, 1.0f, 15.0f);
-	pointlights[8] = PointLight(7.0f, 1.0f, -0.0f, 0.33f, 1.0f, 0.7f, 0.5f, 15.0f);
-	pointlights[9] = PointLight(3.0f, 3.0f, -0.0f, 0.33f, 0.3f, 0.7f, 0.2f, 15.0f);
-	pointlights[0] = PointLight(8.0f, 5.0f, -0.0f, 0.33f, 0.6f, 0.7f, 0.8f, 15.0f);
-	pointlights[1] = PointLight(-9.0f, 7.0f, -0.0f, 0.33f, 0.7f, 0.9f, 0.0f, 15.0f);
-	pointlights[2] = PointLight(-5.0f, 9.0f, -0.0f, 0.33f, 0.2f, 0.1f, 0.9f, 15.0f);
-	graphics->SetPointLights(pointlights, pointLightCount);
+	std::vector<PointLight> pointlights = scene.GetPointLights();
+	int pointLightCount = (int)scene.GetActivePointLightCount();
 
-	SpotLight spotlights[10];
-	spotlights[0] = SpotLight(-2.0f, 0.0f, 2.0f, 0.70f,
-		1.0f, 1.0f, 1.0f, 20.0f,
-		0.7071f, 0.0f, -0.7071f, 9.0f);
-	graphics->SetSpotLights(spotlights, 1);
-	graphics->SetBounceCount(0);
+	graphics->SetSamplesPerPixel(renderSettings.samples);
+	graphics->SetTemporal(renderSettings.temporal);
 
+	bool animate = false;
+	float animationTime = 0.0f;
 	float dt = 0.0f;
 	while (!input->IsKeyDown(SDLK_ESCAPE))
 	{
@@ -183,20 +291,42 @@ int main(int argc, char** argv)
 			for (int i = 0; i < pointLightCount; i++)
 			{
 				MovePointlight(pointlights[i], dt);
+				graphics->UpdatePointLight(i, pointlights[i]);
 			}
-			graphics->SetPointLights(&pointlights[0], pointLightCount);
 		}
+		//Changing the number of lights needs a full upload, moving them only sends what changed
 		if (input->WasKeyPressed(SDLK_l))
-			pointLightCount = min(pointLightCount + 1, 10);
+		{
+			pointLightCount = (std::min)(pointLightCount + 1, (int)pointlights.size());
+			graphics->SetPointLights(&pointlights[0], pointLightCount);
+		}
 		if (input->WasKeyPressed(SDLK_k))
-			pointLightCount = max(pointLightCount - 1, 0);
+		{
+			pointLightCount = (std::max)(pointLightCount - 1, 0);
+			graphics->SetPointLights(&pointlights[0], pointLightCount);
+		}
+		if (input->WasKeyPressed(SDLK_h))
+			graphics->DumpRayStatsHeatmap("heatmap.ppm");
+		//Keeps what earlier frames traced while the camera moves, with the settings of --temporal
+		if (input->WasKeyPressed(SDLK_t))
+		{
+			renderSettings.temporal.enabled = !renderSettings.temporal.enabled;
+			graphics->SetTemporal(renderSettings.temporal);
+		}
+		//Deforms the meshes every frame, their bvhs are refit instead of rebuilt
+		if (input->WasKeyPressed(SDLK_j))
+			animate = !animate;
+		if (animate)
+		{
+			animationTime += dt;
+			scene.Animate(animationTime, graphics);
+		}
 		cam->RotateYaw(input->GetMouseXMovement() * dt *0.01f);
 		cam->RotatePitch(input->GetMouseYMovement() * dt * 0.01f);
 		core->Update();
 
 	}
-	delete[] tree;
-	delete[] triangles;
+#endif
 	Core::ShutDown();
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1076 @@
+#include "MicroBenchmark.h"
+#include "RayKernels.h"
+#include "OBJLoader.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "TriangleBlocks.h"
+#include "HardwareCounters.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cfloat>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+struct MicroMesh
+{
+	std::string name;
+	std::vector<Triangle> triangles;
+	std::vector<OctNode> nodes;
+	MeshIndices indices;
+	BVH bvh;
+	MeshIndices bvhIndices;
+	Box bounds;
+};
+
+struct MicroBuildResult
+{
+	std::string mesh;
+	unsigned triangles;
+	size_t references; //Above triangles when spatial splits put a triangle in several leaves
+	size_t nodes;
+	double buildSeconds;
+	double refitSeconds;
+	float sahCost;
+	double raysPerSecond; //Random rays
+	double restructureSeconds;
+	float restructuredSahCost;
+	double restructuredRaysPerSecond;
+};
+
+//Memory of one mesh's bvh in one layout against how fast it traverses random rays
+struct MicroLayoutResult
+{
+	std::string mesh;
+	BVHLayout layout;
+	size_t nodes;
+	size_t nodeBytes;
+	size_t indexBytes;
+	double raysPerSecond;
+};
+
+//Cache behaviour of one node order, over the random rays
+struct MicroOrderResult
+{
+	std::string mesh;
+	std::string order;
+	double raysPerSecond;
+	double simulatedMisses;                   //Per ray
+	double hardwareCounts[HW_COUNTER_COUNT];  //Per ray, negative when the counter is unavailable
+};
+
+//One triangle test through the binary bvh, with how many rays aimed right at a shared edge of the mesh got through it
+struct MicroTriangleTestResult
+{
+	std::string mesh;
+	TriangleTest test;
+	double raysPerSecond;  //Random rays
+	uint64_t differences;  //Random rays whose closest hit differs from the Moller-Trumbore one
+	uint64_t edgeRays;
+	uint64_t leaks;        //Edge rays that hit nothing
+};
+
+struct MicroResult
+{
+	std::string mesh;
+	std::string raySet;
+	std::string kernel;
+	SimdIsa isa;
+	uint64_t rays;  //A ray counts once it has been tested against every primitive
+	uint64_t tests;
+	double seconds;
+	uint64_t hits;
+	uint64_t mismatches;
+};
+
+//The standard distributions are implementation defined, this keeps the ray sets identical on every platform
+static float RandomFloat(std::mt19937& rng)
+{
+	return (rng() >> 8) * (1.0f / 16777216.0f);
+}
+
+static bool LoadMicroMesh(const std::string& filename, unsigned levels, MicroMesh& mesh)
+{
+	OBJLoader objLoader;
+	unsigned count = objLoader.LoadOBJ(filename, mesh.triangles);
+	if (count == 0)
+		return false;
+
+	count = objLoader.PartitionMesh(&mesh.triangles[0], count, 0, mesh.nodes, levels);
+	mesh.name = filename;
+	mesh.triangles.resize(count);
+
+	mesh.indices.lowerIndex = 0;
+	mesh.indices.upperIndex = (int)count;
+	mesh.indices.rootPartition = 0;
+	mesh.indices.partitionCount = (int)mesh.nodes.size();
+
+	mesh.bvh.Build(&mesh.triangles[0], 0, count);
+	mesh.bvhIndices = mesh.indices;
+	mesh.bvhIndices.partitionCount = (int)mesh.bvh.GetNodes().size();
+
+	mesh.bounds.min = MakeVec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	mesh.bounds.max = MakeVec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const Triangle& t : mesh.triangles)
+	{
+		for (const TriangleVertex* v : { &t.v1, &t.v2, &t.v3 })
+		{
+			mesh.bounds.min = MakeVec3((std::min)(mesh.bounds.min.x, v->posx), (std::min)(mesh.bounds.min.y, v->posy), (std::min)(mesh.bounds.min.z, v->posz));
+			mesh.bounds.max = MakeVec3((std::max)(mesh.bounds.max.x, v->posx), (std::max)(mesh.bounds.max.y, v->posy), (std::max)(mesh.bounds.max.z, v->posz));
+		}
+	}
+	return true;
+}
+
+//A pinhole camera in front of the mesh, neighbouring rays take nearly the same path
+static void MakeCoherentRays(const Box& bounds, unsigned count, RayStream& rays)
+{
+	unsigned side = (unsigned)std::ceil(std::sqrt((double)count));
+	Vec3 center = (bounds.min + bounds.max) * 0.5f;
+	Vec3 extent = bounds.max - bounds.min;
+	float radius = std::sqrt(Dot(extent, extent)) * 0.5f;
+	Vec3 eye = center - MakeVec3(0.0f, 0.0f, radius * 2.5f);
+
+	rays.Resize(side * side);
+	for (unsigned y = 0; y < side; y++)
+	{
+		for (unsigned x = 0; x < side; x++)
+		{
+			//Fov of about 45 degrees, wide enough to see the whole bounding sphere
+			float px = ((x + 0.5f) / side * 2.0f - 1.0f) * 0.45f;
+			float py = (1.0f - (y + 0.5f) / side * 2.0f) * 0.45f;
+			Ray r = { eye, Normalize(MakeVec3(px, py, 1.0f)) };
+			rays.Set(y * side + x, r);
+		}
+	}
+}
+
+//Origins spread over a sphere around the mesh, each aimed at a random point inside the bounds
+static void MakeRandomRays(const Box& bounds, unsigned count, std::mt19937& rng, RayStream& rays)
+{
+	Vec3 center = (bounds.min + bounds.max) * 0.5f;
+	Vec3 extent = bounds.max - bounds.min;
+	float radius = std::sqrt(Dot(extent, extent)) * 0.5f;
+
+	rays.Resize(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		float z = RandomFloat(rng) * 2.0f - 1.0f;
+		float phi = RandomFloat(rng) * 6.2831853f;
+		float s = std::sqrt((std::max)(0.0f, 1.0f - z * z));
+		Vec3 o = center + MakeVec3(s * std::cos(phi), s * std::sin(phi), z) * (radius * 2.0f);
+		Vec3 target = MakeVec3(bounds.min.x + extent.x * RandomFloat(rng),
+			bounds.min.y + extent.y * RandomFloat(rng),
+			bounds.min.z + extent.z * RandomFloat(rng));
+		Ray r = { o, Normalize(target - o) };
+		rays.Set(i, r);
+	}
+}
+
+//Runs pass once to warm the caches, then repeats it until minSeconds have passed
+template<typename Pass>
+static double TimePasses(Pass pass, double minSeconds, uint64_t& passes)
+{
+	pass();
+	passes = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	double elapsed = 0.0;
+	do
+	{
+		pass();
+		passes++;
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	} while (elapsed < minSeconds);
+	return elapsed;
+}
+
+//What the scalar inline functions return for one ray set, every ISA is compared against this
+struct KernelReference
+{
+	std::vector<float> triangleDist;          //Closest triangle per ray
+	std::vector<uint32_t> triangleHits;       //Triangles with a positive distance per ray
+	std::vector<float> sphereDist;            //Closest sphere per ray
+	std::vector<uint32_t> boxHits;            //Boxes hit per ray
+};
+
+static void ComputeReference(const RayStream& rays, const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres,
+	const std::vector<Box>& boxes, KernelReference& ref)
+{
+	ref.triangleDist.assign(rays.count, -1.0f);
+	ref.triangleHits.assign(rays.count, 0);
+	ref.sphereDist.assign(rays.count, -1.0f);
+	ref.boxHits.assign(rays.count, 0);
+	for (size_t i = 0; i < rays.count; i++)
+	{
+		Ray r = rays.Get(i);
+		Vec3 rcpDir = MakeVec3(rays.rx[i], rays.ry[i], rays.rz[i]);
+		float u = 0.0f, v = 0.0f;
+		Vec3 normal;
+		for (const Triangle& t : triangles)
+		{
+			RayVSTriangle(t, r, ref.triangleDist[i], u, v);
+			ref.triangleHits[i] += RayVSTriangleDistance(t, r) > 0.0f ? 1 : 0;
+		}
+		for (const Sphere& s : spheres)
+			RayVSSphere(s, r, ref.sphereDist[i], normal);
+		for (const Box& b : boxes)
+			ref.boxHits[i] += RayVSBox(r, rcpDir, b) ? 1 : 0;
+	}
+}
+
+static bool SameDistance(float a, float b)
+{
+	if ((a < 0.0f) != (b < 0.0f))
+		return false;
+	return a < 0.0f || std::fabs(a - b) <= 1e-4f * (std::max)(1.0f, std::fabs(b));
+}
+
+static void BenchmarkKernels(const PacketKernels& kernels, const MicroMesh& mesh, const char* raySet, const RayStream& rays,
+	const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres, const std::vector<Box>& boxes,
+	const KernelReference& ref, double minSeconds, std::vector<MicroResult>& results)
+{
+	size_t n = rays.paddedCount;
+	std::vector<float> dist(n), u(n), v(n);
+	std::vector<uint32_t> counts(n);
+	uint64_t passes = 0;
+	MicroResult result;
+	result.mesh = mesh.name;
+	result.raySet = raySet;
+	result.isa = kernels.isa;
+
+	//Closest hit over all triangles
+	{
+		auto pass = [&]()
+		{
+			std::fill(dist.begin(), dist.end(), -1.0f);
+			for (const Triangle& t : triangles)
+				for (size_t i = 0; i < n; i += kernels.width)
+					kernels.rayVsTriangle(rays, i, t, &dist[0], &u[0], &v[0]);
+		};
+		result.kernel = "RayVSTriangle";
+		result.seconds = TimePasses(pass, minSeconds, passes);
+		result.rays = passes * rays.count;
+		result.tests = result.rays * triangles.size();
+		result.hits = result.mismatches = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			result.hits += dist[i] >= 0.0f ? 1 : 0;
+			result.mismatches += SameDistance(dist[i], ref.triangleDist[i]) ? 0 : 1;
+		}
+		results.push_back(result);
+	}
+
+	//Distance only, every triangle a ray hits is counted
+	{
+		auto pass = [&]()
+		{
+			for (const Triangle& t : triangles)
+				for (size_t i = 0; i < n; i += kernels.width)
+					kernels.rayVsTriangleDistance(rays, i, t, &dist[0]);
+		};
+		result.kernel = "RayVSTriangleDistance";
+		result.seconds = TimePasses(pass, minSeconds, passes);
+		result.rays = passes * rays.count;
+		result.tests = result.rays * triangles.size();
+		std::fill(counts.begin(), counts.end(), 0);
+		for (const Triangle& t : triangles)
+		{
+			for (size_t i = 0; i < n; i += kernels.width)
+				kernels.rayVsTriangleDistance(rays, i, t, &dist[0]);
+			for (size_t i = 0; i < rays.count; i++)
+				counts[i] += dist[i] > 0.0f ? 1 : 0;
+		}
+		result.hits = result.mismatches = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			result.hits += counts[i];
+			result.mismatches += counts[i] == ref.triangleHits[i] ? 0 : 1;
+		}
+		results.push_back(result);
+	}
+
+	//Closest hit over the bounding spheres of the triangles
+	{
+		auto pass = [&]()
+		{
+			std::fill(dist.begin(), dist.end(), -1.0f);
+			for (const Sphere& s : spheres)
+				for (size_t i = 0; i < n; i += kernels.width)
+					kernels.rayVsSphere(rays, i, s, &dist[0]);
+		};
+		result.kernel = "RayVSSphere";
+		result.seconds = TimePasses(pass, minSeconds, passes);
+		result.rays = passes * rays.count;
+		result.tests = result.rays * spheres.size();
+		result.hits = result.mismatches = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			result.hits += dist[i] >= 0.0f ? 1 : 0;
+			result.mismatches += SameDistance(dist[i], ref.sphereDist[i]) ? 0 : 1;
+		}
+		results.push_back(result);
+	}
+
+	//The bounding boxes of the triangles
+	{
+		volatile unsigned sink = 0;
+		auto pass = [&]()
+		{
+			unsigned bits = 0;
+			for (const Box& b : boxes)
+				for (size_t i = 0; i < n; i += kernels.width)
+					bits |= kernels.rayVsBox(rays, i, b);
+			sink = bits;
+		};
+		result.kernel = "RayVSBox";
+		result.seconds = TimePasses(pass, minSeconds, passes);
+		result.rays = passes * rays.count;
+		result.tests = result.rays * boxes.size();
+		std::fill(counts.begin(), counts.end(), 0);
+		for (const Box& b : boxes)
+		{
+			for (size_t i = 0; i < n; i += kernels.width)
+			{
+				unsigned bits = kernels.rayVsBox(rays, i, b);
+				for (unsigned lane = 0; lane < kernels.width; lane++)
+					counts[i + lane] += bits >> lane & 1;
+			}
+		}
+		result.hits = result.mismatches = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			result.hits += counts[i];
+			result.mismatches += counts[i] == ref.boxHits[i] ? 0 : 1;
+		}
+		results.push_back(result);
+	}
+}
+
+//The binary bvh traversal with its leaves in triangle blocks, for every triangle test in every ISA that has kernels
+//for the block width. It has to find the same closest hits and occluded rays as the scalar traversal with that test.
+template<typename Block>
+static void BenchmarkTriangleBlocks(const MicroMesh& mesh, const char* raySet, const RayStream& rays, unsigned width,
+	const Block* (TriangleBlocks::*getBlocks)() const, TriangleBlockKernels<Block> PacketKernels::*member, double minSeconds, std::vector<MicroResult>& results)
+{
+	const BVHNode* nodes = &mesh.bvh.GetNodes()[0];
+	const uint32_t* triangleIndices = &mesh.bvh.GetTriangleIndices()[0];
+	std::vector<PrecomputedTriangle> precomputed(mesh.triangles.size());
+	std::vector<float> referenceDist(rays.count), blockDist(rays.count);
+	std::vector<uint8_t> referenceOccluded(rays.count), blockOccluded(rays.count);
+	for (int test = TRIANGLE_TEST_MOLLER_TRUMBORE; test < TRIANGLE_TEST_COUNT; test++)
+	{
+		for (size_t i = 0; i < mesh.triangles.size(); i++)
+			precomputed[i] = PrecomputeTriangle(mesh.triangles[i], (TriangleTest)test);
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			float u = 0.0f, v = 0.0f;
+			Ray r = rays.Get(i);
+			referenceDist[i] = -1.0f;
+			TraverseBVH(r, Reciprocal(r.d), (TriangleTest)test, &mesh.triangles[0], &precomputed[0], nodes, triangleIndices, &mesh.bvhIndices, 1,
+				referenceDist[i], u, v);
+			referenceOccluded[i] = TraverseBVHForShadows(r, Reciprocal(r.d), FLT_MAX, (TriangleTest)test, &mesh.triangles[0], &precomputed[0], nodes,
+				triangleIndices, &mesh.bvhIndices, 1) ? 1 : 0;
+		}
+
+		TriangleBlocks blocks;
+		blocks.Set(width, (TriangleTest)test, &mesh.triangles[0], nodes, mesh.bvh.GetNodes().size(), triangleIndices, &mesh.bvhIndices, 1);
+		const Block* table = (blocks.*getBlocks)();
+		std::string testName = GetTriangleTestName((TriangleTest)test);
+		testName[0] = (char)std::toupper((unsigned char)testName[0]);
+		std::string kernel = "BVHBlocks" + std::to_string(width) + testName;
+
+		uint64_t passes = 0;
+		uint64_t hits = 0;
+		MicroResult result;
+		result.mesh = mesh.name;
+		result.raySet = raySet;
+		for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++)
+		{
+			const PacketKernels* kernels = GetPacketKernels((SimdIsa)isa);
+			if (!kernels || !(kernels->*member).traverse)
+				continue;
+			const TriangleBlockKernels<Block>& k = kernels->*member;
+			result.isa = (SimdIsa)isa;
+
+			auto closest = [&]()
+			{
+				hits = 0;
+				for (size_t i = 0; i < rays.count; i++)
+				{
+					float u = 0.0f, v = 0.0f;
+					Ray r = rays.Get(i);
+					blockDist[i] = -1.0f;
+					if (k.traverse(r, Reciprocal(r.d), (TriangleTest)test, table, blocks.GetNodes(), blocks.GetMeshes(), blocks.GetMeshCount(), blockDist[i], u, v, nullptr) >= 0)
+						hits++;
+				}
+			};
+			result.kernel = kernel;
+			result.seconds = TimePasses(closest, minSeconds, passes);
+			result.rays = result.tests = passes * rays.count;
+			result.hits = hits;
+			result.mismatches = 0;
+			for (size_t i = 0; i < rays.count; i++)
+				result.mismatches += SameDistance(blockDist[i], referenceDist[i]) ? 0 : 1;
+			results.push_back(result);
+
+			auto shadows = [&]()
+			{
+				hits = 0;
+				for (size_t i = 0; i < rays.count; i++)
+				{
+					Ray r = rays.Get(i);
+					blockOccluded[i] = k.traverseShadows(r, Reciprocal(r.d), FLT_MAX, (TriangleTest)test, table, blocks.GetNodes(), blocks.GetMeshes(),
+						blocks.GetMeshCount(), nullptr) ? 1 : 0;
+					hits += blockOccluded[i];
+				}
+			};
+			result.kernel = kernel + "Shadows";
+			result.seconds = TimePasses(shadows, minSeconds, passes);
+			result.rays = result.tests = passes * rays.count;
+			result.hits = hits;
+			result.mismatches = 0;
+			for (size_t i = 0; i < rays.count; i++)
+				result.mismatches += blockOccluded[i] == referenceOccluded[i] ? 0 : 1;
+			results.push_back(result);
+		}
+	}
+}
+
+static void BenchmarkTraversal(const MicroMesh& mesh, const char* raySet, const RayStream& rays, double minSeconds, std::vector<MicroResult>& results,
+	std::vector<MicroLayoutResult>& layouts)
+{
+	uint64_t passes = 0;
+	MicroResult result;
+	result.mesh = mesh.name;
+	result.raySet = raySet;
+	result.isa = ISA_SCALAR;
+	result.mismatches = 0;
+
+	uint64_t hits = 0;
+	auto closest = [&]()
+	{
+		hits = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			float dist = -1.0f, u = 0.0f, v = 0.0f;
+			Ray r = rays.Get(i);
+			if (TraverseOctTree(r, Reciprocal(r.d), &mesh.triangles[0], &mesh.nodes[0], &mesh.indices, 1, dist, u, v) >= 0)
+				hits++;
+		}
+	};
+	result.kernel = "TraverseOctTree";
+	result.seconds = TimePasses(closest, minSeconds, passes);
+	result.rays = result.tests = passes * rays.count;
+	result.hits = hits;
+	results.push_back(result);
+
+	auto shadows = [&]()
+	{
+		hits = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			Ray r = rays.Get(i);
+			if (TraverseOctTreeForShadows(r, Reciprocal(r.d), FLT_MAX, &mesh.triangles[0], &mesh.nodes[0], &mesh.indices, 1))
+				hits++;
+		}
+	};
+	result.kernel = "TraverseOctTreeForShadows";
+	result.seconds = TimePasses(shadows, minSeconds, passes);
+	result.rays = result.tests = passes * rays.count;
+	result.hits = hits;
+	results.push_back(result);
+
+	//The bvh has to find the same closest hits as the octree
+	std::vector<float> octreeDist(rays.count, -1.0f), bvhDist(rays.count, -1.0f);
+	for (size_t i = 0; i < rays.count; i++)
+	{
+		float u = 0.0f, v = 0.0f;
+		Ray r = rays.Get(i);
+		TraverseOctTree(r, Reciprocal(r.d), &mesh.triangles[0], &mesh.nodes[0], &mesh.indices, 1, octreeDist[i], u, v);
+	}
+
+
+	const BVHNode* nodes = &mesh.bvh.GetNodes()[0];
+	const uint32_t* triangleIndices = &mesh.bvh.GetTriangleIndices()[0];
+	auto bvhClosest = [&]()
+	{
+		hits = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			float u = 0.0f, v = 0.0f;
+			Ray r = rays.Get(i);
+			bvhDist[i] = -1.0f;
+			if (TraverseBVH(r, Reciprocal(r.d), &mesh.triangles[0], nodes, triangleIndices, &mesh.bvhIndices, 1, bvhDist[i], u, v) >= 0)
+				hits++;
+		}
+	};
+	result.kernel = "TraverseBVH";
+	result.seconds = TimePasses(bvhClosest, minSeconds, passes);
+	result.rays = result.tests = passes * rays.count;
+	result.hits = hits;
+	for (size_t i = 0; i < rays.count; i++)
+		result.mismatches += SameDistance(bvhDist[i], octreeDist[i]) ? 0 : 1;
+	results.push_back(result);
+	result.mismatches = 0;
+	MicroLayoutResult layoutResult;
+	layoutResult.mesh = mesh.name;
+	layoutResult.layout = BVH_LAYOUT_BINARY;
+	layoutResult.nodes = mesh.bvh.GetNodes().size();
+	layoutResult.nodeBytes = layoutResult.nodes * sizeof(BVHNode);
+	layoutResult.indexBytes = mesh.bvh.GetTriangleIndices().size() * sizeof(uint32_t);
+	layoutResult.raysPerSecond = result.rays / result.seconds;
+	layouts.push_back(layoutResult);
+
+	auto bvhShadows = [&]()
+	{
+		hits = 0;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			Ray r = rays.Get(i);
+			if (TraverseBVHForShadows(r, Reciprocal(r.d), FLT_MAX, &mesh.triangles[0], nodes, triangleIndices, &mesh.bvhIndices, 1))
+				hits++;
+		}
+	};
+	result.kernel = "TraverseBVHForShadows";
+	result.seconds = TimePasses(bvhShadows, minSeconds, passes);
+	result.rays = result.tests = passes * rays.count;
+	result.hits = hits;
+	results.push_back(result);
+
+	//The collapsed trees have to find the same closest hits and occluded rays as the binary one
+	std::vector<uint8_t> bvhOccluded(rays.count), wideOccluded(rays.count);
+	for (size_t i = 0; i < rays.count; i++)
+	{
+		Ray r = rays.Get(i);
+		bvhOccluded[i] = TraverseBVHForShadows(r, Reciprocal(r.d), FLT_MAX, &mesh.triangles[0], nodes, triangleIndices, &mesh.bvhIndices, 1) ? 1 : 0;
+	}
+	std::vector<float> wideDist(rays.count);
+	for (BVHLayout layout : { BVH_LAYOUT_WIDE4, BVH_LAYOUT_WIDE8, BVH_LAYOUT_QUANTIZED8 })
+	{
+		WideBVH wide;
+		wide.Set(layout, nodes, mesh.bvh.GetNodes().size(), triangleIndices, mesh.bvh.GetTriangleIndices().size(), &mesh.bvhIndices, 1);
+		result.isa = GetBVHLayoutIsa(layout);
+
+		auto wideClosest = [&]()
+		{
+			hits = 0;
+			for (size_t i = 0; i < rays.count; i++)
+			{
+				float u = 0.0f, v = 0.0f;
+				Ray r = rays.Get(i);
+				wideDist[i] = -1.0f;
+				if (TraverseBVH(r, Reciprocal(r.d), &mesh.triangles[0], wide, wideDist[i], u, v) >= 0)
+					hits++;
+			}
+		};
+		result.kernel = std::string("Traverse") + GetBVHLayoutName(layout);
+		result.seconds = TimePasses(wideClosest, minSeconds, passes);
+		result.rays = result.tests = passes * rays.count;
+		result.hits = hits;
+		result.mismatches = 0;
+		for (size_t i = 0; i < rays.count; i++)
+			result.mismatches += SameDistance(wideDist[i], bvhDist[i]) ? 0 : 1;
+		results.push_back(result);
+		layoutResult.layout = layout;
+		layoutResult.nodes = wide.GetNodeCount();
+		layoutResult.nodeBytes = wide.GetNodeBytes();
+		layoutResult.indexBytes = wide.GetTriangleIndexBytes();
+		layoutResult.raysPerSecond = result.rays / result.seconds;
+		layouts.push_back(layoutResult);
+
+		auto wideShadows = [&]()
+		{
+			hits = 0;
+			for (size_t i = 0; i < rays.count; i++)
+			{
+				Ray r = rays.Get(i);
+				wideOccluded[i] = TraverseBVHForShadows(r, Reciprocal(r.d), FLT_MAX, &mesh.triangles[0], wide) ? 1 : 0;
+				hits += wideOccluded[i];
+			}
+		};
+		result.kernel = std::string("Traverse") + GetBVHLayoutName(layout) + "ForShadows";
+		result.seconds = TimePasses(wideShadows, minSeconds, passes);
+		result.rays = result.tests = passes * rays.count;
+		result.hits = hits;
+		result.mismatches = 0;
+		for (size_t i = 0; i < rays.count; i++)
+			result.mismatches += wideOccluded[i] == bvhOccluded[i] ? 0 : 1;
+		results.push_back(result);
+	}
+
+	BenchmarkTriangleBlocks(mesh, raySet, rays, 4, &TriangleBlocks::GetBlocks4, &PacketKernels::blocks4, minSeconds, results);
+	BenchmarkTriangleBlocks(mesh, raySet, rays, 8, &TriangleBlocks::GetBlocks8, &PacketKernels::blocks8, minSeconds, results);
+	BenchmarkTriangleBlocks(mesh, raySet, rays, 16, &TriangleBlocks::GetBlocks16, &PacketKernels::blocks16, minSeconds, results);
+}
+
+//Set associative LRU model of an L1 data cache, counting the lines a traversal has to fetch.
+//It stands in for the hardware counters where those are closed and only sees the memory the traversal reads.
+#define SIMULATED_CACHE_LINE 64
+#define SIMULATED_CACHE_SETS 64
+#define SIMULATED_CACHE_WAYS 8
+
+//Addresses are offsets into one of a few tables, each starting on a line the way the gpu buffers do,
+//so the misses don't depend on where the heap happened to put the vectors
+enum SimulatedTable
+{
+	SIMULATED_NODES,
+	SIMULATED_TRIANGLE_INDICES,
+	SIMULATED_TRIANGLES
+};
+
+struct SimulatedCache
+{
+	uint64_t tags[SIMULATED_CACHE_SETS][SIMULATED_CACHE_WAYS]; //Most recently used first
+	uint64_t misses = 0;
+
+	SimulatedCache() { memset(tags, 0xff, sizeof(tags)); }
+	void Touch(SimulatedTable table, size_t offset)
+	{
+		uint64_t line = ((uint64_t)table << 48) + offset / SIMULATED_CACHE_LINE;
+		uint64_t* set = tags[line % SIMULATED_CACHE_SETS];
+		int way = 0;
+		while (way < SIMULATED_CACHE_WAYS - 1 && set[way] != line)
+			way++;
+		misses += set[way] == line ? 0 : 1;
+		for (; way > 0; way--)
+			set[way] = set[way - 1];
+		set[0] = line;
+	}
+};
+
+//TraverseBVH for a single mesh, telling the cache about every node, index and vertex it reads
+static void TraverseBVHThroughCache(const Ray& r, const Vec3& rcpDir, const Triangle* triangles, const BVHNode* nodes, const uint32_t* triangleIndices,
+	int root, SimulatedCache& cache)
+{
+	float dist = -1.0f, u = 0.0f, v = 0.0f;
+	int stack[BVH_MAX_DEPTH + 1];
+	int stackPtr = 0;
+	stack[stackPtr++] = root;
+	while (stackPtr)
+	{
+		int index = stack[--stackPtr];
+		const BVHNode& node = nodes[index];
+		cache.Touch(SIMULATED_NODES, index * sizeof(BVHNode));
+		if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+			continue;
+		if (node.count == 0)
+		{
+			stack[stackPtr++] = node.leftFirst + 1;
+			stack[stackPtr++] = node.leftFirst;
+		}
+		for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+		{
+			const Triangle& t = triangles[triangleIndices[c]];
+			size_t offset = triangleIndices[c] * sizeof(Triangle);
+			cache.Touch(SIMULATED_TRIANGLE_INDICES, c * sizeof(uint32_t));
+			cache.Touch(SIMULATED_TRIANGLES, offset + offsetof(Triangle, v1));
+			cache.Touch(SIMULATED_TRIANGLES, offset + offsetof(Triangle, v2));
+			cache.Touch(SIMULATED_TRIANGLES, offset + offsetof(Triangle, v3));
+			RayVSTriangle(t, r, dist, u, v);
+		}
+	}
+}
+
+//Lays the same tree out in every node order, sorting the triangles to match each time, and measures the random rays
+//against a breadth first layout over the triangles as loaded, which is how the octrees were stored
+static void BenchmarkNodeOrders(const MicroMesh& mesh, const RayStream& rays, double minSeconds, std::vector<MicroOrderResult>& orders)
+{
+	HardwareCounters counters;
+	for (int o = -1; o < BVH_ORDER_COUNT; o++)
+	{
+		BVH bvh = mesh.bvh;
+		std::vector<Triangle> triangles = mesh.triangles;
+		MicroOrderResult result;
+		result.mesh = mesh.name;
+		if (o < 0)
+		{
+			bvh.Reorder(BVH_ORDER_BREADTH_FIRST);
+			result.order = "breadth first, unsorted";
+		}
+		else
+		{
+			bvh.Reorder((BVHNodeOrder)o);
+			bvh.SortTriangles(&triangles[0]);
+			result.order = GetBVHNodeOrderName((BVHNodeOrder)o);
+		}
+		const BVHNode* nodes = &bvh.GetNodes()[0];
+		const uint32_t* triangleIndices = &bvh.GetTriangleIndices()[0];
+
+		auto pass = [&]()
+		{
+			for (size_t i = 0; i < rays.count; i++)
+			{
+				float dist = -1.0f, u = 0.0f, v = 0.0f;
+				Ray r = rays.Get(i);
+				TraverseBVH(r, Reciprocal(r.d), &triangles[0], nodes, triangleIndices, &mesh.bvhIndices, 1, dist, u, v);
+			}
+		};
+		uint64_t passes = 0;
+		double seconds = TimePasses(pass, minSeconds, passes);
+		result.raysPerSecond = passes * rays.count / seconds;
+
+		counters.Start();
+		pass();
+		counters.Stop();
+		for (int c = 0; c < HW_COUNTER_COUNT; c++)
+			result.hardwareCounts[c] = counters.IsAvailable((HardwareCounter)c) ? (double)counters.Get((HardwareCounter)c) / rays.count : -1.0;
+
+		SimulatedCache cache;
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			Ray r = rays.Get(i);
+			TraverseBVHThroughCache(r, Reciprocal(r.d), &triangles[0], nodes, triangleIndices, 0, cache);
+		}
+		result.simulatedMisses = (double)cache.misses / rays.count;
+		orders.push_back(result);
+	}
+}
+
+static double TimeBVHTraversal(const BVH& bvh, const MicroMesh& mesh, const RayStream& rays, double minSeconds)
+{
+	MeshIndices indices = mesh.bvhIndices;
+	indices.partitionCount = (int)bvh.GetNodes().size();
+	uint64_t passes = 0;
+	double seconds = TimePasses([&]()
+	{
+		for (size_t i = 0; i < rays.count; i++)
+		{
+			float dist = -1.0f, u = 0.0f, v = 0.0f;
+			Ray r = rays.Get(i);
+			TraverseBVH(r, Reciprocal(r.d), &mesh.triangles[0], &bvh.GetNodes()[0], &bvh.GetTriangleIndices()[0], &indices, 1, dist, u, v);
+		}
+	}, minSeconds, passes);
+	return passes * rays.count / seconds;
+}
+
+static bool FacesRay(const Triangle& t, const Vec3& d)
+{
+	return Dot(Cross(Position(t.v2) - Position(t.v1), Position(t.v3) - Position(t.v1)), d) < 0.0f;
+}
+
+//Origins spread over a sphere around the mesh like MakeRandomRays, each aimed at a point on an edge whose two triangles
+//both face the ray. Such a ray crosses the surface right there, so unless the triangle test leaves a crack it hits something.
+static void MakeEdgeRays(const MicroMesh& mesh, unsigned count, std::mt19937& rng, RayStream& rays)
+{
+	Vec3 center = (mesh.bounds.min + mesh.bounds.max) * 0.5f;
+	Vec3 extent = mesh.bounds.max - mesh.bounds.min;
+	float radius = std::sqrt(Dot(extent, extent)) * 0.5f;
+
+	//Every directed edge with its triangle, the neighbour across an edge has it the other way around
+	typedef std::array<float, 6> Edge;
+	std::map<Edge, size_t> edges;
+	for (size_t i = 0; i < mesh.triangles.size(); i++)
+	{
+		const TriangleVertex* v[] = { &mesh.triangles[i].v1, &mesh.triangles[i].v2, &mesh.triangles[i].v3 };
+		for (int e = 0; e < 3; e++)
+			edges[{ { v[e]->posx, v[e]->posy, v[e]->posz, v[(e + 1) % 3]->posx, v[(e + 1) % 3]->posy, v[(e + 1) % 3]->posz } }] = i;
+	}
+
+	std::vector<Ray> accepted;
+	for (size_t attempt = 0; accepted.size() < count && attempt < (size_t)count * 64; attempt++)
+	{
+		float z = RandomFloat(rng) * 2.0f - 1.0f;
+		float phi = RandomFloat(rng) * 6.2831853f;
+		float s = std::sqrt((std::max)(0.0f, 1.0f - z * z));
+		Vec3 o = center + MakeVec3(s * std::cos(phi), s * std::sin(phi), z) * (radius * 2.0f);
+		const Triangle& t = mesh.triangles[rng() % mesh.triangles.size()];
+		const TriangleVertex* v[] = { &t.v1, &t.v2, &t.v3 };
+		int e = (int)(rng() % 3);
+		const TriangleVertex* a = v[e];
+		const TriangleVertex* b = v[(e + 1) % 3];
+		auto neighbour = edges.find({ { b->posx, b->posy, b->posz, a->posx, a->posy, a->posz } });
+		if (neighbour == edges.end())
+			continue; //An open edge
+		Vec3 target = Position(*a) + (Position(*b) - Position(*a)) * RandomFloat(rng);
+		Ray r = { o, Normalize(target - o) };
+		if (FacesRay(t, r.d) && FacesRay(mesh.triangles[neighbour->second], r.d))
+			accepted.push_back(r);
+	}
+	rays.Resize(accepted.size());
+	for (size_t i = 0; i < accepted.size(); i++)
+		rays.Set(i, accepted[i]);
+}
+
+static void BenchmarkTriangleTests(const MicroMesh& mesh, const RayStream& rays, const RayStream& edgeRays, double minSeconds,
+	std::vector<MicroTriangleTestResult>& tests)
+{
+	const BVHNode* nodes = &mesh.bvh.GetNodes()[0];
+	const uint32_t* triangleIndices = &mesh.bvh.GetTriangleIndices()[0];
+	std::vector<PrecomputedTriangle> precomputed(mesh.triangles.size());
+	std::vector<float> reference(rays.count), dist(rays.count);
+	for (int test = TRIANGLE_TEST_MOLLER_TRUMBORE; test < TRIANGLE_TEST_COUNT; test++)
+	{
+		for (size_t i = 0; i < mesh.triangles.size(); i++)
+			precomputed[i] = PrecomputeTriangle(mesh.triangles[i], (TriangleTest)test);
+
+		uint64_t passes = 0;
+		double seconds = TimePasses([&]()
+		{
+			for (size_t i = 0; i < rays.count; i++)
+			{
+				float u = 0.0f, v = 0.0f;
+				Ray r = rays.Get(i);
+				dist[i] = -1.0f;
+				TraverseBVH(r, Reciprocal(r.d), (TriangleTest)test, &mesh.triangles[0], &precomputed[0], nodes, triangleIndices, &mesh.bvhIndices, 1, dist[i], u, v);
+			}
+		}, minSeconds, passes);
+		if (test == TRIANGLE_TEST_MOLLER_TRUMBORE)
+			reference = dist;
+
+		MicroTriangleTestResult result;
+		result.mesh = mesh.name;
+		result.test = (TriangleTest)test;
+		result.raysPerSecond = passes * rays.count / seconds;
+		result.differences = 0;
+		for (size_t i = 0; i < rays.count; i++)
+			result.differences += SameDistance(dist[i], reference[i]) ? 0 : 1;
+		result.edgeRays = edgeRays.count;
+		result.leaks = 0;
+		for (size_t i = 0; i < edgeRays.count; i++)
+		{
+			float edgeDist = -1.0f, u = 0.0f, v = 0.0f;
+			Ray r = edgeRays.Get(i);
+			if (TraverseBVH(r, Reciprocal(r.d), (TriangleTest)test, &mesh.triangles[0], &precomputed[0], nodes, triangleIndices, &mesh.bvhIndices, 1, edgeDist, u, v) < 0)
+				result.leaks++;
+		}
+		tests.push_back(result);
+	}
+}
+
+//A full build against a refit of the unchanged triangles, the per frame cost of an animated mesh,
+//and what restructuring the built tree within restructureSeconds gains for a static one
+static MicroBuildResult BenchmarkBVHBuild(MicroMesh& mesh, const RayStream& rays, double minSeconds, double restructureSeconds)
+{
+	MicroBuildResult result;
+	result.mesh = mesh.name;
+	result.triangles = (unsigned)mesh.triangles.size();
+	uint64_t passes = 0;
+	result.buildSeconds = TimePasses([&]() { mesh.bvh.Build(&mesh.triangles[0], 0, result.triangles); }, minSeconds, passes) / passes;
+	result.nodes = mesh.bvh.GetNodes().size();
+	result.references = mesh.bvh.GetTriangleIndices().size();
+	result.sahCost = mesh.bvh.GetSAHCost();
+	result.refitSeconds = TimePasses([&]() { mesh.bvh.Refit(&mesh.triangles[0]); }, minSeconds, passes) / passes;
+	//A refit loosens the leaves a spatial split clipped, leave the built tree behind for whoever runs next
+	mesh.bvh.Build(&mesh.triangles[0], 0, result.triangles);
+	result.raysPerSecond = TimeBVHTraversal(mesh.bvh, mesh, rays, minSeconds);
+
+	BVH restructured = mesh.bvh;
+	auto start = std::chrono::steady_clock::now();
+	result.restructuredSahCost = restructured.Restructure(restructureSeconds);
+	result.restructureSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.restructuredRaysPerSecond = TimeBVHTraversal(restructured, mesh, rays, minSeconds);
+	return result;
+}
+
+int RunMicroBenchmarks(const MicroBenchmarkSettings & settings)
+{
+	PROFILE_ZONE("RunMicroBenchmarks");
+	const char* meshFiles[] = { "cube.obj", "Sphere0.obj", "Sphere1.obj", "Sphere2.obj", "Sphere3.obj", "torus.obj", "Raptor.obj" };
+
+	std::vector<const PacketKernels*> isas;
+	for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++)
+	{
+		const PacketKernels* kernels = GetPacketKernels((SimdIsa)isa);
+		if (kernels)
+			isas.push_back(kernels);
+	}
+
+	std::mt19937 rng(settings.seed);
+	std::vector<MicroResult> results;
+	std::vector<MicroBuildResult> builds;
+	std::vector<MicroLayoutResult> layouts;
+	std::vector<MicroOrderResult> orders;
+	std::vector<MicroTriangleTestResult> triangleTests;
+	for (const char* file : meshFiles)
+	{
+		MicroMesh mesh;
+		if (!LoadMicroMesh(file, settings.octreeLevels, mesh))
+		{
+			std::cerr << "Failed to load " << file << std::endl;
+			return 1;
+		}
+
+		//An evenly strided subset so big meshes keep the kernel timings short
+		std::vector<Triangle> triangles;
+		size_t stride = (mesh.triangles.size() + settings.maxPrimitives - 1) / settings.maxPrimitives;
+		for (size_t i = 0; i < mesh.triangles.size(); i += (std::max)((size_t)1, stride))
+			triangles.push_back(mesh.triangles[i]);
+
+		std::vector<Sphere> spheres;
+		std::vector<Box> boxes;
+		for (const Triangle& t : triangles)
+		{
+			Vec3 p[] = { Position(t.v1), Position(t.v2), Position(t.v3) };
+			Box b;
+			b.min = MakeVec3((std::min)({ p[0].x, p[1].x, p[2].x }), (std::min)({ p[0].y, p[1].y, p[2].y }), (std::min)({ p[0].z, p[1].z, p[2].z }));
+			b.max = MakeVec3((std::max)({ p[0].x, p[1].x, p[2].x }), (std::max)({ p[0].y, p[1].y, p[2].y }), (std::max)({ p[0].z, p[1].z, p[2].z }));
+			boxes.push_back(b);
+
+			Vec3 c = (p[0] + p[1] + p[2]) * (1.0f / 3.0f);
+			float r2 = 0.0f;
+			for (const Vec3& q : p)
+				r2 = (std::max)(r2, Dot(q - c, q - c));
+			spheres.push_back(Sphere(c.x, c.y, c.z, std::sqrt(r2)));
+		}
+
+		RayStream coherent, random;
+		MakeCoherentRays(mesh.bounds, settings.rays, coherent);
+		MakeRandomRays(mesh.bounds, settings.rays, rng, random);
+		struct { const char* name; const RayStream* rays; } raySets[] = { { "coherent", &coherent }, { "random", &random } };
+
+		for (auto& set : raySets)
+		{
+			KernelReference ref;
+			ComputeReference(*set.rays, triangles, spheres, boxes, ref);
+			for (const PacketKernels* kernels : isas)
+				BenchmarkKernels(*kernels, mesh, set.name, *set.rays, triangles, spheres, boxes, ref, settings.minSeconds, results);
+			//Only the random rays go into the layout table, coherent ones hardly ever miss the cache
+			std::vector<MicroLayoutResult> setLayouts;
+			BenchmarkTraversal(mesh, set.name, *set.rays, settings.minSeconds, results, setLayouts);
+			if (set.rays == &random)
+				layouts.insert(layouts.end(), setLayouts.begin(), setLayouts.end());
+		}
+		BenchmarkNodeOrders(mesh, random, settings.minSeconds, orders);
+		RayStream edgeRays;
+		MakeEdgeRays(mesh, settings.rays, rng, edgeRays);
+		BenchmarkTriangleTests(mesh, random, edgeRays, settings.minSeconds, triangleTests);
+		builds.push_back(BenchmarkBVHBuild(mesh, random, settings.minSeconds, settings.restructureSeconds));
+	}
+
+	std::cout << std::left << std::setw(13) << "mesh" << std::setw(10) << "rays" << std::setw(27) << "kernel" << std::setw(8) << "isa"
+		<< std::right << std::setw(11) << "ns/test" << std::setw(14) << "Mrays/s" << std::setw(10) << "hits" << std::setw(12) << "mismatches" << std::endl;
+	std::cout << std::fixed;
+	uint64_t totalMismatches = 0;
+	for (const MicroResult& r : results)
+	{
+		totalMismatches += r.mismatches;
+		std::cout << std::left << std::setw(13) << r.mesh << std::setw(10) << r.raySet << std::setw(27) << r.kernel << std::setw(8) << GetSimdIsaName(r.isa)
+			<< std::right << std::setprecision(3) << std::setw(11) << r.seconds * 1e9 / r.tests << std::setw(14) << r.rays / r.seconds * 1e-6
+			<< std::setw(10) << r.hits << std::setw(12) << r.mismatches << std::endl;
+	}
+
+	std::cout << std::endl << std::left << std::setw(13) << "mesh" << std::right << std::setw(10) << "triangles" << std::setw(12) << "references" << std::setw(10) << "nodes"
+		<< std::setw(12) << "build ms" << std::setw(12) << "refit ms" << std::setw(10) << "sah" << std::setw(10) << "Mrays/s"
+		<< std::setw(14) << "restruct. ms" << std::setw(10) << "sah" << std::setw(10) << "Mrays/s" << std::endl;
+	for (const MicroBuildResult& b : builds)
+	{
+		std::cout << std::left << std::setw(13) << b.mesh << std::right << std::setw(10) << b.triangles << std::setw(12) << b.references << std::setw(10) << b.nodes
+			<< std::setprecision(3) << std::setw(12) << b.buildSeconds * 1e3 << std::setw(12) << b.refitSeconds * 1e3 << std::setw(10) << b.sahCost
+			<< std::setw(10) << b.raysPerSecond * 1e-6 << std::setw(14) << b.restructureSeconds * 1e3 << std::setw(10) << b.restructuredSahCost
+			<< std::setw(10) << b.restructuredRaysPerSecond * 1e-6 << std::endl;
+	}
+
+	std::cout << std::endl << std::left << std::setw(13) << "mesh" << std::setw(8) << "layout" << std::right << std::setw(10) << "nodes"
+		<< std::setw(12) << "node KB" << std::setw(12) << "index KB" << std::setw(14) << "bytes/tri" << std::setw(14) << "Mrays/s" << std::endl;
+	for (const MicroLayoutResult& l : layouts)
+	{
+		size_t triangles = 0;
+		for (const MicroBuildResult& b : builds)
+			triangles = b.mesh == l.mesh ? b.triangles : triangles;
+		std::cout << std::left << std::setw(13) << l.mesh << std::setw(8) << GetBVHLayoutName(l.layout) << std::right << std::setw(10) << l.nodes
+			<< std::setprecision(1) << std::setw(12) << l.nodeBytes / 1024.0 << std::setw(12) << l.indexBytes / 1024.0
+			<< std::setw(14) << (double)(l.nodeBytes + l.indexBytes) / triangles << std::setprecision(3) << std::setw(14) << l.raysPerSecond * 1e-6 << std::endl;
+	}
+
+	std::cout << std::endl << std::left << std::setw(13) << "mesh" << std::setw(25) << "node order" << std::right << std::setw(10) << "Mrays/s"
+		<< std::setw(16) << "sim L1 miss/ray";
+	for (int c = 0; c < HW_COUNTER_COUNT; c++)
+		std::cout << std::setw(18) << GetHardwareCounterName((HardwareCounter)c);
+	std::cout << std::endl;
+	for (const MicroOrderResult& o : orders)
+	{
+		std::cout << std::left << std::setw(13) << o.mesh << std::setw(25) << o.order << std::right << std::setprecision(3) << std::setw(10) << o.raysPerSecond * 1e-6
+			<< std::setprecision(1) << std::setw(16) << o.simulatedMisses;
+		for (double count : o.hardwareCounts)
+		{
+			if (count < 0.0)
+				std::cout << std::setw(18) << "n/a";
+			else
+				std::cout << std::setw(18) << count;
+		}
+		std::cout << std::endl;
+	}
+
+	std::cout << std::endl << std::left << std::setw(13) << "mesh" << std::setw(12) << "test" << std::right << std::setw(14) << "Mrays/s"
+		<< std::setw(13) << "differences" << std::setw(12) << "edge rays" << std::setw(8) << "leaks" << std::endl;
+	for (const MicroTriangleTestResult& t : triangleTests)
+	{
+		std::cout << std::left << std::setw(13) << t.mesh << std::setw(12) << GetTriangleTestName(t.test) << std::right << std::setprecision(3)
+			<< std::setw(14) << t.raysPerSecond * 1e-6 << std::setw(13) << t.differences << std::setw(12) << t.edgeRays << std::setw(8) << t.leaks << std::endl;
+	}
+
+	std::ofstream file(settings.output);
+	if (!file)
+	{
+		std::cerr << "Failed to open " << settings.output << std::endl;
+		return 1;
+	}
+	file << std::setprecision(6);
+	file << "{\n  \"rays\": " << settings.rays << ",\n  \"seed\": " << settings.seed << ",\n  \"bestIsa\": \"" << GetSimdIsaName(GetBestSimdIsa()) << "\",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const MicroResult& r = results[i];
+		file << "    { \"mesh\": \"" << r.mesh << "\", \"rays\": \"" << r.raySet << "\", \"kernel\": \"" << r.kernel << "\", \"isa\": \"" << GetSimdIsaName(r.isa)
+			<< "\", \"tests\": " << r.tests << ", \"seconds\": " << r.seconds << ", \"nsPerTest\": " << r.seconds * 1e9 / r.tests
+			<< ", \"raysPerSecond\": " << r.rays / r.seconds << ", \"hits\": " << r.hits << ", \"mismatches\": " << r.mismatches << " }"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	file << "  ],\n  \"bvhBuilds\": [\n";
+	for (size_t i = 0; i < builds.size(); i++)
+	{
+		const MicroBuildResult& b = builds[i];
+		file << "    { \"mesh\": \"" << b.mesh << "\", \"triangles\": " << b.triangles << ", \"references\": " << b.references << ", \"nodes\": " << b.nodes
+			<< ", \"buildSeconds\": " << b.buildSeconds << ", \"refitSeconds\": " << b.refitSeconds << ", \"sahCost\": " << b.sahCost
+			<< ", \"raysPerSecond\": " << b.raysPerSecond << ", \"restructureSeconds\": " << b.restructureSeconds
+			<< ", \"restructuredSahCost\": " << b.restructuredSahCost << ", \"restructuredRaysPerSecond\": " << b.restructuredRaysPerSecond << " }"
+			<< (i + 1 < builds.size() ? ",\n" : "\n");
+	}
+	file << "  ],\n  \"bvhLayouts\": [\n";
+	for (size_t i = 0; i < layouts.size(); i++)
+	{
+		const MicroLayoutResult& l = layouts[i];
+		file << "    { \"mesh\": \"" << l.mesh << "\", \"layout\": \"" << GetBVHLayoutName(l.layout) << "\", \"nodes\": " << l.nodes
+			<< ", \"nodeBytes\": " << l.nodeBytes << ", \"indexBytes\": " << l.indexBytes << ", \"raysPerSecond\": " << l.raysPerSecond << " }"
+			<< (i + 1 < layouts.size() ? ",\n" : "\n");
+	}
+	file << "  ],\n  \"bvhNodeOrders\": [\n";
+	for (size_t i = 0; i < orders.size(); i++)
+	{
+		const MicroOrderResult& o = orders[i];
+		file << "    { \"mesh\": \"" << o.mesh << "\", \"order\": \"" << o.order << "\", \"raysPerSecond\": " << o.raysPerSecond
+			<< ", \"simulatedL1MissesPerRay\": " << o.simulatedMisses;
+		for (int c = 0; c < HW_COUNTER_COUNT; c++)
+		{
+			file << ", \"" << GetHardwareCounterName((HardwareCounter)c) << " per ray\": ";
+			if (o.hardwareCounts[c] < 0.0)
+				file << "null";
+			else
+				file << o.hardwareCounts[c];
+		}
+		file << " }" << (i + 1 < orders.size() ? ",\n" : "\n");
+	}
+	file << "  ],\n  \"triangleTests\": [\n";
+	for (size_t i = 0; i < triangleTests.size(); i++)
+	{
+		const MicroTriangleTestResult& t = triangleTests[i];
+		file << "    { \"mesh\": \"" << t.mesh << "\", \"test\": \"" << GetTriangleTestName(t.test) << "\", \"raysPerSecond\": " << t.raysPerSecond
+			<< ", \"differences\": " << t.differences << ", \"edgeRays\": " << t.edgeRays << ", \"leaks\": " << t.leaks << " }"
+			<< (i + 1 < triangleTests.size() ? ",\n" : "\n");
+	}
+	file << "  ]\n}\n";
+
+	if (totalMismatches)
+	{
+		std::cerr << totalMismatches << " results differ from the scalar kernels" << std::endl;
+		return 1;
+	}
+	return 0;
+}
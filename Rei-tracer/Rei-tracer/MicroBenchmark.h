@@ -0,0 +1,27 @@
+#ifndef _MICRO_BENCHMARK_H_
+#define _MICRO_BENCHMARK_H_
+
+#include <string>
+#include <stdint.h>
+
+struct MicroBenchmarkSettings
+{
+	std::string output = "microbench.json";
+	unsigned rays = 16384;          //Per ray set, rounded up to a square for the coherent set
+	unsigned maxPrimitives = 1024;  //Triangles (and their spheres and boxes) tested per mesh
+	unsigned octreeLevels = 2;
+	double minSeconds = 0.05;       //Each measurement repeats until at least this much time has passed
+	double restructureSeconds = 1.0; //Budget of the treelet restructuring per mesh
+	uint32_t seed = 1337;
+};
+
+//Times the cpu ports of the intersection kernels in raytracer.hlsl for every ISA this cpu supports, the octree traversal
+//with plain leaves and with triangle blocks of every width, the bvh traversal in every layout with the memory each layout takes,
+//the cache misses of every node order, every triangle test with the rays it lets through shared edges, and the bvh build,
+//refit and restructuring, over the bundled meshes with coherent and random rays.
+//Every ISA variant is checked against the scalar kernels on the same rays.
+//Writes a table to stdout and the results as json to settings.output. Returns the process exit code, 1 when
+//any simd kernel disagrees with the scalar one.
+int RunMicroBenchmarks(const MicroBenchmarkSettings& settings);
+
+#endif
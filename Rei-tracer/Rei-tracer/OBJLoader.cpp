@@ -1,16 +1,19 @@
 #include "OBJLoader.h"
+#include "Profiler.h"
 #include <sstream>
+#include <string.h>
 
-using namespace DirectX;
+using namespace VectorMath;
 
-unsigned OBJLoader::LoadOBJ(const std::string & filename, Triangle * triangleArray, unsigned maxCount) const
+unsigned OBJLoader::LoadOBJ(const std::string & filename, std::vector<Triangle>& triangles) const
 {
+	PROFILE_ZONE("LoadOBJ");
 
 	std::ifstream fin(filename);
 
-	std::vector<XMFLOAT3> positions;
-	std::vector<XMFLOAT3> normals;
-	std::vector<XMFLOAT2> texcoords;
+	std::vector<Float3> positions;
+	std::vector<Float3> normals;
+	std::vector<Float2> texcoords;
 
 	std::vector<unsigned> positionIndices;
 	std::vector<unsigned> normalIndices;
@@ -20,7 +23,7 @@ unsigned OBJLoader::LoadOBJ(const std::string & filename, Triangle * triangleArr
 
 	if (filename.substr(filename.size() - 3) == "obj")
 	{
-
+		PROFILE_ZONE("Parse OBJ");
 
 		for (std::string line; std::getline(fin, line);)
 		{
@@ -30,19 +33,19 @@ unsigned OBJLoader::LoadOBJ(const std::string & filename, Triangle * triangleArr
 
 			if (type == "v")
 			{
-				XMFLOAT3 pos;
+				Float3 pos;
 				input >> pos.x >> pos.y >> pos.z;
 				positions.push_back(pos);
 			}
 			else if (type == "vt")
 			{
-				XMFLOAT2 tex;
+				Float2 tex;
 				input >> tex.x >> tex.y;
 				texcoords.push_back(tex);
 			}
 			else if (type == "vn")
 			{
-				XMFLOAT3 normal;
+				Float3 normal;
 				input >> normal.x >> normal.y >> normal.z;
 				normals.push_back(normal);
 			}
@@ -66,11 +69,11 @@ unsigned OBJLoader::LoadOBJ(const std::string & filename, Triangle * triangleArr
 		return 0;
 	}
 
-	std::vector<XMFLOAT3> realPos;
+	std::vector<Float3> realPos;
 	realPos.reserve(positionIndices.size());
-	std::vector<XMFLOAT2> realTex;
+	std::vector<Float2> realTex;
 	realTex.reserve(texcoordIndices.size());
-	std::vector<XMFLOAT3> realNor;
+	std::vector<Float3> realNor;
 	realNor.reserve(normalIndices.size());
 
 
@@ -87,36 +90,37 @@ unsigned OBJLoader::LoadOBJ(const std::string & filename, Triangle * triangleArr
 	{
 		realNor.push_back(normals[nor - 1]);
 	}
-	std::vector<XMFLOAT4> tan1;
-	std::vector<XMFLOAT4> tan2;
-	tan1.resize(realNor.size(), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
-	tan2.resize(realNor.size(), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
-
-	std::vector<XMFLOAT4> realTan;
-	realTan.resize(realNor.size(), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+	PROFILE_ZONE("Tangent generation");
+	std::vector<Float4> tan1;
+	std::vector<Float4> tan2;
+	tan1.resize(realNor.size(), Float4(0.0f, 0.0f, 0.0f, 0.0f));
+	tan2.resize(realNor.size(), Float4(0.0f, 0.0f, 0.0f, 0.0f));
+
+	std::vector<Float4> realTan;
+	realTan.resize(realNor.size(), Float4(0.0f, 0.0f, 0.0f, 0.0f));
 	for (unsigned i = 0; i < positionIndices.size(); i += 3)
 	{
-		const XMFLOAT3& v1 = realPos[i];
-		const XMFLOAT3& v2 = realPos[i + 1];
-		const XMFLOAT3& v3 = realPos[i + 2];
+		const Float3& v1 = realPos[i];
+		const Float3& v2 = realPos[i + 1];
+		const Float3& v3 = realPos[i + 2];
 
-		const XMFLOAT2& u1 = realTex[i];
-		const XMFLOAT2& u2 = realTex[i + 1];
-		const XMFLOAT2& u3 = realTex[i + 2];
+		const Float2& u1 = realTex[i];
+		const Float2& u2 = realTex[i + 1];
+		const Float2& u3 = realTex[i + 2];
 
 		//Edge positions
-		XMFLOAT3 deltaPos1(v2.x - v1.x, v2.y - v1.y, v2.z - v1.z);
-		XMFLOAT3 deltaPos2(v3.x - v1.x, v3.y - v1.y, v3.z - v1.z);
+		Float3 deltaPos1(v2.x - v1.x, v2.y - v1.y, v2.z - v1.z);
+		Float3 deltaPos2(v3.x - v1.x, v3.y - v1.y, v3.z - v1.z);
 		//Edge UVs
-		XMFLOAT2 deltaTex1(u2.x - u1.x, u3.x - u1.x);
-		XMFLOAT2 deltaTex2(u2.y - u1.y, u3.y - u1.y);
+		Float2 deltaTex1(u2.x - u1.x, u3.x - u1.x);
+		Float2 deltaTex2(u2.y - u1.y, u3.y - u1.y);
 
 		float r = 1.0f / (deltaTex1.x * deltaTex2.y - deltaTex1.y * deltaTex2.x);
 		
-		XMFLOAT4 tangent(r*(deltaPos1.x * deltaTex2.y - deltaPos2.x * deltaTex1.y), r*(deltaPos1.y * deltaTex2.y - deltaPos2.y * deltaTex1.y), r*(deltaPos1.z * deltaTex2.y - deltaPos2.z * deltaTex1.y), 1.0f);
+		Float4 tangent(r*(deltaPos1.x * deltaTex2.y - deltaPos2.x * deltaTex1.y), r*(deltaPos1.y * deltaTex2.y - deltaPos2.y * deltaTex1.y), r*(deltaPos1.z * deltaTex2.y - deltaPos2.z * deltaTex1.y), 1.0f);
 
-		XMFLOAT3 sdir = XMFLOAT3((deltaTex2.y*deltaPos1.x - deltaTex2.x*deltaPos2.x) * r, (deltaTex2.y*deltaPos1.y - deltaTex2.x*deltaPos2.y)*r, (deltaTex2.y*deltaPos1.z - deltaTex2.x*deltaPos2.z)*r);
-		XMFLOAT3 tdir = XMFLOAT3((deltaTex1.x*deltaPos2.x - deltaTex1.y*deltaPos1.x)*r, (deltaTex1.x*deltaPos2.y - deltaTex1.y*deltaPos1.y)*r, (deltaTex1.x*deltaPos2.z - deltaTex1.y*deltaPos1.z)*r);
+		Float3 sdir = Float3((deltaTex2.y*deltaPos1.x - deltaTex2.x*deltaPos2.x) * r, (deltaTex2.y*deltaPos1.y - deltaTex2.x*deltaPos2.y)*r, (deltaTex2.y*deltaPos1.z - deltaTex2.x*deltaPos2.z)*r);
+		Float3 tdir = Float3((deltaTex1.x*deltaPos2.x - deltaTex1.y*deltaPos1.x)*r, (deltaTex1.x*deltaPos2.y - deltaTex1.y*deltaPos1.y)*r, (deltaTex1.x*deltaPos2.z - deltaTex1.y*deltaPos1.z)*r);
 
 		tan1[i].x += sdir.x;
 		tan1[i].y += sdir.y;
@@ -145,33 +149,32 @@ unsigned OBJLoader::LoadOBJ(const std::string & filename, Triangle * triangleArr
 
 	for (unsigned i = 0; i < realPos.size(); ++i)
 	{
-		XMVECTOR n = XMLoadFloat3(&realNor[i]);
-		XMVECTOR t = XMLoadFloat4(&tan1[i]);
+		Vector n = LoadFloat3(&realNor[i]);
+		Vector t = LoadFloat4(&tan1[i]);
 
-		XMVECTOR tangent = XMVector3Normalize(t - n * XMVector3Dot(n, t));
+		Vector tangent = Vector3Normalize(t - n * Vector3Dot(n, t));
 
-		XMStoreFloat4(&realTan[i], tangent);
+		StoreFloat4(&realTan[i], tangent);
 		//Calculate handedness
-		realTan[i].w = XMVectorGetX(XMVector3Dot(XMVector3Cross(n, t), XMLoadFloat4(&tan2[i]))) < 0.0f ? -1.0f : 1.0f;
+		realTan[i].w = VectorGetX(Vector3Dot(Vector3Cross(n, t), LoadFloat4(&tan2[i]))) < 0.0f ? -1.0f : 1.0f;
 	}
 
 	auto nrOfVertices = realPos.size();
-	if (nrOfVertices / 3 > maxCount)
-		return 0;
-
-	for (int i = 0; i < nrOfVertices; i += 3)
+	triangles.reserve(triangles.size() + nrOfVertices / 3);
+	for (size_t i = 0; i < nrOfVertices; i += 3)
 	{
-		triangleArray[i / 3].v1 = TriangleVertex(realPos[i], realNor[i], realTan[i], realTex[i]);
-		triangleArray[i / 3].v2 = TriangleVertex(realPos[i + 1], realNor[i + 1], realTan[i + 1], realTex[i + 1]);
-		triangleArray[i / 3].v3 = TriangleVertex(realPos[i + 2], realNor[i + 2], realTan[i + 2], realTex[i + 2]);
+		triangles.push_back(Triangle(TriangleVertex(realPos[i], realNor[i], realTan[i], realTex[i]),
+			TriangleVertex(realPos[i + 1], realNor[i + 1], realTan[i + 1], realTex[i + 1]),
+			TriangleVertex(realPos[i + 2], realNor[i + 2], realTan[i + 2], realTex[i + 2])));
 	}
 
 	return (unsigned)nrOfVertices / 3;
 
 }
 
-unsigned OBJLoader::PartitionMesh(Triangle * triangles, unsigned triangleCount, unsigned offset, OctNode ** octTree, unsigned levels, unsigned& nodeCountOut, unsigned maxCount) const
+unsigned OBJLoader::PartitionMesh(Triangle * triangles, unsigned triangleCount, unsigned offset, std::vector<OctNode>& octTree, unsigned levels) const
 {
+	PROFILE_ZONE("PartitionMesh");
 	/*
 		k-ary tree
 	  Stored in an array:
@@ -181,7 +184,7 @@ unsigned OBJLoader::PartitionMesh(Triangle * triangles, unsigned triangleCount,
 	   i.e.
 	   indexOf(AAB) = indexOf(AA) * 8 + 2 = 10
 	*/
-	XMFLOAT3 centerPoint;
+	Float3 centerPoint;
 	float x, y, z;
 	x = y = z = 0;
 	float maxx, maxy, maxz;
@@ -235,19 +238,19 @@ unsigned OBJLoader::PartitionMesh(Triangle * triangles, unsigned triangleCount,
 	}
 
 
-	XMFLOAT3 centerPos = XMFLOAT3((maxx + minx) / 2.0f, (maxy + miny) / 2.0f, (maxz + minz) / 2.0f);
-	XMFLOAT3 halflengths = XMFLOAT3((maxx - minx) / 2.0f, (maxy - miny) / 2.0f, (maxy - miny) / 2.0f);
+	Float3 centerPos = Float3((maxx + minx) / 2.0f, (maxy + miny) / 2.0f, (maxz + minz) / 2.0f);
+	Float3 halflengths = Float3((maxx - minx) / 2.0f, (maxy - miny) / 2.0f, (maxy - miny) / 2.0f);
 	//halflengths.x += 0.01f;
 	//halflengths.y += 0.01f;
 	//halflengths.z += 0.01f;
 
-	nodeCountOut = 0;
+	unsigned nodeCountOut = 0;
 	for (int i = levels; i >= 0; i--)
 	{
-		nodeCountOut += _Pow_int(8, i);
+		nodeCountOut += 1u << (3 * i); //8^i
 	}
-	*octTree = new OctNode[nodeCountOut];
-	OctNode* tree = *octTree;
+	octTree.assign(nodeCountOut, OctNode());
+	OctNode* tree = &octTree[0];
 	_BuildOctTree(tree, 0, nodeCountOut, centerPos, halflengths);
 
 	std::vector<Triangle> newTriangles;
@@ -281,12 +284,13 @@ unsigned OBJLoader::PartitionMesh(Triangle * triangles, unsigned triangleCount,
 	}
 	delete[] taken;
 
-	memcpy(triangles, &newTriangles[0], sizeof(Triangle) * newTriangles.size());
+	if (!newTriangles.empty())
+		memcpy(triangles, &newTriangles[0], sizeof(Triangle) * newTriangles.size());
 
 	return newTriangles.size();
 }
 
-void OBJLoader::_BuildOctTree(OctNode * octTree, unsigned index, unsigned stop, DirectX::XMFLOAT3 pos, DirectX::XMFLOAT3 halflengths) const
+void OBJLoader::_BuildOctTree(OctNode * octTree, unsigned index, unsigned stop, VectorMath::Float3 pos, VectorMath::Float3 halflengths) const
 {
 	if (index >= stop)
 		return;
@@ -308,7 +312,7 @@ void OBJLoader::_BuildOctTree(OctNode * octTree, unsigned index, unsigned stop,
 		float offsetx = i % 2 == 0 ? -1 : 1;
 		float offsetz = i % 4 < 2 ? 1 : -1;
 		float offsety = i < 4 ? 1 : -1;
-		XMFLOAT3 newpos = pos;
+		Float3 newpos = pos;
 		newpos.x += offsetx * (halflengths.x);
 		newpos.y += offsety * (halflengths.y);
 		newpos.z += offsetz * (halflengths.z);
@@ -319,19 +323,19 @@ void OBJLoader::_BuildOctTree(OctNode * octTree, unsigned index, unsigned stop,
 
 bool OBJLoader::_NodeContainsTriangle(const OctNode & node, const Triangle & t) const
 {
-	//XMVECTOR center = XMVectorSet(node.posx, node.posy, node.posz, 1.0f);
-	//XMVECTOR vertices[3];
-	//vertices[0] = XMVectorSet(t.v1.posx, t.v1.posy, t.v1.posz, 1.0f);
-	//vertices[1] = XMVectorSet(t.v2.posx, t.v2.posy, t.v2.posz, 1.0f);
-	//vertices[2] = XMVectorSet(t.v3.posx, t.v3.posy, t.v3.posz, 1.0f);
-
-	//XMVECTOR planes[6];
-	//planes[0] = XMVectorSet(1.0f, 0.0f, 0.0f, (node.posx - node.halfx));
-	//planes[1] = XMVectorSet(-1.0f, 0.0f, 0.0f, -(node.posx + node.halfx));
-	//planes[2] = XMVectorSet(0.0f, 1.0f, 0.0f, (node.posy - node.halfy));
-	//planes[3] = XMVectorSet(0.0f, -1.0f, 0.0f, -(node.posy + node.halfy));
-	//planes[4] = XMVectorSet(0.0f, 0.0f, 1.0f, (node.posz - node.halfz));
-	//planes[5] = XMVectorSet(0.0f, 0.0f, -1.0f, -(node.posz + node.halfz));
+	//Vector center = VectorSet(node.posx, node.posy, node.posz, 1.0f);
+	//Vector vertices[3];
+	//vertices[0] = VectorSet(t.v1.posx, t.v1.posy, t.v1.posz, 1.0f);
+	//vertices[1] = VectorSet(t.v2.posx, t.v2.posy, t.v2.posz, 1.0f);
+	//vertices[2] = VectorSet(t.v3.posx, t.v3.posy, t.v3.posz, 1.0f);
+
+	//Vector planes[6];
+	//planes[0] = VectorSet(1.0f, 0.0f, 0.0f, (node.posx - node.halfx));
+	//planes[1] = VectorSet(-1.0f, 0.0f, 0.0f, -(node.posx + node.halfx));
+	//planes[2] = VectorSet(0.0f, 1.0f, 0.0f, (node.posy - node.halfy));
+	//planes[3] = VectorSet(0.0f, -1.0f, 0.0f, -(node.posy + node.halfy));
+	//planes[4] = VectorSet(0.0f, 0.0f, 1.0f, (node.posz - node.halfz));
+	//planes[5] = VectorSet(0.0f, 0.0f, -1.0f, -(node.posz + node.halfz));
 
 	//bool completelyOutside = true;
 	//for (int i = 0; i < 3; i++)
@@ -339,7 +343,7 @@ bool OBJLoader::_NodeContainsTriangle(const OctNode & node, const Triangle & t)
 	//	bool vertInside = true;
 	//	for (int j = 0; j < 6; j++)
 	//	{
-	//		float test = XMVectorGetX(XMVector3Dot(vertices[i] - (planes[j] * XMVectorGetW(planes[j])) , planes[j]));
+	//		float test = VectorGetX(Vector3Dot(vertices[i] - (planes[j] * VectorGetW(planes[j])) , planes[j]));
 	//		if (test < 0.0f)
 	//		{
 	//			vertInside = false;
@@ -3,7 +3,7 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
-#include <DirectXMath.h>
+#include "VectorMath.h"
 #include "Structs.h"
 #include <string>
 
@@ -12,16 +12,18 @@ class OBJLoader
 public:
 	OBJLoader() {};
 	~OBJLoader() {};
-	//Returns the number of triangles added
-	unsigned LoadOBJ(const std::string& filename, Triangle* triangleArray, unsigned maxCount) const;
+	//Appends the triangles of the file. Returns the number of triangles added.
+	unsigned LoadOBJ(const std::string& filename, std::vector<Triangle>& triangles) const;
 
 	/*Partitions the mesh into an octree and sorts the triangle array accordingly.
-	 *Will create new triangles where triangles overlap two nodes so that one triangle
-	 *only exists in one node */
-	unsigned PartitionMesh(Triangle* triangles, unsigned triangleCount, unsigned offset, OctNode** octTree, unsigned levels, unsigned& nodeCountOut, unsigned maxCount) const;
+	 *A triangle overlapping two nodes goes to their parent so that one triangle
+	 *only exists in one node, the spatial splits in BVH split such triangles instead.
+	 *Returns the number of triangles kept, never more than triangleCount.
+	 *The nodes replace the contents of octTree. */
+	unsigned PartitionMesh(Triangle* triangles, unsigned triangleCount, unsigned offset, std::vector<OctNode>& octTree, unsigned levels) const;
 
 private:
-	void _BuildOctTree(OctNode* octTree, unsigned index, unsigned stop, DirectX::XMFLOAT3 pos, DirectX::XMFLOAT3 halflengths) const;
+	void _BuildOctTree(OctNode* octTree, unsigned index, unsigned stop, VectorMath::Float3 pos, VectorMath::Float3 halflengths) const;
 	bool _NodeContainsTriangle(const OctNode& node, const Triangle& triangle) const;
 
 };
@@ -0,0 +1,61 @@
+#include "OffscreenTarget.h"
+#include <string.h>
+
+OffscreenTarget::OffscreenTarget(uint32_t width, uint32_t height)
+{
+	_width = width;
+	_height = height;
+	_framebuffer.assign((size_t)width * height * 4, 0);
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+}
+
+uint32_t OffscreenTarget::GetWidth() const
+{
+	return _width;
+}
+
+uint32_t OffscreenTarget::GetHeight() const
+{
+	return _height;
+}
+
+bool OffscreenTarget::GetWindowedMode() const
+{
+	return true;
+}
+
+void * OffscreenTarget::GetNativeHandle() const
+{
+	return nullptr;
+}
+
+void OffscreenTarget::SetTitle(const std::string & title)
+{
+	_title = title;
+}
+
+const std::string & OffscreenTarget::GetTitle() const
+{
+	return _title;
+}
+
+void OffscreenTarget::LockMouseToScreen(bool)
+{
+}
+
+void OffscreenTarget::ToggleLockMouseToScreen()
+{
+}
+
+void OffscreenTarget::Present(const uint8_t * rgba)
+{
+	memcpy(_framebuffer.data(), rgba, _framebuffer.size());
+}
+
+const std::vector<uint8_t>& OffscreenTarget::GetFramebuffer() const
+{
+	return _framebuffer;
+}
@@ -0,0 +1,36 @@
+#ifndef _OFFSCREEN_TARGET_H_
+#define _OFFSCREEN_TARGET_H_
+
+#include <vector>
+#include "IWindow.h"
+
+//A window without a display: Present keeps a copy of the frame to read back
+class OffscreenTarget : public IWindow
+{
+public:
+	OffscreenTarget(uint32_t width = 800, uint32_t height = 600);
+	~OffscreenTarget();
+
+	uint32_t GetWidth() const;
+	uint32_t GetHeight() const;
+	bool GetWindowedMode() const;
+	void* GetNativeHandle() const;
+
+	void SetTitle(const std::string& title);
+	const std::string& GetTitle() const;
+
+	void LockMouseToScreen(bool lock);
+	void ToggleLockMouseToScreen();
+
+	void Present(const uint8_t* rgba);
+	//The last presented frame, black until the first Present
+	const std::vector<uint8_t>& GetFramebuffer() const;
+
+private:
+	uint32_t _width;
+	uint32_t _height;
+	std::string _title;
+	std::vector<uint8_t> _framebuffer;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#include "Parallel.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+unsigned GetWorkerCount()
+{
+	static const unsigned count = (std::max)(1U, std::thread::hardware_concurrency());
+	return count;
+}
+
+void ParallelFor(size_t count, size_t minChunk, const std::function<void(size_t begin, size_t end, unsigned worker)>& body)
+{
+	if (count == 0)
+		return;
+	size_t chunks = (std::min)((size_t)GetWorkerCount(), count / (std::max)((size_t)1, minChunk));
+	if (chunks < 2)
+	{
+		body(0, count, 0);
+		return;
+	}
+
+	//The calling thread takes the first chunk instead of idling in join
+	size_t chunkSize = (count + chunks - 1) / chunks;
+	std::vector<std::thread> threads;
+	threads.reserve(chunks - 1);
+	for (size_t c = 1; c < chunks; c++)
+	{
+		size_t begin = c * chunkSize;
+		size_t end = (std::min)(count, begin + chunkSize);
+		if (begin < end)
+			threads.emplace_back(body, begin, end, (unsigned)c);
+	}
+	body(0, (std::min)(count, chunkSize), 0);
+	for (std::thread& t : threads)
+		t.join();
+}
@@ -0,0 +1,15 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stddef.h>
+#include <functional>
+
+//Number of threads ParallelFor spreads work over, one per hardware thread
+unsigned GetWorkerCount();
+
+//Calls body(begin, end, worker) over [0, count) split into at most one chunk per worker,
+//and returns once every chunk is done. worker is in [0, GetWorkerCount()) and unique per chunk,
+//so it can index per worker scratch data. Ranges smaller than minChunk * 2 run on the calling thread.
+void ParallelFor(size_t count, size_t minChunk, const std::function<void(size_t begin, size_t end, unsigned worker)>& body);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+//1 when the build has an SDL window and Direct3D 11. Everything else only has Core::InitHeadless:
+//no display server, no input, and the cpu backend rendering into an OffscreenTarget.
+//Define REI_HEADLESS to build without them on Windows as well.
+#if defined(_WIN32) && !defined(REI_HEADLESS)
+#define REI_WINDOWED 1
+#else
+#define REI_WINDOWED 0
+#endif
+
+#endif
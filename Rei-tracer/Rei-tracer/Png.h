@@ -0,0 +1,30 @@
+#ifndef _PNG_H_
+#define _PNG_H_
+
+#include <cstdlib>
+#include <stdint.h>
+
+//What the png encoder in ImageWriter.cpp and the decoder in ImageReader.cpp share
+
+//The most a deflate stream can expand, a 258 byte match coded in 2 bits
+#define DEFLATE_MAX_RATIO 1032
+
+//Base and number of extra bits of every deflate length and distance symbol
+extern const uint16_t gLengthBase[29];
+extern const uint8_t gLengthExtra[29];
+extern const uint16_t gDistanceBase[30];
+extern const uint8_t gDistanceExtra[30];
+
+//The png paeth filter's prediction from the left, upper and upper left bytes
+inline uint8_t Paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = std::abs(p - a);
+	int pb = std::abs(p - b);
+	int pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return (uint8_t)a;
+	return (uint8_t)(pb <= pc ? b : c);
+}
+
+#endif
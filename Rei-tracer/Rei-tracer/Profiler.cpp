@@ -0,0 +1,164 @@
+#include "Profiler.h"
+#include <fstream>
+#include <atomic>
+
+static std::atomic<Profiler*> gInstance(nullptr);
+static std::mutex gInstanceLock;
+static thread_local ProfileThread* gThread = nullptr;
+static thread_local Profiler* gThreadOwner = nullptr;
+
+Profiler::Profiler()
+{
+	_start = std::chrono::steady_clock::now();
+	_recording.store(false);
+}
+
+Profiler::~Profiler()
+{
+}
+
+Profiler* Profiler::GetInstance()
+{
+	//Zones can open on any thread before Core exists, so the instance is created on first use
+	Profiler* profiler = gInstance.load(std::memory_order_acquire);
+	if (!profiler)
+	{
+		std::lock_guard<std::mutex> lock(gInstanceLock);
+		profiler = gInstance.load(std::memory_order_relaxed);
+		if (!profiler)
+		{
+			profiler = new Profiler();
+			gInstance.store(profiler, std::memory_order_release);
+		}
+	}
+	return profiler;
+}
+
+void Profiler::ShutDown()
+{
+	std::lock_guard<std::mutex> lock(gInstanceLock);
+	delete gInstance.exchange(nullptr);
+}
+
+uint64_t Profiler::Now() const
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+ProfileThread* Profiler::GetThread()
+{
+	if (gThreadOwner == this)
+		return gThread;
+
+	std::lock_guard<std::mutex> lock(_threadLock);
+	ProfileThread* thread = new ProfileThread;
+	thread->id = (uint32_t)_threads.size();
+	thread->name = thread->id == 0 ? "Main" : "Thread " + std::to_string(thread->id);
+	thread->events.reserve(1024);
+	_threads.push_back(std::unique_ptr<ProfileThread>(thread));
+	gThread = thread;
+	gThreadOwner = this;
+	return thread;
+}
+
+void Profiler::SetThreadName(const std::string & name)
+{
+	ProfileThread* thread = GetThread();
+	std::lock_guard<std::mutex> lock(_threadLock);
+	thread->name = name;
+}
+
+void Profiler::SetTraceFile(const std::string & filename)
+{
+	_traceFile = filename;
+	_recording.store(!filename.empty(), std::memory_order_release);
+}
+
+const std::string & Profiler::GetTraceFile() const
+{
+	return _traceFile;
+}
+
+bool Profiler::IsRecording() const
+{
+	return _recording.load(std::memory_order_relaxed);
+}
+
+void Profiler::RecordZone(const char * name, uint64_t start, uint64_t duration, uint32_t depth)
+{
+	ProfileThread* thread = GetThread();
+	if (thread->events.size() >= PROFILER_MAX_EVENTS_PER_THREAD)
+		return;
+	thread->events.push_back({ name, start, duration, depth });
+}
+
+void Profiler::RecordCounter(const char * name, double value)
+{
+	if (!IsRecording())
+		return;
+	ProfileThread* thread = GetThread();
+	if (thread->counters.size() >= PROFILER_MAX_EVENTS_PER_THREAD)
+		return;
+	thread->counters.push_back({ name, Now(), value });
+}
+
+bool Profiler::WriteChromeTrace(const std::string & filename)
+{
+	std::ofstream fout(filename);
+	if (!fout)
+		return false;
+
+	std::lock_guard<std::mutex> lock(_threadLock);
+	fout << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (auto& thread : _threads)
+	{
+		fout << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread->id
+			<< ",\"args\":{\"name\":\"" << thread->name << "\"}}";
+		first = false;
+		for (auto& e : thread->events)
+		{
+			fout << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread->id
+				<< ",\"ts\":" << e.start << ",\"dur\":" << e.duration << ",\"args\":{\"depth\":" << e.depth << "}}";
+		}
+		for (auto& c : thread->counters)
+		{
+			fout << ",\n{\"name\":\"" << c.name << "\",\"ph\":\"C\",\"pid\":0,\"tid\":" << thread->id
+				<< ",\"ts\":" << c.time << ",\"args\":{\"value\":" << c.value << "}}";
+		}
+	}
+	fout << "\n]}\n";
+	return (bool)fout;
+}
+
+void Profiler::Clear()
+{
+	std::lock_guard<std::mutex> lock(_threadLock);
+	for (auto& thread : _threads)
+	{
+		thread->events.clear();
+		thread->counters.clear();
+	}
+}
+
+ProfileZone::ProfileZone(const char * name)
+{
+	Profiler* profiler = Profiler::GetInstance();
+	_name = name;
+	_thread = nullptr;
+	if (!profiler->IsRecording())
+		return;
+	_thread = profiler->GetThread();
+	_thread->depth++;
+	_start = profiler->Now();
+}
+
+ProfileZone::~ProfileZone()
+{
+	if (!_thread)
+		return;
+	Profiler* profiler = Profiler::GetInstance();
+	uint64_t end = profiler->Now();
+	_thread->depth--;
+	profiler->RecordZone(_name, _start, end - _start, _thread->depth);
+}
@@ -0,0 +1,103 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+//Set to 0 to compile every PROFILE_ZONE away
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#define PROFILER_MAX_EVENTS_PER_THREAD 1000000
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+
+struct ProfileEvent
+{
+	const char* name;
+	uint64_t start; //microseconds since the profiler was created
+	uint64_t duration;
+	uint32_t depth;
+};
+
+struct ProfileCounter
+{
+	const char* name;
+	uint64_t time;
+	double value;
+};
+
+struct ProfileThread
+{
+	uint32_t id;
+	uint32_t depth = 0;
+	std::string name;
+	std::vector<ProfileEvent> events;
+	std::vector<ProfileCounter> counters;
+};
+
+//Singleton
+//Every thread records into its own buffer, so zones never contend on a lock.
+//The buffers are only walked when the trace is written. Nothing is recorded until a trace file is set.
+class Profiler
+{
+private:
+	Profiler();
+	~Profiler();
+
+	std::chrono::steady_clock::time_point _start;
+	std::mutex _threadLock;
+	std::vector<std::unique_ptr<ProfileThread>> _threads;
+	std::string _traceFile;
+	std::atomic<bool> _recording;
+
+public:
+	static Profiler* GetInstance();
+	static void ShutDown();
+
+	uint64_t Now() const;
+	ProfileThread* GetThread();
+	void SetThreadName(const std::string& name);
+
+	//Starts recording, Core::ShutDown writes the trace to filename. Set it before any other thread opens a zone.
+	void SetTraceFile(const std::string& filename);
+	const std::string& GetTraceFile() const;
+	bool IsRecording() const;
+
+	void RecordZone(const char* name, uint64_t start, uint64_t duration, uint32_t depth);
+	void RecordCounter(const char* name, double value);
+
+	//Writes all recorded zones in the Chrome trace_event format, open it in chrome://tracing
+	bool WriteChromeTrace(const std::string& filename);
+	void Clear();
+};
+
+class ProfileZone
+{
+private:
+	const char* _name;
+	uint64_t _start;
+	ProfileThread* _thread;
+
+public:
+	explicit ProfileZone(const char* name);
+	~ProfileZone();
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::GetInstance()->RecordCounter(name, value)
+#define PROFILE_THREAD_NAME(name) Profiler::GetInstance()->SetThreadName(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_COUNTER(name, value)
+#define PROFILE_THREAD_NAME(name)
+#endif
+
+#endif
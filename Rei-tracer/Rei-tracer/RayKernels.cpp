@@ -0,0 +1,596 @@
+#include "RayKernels.h"
+#include <stdlib.h>
+#include <string.h>
+
+int TraverseOctTree(const Ray & r, const Vec3 & rcpDir, const Triangle * triangles, const OctNode * nodes,
+	const MeshIndices * meshes, int meshCount, float & dist, float & u, float & v)
+{
+	int triangleIndex = -1;
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				int nodeIndex = stack[--stackPtr];
+				const OctNode& node = nodes[nodeIndex];
+				if (!RayVSBox(r, rcpDir, OctNodeBox(node)))
+					continue;
+
+				int local = nodeIndex - mesh.rootPartition;
+				if (mesh.partitionCount >= local * 8 + 8 + 1)
+				{
+					for (int c = 1; c < 9; c++)
+						stack[stackPtr++] = mesh.rootPartition + local * 8 + c;
+				}
+				for (unsigned c = node.lower; c < node.upper; c++)
+				{
+					if (RayVSTriangle(triangles[c], r, dist, u, v))
+						triangleIndex = (int)c;
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				if (RayVSTriangle(triangles[j], r, dist, u, v))
+					triangleIndex = j;
+			}
+		}
+	}
+	return triangleIndex;
+}
+
+bool TraverseOctTreeForShadows(const Ray & r, const Vec3 & rcpDir, float dist, const Triangle * triangles, const OctNode * nodes,
+	const MeshIndices * meshes, int meshCount)
+{
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				int nodeIndex = stack[--stackPtr];
+				const OctNode& node = nodes[nodeIndex];
+				if (!RayVSBox(r, rcpDir, OctNodeBox(node)))
+					continue;
+
+				int local = nodeIndex - mesh.rootPartition;
+				if (mesh.partitionCount >= local * 8 + 8 + 1)
+				{
+					for (int c = 1; c < 9; c++)
+						stack[stackPtr++] = mesh.rootPartition + local * 8 + c;
+				}
+				for (unsigned c = node.lower; c < node.upper; c++)
+				{
+					float comp = RayVSTriangleDistance(triangles[c], r);
+					if (comp < dist && comp > 0.0f)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				float comp = RayVSTriangleDistance(triangles[j], r);
+				if (comp < dist && comp > 0.0f)
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+int TraverseBVH(const Ray & r, const Vec3 & rcpDir, const Triangle * triangles, const BVHNode * nodes, const uint32_t * triangleIndices,
+	const MeshIndices * meshes, int meshCount, float & dist, float & u, float & v)
+{
+	int triangleIndex = -1;
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = nodes[stack[--stackPtr]];
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+				{
+					uint32_t t = triangleIndices[c];
+					if (RayVSTriangle(triangles[t], r, dist, u, v))
+						triangleIndex = (int)t;
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				if (RayVSTriangle(triangles[j], r, dist, u, v))
+					triangleIndex = j;
+			}
+		}
+	}
+	return triangleIndex;
+}
+
+bool TraverseBVHForShadows(const Ray & r, const Vec3 & rcpDir, float dist, const Triangle * triangles, const BVHNode * nodes, const uint32_t * triangleIndices,
+	const MeshIndices * meshes, int meshCount)
+{
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = nodes[stack[--stackPtr]];
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+				{
+					float comp = RayVSTriangleDistance(triangles[triangleIndices[c]], r);
+					if (comp < dist && comp > 0.0f)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				float comp = RayVSTriangleDistance(triangles[j], r);
+				if (comp < dist && comp > 0.0f)
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+int TraverseBVH(const Ray & r, const Vec3 & rcpDir, TriangleTest test, const Triangle * triangles, const PrecomputedTriangle * precomputed,
+	const BVHNode * nodes, const uint32_t * triangleIndices, const MeshIndices * meshes, int meshCount, float & dist, float & u, float & v)
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	int triangleIndex = -1;
+	auto hit = [&](int t)
+	{
+		float bu = 0.0f, bv = 0.0f;
+		float ttt = RayVSSelectedTriangle(test, triangles, precomputed, t, r, wr, bu, bv);
+		if (IsCloserHit(ttt, t, dist, triangleIndex))
+		{
+			dist = ttt;
+			u = bu;
+			v = bv;
+			triangleIndex = t;
+		}
+	};
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = nodes[stack[--stackPtr]];
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+					hit((int)triangleIndices[c]);
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+				hit(j);
+		}
+	}
+	return triangleIndex;
+}
+
+bool TraverseBVHForShadows(const Ray & r, const Vec3 & rcpDir, float dist, TriangleTest test, const Triangle * triangles, const PrecomputedTriangle * precomputed,
+	const BVHNode * nodes, const uint32_t * triangleIndices, const MeshIndices * meshes, int meshCount)
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	auto occludes = [&](int t)
+	{
+		float bu = 0.0f, bv = 0.0f;
+		float comp = RayVSSelectedTriangle(test, triangles, precomputed, t, r, wr, bu, bv);
+		return comp < dist && comp > 0.0f;
+	};
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = nodes[stack[--stackPtr]];
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+				{
+					if (occludes((int)triangleIndices[c]))
+						return true;
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				if (occludes(j))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+PrecomputedTriangle PrecomputeTriangle(const Triangle & t, TriangleTest test)
+{
+	PrecomputedTriangle p = {};
+	Vec3 v1 = Position(t.v1);
+	if (test != TRIANGLE_TEST_WOOP)
+	{
+		memcpy(p.r0, &t.v1.posx, 3 * sizeof(float));
+		memcpy(p.r1, &t.v2.posx, 3 * sizeof(float));
+		memcpy(p.r2, &t.v3.posx, 3 * sizeof(float));
+		return p;
+	}
+
+	//The inverse of the matrix with columns e1, e2 and n = e1 x e2, whose determinant is |n|^2
+	Vec3 e1 = Position(t.v2) - v1;
+	Vec3 e2 = Position(t.v3) - v1;
+	Vec3 n = Cross(e1, e2);
+	float det = Dot(n, n);
+	if (det == 0.0f)
+		return p; //All zero rows miss every ray
+	Vec3 rows[3] = { Cross(e2, n) * (1.0f / det), Cross(n, e1) * (1.0f / det), n * (1.0f / det) };
+	float* out[3] = { p.r0, p.r1, p.r2 };
+	for (int i = 0; i < 3; i++)
+	{
+		out[i][0] = rows[i].x;
+		out[i][1] = rows[i].y;
+		out[i][2] = rows[i].z;
+		out[i][3] = -Dot(rows[i], v1);
+	}
+	return p;
+}
+
+const char * GetTriangleTestName(TriangleTest test)
+{
+	switch (test)
+	{
+	case TRIANGLE_TEST_MOLLER_TRUMBORE:
+		return "moller";
+	case TRIANGLE_TEST_WOOP:
+		return "woop";
+	case TRIANGLE_TEST_WATERTIGHT:
+		return "watertight";
+	default:
+		return "unknown";
+	}
+}
+
+RayStream::~RayStream()
+{
+	free(_data);
+}
+
+void RayStream::Resize(size_t newCount)
+{
+	free(_data);
+	count = newCount;
+	paddedCount = (newCount + 15) & ~(size_t)15;
+	_data = (float*)calloc(paddedCount * 9, sizeof(float));
+	float* arrays[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+	for (int i = 0; i < 9; i++)
+		arrays[i] = _data + i * paddedCount;
+	ox = arrays[0]; oy = arrays[1]; oz = arrays[2];
+	dx = arrays[3]; dy = arrays[4]; dz = arrays[5];
+	rx = arrays[6]; ry = arrays[7]; rz = arrays[8];
+
+	//Padding lanes get a ray pointing away from everything so they never report hits
+	for (size_t i = newCount; i < paddedCount; i++)
+		Set(i, { MakeVec3(1e30f, 1e30f, 1e30f), MakeVec3(0.0f, 0.0f, 1.0f) });
+}
+
+void RayStream::Set(size_t i, const Ray & r)
+{
+	ox[i] = r.o.x; oy[i] = r.o.y; oz[i] = r.o.z;
+	dx[i] = r.d.x; dy[i] = r.d.y; dz[i] = r.d.z;
+	rx[i] = 1.0f / r.d.x; ry[i] = 1.0f / r.d.y; rz[i] = 1.0f / r.d.z;
+}
+
+Ray RayStream::Get(size_t i) const
+{
+	Ray r;
+	r.o = MakeVec3(ox[i], oy[i], oz[i]);
+	r.d = MakeVec3(dx[i], dy[i], dz[i]);
+	return r;
+}
+
+static void ScalarRayVSTriangle(const RayStream& rays, size_t i, const Triangle& t, float* dist, float* u, float* v)
+{
+	RayVSTriangle(t, rays.Get(i), dist[i], u[i], v[i]);
+}
+
+static void ScalarRayVSTriangleDistance(const RayStream& rays, size_t i, const Triangle& t, float* dist)
+{
+	dist[i] = RayVSTriangleDistance(t, rays.Get(i));
+}
+
+static void ScalarRayVSSphere(const RayStream& rays, size_t i, const Sphere& s, float* dist)
+{
+	Vec3 normal;
+	RayVSSphere(s, rays.Get(i), dist[i], normal);
+}
+
+static unsigned ScalarRayVSBox(const RayStream& rays, size_t i, const Box& b)
+{
+	return RayVSBox(rays.Get(i), MakeVec3(rays.rx[i], rays.ry[i], rays.rz[i]), b) ? 1U : 0U;
+}
+
+//One lane wide wrapper so the wide bvh traversal and the triangle blocks also work without SIMD, testing the children
+//and triangles one by one
+namespace scalar
+{
+	const unsigned WIDTH = 1;
+	struct VFloat { float v; };
+	struct VMask { bool m; };
+
+	inline VFloat Load(const float* p) { VFloat r = { *p }; return r; }
+	inline void Store(float* p, VFloat a) { *p = a.v; }
+	inline VFloat Set1(float f) { VFloat r = { f }; return r; }
+	inline VFloat operator+(VFloat a, VFloat b) { VFloat r = { a.v + b.v }; return r; }
+	inline VFloat operator-(VFloat a, VFloat b) { VFloat r = { a.v - b.v }; return r; }
+	inline VFloat operator*(VFloat a, VFloat b) { VFloat r = { a.v * b.v }; return r; }
+	inline VFloat operator/(VFloat a, VFloat b) { VFloat r = { a.v / b.v }; return r; }
+	inline VFloat Min(VFloat a, VFloat b) { VFloat r = { fminf(a.v, b.v) }; return r; }
+	inline VFloat Max(VFloat a, VFloat b) { VFloat r = { fmaxf(a.v, b.v) }; return r; }
+	inline VMask Lt(VFloat a, VFloat b) { VMask r = { a.v < b.v }; return r; }
+	inline VMask Gt(VFloat a, VFloat b) { VMask r = { a.v > b.v }; return r; }
+	inline VMask Le(VFloat a, VFloat b) { VMask r = { a.v <= b.v }; return r; }
+	inline VMask Ge(VFloat a, VFloat b) { VMask r = { a.v >= b.v }; return r; }
+	inline VMask operator&(VMask a, VMask b) { VMask r = { a.m && b.m }; return r; }
+	inline VMask operator|(VMask a, VMask b) { VMask r = { a.m || b.m }; return r; }
+	inline VFloat Select(VMask m, VFloat a, VFloat b) { return m.m ? a : b; }
+	inline unsigned Bits(VMask m) { return m.m ? 1U : 0U; }
+	inline VFloat LoadBytes(const uint8_t* p) { VFloat r = { (float)*p }; return r; }
+
+#include "BoxKernels.inl"
+#include "WideBVHKernels.inl"
+#include "TriangleBlockKernels.inl"
+}
+
+static const PacketKernels gPacketKernelsScalar = { ISA_SCALAR, 1, ScalarRayVSTriangle, ScalarRayVSTriangleDistance, ScalarRayVSSphere, ScalarRayVSBox,
+	{ scalar::TraverseWideBVH<BVHNode4>, scalar::TraverseWideBVHForShadows<BVHNode4> }, { scalar::TraverseWideBVH<BVHNode8>, scalar::TraverseWideBVHForShadows<BVHNode8> },
+	{ scalar::TraverseWideBVH<BVHNodeQ8>, scalar::TraverseWideBVHForShadows<BVHNodeQ8> },
+	{ scalar::BlockRayVSTriangle<4>, scalar::BlockRayVSTriangleAny<4>, scalar::TraverseBVHBlocks<4>, scalar::TraverseBVHBlocksForShadows<4> },
+	{ scalar::BlockRayVSTriangle<8>, scalar::BlockRayVSTriangleAny<8>, scalar::TraverseBVHBlocks<8>, scalar::TraverseBVHBlocksForShadows<8> },
+	{ scalar::BlockRayVSTriangle<16>, scalar::BlockRayVSTriangleAny<16>, scalar::TraverseBVHBlocks<16>, scalar::TraverseBVHBlocksForShadows<16> } };
+
+#if REI_X86
+extern const PacketKernels gPacketKernelsSSE;
+extern const PacketKernels gPacketKernelsAVX2;
+extern const PacketKernels gPacketKernelsAVX512;
+#endif
+
+const PacketKernels* GetPacketKernels(SimdIsa isa)
+{
+	if (!IsSimdIsaSupported(isa))
+		return nullptr;
+	switch (isa)
+	{
+	case ISA_SCALAR:
+		return &gPacketKernelsScalar;
+#if REI_X86
+	case ISA_SSE:
+		return &gPacketKernelsSSE;
+	case ISA_AVX2:
+		return &gPacketKernelsAVX2;
+	case ISA_AVX512:
+		return &gPacketKernelsAVX512;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+struct WideTraversalTable
+{
+	const PacketKernels* kernels[BVH_LAYOUT_COUNT];
+};
+
+static WideTraversalTable FindWideTraversalKernels()
+{
+	WideTraversalTable table = {};
+	for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++)
+	{
+		const PacketKernels* k = GetPacketKernels((SimdIsa)isa);
+		if (k && k->bvh4.closest)
+			table.kernels[BVH_LAYOUT_WIDE4] = k;
+		if (k && k->bvh8.closest)
+			table.kernels[BVH_LAYOUT_WIDE8] = k;
+		if (k && k->bvh8q.closest)
+			table.kernels[BVH_LAYOUT_QUANTIZED8] = k;
+	}
+	return table;
+}
+
+//The widest supported ISA with kernels for the node width of the layout, looked up once
+static const PacketKernels* GetWideTraversalKernels(BVHLayout layout)
+{
+	static const WideTraversalTable table = FindWideTraversalKernels();
+	return table.kernels[layout];
+}
+
+SimdIsa GetBVHLayoutIsa(BVHLayout layout)
+{
+	if (layout == BVH_LAYOUT_BINARY_BLOCKS)
+		return GetTriangleBlockIsa(TRIANGLE_BLOCK_BVH_WIDTH);
+	return layout == BVH_LAYOUT_BINARY ? ISA_SCALAR : GetWideTraversalKernels(layout)->isa;
+}
+
+int TraverseBVH(const Ray & r, const Vec3 & rcpDir, const Triangle * triangles, const WideBVH & bvh, float & dist, float & u, float & v)
+{
+	return TraverseBVH(r, rcpDir, TRIANGLE_TEST_MOLLER_TRUMBORE, triangles, nullptr, bvh, dist, u, v);
+}
+
+bool TraverseBVHForShadows(const Ray & r, const Vec3 & rcpDir, float dist, const Triangle * triangles, const WideBVH & bvh)
+{
+	return TraverseBVHForShadows(r, rcpDir, dist, TRIANGLE_TEST_MOLLER_TRUMBORE, triangles, nullptr, bvh);
+}
+
+int TraverseBVH(const Ray & r, const Vec3 & rcpDir, TriangleTest test, const Triangle * triangles, const PrecomputedTriangle * precomputed,
+	const WideBVH & bvh, float & dist, float & u, float & v, RayStats * stats)
+{
+	switch (bvh.GetLayout())
+	{
+	case BVH_LAYOUT_WIDE4:
+		return GetWideTraversalKernels(BVH_LAYOUT_WIDE4)->bvh4.closest(r, rcpDir, test, triangles, precomputed, bvh.GetNodes4(), bvh.GetTriangleIndices(),
+			bvh.GetMeshes(), bvh.GetMeshCount(), dist, u, v, stats);
+	case BVH_LAYOUT_WIDE8:
+		return GetWideTraversalKernels(BVH_LAYOUT_WIDE8)->bvh8.closest(r, rcpDir, test, triangles, precomputed, bvh.GetNodes8(), bvh.GetTriangleIndices(),
+			bvh.GetMeshes(), bvh.GetMeshCount(), dist, u, v, stats);
+	case BVH_LAYOUT_QUANTIZED8:
+		return GetWideTraversalKernels(BVH_LAYOUT_QUANTIZED8)->bvh8q.closest(r, rcpDir, test, triangles, precomputed, bvh.GetNodesQ8(), bvh.GetTriangleIndices(),
+			bvh.GetMeshes(), bvh.GetMeshCount(), dist, u, v, stats);
+	default:
+		return TraverseBVH(r, rcpDir, test, triangles, precomputed, bvh.GetNodes(), bvh.GetTriangleIndices(), bvh.GetMeshes(), bvh.GetMeshCount(), dist, u, v);
+	}
+}
+
+bool TraverseBVHForShadows(const Ray & r, const Vec3 & rcpDir, float dist, TriangleTest test, const Triangle * triangles, const PrecomputedTriangle * precomputed,
+	const WideBVH & bvh, RayStats * stats)
+{
+	switch (bvh.GetLayout())
+	{
+	case BVH_LAYOUT_WIDE4:
+		return GetWideTraversalKernels(BVH_LAYOUT_WIDE4)->bvh4.shadows(r, rcpDir, dist, test, triangles, precomputed, bvh.GetNodes4(), bvh.GetTriangleIndices(),
+			bvh.GetMeshes(), bvh.GetMeshCount(), stats);
+	case BVH_LAYOUT_WIDE8:
+		return GetWideTraversalKernels(BVH_LAYOUT_WIDE8)->bvh8.shadows(r, rcpDir, dist, test, triangles, precomputed, bvh.GetNodes8(), bvh.GetTriangleIndices(),
+			bvh.GetMeshes(), bvh.GetMeshCount(), stats);
+	case BVH_LAYOUT_QUANTIZED8:
+		return GetWideTraversalKernels(BVH_LAYOUT_QUANTIZED8)->bvh8q.shadows(r, rcpDir, dist, test, triangles, precomputed, bvh.GetNodesQ8(), bvh.GetTriangleIndices(),
+			bvh.GetMeshes(), bvh.GetMeshCount(), stats);
+	default:
+		return TraverseBVHForShadows(r, rcpDir, dist, test, triangles, precomputed, bvh.GetNodes(), bvh.GetTriangleIndices(), bvh.GetMeshes(), bvh.GetMeshCount());
+	}
+}
+
+struct TriangleBlockTable
+{
+	const PacketKernels* kernels[3]; //Widths 4, 8 and 16
+};
+
+static TriangleBlockTable FindTriangleBlockKernels()
+{
+	TriangleBlockTable table = {};
+	for (int isa = ISA_SCALAR; isa < ISA_COUNT; isa++)
+	{
+		const PacketKernels* k = GetPacketKernels((SimdIsa)isa);
+		if (k && k->blocks4.closest)
+			table.kernels[0] = k;
+		if (k && k->blocks8.closest)
+			table.kernels[1] = k;
+		if (k && k->blocks16.closest)
+			table.kernels[2] = k;
+	}
+	return table;
+}
+
+//The widest supported ISA with kernels for the block width, looked up once
+static const PacketKernels* GetTriangleBlockKernels(unsigned width)
+{
+	static const TriangleBlockTable table = FindTriangleBlockKernels();
+	return table.kernels[width <= 4 ? 0 : width <= 8 ? 1 : 2];
+}
+
+SimdIsa GetTriangleBlockIsa(unsigned width)
+{
+	return GetTriangleBlockKernels(width)->isa;
+}
+
+int TraverseBVH(const Ray & r, const Vec3 & rcpDir, const TriangleBlocks & blocks, float & dist, float & u, float & v, RayStats * stats)
+{
+	const PacketKernels* k = GetTriangleBlockKernels(blocks.GetWidth());
+	switch (blocks.GetWidth())
+	{
+	case 4:
+		return k->blocks4.traverse(r, rcpDir, blocks.GetTriangleTest(), blocks.GetBlocks4(), blocks.GetNodes(), blocks.GetMeshes(), blocks.GetMeshCount(), dist, u, v, stats);
+	case 8:
+		return k->blocks8.traverse(r, rcpDir, blocks.GetTriangleTest(), blocks.GetBlocks8(), blocks.GetNodes(), blocks.GetMeshes(), blocks.GetMeshCount(), dist, u, v, stats);
+	default:
+		return k->blocks16.traverse(r, rcpDir, blocks.GetTriangleTest(), blocks.GetBlocks16(), blocks.GetNodes(), blocks.GetMeshes(), blocks.GetMeshCount(), dist, u, v, stats);
+	}
+}
+
+bool TraverseBVHForShadows(const Ray & r, const Vec3 & rcpDir, float dist, const TriangleBlocks & blocks, RayStats * stats)
+{
+	const PacketKernels* k = GetTriangleBlockKernels(blocks.GetWidth());
+	switch (blocks.GetWidth())
+	{
+	case 4:
+		return k->blocks4.traverseShadows(r, rcpDir, dist, blocks.GetTriangleTest(), blocks.GetBlocks4(), blocks.GetNodes(), blocks.GetMeshes(), blocks.GetMeshCount(), stats);
+	case 8:
+		return k->blocks8.traverseShadows(r, rcpDir, dist, blocks.GetTriangleTest(), blocks.GetBlocks8(), blocks.GetNodes(), blocks.GetMeshes(), blocks.GetMeshCount(), stats);
+	default:
+		return k->blocks16.traverseShadows(r, rcpDir, dist, blocks.GetTriangleTest(), blocks.GetBlocks16(), blocks.GetNodes(), blocks.GetMeshes(), blocks.GetMeshCount(), stats);
+	}
+}
@@ -0,0 +1,411 @@
+#ifndef _RAY_KERNELS_H_
+#define _RAY_KERNELS_H_
+
+#include <cfloat>
+#include <cmath>
+#include <stddef.h>
+#include <stdint.h>
+#include "Structs.h"
+#include "SimdIsa.h"
+#include "WideBVH.h"
+#include "TriangleBlocks.h"
+#include "RayStats.h"
+
+#define RAY_KERNELS_STACK_SIZE 256
+
+//Counts into the RayStats a traversal was given, if any, the same counters as STAT_ADD in the shader.
+//Compiled out unless RAY_STATS_ENABLED is set.
+#if RAY_STATS_ENABLED
+#define KERNEL_STAT_ADD(stats, counter, n) do { if (stats) (stats)->counter += (n); } while (0)
+#else
+#define KERNEL_STAT_ADD(stats, counter, n) ((void)(stats))
+#endif
+
+//C++ ports of the intersection functions in Shaders/raytracer.hlsl.
+//They follow the shader line by line so the cpu side sees exactly what the gpu computes.
+//The helpers are static: the SSE, AVX2 and AVX512 files include them too, and a shared inline copy of one compiled
+//there could be the one the linker keeps for the scalar code, running AVX instructions on cpus without them.
+
+struct Vec3
+{
+	float x, y, z;
+};
+
+static inline Vec3 MakeVec3(float x, float y, float z) { Vec3 v = { x, y, z }; return v; }
+static inline Vec3 operator+(const Vec3& a, const Vec3& b) { return MakeVec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+static inline Vec3 operator-(const Vec3& a, const Vec3& b) { return MakeVec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+static inline Vec3 operator*(const Vec3& a, float s) { return MakeVec3(a.x * s, a.y * s, a.z * s); }
+static inline float Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline Vec3 Cross(const Vec3& a, const Vec3& b) { return MakeVec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+static inline Vec3 Normalize(const Vec3& a) { return a * (1.0f / std::sqrt(Dot(a, a))); }
+static inline Vec3 Reciprocal(const Vec3& a) { return MakeVec3(1.0f / a.x, 1.0f / a.y, 1.0f / a.z); }
+static inline Vec3 Position(const TriangleVertex& v) { return MakeVec3(v.posx, v.posy, v.posz); }
+
+struct Ray
+{
+	Vec3 o;
+	Vec3 d;
+};
+
+struct Box
+{
+	Vec3 min;
+	Vec3 max;
+};
+
+static inline Box OctNodeBox(const OctNode& n)
+{
+	Box b;
+	b.min = MakeVec3(n.posx - n.halfx, n.posy - n.halfy, n.posz - n.halfz);
+	b.max = MakeVec3(n.posx + n.halfx, n.posy + n.halfy, n.posz + n.halfz);
+	return b;
+}
+
+static inline Box BVHNodeBox(const BVHNode& n)
+{
+	Box b;
+	b.min = MakeVec3(n.minx, n.miny, n.minz);
+	b.max = MakeVec3(n.maxx, n.maxy, n.maxz);
+	return b;
+}
+
+//t0 < 0 means no hit so far. Updates t0 and normal if the sphere is closer.
+static inline void RayVSSphere(const Sphere& s, const Ray& r, float& t0, Vec3& normal)
+{
+	Vec3 l = MakeVec3(s.posx, s.posy, s.posz) - r.o;
+	float tca = Dot(l, r.d);
+	if (tca < 0.0f)
+		return;
+	float d2 = Dot(l, l) - tca * tca;
+	float radius2 = s.radius * s.radius;
+	if (d2 > radius2)
+		return;
+	float thc = std::sqrt(radius2 - d2);
+	float dist = tca - thc;
+	if (dist < t0 || t0 < 0.0f)
+	{
+		t0 = dist;
+		normal = Normalize((r.o + r.d * dist) - MakeVec3(s.posx, s.posy, s.posz));
+	}
+}
+
+//Returns -1 on a miss
+static inline float RayVSSphereDistance(const Sphere& s, const Ray& r)
+{
+	Vec3 l = MakeVec3(s.posx, s.posy, s.posz) - r.o;
+	float tca = Dot(l, r.d);
+	if (tca < 0.0f)
+		return -1.0f;
+	float d2 = Dot(l, l) - tca * tca;
+	float radius2 = s.radius * s.radius;
+	if (d2 > radius2)
+		return -1.0f;
+	return tca - std::sqrt(radius2 - d2);
+}
+
+//dist < 0 means no hit so far. On a closer hit dist and the barycentric coordinates of v2 and v3 are updated.
+//The shader interpolates the vertex attributes right away, here that is left to the caller.
+static inline bool RayVSTriangle(const Triangle& t, const Ray& r, float& dist, float& u, float& v)
+{
+	Vec3 v1 = Position(t.v1);
+	Vec3 e1 = Position(t.v2) - v1;
+	Vec3 e2 = Position(t.v3) - v1;
+	Vec3 q = Cross(r.d, e2);
+	float a = Dot(e1, q); //The determinant of the matrix (-direction e1 e2)
+	if (a < 0.0001f)
+		return false; //avoid determinants close to zero since we will divide by this
+	float f = 1.0f / a;
+	Vec3 s = r.o - v1;
+	float bu = f * Dot(s, q); //barycentric u coordinate
+	if (bu < 0.0f)
+		return false;
+	Vec3 rr = Cross(s, e1);
+	float bv = f * Dot(r.d, rr); //barycentric v coordinate
+	if (bv < 0.0f || bu + bv > 1.0f)
+		return false;
+	float ttt = f * Dot(e2, rr);
+	if (ttt > 0.0f && (ttt < dist || dist < 0.0f))
+	{
+		dist = ttt;
+		u = bu;
+		v = bv;
+		return true;
+	}
+	return false;
+}
+
+//Used for checking occlusion of lights. Returns -1 on a miss.
+static inline float RayVSTriangleDistance(const Triangle& t, const Ray& r)
+{
+	Vec3 v1 = Position(t.v1);
+	Vec3 e1 = Position(t.v2) - v1;
+	Vec3 e2 = Position(t.v3) - v1;
+	Vec3 q = Cross(r.d, e2);
+	float a = Dot(e1, q);
+	if (a < 0.0001f)
+		return -1.0f;
+	float f = 1.0f / a;
+	Vec3 s = r.o - v1;
+	float bu = f * Dot(s, q);
+	if (bu < 0.0f)
+		return -1.0f;
+	Vec3 rr = Cross(s, e1);
+	float bv = f * Dot(r.d, rr);
+	if (bv < 0.0f || bu + bv > 1.0f)
+		return -1.0f;
+	return f * Dot(e2, rr);
+}
+
+//Fills in what test reads instead of t. Moller-Trumbore reads the Triangle itself, for it the positions are stored like for the watertight test.
+PrecomputedTriangle PrecomputeTriangle(const Triangle& t, TriangleTest test);
+const char* GetTriangleTestName(TriangleTest test);
+
+//Returns -1 on a miss, otherwise the distance with the barycentric coordinates of v2 and v3 in u and v.
+//Back faces and rays in the plane of the triangle miss without needing a determinant epsilon.
+static inline float RayVSTriangleWoop(const PrecomputedTriangle& t, const Ray& r, float& u, float& v)
+{
+	float dz = t.r2[0] * r.d.x + t.r2[1] * r.d.y + t.r2[2] * r.d.z;
+	if (!(dz < 0.0f))
+		return -1.0f;
+	float oz = t.r2[0] * r.o.x + t.r2[1] * r.o.y + t.r2[2] * r.o.z + t.r2[3];
+	float ttt = -oz / dz;
+	if (ttt <= 0.0f)
+		return -1.0f;
+	float bu = t.r0[0] * r.o.x + t.r0[1] * r.o.y + t.r0[2] * r.o.z + t.r0[3] + ttt * (t.r0[0] * r.d.x + t.r0[1] * r.d.y + t.r0[2] * r.d.z);
+	if (bu < 0.0f)
+		return -1.0f;
+	float bv = t.r1[0] * r.o.x + t.r1[1] * r.o.y + t.r1[2] * r.o.z + t.r1[3] + ttt * (t.r1[0] * r.d.x + t.r1[1] * r.d.y + t.r1[2] * r.d.z);
+	if (bv < 0.0f || bu + bv > 1.0f)
+		return -1.0f;
+	u = bu;
+	v = bv;
+	return ttt;
+}
+
+static inline float Component(const Vec3& a, int i)
+{
+	return i == 0 ? a.x : (i == 1 ? a.y : a.z);
+}
+
+//The per ray part of the watertight test. The axis the ray is longest along becomes z, swapping x and y when the ray
+//runs down it so the winding stays the same, and the shear makes the ray point straight along z.
+struct WatertightRay
+{
+	Vec3 o;
+	int kx, ky, kz;
+	float sx, sy, sz;
+};
+
+static inline WatertightRay MakeWatertightRay(const Ray& r)
+{
+	WatertightRay w;
+	w.o = r.o;
+	float ax = std::fabs(r.d.x), ay = std::fabs(r.d.y), az = std::fabs(r.d.z);
+	w.kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+	w.kx = w.kz == 2 ? 0 : w.kz + 1;
+	w.ky = w.kx == 2 ? 0 : w.kx + 1;
+	if (Component(r.d, w.kz) < 0.0f)
+	{
+		int k = w.kx;
+		w.kx = w.ky;
+		w.ky = k;
+	}
+	w.sx = Component(r.d, w.kx) / Component(r.d, w.kz);
+	w.sy = Component(r.d, w.ky) / Component(r.d, w.kz);
+	w.sz = 1.0f / Component(r.d, w.kz);
+	return w;
+}
+
+//Same rules as RayVSTriangleWoop. A shared edge gets the exact same edge function with the sign flipped in both of its
+//triangles and 0 counts as inside, so a ray through the edge always hits at least one of them.
+static inline float RayVSTriangleWatertight(const PrecomputedTriangle& t, const WatertightRay& r, float& u, float& v)
+{
+	Vec3 a = MakeVec3(t.r0[0], t.r0[1], t.r0[2]) - r.o;
+	Vec3 b = MakeVec3(t.r1[0], t.r1[1], t.r1[2]) - r.o;
+	Vec3 c = MakeVec3(t.r2[0], t.r2[1], t.r2[2]) - r.o;
+	float ax = Component(a, r.kx) - r.sx * Component(a, r.kz);
+	float ay = Component(a, r.ky) - r.sy * Component(a, r.kz);
+	float bx = Component(b, r.kx) - r.sx * Component(b, r.kz);
+	float by = Component(b, r.ky) - r.sy * Component(b, r.kz);
+	float cx = Component(c, r.kx) - r.sx * Component(c, r.kz);
+	float cy = Component(c, r.ky) - r.sy * Component(c, r.kz);
+
+	float eu = cx * by - cy * bx; //Weight of v1
+	float ev = ax * cy - ay * cx; //v2
+	float ew = bx * ay - by * ax; //v3
+	if (eu < 0.0f || ev < 0.0f || ew < 0.0f)
+		return -1.0f; //Outside an edge or a back face
+	float det = eu + ev + ew;
+	if (det == 0.0f)
+		return -1.0f;
+	float tScaled = (eu * Component(a, r.kz) + ev * Component(b, r.kz) + ew * Component(c, r.kz)) * r.sz;
+	if (tScaled <= 0.0f)
+		return -1.0f; //Behind the origin
+	float rcpDet = 1.0f / det;
+	u = ev * rcpDet;
+	v = ew * rcpDet;
+	return tScaled * rcpDet;
+}
+
+//Triangle index with the test picked when the scene was built. Returns -1 on a miss like RayVSTriangleDistance.
+static inline float RayVSSelectedTriangle(TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed, int index,
+	const Ray& r, const WatertightRay& wr, float& u, float& v)
+{
+	if (test == TRIANGLE_TEST_WOOP)
+		return RayVSTriangleWoop(precomputed[index], r, u, v);
+	if (test == TRIANGLE_TEST_WATERTIGHT)
+		return RayVSTriangleWatertight(precomputed[index], wr, u, v);
+	float dist = -1.0f;
+	RayVSTriangle(triangles[index], r, dist, u, v);
+	return dist;
+}
+
+//Whether a hit at ttt on the triangle index beats the closest one so far, dist < 0 meaning there is none. A ray running
+//along an edge hits both triangles at the same distance, there the lower index wins so every traversal order and
+//bvh layout keeps the same triangle.
+static inline bool IsCloserHit(float ttt, int index, float dist, int closest)
+{
+	return ttt > 0.0f && (ttt < dist || dist < 0.0f || (ttt == dist && index < closest));
+}
+
+//Narrows [tmin, tmax] to where the ray is between the two planes of a slab. A ray running in one of the planes
+//gets 0 * inf = NaN for it, and as it never leaves the slab that axis is skipped instead of leaving the NaN to
+//fminf and fmaxf, which would take the other plane alone and miss boxes the ray grazes.
+static inline void ClipSlab(float t1, float t2, float& tmin, float& tmax)
+{
+	if (t1 != t1 || t2 != t2)
+		return;
+	tmin = fmaxf(tmin, fminf(t1, t2));
+	tmax = fminf(tmax, fmaxf(t1, t2));
+}
+
+static inline bool RayVSBox(const Ray& r, const Vec3& rcpDir, const Box& b)
+{
+	float tmin = -INFINITY;
+	float tmax = INFINITY;
+	ClipSlab((b.min.x - r.o.x) * rcpDir.x, (b.max.x - r.o.x) * rcpDir.x, tmin, tmax);
+	ClipSlab((b.min.y - r.o.y) * rcpDir.y, (b.max.y - r.o.y) * rcpDir.y, tmin, tmax);
+	ClipSlab((b.min.z - r.o.z) * rcpDir.z, (b.max.z - r.o.z) * rcpDir.z, tmin, tmax);
+	return tmax >= fmaxf(tmin, 0.0f);
+}
+
+//Closest hit through the octrees (or plain ranges) of every mesh. Nothing renders with it any more, it is kept as
+//the octree baseline the microbenchmark measures the BVH layouts against.
+//Returns the index of the closest triangle or -1.
+int TraverseOctTree(const Ray& r, const Vec3& rcpDir, const Triangle* triangles, const OctNode* nodes,
+	const MeshIndices* meshes, int meshCount, float& dist, float& u, float& v);
+//Any hit closer than dist for the microbenchmark's octree baseline
+bool TraverseOctTreeForShadows(const Ray& r, const Vec3& rcpDir, float dist, const Triangle* triangles, const OctNode* nodes,
+	const MeshIndices* meshes, int meshCount);
+
+//Closest hit through the bvhs (or plain ranges) of every mesh, like TraverseBVH in the shader.
+//Returns the index of the closest triangle or -1.
+int TraverseBVH(const Ray& r, const Vec3& rcpDir, const Triangle* triangles, const BVHNode* nodes, const uint32_t* triangleIndices,
+	const MeshIndices* meshes, int meshCount, float& dist, float& u, float& v);
+//Any hit closer than dist, like TraverseBVHForShadows in the shader
+bool TraverseBVHForShadows(const Ray& r, const Vec3& rcpDir, float dist, const Triangle* triangles, const BVHNode* nodes, const uint32_t* triangleIndices,
+	const MeshIndices* meshes, int meshCount);
+
+//The same with the triangle test picked when the scene was built, like the shader runs them.
+//precomputed holds PrecomputeTriangle(triangles[i], test) for every triangle.
+int TraverseBVH(const Ray& r, const Vec3& rcpDir, TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed,
+	const BVHNode* nodes, const uint32_t* triangleIndices, const MeshIndices* meshes, int meshCount, float& dist, float& u, float& v);
+bool TraverseBVHForShadows(const Ray& r, const Vec3& rcpDir, float dist, TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed,
+	const BVHNode* nodes, const uint32_t* triangleIndices, const MeshIndices* meshes, int meshCount);
+
+//Closest hit and any hit through a WideBVH in whichever layout it was set to. The wide layouts test all children
+//of a node at once with the widest ISA that fits the node, and descend into the nearest child first.
+int TraverseBVH(const Ray& r, const Vec3& rcpDir, const Triangle* triangles, const WideBVH& bvh, float& dist, float& u, float& v);
+bool TraverseBVHForShadows(const Ray& r, const Vec3& rcpDir, float dist, const Triangle* triangles, const WideBVH& bvh);
+//The same with the triangle test picked when the scene was built, precomputed like for the binary tables.
+//stats, if given, counts every wide node popped as one node visit and every triangle tested.
+int TraverseBVH(const Ray& r, const Vec3& rcpDir, TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed,
+	const WideBVH& bvh, float& dist, float& u, float& v, RayStats* stats = nullptr);
+bool TraverseBVHForShadows(const Ray& r, const Vec3& rcpDir, float dist, TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed,
+	const WideBVH& bvh, RayStats* stats = nullptr);
+//The ISA TraverseBVH runs the node tests of a layout with
+SimdIsa GetBVHLayoutIsa(BVHLayout layout);
+
+//The binary traversals with the bvh leaves stored as triangle blocks, each block tested against the ray at once
+//with the widest ISA that fits its width and the triangle test the blocks were set for.
+//stats, if given, counts the nodes like the binary traversal and every lane of a tested block as a triangle test.
+int TraverseBVH(const Ray& r, const Vec3& rcpDir, const TriangleBlocks& blocks, float& dist, float& u, float& v, RayStats* stats = nullptr);
+bool TraverseBVHForShadows(const Ray& r, const Vec3& rcpDir, float dist, const TriangleBlocks& blocks, RayStats* stats = nullptr);
+//The ISA TraverseBVH tests blocks of a width with
+SimdIsa GetTriangleBlockIsa(unsigned width);
+
+//Rays in structure of arrays layout so a SIMD kernel can load one component of several rays at once.
+//The arrays are padded to a multiple of 16 so any kernel width can run over the full count.
+struct RayStream
+{
+	float* ox = nullptr;
+	float* oy = nullptr;
+	float* oz = nullptr;
+	float* dx = nullptr;
+	float* dy = nullptr;
+	float* dz = nullptr;
+	float* rx = nullptr; //reciprocal direction
+	float* ry = nullptr;
+	float* rz = nullptr;
+	size_t count = 0;
+	size_t paddedCount = 0;
+
+	RayStream() {};
+	~RayStream();
+	void Resize(size_t count);
+	void Set(size_t i, const Ray& r);
+	Ray Get(size_t i) const;
+
+private:
+	float* _data = nullptr;
+	RayStream(const RayStream& other);
+	RayStream& operator=(const RayStream& other);
+};
+
+//The wide bvh traversals of one ISA for one node width, nullptr where the node is narrower than the ISA
+template<typename Node>
+struct WideTraversalKernels
+{
+	int(*closest)(const Ray& r, const Vec3& rcpDir, TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed,
+		const Node* nodes, const uint32_t* triangleIndices, const MeshIndices* meshes, int meshCount, float& dist, float& u, float& v, RayStats* stats);
+	bool(*shadows)(const Ray& r, const Vec3& rcpDir, float dist, TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed,
+		const Node* nodes, const uint32_t* triangleIndices, const MeshIndices* meshes, int meshCount, RayStats* stats);
+};
+
+//The triangle block kernels of one ISA for one block width, nullptr where the block is narrower than the ISA
+template<typename Block>
+struct TriangleBlockKernels
+{
+	//dist < 0 means no hit so far. Updates dist, u, v and triangleIndex on a closer hit like IsCloserHit and returns whether there was one.
+	bool(*closest)(const Block& block, TriangleTest test, const Ray& r, const WatertightRay& wr, float& dist, float& u, float& v, int& triangleIndex);
+	//Whether any lane is hit in front of the ray closer than dist
+	bool(*any)(const Block& block, TriangleTest test, const Ray& r, const WatertightRay& wr, float dist);
+	int(*traverse)(const Ray& r, const Vec3& rcpDir, TriangleTest test, const Block* blocks, const BVHNode* nodes, const MeshIndices* meshes, int meshCount,
+		float& dist, float& u, float& v, RayStats* stats);
+	bool(*traverseShadows)(const Ray& r, const Vec3& rcpDir, float dist, TriangleTest test, const Block* blocks, const BVHNode* nodes,
+		const MeshIndices* meshes, int meshCount, RayStats* stats);
+};
+
+//One ISA's versions of the kernels above, each testing lanes [i, i + width) of a ray stream against one primitive.
+//dist/u/v point at arrays with one entry per ray and follow the same rules as the scalar kernels.
+struct PacketKernels
+{
+	SimdIsa isa;
+	unsigned width;
+	void(*rayVsTriangle)(const RayStream& rays, size_t i, const Triangle& t, float* dist, float* u, float* v);
+	void(*rayVsTriangleDistance)(const RayStream& rays, size_t i, const Triangle& t, float* dist);
+	void(*rayVsSphere)(const RayStream& rays, size_t i, const Sphere& s, float* dist);
+	//Returns a bit per lane that hit the box
+	unsigned(*rayVsBox)(const RayStream& rays, size_t i, const Box& b);
+	WideTraversalKernels<BVHNode4> bvh4;
+	WideTraversalKernels<BVHNode8> bvh8;
+	WideTraversalKernels<BVHNodeQ8> bvh8q;
+	TriangleBlockKernels<TriangleBlock4> blocks4;
+	TriangleBlockKernels<TriangleBlock8> blocks8;
+	TriangleBlockKernels<TriangleBlock16> blocks16;
+};
+
+//nullptr if the ISA is not compiled in or not supported by this cpu
+const PacketKernels* GetPacketKernels(SimdIsa isa);
+
+#endif
@@ -0,0 +1,54 @@
+//Compiled with AVX2 enabled (/arch:AVX2, -mavx2), only called after GetPacketKernels checked the cpu
+
+//The intrinsics are plain vector operators to GCC and clang, which would fuse them into fma with -mfma and round
+//differently than the scalar kernels, so rays grazing an edge would land elsewhere. MSVC never fuses intrinsics.
+//Set before the include, this file compiles its own copies of the static RayKernels.h helpers too.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include "RayKernels.h"
+
+#if REI_X86
+#include <immintrin.h>
+
+namespace avx2
+{
+	const unsigned WIDTH = 8;
+	struct VFloat { __m256 v; };
+	struct VMask { __m256 m; };
+
+	inline VFloat Load(const float* p) { VFloat r = { _mm256_loadu_ps(p) }; return r; }
+	inline void Store(float* p, VFloat a) { _mm256_storeu_ps(p, a.v); }
+	inline VFloat Set1(float f) { VFloat r = { _mm256_set1_ps(f) }; return r; }
+	inline VFloat operator+(VFloat a, VFloat b) { VFloat r = { _mm256_add_ps(a.v, b.v) }; return r; }
+	inline VFloat operator-(VFloat a, VFloat b) { VFloat r = { _mm256_sub_ps(a.v, b.v) }; return r; }
+	inline VFloat operator*(VFloat a, VFloat b) { VFloat r = { _mm256_mul_ps(a.v, b.v) }; return r; }
+	inline VFloat operator/(VFloat a, VFloat b) { VFloat r = { _mm256_div_ps(a.v, b.v) }; return r; }
+	inline VFloat Min(VFloat a, VFloat b) { VFloat r = { _mm256_min_ps(a.v, b.v) }; return r; }
+	inline VFloat Max(VFloat a, VFloat b) { VFloat r = { _mm256_max_ps(a.v, b.v) }; return r; }
+	inline VFloat Sqrt(VFloat a) { VFloat r = { _mm256_sqrt_ps(a.v) }; return r; }
+	inline VMask Lt(VFloat a, VFloat b) { VMask r = { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; return r; }
+	inline VMask Gt(VFloat a, VFloat b) { VMask r = { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; return r; }
+	inline VMask Le(VFloat a, VFloat b) { VMask r = { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; return r; }
+	inline VMask Ge(VFloat a, VFloat b) { VMask r = { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; return r; }
+	inline VMask operator&(VMask a, VMask b) { VMask r = { _mm256_and_ps(a.m, b.m) }; return r; }
+	inline VMask operator|(VMask a, VMask b) { VMask r = { _mm256_or_ps(a.m, b.m) }; return r; }
+	inline VFloat Select(VMask m, VFloat a, VFloat b) { VFloat r = { _mm256_blendv_ps(b.v, a.v, m.m) }; return r; }
+	inline unsigned Bits(VMask m) { return (unsigned)_mm256_movemask_ps(m.m); }
+	inline VFloat LoadBytes(const uint8_t* p) { VFloat r = { _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p))) }; return r; }
+
+#include "BoxKernels.inl"
+#include "RayPacketKernels.inl"
+#include "WideBVHKernels.inl"
+#include "TriangleBlockKernels.inl"
+}
+
+extern const PacketKernels gPacketKernelsAVX2 = { ISA_AVX2, avx2::WIDTH, avx2::PacketRayVSTriangle, avx2::PacketRayVSTriangleDistance, avx2::PacketRayVSSphere, avx2::PacketRayVSBox,
+	{ nullptr, nullptr }, { avx2::TraverseWideBVH<BVHNode8>, avx2::TraverseWideBVHForShadows<BVHNode8> },
+	{ avx2::TraverseWideBVH<BVHNodeQ8>, avx2::TraverseWideBVHForShadows<BVHNodeQ8> },
+	{ nullptr, nullptr, nullptr, nullptr }, { avx2::BlockRayVSTriangle<8>, avx2::BlockRayVSTriangleAny<8>, avx2::TraverseBVHBlocks<8>, avx2::TraverseBVHBlocksForShadows<8> },
+	{ avx2::BlockRayVSTriangle<16>, avx2::BlockRayVSTriangleAny<16>, avx2::TraverseBVHBlocks<16>, avx2::TraverseBVHBlocksForShadows<16> } };
+#endif
@@ -0,0 +1,54 @@
+//Compiled with AVX-512 enabled (/arch:AVX512, -mavx512f), only called after GetPacketKernels checked the cpu
+
+//The intrinsics are plain vector operators to GCC and clang, which would fuse them into fma with -mfma and round
+//differently than the scalar kernels, so rays grazing an edge would land elsewhere. MSVC never fuses intrinsics.
+//Set before the include, this file compiles its own copies of the static RayKernels.h helpers too.
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include "RayKernels.h"
+
+#if REI_X86
+#include <immintrin.h>
+
+namespace avx512
+{
+	const unsigned WIDTH = 16;
+	struct VFloat { __m512 v; };
+	struct VMask { __mmask16 m; };
+
+	inline VFloat Load(const float* p) { VFloat r = { _mm512_loadu_ps(p) }; return r; }
+	inline void Store(float* p, VFloat a) { _mm512_storeu_ps(p, a.v); }
+	inline VFloat Set1(float f) { VFloat r = { _mm512_set1_ps(f) }; return r; }
+	inline VFloat operator+(VFloat a, VFloat b) { VFloat r = { _mm512_add_ps(a.v, b.v) }; return r; }
+	inline VFloat operator-(VFloat a, VFloat b) { VFloat r = { _mm512_sub_ps(a.v, b.v) }; return r; }
+	inline VFloat operator*(VFloat a, VFloat b) { VFloat r = { _mm512_mul_ps(a.v, b.v) }; return r; }
+	inline VFloat operator/(VFloat a, VFloat b) { VFloat r = { _mm512_div_ps(a.v, b.v) }; return r; }
+	inline VFloat Min(VFloat a, VFloat b) { VFloat r = { _mm512_min_ps(a.v, b.v) }; return r; }
+	inline VFloat Max(VFloat a, VFloat b) { VFloat r = { _mm512_max_ps(a.v, b.v) }; return r; }
+	inline VFloat Sqrt(VFloat a) { VFloat r = { _mm512_sqrt_ps(a.v) }; return r; }
+	//AVX-512 compares straight into mask registers
+	inline VMask Lt(VFloat a, VFloat b) { VMask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; return r; }
+	inline VMask Gt(VFloat a, VFloat b) { VMask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; return r; }
+	inline VMask Le(VFloat a, VFloat b) { VMask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; return r; }
+	inline VMask Ge(VFloat a, VFloat b) { VMask r = { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; return r; }
+	inline VMask operator&(VMask a, VMask b) { VMask r = { (__mmask16)(a.m & b.m) }; return r; }
+	inline VMask operator|(VMask a, VMask b) { VMask r = { (__mmask16)(a.m | b.m) }; return r; }
+	inline VFloat Select(VMask m, VFloat a, VFloat b) { VFloat r = { _mm512_mask_blend_ps(m.m, b.v, a.v) }; return r; }
+	inline unsigned Bits(VMask m) { return (unsigned)m.m; }
+	inline VFloat LoadBytes(const uint8_t* p) { VFloat r = { _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)p))) }; return r; }
+
+#include "BoxKernels.inl"
+#include "RayPacketKernels.inl"
+#include "WideBVHKernels.inl"
+#include "TriangleBlockKernels.inl"
+}
+
+extern const PacketKernels gPacketKernelsAVX512 = { ISA_AVX512, avx512::WIDTH, avx512::PacketRayVSTriangle, avx512::PacketRayVSTriangleDistance, avx512::PacketRayVSSphere, avx512::PacketRayVSBox,
+	{ nullptr, nullptr }, { nullptr, nullptr }, { nullptr, nullptr },
+	{ nullptr, nullptr, nullptr, nullptr }, { nullptr, nullptr, nullptr, nullptr },
+	{ avx512::BlockRayVSTriangle<16>, avx512::BlockRayVSTriangleAny<16>, avx512::TraverseBVHBlocks<16>, avx512::TraverseBVHBlocksForShadows<16> } };
+#endif
@@ -0,0 +1,53 @@
+#include "RayKernels.h"
+
+#if REI_X86
+#include <emmintrin.h>
+#include <string.h>
+
+namespace sse
+{
+	const unsigned WIDTH = 4;
+	struct VFloat { __m128 v; };
+	struct VMask { __m128 m; };
+
+	inline VFloat Load(const float* p) { VFloat r = { _mm_loadu_ps(p) }; return r; }
+	inline void Store(float* p, VFloat a) { _mm_storeu_ps(p, a.v); }
+	inline VFloat Set1(float f) { VFloat r = { _mm_set1_ps(f) }; return r; }
+	inline VFloat operator+(VFloat a, VFloat b) { VFloat r = { _mm_add_ps(a.v, b.v) }; return r; }
+	inline VFloat operator-(VFloat a, VFloat b) { VFloat r = { _mm_sub_ps(a.v, b.v) }; return r; }
+	inline VFloat operator*(VFloat a, VFloat b) { VFloat r = { _mm_mul_ps(a.v, b.v) }; return r; }
+	inline VFloat operator/(VFloat a, VFloat b) { VFloat r = { _mm_div_ps(a.v, b.v) }; return r; }
+	inline VFloat Min(VFloat a, VFloat b) { VFloat r = { _mm_min_ps(a.v, b.v) }; return r; }
+	inline VFloat Max(VFloat a, VFloat b) { VFloat r = { _mm_max_ps(a.v, b.v) }; return r; }
+	inline VFloat Sqrt(VFloat a) { VFloat r = { _mm_sqrt_ps(a.v) }; return r; }
+	inline VMask Lt(VFloat a, VFloat b) { VMask r = { _mm_cmplt_ps(a.v, b.v) }; return r; }
+	inline VMask Gt(VFloat a, VFloat b) { VMask r = { _mm_cmpgt_ps(a.v, b.v) }; return r; }
+	inline VMask Le(VFloat a, VFloat b) { VMask r = { _mm_cmple_ps(a.v, b.v) }; return r; }
+	inline VMask Ge(VFloat a, VFloat b) { VMask r = { _mm_cmpge_ps(a.v, b.v) }; return r; }
+	inline VMask operator&(VMask a, VMask b) { VMask r = { _mm_and_ps(a.m, b.m) }; return r; }
+	inline VMask operator|(VMask a, VMask b) { VMask r = { _mm_or_ps(a.m, b.m) }; return r; }
+	//SSE2 has no blend, pick with and/andnot
+	inline VFloat Select(VMask m, VFloat a, VFloat b) { VFloat r = { _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)) }; return r; }
+	inline unsigned Bits(VMask m) { return (unsigned)_mm_movemask_ps(m.m); }
+	inline VFloat LoadBytes(const uint8_t* p)
+	{
+		int bytes;
+		memcpy(&bytes, p, sizeof(bytes));
+		__m128i zero = _mm_setzero_si128();
+		VFloat r = { _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero)) };
+		return r;
+	}
+
+#include "BoxKernels.inl"
+#include "RayPacketKernels.inl"
+#include "WideBVHKernels.inl"
+#include "TriangleBlockKernels.inl"
+}
+
+extern const PacketKernels gPacketKernelsSSE = { ISA_SSE, sse::WIDTH, sse::PacketRayVSTriangle, sse::PacketRayVSTriangleDistance, sse::PacketRayVSSphere, sse::PacketRayVSBox,
+	{ sse::TraverseWideBVH<BVHNode4>, sse::TraverseWideBVHForShadows<BVHNode4> }, { sse::TraverseWideBVH<BVHNode8>, sse::TraverseWideBVHForShadows<BVHNode8> },
+	{ sse::TraverseWideBVH<BVHNodeQ8>, sse::TraverseWideBVHForShadows<BVHNodeQ8> },
+	{ sse::BlockRayVSTriangle<4>, sse::BlockRayVSTriangleAny<4>, sse::TraverseBVHBlocks<4>, sse::TraverseBVHBlocksForShadows<4> },
+	{ sse::BlockRayVSTriangle<8>, sse::BlockRayVSTriangleAny<8>, sse::TraverseBVHBlocks<8>, sse::TraverseBVHBlocksForShadows<8> },
+	{ sse::BlockRayVSTriangle<16>, sse::BlockRayVSTriangleAny<16>, sse::TraverseBVHBlocks<16>, sse::TraverseBVHBlocksForShadows<16> } };
+#endif
@@ -0,0 +1,98 @@
+//Packet versions of the kernels in RayKernels.h, written once against a small SIMD wrapper.
+//Included inside a namespace by each RayKernels<ISA>.cpp after it defines WIDTH, VFloat, VMask,
+//Load, Store, Set1, Min, Max, Sqrt, Lt, Gt, Le, Ge, Select and Bits for its instruction set.
+//Lanes that the scalar kernel would leave through an early return are masked out instead.
+
+static void PacketRayVSTriangle(const RayStream& rays, size_t i, const Triangle& t, float* dist, float* u, float* v)
+{
+	VFloat ox = Load(rays.ox + i), oy = Load(rays.oy + i), oz = Load(rays.oz + i);
+	VFloat dx = Load(rays.dx + i), dy = Load(rays.dy + i), dz = Load(rays.dz + i);
+
+	VFloat e1x = Set1(t.v2.posx - t.v1.posx), e1y = Set1(t.v2.posy - t.v1.posy), e1z = Set1(t.v2.posz - t.v1.posz);
+	VFloat e2x = Set1(t.v3.posx - t.v1.posx), e2y = Set1(t.v3.posy - t.v1.posy), e2z = Set1(t.v3.posz - t.v1.posz);
+
+	VFloat qx = dy * e2z - dz * e2y;
+	VFloat qy = dz * e2x - dx * e2z;
+	VFloat qz = dx * e2y - dy * e2x;
+	VFloat a = e1x * qx + e1y * qy + e1z * qz;
+	VMask valid = Ge(a, Set1(0.0001f));
+	VFloat f = Set1(1.0f) / a;
+
+	VFloat sx = ox - Set1(t.v1.posx), sy = oy - Set1(t.v1.posy), sz = oz - Set1(t.v1.posz);
+	VFloat bu = f * (sx * qx + sy * qy + sz * qz);
+	valid = valid & Ge(bu, Set1(0.0f));
+
+	VFloat rx = sy * e1z - sz * e1y;
+	VFloat ry = sz * e1x - sx * e1z;
+	VFloat rz = sx * e1y - sy * e1x;
+	VFloat bv = f * (dx * rx + dy * ry + dz * rz);
+	valid = valid & Ge(bv, Set1(0.0f)) & Le(bu + bv, Set1(1.0f));
+
+	VFloat ttt = f * (e2x * rx + e2y * ry + e2z * rz);
+	VFloat current = Load(dist + i);
+	valid = valid & Gt(ttt, Set1(0.0f)) & (Lt(ttt, current) | Lt(current, Set1(0.0f)));
+
+	Store(dist + i, Select(valid, ttt, current));
+	Store(u + i, Select(valid, bu, Load(u + i)));
+	Store(v + i, Select(valid, bv, Load(v + i)));
+}
+
+static void PacketRayVSTriangleDistance(const RayStream& rays, size_t i, const Triangle& t, float* dist)
+{
+	VFloat ox = Load(rays.ox + i), oy = Load(rays.oy + i), oz = Load(rays.oz + i);
+	VFloat dx = Load(rays.dx + i), dy = Load(rays.dy + i), dz = Load(rays.dz + i);
+
+	VFloat e1x = Set1(t.v2.posx - t.v1.posx), e1y = Set1(t.v2.posy - t.v1.posy), e1z = Set1(t.v2.posz - t.v1.posz);
+	VFloat e2x = Set1(t.v3.posx - t.v1.posx), e2y = Set1(t.v3.posy - t.v1.posy), e2z = Set1(t.v3.posz - t.v1.posz);
+
+	VFloat qx = dy * e2z - dz * e2y;
+	VFloat qy = dz * e2x - dx * e2z;
+	VFloat qz = dx * e2y - dy * e2x;
+	VFloat a = e1x * qx + e1y * qy + e1z * qz;
+	VMask valid = Ge(a, Set1(0.0001f));
+	VFloat f = Set1(1.0f) / a;
+
+	VFloat sx = ox - Set1(t.v1.posx), sy = oy - Set1(t.v1.posy), sz = oz - Set1(t.v1.posz);
+	VFloat bu = f * (sx * qx + sy * qy + sz * qz);
+	valid = valid & Ge(bu, Set1(0.0f));
+
+	VFloat rx = sy * e1z - sz * e1y;
+	VFloat ry = sz * e1x - sx * e1z;
+	VFloat rz = sx * e1y - sy * e1x;
+	VFloat bv = f * (dx * rx + dy * ry + dz * rz);
+	valid = valid & Ge(bv, Set1(0.0f)) & Le(bu + bv, Set1(1.0f));
+
+	VFloat ttt = f * (e2x * rx + e2y * ry + e2z * rz);
+	Store(dist + i, Select(valid, ttt, Set1(-1.0f)));
+}
+
+static void PacketRayVSSphere(const RayStream& rays, size_t i, const Sphere& s, float* dist)
+{
+	VFloat lx = Set1(s.posx) - Load(rays.ox + i);
+	VFloat ly = Set1(s.posy) - Load(rays.oy + i);
+	VFloat lz = Set1(s.posz) - Load(rays.oz + i);
+	VFloat tca = lx * Load(rays.dx + i) + ly * Load(rays.dy + i) + lz * Load(rays.dz + i);
+	VMask valid = Ge(tca, Set1(0.0f));
+	VFloat d2 = lx * lx + ly * ly + lz * lz - tca * tca;
+	VFloat radius2 = Set1(s.radius * s.radius);
+	valid = valid & Le(d2, radius2);
+	VFloat thc = Sqrt(Max(radius2 - d2, Set1(0.0f)));
+	VFloat t0 = tca - thc;
+	VFloat current = Load(dist + i);
+	valid = valid & (Lt(t0, current) | Lt(current, Set1(0.0f)));
+	Store(dist + i, Select(valid, t0, current));
+}
+
+static unsigned PacketRayVSBox(const RayStream& rays, size_t i, const Box& b)
+{
+	VFloat ox = Load(rays.ox + i), oy = Load(rays.oy + i), oz = Load(rays.oz + i);
+	VFloat rx = Load(rays.rx + i), ry = Load(rays.ry + i), rz = Load(rays.rz + i);
+
+	VFloat tmin = Set1(-INFINITY);
+	VFloat tmax = Set1(INFINITY);
+	ClipSlab((Set1(b.min.x) - ox) * rx, (Set1(b.max.x) - ox) * rx, tmin, tmax);
+	ClipSlab((Set1(b.min.y) - oy) * ry, (Set1(b.max.y) - oy) * ry, tmin, tmax);
+	ClipSlab((Set1(b.min.z) - oz) * rz, (Set1(b.max.z) - oz) * rz, tmin, tmax);
+
+	return Bits(Ge(tmax, Max(tmin, Set1(0.0f))));
+}
@@ -0,0 +1,73 @@
+#include "RayStats.h"
+#include <fstream>
+#include <vector>
+
+uint32_t GetRayStatCounter(const RayStats & stats, RayStatCounter counter)
+{
+	switch (counter)
+	{
+	case RAYSTAT_PRIMARY:
+		return stats.primaryRays;
+	case RAYSTAT_BOUNCE:
+		return stats.bounceRays;
+	case RAYSTAT_SHADOW:
+		return stats.shadowRays;
+	case RAYSTAT_NODES:
+		return stats.nodeVisits;
+	case RAYSTAT_TRIANGLES:
+		return stats.triangleTests;
+	case RAYSTAT_SPHERES:
+		return stats.sphereTests;
+	case RAYSTAT_COST:
+		return stats.nodeVisits + stats.triangleTests + stats.sphereTests;
+	default:
+		return 0;
+	}
+}
+
+FrameRayStats AccumulateRayStats(const RayStats * pixels, size_t count)
+{
+	FrameRayStats total;
+	for (size_t i = 0; i < count; i++)
+	{
+		total.primaryRays += pixels[i].primaryRays;
+		total.bounceRays += pixels[i].bounceRays;
+		total.shadowRays += pixels[i].shadowRays;
+		total.nodeVisits += pixels[i].nodeVisits;
+		total.triangleTests += pixels[i].triangleTests;
+		total.sphereTests += pixels[i].sphereTests;
+	}
+	return total;
+}
+
+bool WriteRayStatsHeatmap(const std::string & filename, const RayStats * pixels, unsigned width, unsigned height, RayStatCounter counter)
+{
+	size_t count = (size_t)width * height;
+	uint32_t maxValue = 1;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t value = GetRayStatCounter(pixels[i], counter);
+		if (value > maxValue)
+			maxValue = value;
+	}
+
+	std::vector<uint8_t> rgb(count * 3);
+	for (size_t i = 0; i < count; i++)
+	{
+		//0 -> blue, 0.5 -> green, 1 -> red
+		float t = (float)GetRayStatCounter(pixels[i], counter) / (float)maxValue;
+		float r = t < 0.5f ? 0.0f : (t - 0.5f) * 2.0f;
+		float g = t < 0.5f ? t * 2.0f : (1.0f - t) * 2.0f;
+		float b = t < 0.5f ? 1.0f - t * 2.0f : 0.0f;
+		rgb[i * 3 + 0] = (uint8_t)(r * 255.0f + 0.5f);
+		rgb[i * 3 + 1] = (uint8_t)(g * 255.0f + 0.5f);
+		rgb[i * 3 + 2] = (uint8_t)(b * 255.0f + 0.5f);
+	}
+
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout)
+		return false;
+	fout << "P6\n" << width << " " << height << "\n255\n";
+	fout.write((const char*)rgb.data(), rgb.size());
+	return (bool)fout;
+}
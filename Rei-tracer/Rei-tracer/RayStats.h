@@ -0,0 +1,57 @@
+#ifndef _RAY_STATS_H_
+#define _RAY_STATS_H_
+
+//Set to 1 to compile the ray counters into raytracer.hlsl and read them back every frame.
+//With 0 the counters do not exist in the shader and no extra buffers are created.
+#ifndef RAY_STATS_ENABLED
+#define RAY_STATS_ENABLED 0
+#endif
+
+#include <stdint.h>
+#include <string>
+
+//Per pixel counters written by the shader. Layout must match RayStats in raytracer.hlsl
+struct RayStats
+{
+	uint32_t primaryRays;
+	uint32_t bounceRays;
+	uint32_t shadowRays;
+	uint32_t nodeVisits;
+	uint32_t triangleTests;
+	uint32_t sphereTests;
+	uint32_t pad0;
+	uint32_t pad1;
+};
+
+//Sum of all pixels for one frame
+struct FrameRayStats
+{
+	uint64_t primaryRays = 0;
+	uint64_t bounceRays = 0;
+	uint64_t shadowRays = 0;
+	uint64_t nodeVisits = 0;
+	uint64_t triangleTests = 0;
+	uint64_t sphereTests = 0;
+
+	uint64_t TotalRays() const { return primaryRays + bounceRays + shadowRays; }
+};
+
+enum RayStatCounter
+{
+	RAYSTAT_PRIMARY,
+	RAYSTAT_BOUNCE,
+	RAYSTAT_SHADOW,
+	RAYSTAT_NODES,
+	RAYSTAT_TRIANGLES,
+	RAYSTAT_SPHERES,
+	RAYSTAT_COST, //nodes + triangles + spheres, the total number of intersection tests
+	RAYSTAT_COUNT
+};
+
+uint32_t GetRayStatCounter(const RayStats& stats, RayStatCounter counter);
+FrameRayStats AccumulateRayStats(const RayStats* pixels, size_t count);
+
+//Writes the chosen counter as a blue->green->red heatmap normalized to the most expensive pixel. Binary PPM.
+bool WriteRayStatsHeatmap(const std::string& filename, const RayStats* pixels, unsigned width, unsigned height, RayStatCounter counter);
+
+#endif
@@ -0,0 +1,415 @@
+#include "Scene.h"
+#include "OBJLoader.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+using namespace VectorMath;
+
+Scene::Scene()
+{
+}
+
+Scene::~Scene()
+{
+}
+
+const std::vector<std::string>& Scene::GetSceneNames()
+{
+	static const std::vector<std::string> names = { "room", "raptor", "torus", "spheres", "particles" };
+	return names;
+}
+
+bool Scene::Load(const std::string & name)
+{
+	PROFILE_ZONE("Scene::Load");
+	_Clear();
+	_name = name;
+
+	_camera.position = Float3(0.0f, 1.0f, 3.0f);
+	_camera.forward = Float3(0.0f, 0.0f, -1.0f);
+	_camera.up = Float3(0.0f, 1.0f, 0.0f);
+	_camera.fov = 3.14f / 2.0f;
+	_camera.nearPlane = 1.0f;
+	_camera.farPlane = 50.0f;
+	_cameraPath = CameraPath::Orbit(Float3(0.0f, -3.0f, -4.0f), 6.0f, 5.0f, 1.0f, 1.5f);
+
+	_AddRoom();
+	_AddRoomLights();
+	if (!_AddContents(name))
+		return false;
+	_AddSphereBVH();
+	return true;
+}
+
+bool Scene::_AddContents(const std::string & name)
+{
+	if (name == "room")
+	{
+		_spheres.push_back(Sphere(-6.0f, 0.0f, -5.0f, 1.0f));
+		_spheres.push_back(Sphere(0.0f, 4.0f, -5.0f, 1.0f));
+		_spheres.push_back(Sphere(5.0f, -8.0f, -2.5f, 1.0f));
+		_spheres.push_back(Sphere(8.0f, -6.0f, -3.0f, 0.3f));
+		_spheres.push_back(Sphere(-5.0f, 5.0f, -5.0f, 1.0f));
+		if (!_AddMesh("cube.obj", false, "ft_stone01_c.png", "ft_stone01_n.png"))
+			return false;
+		if (!_AddMesh("Sphere2.obj", true, "lunarrock_s.png", "lunarrock_n.png"))
+			return false;
+		return true;
+	}
+	if (name == "raptor")
+	{
+		//The raptor is modelled ~200 units long, scale it down to stand on the floor of the room
+		return _AddMesh("Raptor.obj", true, "raptor.jpg", "raptor_normal.jpg", 0.08f, Float3(-2.4f, -10.0f, -6.7f));
+	}
+	if (name == "torus")
+	{
+		return _AddMesh("torus.obj", true, "lunarrock_s.png", "lunarrock_n.png");
+	}
+	if (name == "spheres")
+	{
+		_spheres.push_back(Sphere(-6.0f, 0.0f, -5.0f, 1.0f));
+		_spheres.push_back(Sphere(0.0f, 4.0f, -5.0f, 1.0f));
+		_spheres.push_back(Sphere(5.0f, -8.0f, -2.5f, 1.0f));
+		_spheres.push_back(Sphere(8.0f, -6.0f, -3.0f, 0.3f));
+		_spheres.push_back(Sphere(-5.0f, 5.0f, -5.0f, 1.0f));
+		_activePointLights = (unsigned)_pointLights.size();
+		if (!_AddMesh("Sphere1.obj", true, "lunarrock_s.png", "lunarrock_n.png", 1.0f, Float3(-4.0f, -8.0f, -4.0f)))
+			return false;
+		return _AddMesh("Sphere3.obj", true, "", "", 1.0f, Float3(4.0f, -4.0f, -4.0f));
+	}
+	if (name == "particles")
+	{
+		//A cloud of small spheres filling the room, with a fixed seed so every run renders the same
+		std::mt19937 rng(7);
+		auto random = [&](float lo, float hi) { return lo + (hi - lo) * ((rng() >> 8) * (1.0f / 16777216.0f)); };
+		for (unsigned i = 0; i < 4096; i++)
+			_spheres.push_back(Sphere(random(-8.0f, 8.0f), random(-9.5f, 6.0f), random(-9.0f, -1.0f), random(0.05f, 0.2f)));
+		_activePointLights = (unsigned)_pointLights.size();
+		return true;
+	}
+	return false;
+}
+
+void Scene::Upload(IGraphics * graphics) const
+{
+	PROFILE_ZONE("Scene::Upload");
+	graphics->SetBVHLayout(_bvhLayout);
+	graphics->SetMeshPartitions(_nodes.empty() ? nullptr : (BVHNode*)&_nodes[0], _nodes.size(),
+		_triangleIndices.empty() ? nullptr : (uint32_t*)&_triangleIndices[0], _triangleIndices.size(), (MeshIndices*)_meshes.data(), _meshes.size());
+	graphics->SetTriangleTest(_triangleTest);
+	graphics->SetTriangles((Triangle*)_triangles.data(), _triangles.size());
+	graphics->SetPlanes((Plane*)_planes.data(), _planes.size());
+	for (auto& t : _textures)
+		graphics->PrepareTextures(t.lowerIndex, t.upperIndex, t.diffuse, t.normal);
+	for (auto& t : _planeTextures)
+		graphics->PreparePlaneTextures(t.lowerIndex, t.upperIndex, t.diffuse, t.normal);
+	graphics->SetTextures();
+	graphics->SetSpheres(_spheres.empty() ? nullptr : (Sphere*)&_spheres[0], _spheres.size());
+	graphics->SetPointLights((PointLight*)&_pointLights[0], _activePointLights);
+	graphics->SetSpotLights((SpotLight*)&_spotLights[0], _spotLights.size());
+	graphics->SetBounceCount(0);
+}
+
+void Scene::SetTriangleTest(TriangleTest test)
+{
+	_triangleTest = test;
+}
+
+void Scene::SetBVHLayout(BVHLayout layout)
+{
+	_bvhLayout = layout;
+}
+
+const std::string & Scene::GetName() const
+{
+	return _name;
+}
+
+Camera Scene::GetCamera(float aspectRatio) const
+{
+	Camera cam = _camera;
+	cam.aspectRatio = aspectRatio;
+	return cam;
+}
+
+const CameraPath & Scene::GetCameraPath() const
+{
+	return _cameraPath;
+}
+
+const std::vector<PointLight>& Scene::GetPointLights() const
+{
+	return _pointLights;
+}
+
+unsigned Scene::GetActivePointLightCount() const
+{
+	return _activePointLights;
+}
+
+size_t Scene::GetTriangleCount() const
+{
+	return _triangles.size();
+}
+
+void Scene::_Clear()
+{
+	_triangles.clear();
+	_restTriangles.clear();
+	_nodes.clear();
+	_triangleIndices.clear();
+	_meshes.clear();
+	_bvhs.clear();
+	_textures.clear();
+	_planes.clear();
+	_planeTextures.clear();
+	_spheres.clear();
+	_sphereBVH = SceneBVH();
+	_pointLights.clear();
+	_spotLights.clear();
+	_activePointLights = 0;
+	_cameraPath = CameraPath();
+}
+
+void Scene::_AddRoom()
+{
+	//The inside of a 20 unit box, each wall facing in. Planes keep the walls out of the bvh,
+	//as triangles they were as big as the room and stretched every bound that contained them.
+	_planes.push_back(Plane(0.0f, 1.0f, 0.0f, -10.0f));  //Floor
+	_planes.push_back(Plane(0.0f, -1.0f, 0.0f, -10.0f)); //Roof
+	_planes.push_back(Plane(1.0f, 0.0f, 0.0f, -10.0f));  //Right wall
+	_planes.push_back(Plane(-1.0f, 0.0f, 0.0f, -10.0f)); //Left wall
+	_planes.push_back(Plane(0.0f, 0.0f, 1.0f, -10.0f));  //Back wall
+	_planes.push_back(Plane(0.0f, 0.0f, -1.0f, -10.0f)); //Front wall
+
+	//Only the floor is textured, two tiles across and one deep
+	Plane& floor = _planes[0];
+	floor.ux = 1.0f / 25.0f;
+	floor.uOffset = 0.4f;
+	floor.vz = -1.0f / 50.0f;
+	floor.vOffset = 0.2f;
+	_planeTextures.push_back({ 0, 0, "ft_stone01_c.png", "ft_stone01_n.png" });
+}
+
+void Scene::_AddRoomLights()
+{
+	_pointLights.resize(10);
+	_pointLights[3] = PointLight(-5.0f, -9.0f, -0.0f, 0.33f, 1.0f, 1.0f, 1.0f, 15.0f);
+	_pointLights[4] = PointLight(-3.0f, -7.0f, -0.0f, 0.33f, 0.3f, 0.8f, 1.0f, 15.0f);
+	_pointLights[5] = PointLight(2.0f, -5.0f, -0.0f, 0.33f, 1.0f, 0.6f, 1.0f, 15.0f);
+	_pointLights[6] = PointLight(4.0f, -3.0f, -0.0f, 0.33f, 0.5f, 0.9f, 1.0f, 15.0f);
+	_pointLights[7] = PointLight(-9.0f, -1.0f, -0.0f, 0.33f, 0.8f, 0.2f, 1.0f, 15.0f);
+	_pointLights[8] = PointLight(7.0f, 1.0f, -0.0f, 0.33f, 1.0f, 0.7f, 0.5f, 15.0f);
+	_pointLights[9] = PointLight(3.0f, 3.0f, -0.0f, 0.33f, 0.3f, 0.7f, 0.2f, 15.0f);
+	_pointLights[0] = PointLight(8.0f, 5.0f, -0.0f, 0.33f, 0.6f, 0.7f, 0.8f, 15.0f);
+	_pointLights[1] = PointLight(-9.0f, 7.0f, -0.0f, 0.33f, 0.7f, 0.9f, 0.0f, 15.0f);
+	_pointLights[2] = PointLight(-5.0f, 9.0f, -0.0f, 0.33f, 0.2f, 0.1f, 0.9f, 15.0f);
+	_activePointLights = 5;
+
+	_spotLights.push_back(SpotLight(-2.0f, 0.0f, 2.0f, 0.70f,
+		1.0f, 1.0f, 1.0f, 20.0f,
+		0.7071f, 0.0f, -0.7071f, 9.0f));
+}
+
+bool Scene::_AddMesh(const std::string & filename, bool partition, const std::string & diffuse, const std::string & normal, float scale, VectorMath::Float3 offset)
+{
+	OBJLoader objLoader;
+	std::vector<Triangle> loaded;
+	unsigned count = objLoader.LoadOBJ(filename, loaded);
+	if (count == 0)
+		return false;
+
+	if (scale != 1.0f || offset.x != 0.0f || offset.y != 0.0f || offset.z != 0.0f)
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			TriangleVertex* v[] = { &loaded[i].v1, &loaded[i].v2, &loaded[i].v3 };
+			for (auto vert : v)
+			{
+				vert->posx = vert->posx * scale + offset.x;
+				vert->posy = vert->posy * scale + offset.y;
+				vert->posz = vert->posz * scale + offset.z;
+			}
+		}
+	}
+
+	unsigned lower = (unsigned)_triangles.size();
+	_triangles.insert(_triangles.end(), loaded.begin(), loaded.begin() + count);
+	_AddUnpartitioned(lower, lower + count);
+	if (partition)
+	{
+		SceneBVH b;
+		b.mesh = (unsigned)_meshes.size() - 1;
+		b.indexOffset = 0;
+		b.bvh.Build(&_triangles[0], lower, count);
+		b.bvh.Restructure(SCENE_BVH_RESTRUCTURE_SECONDS);
+		b.bvh.SortTriangles(&_triangles[0]);
+		_bvhs.push_back(b);
+		_FlattenBVHs();
+	}
+
+	if (!diffuse.empty() || !normal.empty())
+		_textures.push_back({ lower, lower + count - 1, diffuse, normal });
+	return true;
+}
+
+void Scene::_AddUnpartitioned(unsigned lowerIndex, unsigned upperIndex)
+{
+	MeshIndices mi;
+	mi.lowerIndex = lowerIndex;
+	mi.upperIndex = upperIndex;
+	mi.rootPartition = -1;
+	mi.partitionCount = -1;
+	_meshes.push_back(mi);
+}
+
+void Scene::_AddSphereBVH()
+{
+	if (_spheres.empty())
+		return;
+	MeshIndices mi;
+	mi.lowerIndex = 0;
+	mi.upperIndex = (int)_spheres.size();
+	mi.rootPartition = -1;
+	mi.partitionCount = -1;
+	_meshes.push_back(mi);
+	_sphereBVH.mesh = (unsigned)_meshes.size() - 1;
+	_sphereBVH.indexOffset = 0;
+	_sphereBVH.bvh.Build(&_spheres[0], 0, (unsigned)_spheres.size());
+	_sphereBVH.bvh.Restructure(SCENE_BVH_RESTRUCTURE_SECONDS);
+	_FlattenBVHs();
+}
+
+void Scene::_FlattenBVHs()
+{
+	_nodes.clear();
+	_triangleIndices.clear();
+	std::vector<SceneBVH*> bvhs;
+	for (SceneBVH& b : _bvhs)
+		bvhs.push_back(&b);
+	if (!_sphereBVH.bvh.GetNodes().empty())
+		bvhs.push_back(&_sphereBVH);
+	for (SceneBVH* b : bvhs)
+	{
+		const BVH& bvh = b->bvh;
+		MeshIndices& mi = _meshes[b->mesh];
+		mi.rootPartition = (int)_nodes.size();
+		mi.partitionCount = (int)bvh.GetNodes().size();
+		b->indexOffset = (unsigned)_triangleIndices.size();
+
+		_nodes.resize(_nodes.size() + bvh.GetNodes().size());
+		bvh.WriteNodes(&_nodes[mi.rootPartition], mi.rootPartition, b->indexOffset);
+		_triangleIndices.insert(_triangleIndices.end(), bvh.GetTriangleIndices().begin(), bvh.GetTriangleIndices().end());
+	}
+}
+
+void Scene::UpdateTriangles(size_t first, size_t count, const Triangle * triangles, IGraphics * graphics)
+{
+	PROFILE_ZONE("Scene::UpdateTriangles");
+	if (first >= _triangles.size())
+		return;
+	count = (std::min)(count, _triangles.size() - first);
+	std::copy(triangles, triangles + count, _triangles.begin() + first);
+	graphics->UpdateTriangles(first, count, &_triangles[first]);
+
+	bool rebuilt = false;
+	std::vector<SceneBVH*> refit;
+	for (SceneBVH& b : _bvhs)
+	{
+		const MeshIndices& mi = _meshes[b.mesh];
+		if ((size_t)mi.upperIndex <= first || (size_t)mi.lowerIndex >= first + count)
+			continue;
+		rebuilt |= b.bvh.RefitOrRebuild(&_triangles[0]);
+		refit.push_back(&b);
+	}
+
+	//A rebuild can change the number of nodes, which moves every bvh after it
+	if (rebuilt)
+	{
+		_FlattenBVHs();
+		graphics->SetMeshPartitions(&_nodes[0], _nodes.size(), &_triangleIndices[0], _triangleIndices.size(), &_meshes[0], _meshes.size());
+		return;
+	}
+	for (SceneBVH* b : refit)
+	{
+		const MeshIndices& mi = _meshes[b->mesh];
+		b->bvh.WriteNodes(&_nodes[mi.rootPartition], mi.rootPartition, b->indexOffset);
+		graphics->UpdateMeshPartitions(mi.rootPartition, mi.partitionCount, &_nodes[mi.rootPartition]);
+	}
+}
+
+void Scene::UpdateSpheres(size_t first, size_t count, const Sphere * spheres, IGraphics * graphics)
+{
+	PROFILE_ZONE("Scene::UpdateSpheres");
+	if (first >= _spheres.size())
+		return;
+	count = (std::min)(count, _spheres.size() - first);
+	std::copy(spheres, spheres + count, _spheres.begin() + first);
+	for (size_t i = first; i < first + count; i++)
+		graphics->UpdateSphere(i, _spheres[i]);
+
+	if (_sphereBVH.bvh.RefitOrRebuild(&_spheres[0]))
+	{
+		_FlattenBVHs();
+		graphics->SetMeshPartitions(&_nodes[0], _nodes.size(), &_triangleIndices[0], _triangleIndices.size(), &_meshes[0], _meshes.size());
+		return;
+	}
+	const MeshIndices& mi = _meshes[_sphereBVH.mesh];
+	_sphereBVH.bvh.WriteNodes(&_nodes[mi.rootPartition], mi.rootPartition, _sphereBVH.indexOffset);
+	graphics->UpdateMeshPartitions(mi.rootPartition, mi.partitionCount, &_nodes[mi.rootPartition]);
+}
+
+void Scene::Animate(float time, IGraphics * graphics)
+{
+	PROFILE_ZONE("Scene::Animate");
+	if (_restTriangles.empty())
+		_restTriangles = _triangles;
+
+	std::vector<Triangle> posed;
+	for (const SceneBVH& b : _bvhs)
+	{
+		const MeshIndices& mi = _meshes[b.mesh];
+		const Triangle* rest = &_restTriangles[mi.lowerIndex];
+		size_t count = mi.upperIndex - mi.lowerIndex;
+
+		float minY = FLT_MAX, maxY = -FLT_MAX, centerX = 0.0f, centerZ = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			for (const TriangleVertex* v : { &rest[i].v1, &rest[i].v2, &rest[i].v3 })
+			{
+				minY = (std::min)(minY, v->posy);
+				maxY = (std::max)(maxY, v->posy);
+				centerX += v->posx;
+				centerZ += v->posz;
+			}
+		}
+		centerX /= count * 3.0f;
+		centerZ /= count * 3.0f;
+		float height = (std::max)(maxY - minY, 1e-6f);
+
+		//Up to a quarter turn at the top, the bottom stays put
+		posed.assign(rest, rest + count);
+		float twist = 1.5707963f * std::sin(time);
+		for (Triangle& t : posed)
+		{
+			for (TriangleVertex* v : { &t.v1, &t.v2, &t.v3 })
+			{
+				float angle = twist * (v->posy - minY) / height;
+				float c = std::cos(angle), s = std::sin(angle);
+				float x = v->posx - centerX, z = v->posz - centerZ;
+				v->posx = centerX + x * c + z * s;
+				v->posz = centerZ - x * s + z * c;
+				float nx = v->norx, nz = v->norz;
+				v->norx = nx * c + nz * s;
+				v->norz = -nx * s + nz * c;
+				float tx = v->tanx, tz = v->tanz;
+				v->tanx = tx * c + tz * s;
+				v->tanz = -tx * s + tz * c;
+			}
+		}
+		UpdateTriangles(mi.lowerIndex, count, &posed[0], graphics);
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <vector>
+#include <string>
+#include "Structs.h"
+#include "IGraphics.h"
+#include "CameraPath.h"
+#include "BVH.h"
+
+//Time each mesh bvh may spend in restructuring when it is loaded, the refits and rebuilds while animating skip it
+#define SCENE_BVH_RESTRUCTURE_SECONDS 0.05
+//The triangle test Upload picks unless SetTriangleTest chose another
+#define SCENE_TRIANGLE_TEST TRIANGLE_TEST_WATERTIGHT
+//The same for the bvh layout of the cpu traversal and SetBVHLayout. All layouts find the same hits,
+//four wide nodes were the fastest on the bundled scenes.
+#define SCENE_BVH_LAYOUT BVH_LAYOUT_WIDE4
+
+struct MeshTextures
+{
+	unsigned lowerIndex; //inclusive range of triangles
+	unsigned upperIndex;
+	std::string diffuse;
+	std::string normal;
+};
+
+//A mesh with a bvh of its own, kept around so moving its triangles only needs a refit
+struct SceneBVH
+{
+	unsigned mesh;        //Into the mesh table
+	unsigned indexOffset; //Where its leaves start in the shared triangle index table
+	BVH bvh;
+};
+
+//Everything that makes up one of the named scenes, built on the cpu and uploaded in one go
+class Scene
+{
+public:
+	Scene();
+	~Scene();
+
+	//"room", "raptor", "torus", "spheres" or "particles". Returns false if the name is unknown or a mesh failed to load.
+	bool Load(const std::string& name);
+	void Upload(IGraphics* graphics) const;
+	//Kept across Load, takes effect at the next Upload
+	void SetTriangleTest(TriangleTest test);
+	void SetBVHLayout(BVHLayout layout);
+	//Overwrites count triangles from first on and refits the bvhs of the meshes they belong to, rebuilding a bvh
+	//that refitting has degraded too far. Only what changed is sent to graphics.
+	void UpdateTriangles(size_t first, size_t count, const Triangle* triangles, IGraphics* graphics);
+	//Same for spheres and the bvh over them
+	void UpdateSpheres(size_t first, size_t count, const Sphere* spheres, IGraphics* graphics);
+	//Twists every mesh with a bvh around its vertical axis by an angle following time, like a skinned
+	//character would deform, and sends the result through UpdateTriangles
+	void Animate(float time, IGraphics* graphics);
+
+	const std::string& GetName() const;
+	Camera GetCamera(float aspectRatio) const;
+	const CameraPath& GetCameraPath() const;
+	const std::vector<PointLight>& GetPointLights() const;
+	unsigned GetActivePointLightCount() const;
+	size_t GetTriangleCount() const;
+
+	static const std::vector<std::string>& GetSceneNames();
+
+private:
+	std::string _name;
+	std::vector<Triangle> _triangles;
+	std::vector<Triangle> _restTriangles; //The pose Animate starts from, taken on its first call
+	std::vector<BVHNode> _nodes;
+	std::vector<uint32_t> _triangleIndices;
+	std::vector<MeshIndices> _meshes;
+	std::vector<SceneBVH> _bvhs;
+	std::vector<MeshTextures> _textures;
+	std::vector<Plane> _planes;
+	std::vector<MeshTextures> _planeTextures; //Ranges of planes instead of triangles
+	std::vector<Sphere> _spheres;
+	SceneBVH _sphereBVH; //Its mesh indexes the spheres, it has no nodes while there are no spheres
+	std::vector<PointLight> _pointLights;
+	std::vector<SpotLight> _spotLights;
+	unsigned _activePointLights = 0;
+	TriangleTest _triangleTest = SCENE_TRIANGLE_TEST;
+	BVHLayout _bvhLayout = SCENE_BVH_LAYOUT;
+	Camera _camera;
+	CameraPath _cameraPath;
+
+	void _Clear();
+	//Everything the named scene puts in the room
+	bool _AddContents(const std::string& name);
+	//Builds the bvh over every sphere added so far and gives it the last entry in the mesh table
+	void _AddSphereBVH();
+	void _AddRoom();
+	void _AddRoomLights();
+	//Loads the obj, scales and moves it, and builds a bvh over it unless partition is false
+	bool _AddMesh(const std::string& filename, bool partition, const std::string& diffuse, const std::string& normal,
+		float scale = 1.0f, VectorMath::Float3 offset = VectorMath::Float3(0.0f, 0.0f, 0.0f));
+	void _AddUnpartitioned(unsigned lowerIndex, unsigned upperIndex);
+	//Lays the nodes and triangle indices of every bvh out in the shared tables and points the meshes at them
+	void _FlattenBVHs();
+};
+
+#endif
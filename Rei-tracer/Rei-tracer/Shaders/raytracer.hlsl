@@ -12,8 +12,7 @@ cbuffer CameraBuffer : register(b0)
 	float gFOV : packoffset(c3.w);
 	uint gWidth : packoffset(c4.x);
 	uint gHeight : packoffset(c4.y);
-	float pad : packoffset(c4.z);
-	float pad2 : packoffset(c4.w);
+	float2 gJitter : packoffset(c4.z); //Subpixel offset of the sample grid in pixels, GetAccumulationJitter
 }
 
 cbuffer Counts : register(b1)
@@ -22,10 +21,16 @@ cbuffer Counts : register(b1)
 	int gTriangleCount;
 	int gPointLightCount;
 	int gBounceCount;
-	int gTextureCount;
+	int gMaterialCount;
 	int gSpotLightCount;
 	int gMeshIndexCount;
 	int gMeshPartitionCount;
+	int gPlaneCount;
+	int gTriangleTest;
+	int gAccumulate; //Add to gAccumulation instead of overwriting it
+	int gSampleMask; //Rays of the 3x3 grid to trace, GetSampleMask
+	int gWriteGuides; //Fill gNormalDepth and gAlbedo for the denoiser
+	int3 countsPad;
 };
 
 struct Sphere
@@ -34,6 +39,20 @@ struct Sphere
 	float radius;
 };
 
+//The points p with dot(normal, p) = d, hit only from the front and only within [min, max].
+//Textures map to u = dot(uAxis.xyz, p) + uAxis.w and v the same way.
+struct Plane
+{
+	float3 normal;
+	float d;
+	float3 min;
+	int material;
+	float3 max;
+	float pad;
+	float4 uAxis;
+	float4 vAxis;
+};
+
 
 struct Ray
 {
@@ -57,6 +76,20 @@ struct Triangle
 	Vertex v3;
 };
 
+//Matches the TriangleTest enum in Structs.h
+#define TRIANGLE_TEST_MOLLER_TRUMBORE 0
+#define TRIANGLE_TEST_WOOP 1
+#define TRIANGLE_TEST_WATERTIGHT 2
+
+//What the triangle tests read instead of a whole Triangle: the rows of the transform into unit triangle space
+//for TRIANGLE_TEST_WOOP, the positions of v1, v2 and v3 for TRIANGLE_TEST_WATERTIGHT
+struct PrecomputedTriangle
+{
+	float4 r0;
+	float4 r1;
+	float4 r2;
+};
+
 struct PointLight
 {
 	float3 position;
@@ -75,20 +108,21 @@ struct SpotLight
 	float cone;
 };
 
-struct TriangleTexture
+struct Material
 {
-	uint lowerIndex;
-	uint upperIndex;
 	int diffuseIndex;
 	int normalIndex;
 };
 
-struct MeshPartition
+//Inner nodes have count 0 and their children at leftFirst and leftFirst + 1,
+//leaves test gTriangleIndices[leftFirst, leftFirst + count), or with a negative count
+//the spheres listed in gTriangleIndices[leftFirst, leftFirst - count)
+struct BVHNode
 {
-	float3 position;
-	int lowerIndex;
-	float3 halflengths;
-	int upperIndex;
+	float3 min;
+	int leftFirst;
+	float3 max;
+	int count;
 };
 
 struct MeshIndices
@@ -109,17 +143,43 @@ struct Box
 StructuredBuffer<Sphere> gSpheres : register(t0);
 StructuredBuffer<Triangle> gTriangles : register(t1);
 StructuredBuffer<PointLight> gPointLights : register(t2);
-StructuredBuffer<TriangleTexture> gTriangleTextureIndices : register(t3);
+StructuredBuffer<Material> gMaterials : register(t3);
 Texture2DArray gMeshTextures : register(t4);
 StructuredBuffer<SpotLight> gSpotLights : register(t5);
 StructuredBuffer<MeshIndices> gMeshIndices : register(t6);
-StructuredBuffer<MeshPartition> gMeshPartitions : register(t7);
+StructuredBuffer<BVHNode> gBVHNodes : register(t7);
+StructuredBuffer<uint> gTriangleMaterials : register(t8);
+StructuredBuffer<uint> gTriangleIndices : register(t9);
+StructuredBuffer<Plane> gPlanes : register(t10);
+StructuredBuffer<PrecomputedTriangle> gPrecomputedTriangles : register(t11);
 
 
 SamplerState gSampleLinear : register(s0);
 
+//Compiled in when the host sets RAY_STATS_ENABLED, otherwise every STAT_ADD disappears
+struct RayStats
+{
+	uint primaryRays;
+	uint bounceRays;
+	uint shadowRays;
+	uint nodeVisits;
+	uint triangleTests;
+	uint sphereTests;
+	uint pad0;
+	uint pad1;
+};
+
+#ifdef RAY_STATS
+static RayStats gStats;
+RWStructuredBuffer<RayStats> gRayStats : register(u1);
+#define STAT_ADD(counter, n) gStats.counter += (n)
+#else
+#define STAT_ADD(counter, n)
+#endif
+
 void RayVSSphere(Sphere s, Ray r, inout float t0, inout float3 normal)
 {
+	STAT_ADD(sphereTests, 1);
 	float3 l = s.position - r.o;
 	float tca = dot(l, r.d);
 	if (tca < 0.0f)
@@ -139,6 +199,7 @@ void RayVSSphere(Sphere s, Ray r, inout float t0, inout float3 normal)
 
 void RayVSSphereDistance(Sphere s, Ray r, out float t0)
 {
+	STAT_ADD(sphereTests, 1);
 	t0 = -1.0f;
 	float3 l = s.position - r.o;
 	float tca = dot(l, r.d);
@@ -154,27 +215,133 @@ void RayVSSphereDistance(Sphere s, Ray r, out float t0)
 
 
 
-void RayVSTriangle(Triangle t, Ray r, inout float dist, inout float u, inout float v, inout float3 normal, out float4 tangent)
+//Moller-Trumbore straight from the vertices. Returns -1 on a miss, otherwise the distance with the barycentric coordinates of v2 and v3.
+float RayVSTriangleMoller(Triangle t, Ray r, out float bu, out float bv)
 {
-
+	bu = bv = 0.0f;
 	float3 e1 = t.v2.position - t.v1.position;
 	float3 e2 = t.v3.position - t.v1.position;
 	float3 q = cross(r.d, e2);
 	float a = dot(e1, q); //The determinant of the matrix (-direction e1 e2)
 	if (a < 0.0001f)
-		return; //avoid determinants close to zero since we will divide by this
+		return -1.0f; //avoid determinants close to zero since we will divide by this
 	float f = 1.0f / a;
 	float3 s = r.o - t.v1.position;
-	float bu = f * dot(s, q); //barycentric u coordinate
+	bu = f * dot(s, q); //barycentric u coordinate
 	if (bu < 0.0f)
-		return;
+		return -1.0f;
 	float3 rr = cross(s, e1);
-	float bv = f*dot(r.d, rr); //barycentric v coordinate
+	bv = f * dot(r.d, rr); //barycentric v coordinate
 	if (bv < 0.0f || bu + bv > 1.0f)
-		return;
-	float ttt = f * dot(e2, rr);
+		return -1.0f;
+	return f * dot(e2, rr);
+}
+
+//The rows of the transform into unit triangle space, the triangle's plane is z = 0.
+//Back faces and rays in the plane miss without needing a determinant epsilon.
+float RayVSTriangleWoop(PrecomputedTriangle t, Ray r, out float bu, out float bv)
+{
+	bu = bv = 0.0f;
+	float dz = dot(t.r2.xyz, r.d);
+	if (!(dz < 0.0f))
+		return -1.0f;
+	float ttt = -(dot(t.r2.xyz, r.o) + t.r2.w) / dz;
+	if (ttt <= 0.0f)
+		return -1.0f;
+	bu = dot(t.r0.xyz, r.o) + t.r0.w + ttt * dot(t.r0.xyz, r.d);
+	if (bu < 0.0f)
+		return -1.0f;
+	bv = dot(t.r1.xyz, r.o) + t.r1.w + ttt * dot(t.r1.xyz, r.d);
+	if (bv < 0.0f || bu + bv > 1.0f)
+		return -1.0f;
+	return ttt;
+}
+
+float Component(float3 a, int i)
+{
+	return i == 0 ? a.x : (i == 1 ? a.y : a.z);
+}
+
+//The axis the ray is longest along becomes z, swapping x and y when the ray runs down it so the winding stays the same,
+//and the shear makes the ray point straight along z. Computed once per ray for the watertight test.
+struct WatertightRay
+{
+	float3 o;
+	int kx;
+	int ky;
+	int kz;
+	float3 shear;
+};
+
+WatertightRay MakeWatertightRay(Ray r)
+{
+	WatertightRay w;
+	w.o = r.o;
+	float3 a = abs(r.d);
+	w.kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+	w.kx = w.kz == 2 ? 0 : w.kz + 1;
+	w.ky = w.kx == 2 ? 0 : w.kx + 1;
+	if (Component(r.d, w.kz) < 0.0f)
+	{
+		int k = w.kx;
+		w.kx = w.ky;
+		w.ky = k;
+	}
+	w.shear = float3(Component(r.d, w.kx), Component(r.d, w.ky), 1.0f) / Component(r.d, w.kz);
+	return w;
+}
+
+//A shared edge gets the exact same edge function with the sign flipped in both of its triangles and 0 counts as inside,
+//so a ray through the edge always hits at least one of them. precise keeps mad from breaking that symmetry.
+float RayVSTriangleWatertight(PrecomputedTriangle t, WatertightRay r, out float bu, out float bv)
+{
+	bu = bv = 0.0f;
+	float3 a = t.r0.xyz - r.o;
+	float3 b = t.r1.xyz - r.o;
+	float3 c = t.r2.xyz - r.o;
+	float ax = Component(a, r.kx) - r.shear.x * Component(a, r.kz);
+	float ay = Component(a, r.ky) - r.shear.y * Component(a, r.kz);
+	float bx = Component(b, r.kx) - r.shear.x * Component(b, r.kz);
+	float by = Component(b, r.ky) - r.shear.y * Component(b, r.kz);
+	float cx = Component(c, r.kx) - r.shear.x * Component(c, r.kz);
+	float cy = Component(c, r.ky) - r.shear.y * Component(c, r.kz);
+
+	precise float eu = cx * by - cy * bx; //Weight of v1
+	precise float ev = ax * cy - ay * cx; //v2
+	precise float ew = bx * ay - by * ax; //v3
+	if (eu < 0.0f || ev < 0.0f || ew < 0.0f)
+		return -1.0f; //Outside an edge or a back face
+	float det = eu + ev + ew;
+	if (det == 0.0f)
+		return -1.0f;
+	float tScaled = (eu * Component(a, r.kz) + ev * Component(b, r.kz) + ew * Component(c, r.kz)) * r.shear.z;
+	if (tScaled <= 0.0f)
+		return -1.0f; //Behind the origin
+	float rcpDet = 1.0f / det;
+	bu = ev * rcpDet;
+	bv = ew * rcpDet;
+	return tScaled * rcpDet;
+}
+
+//gTriangles[index] with the test picked when the scene was built. Returns -1 on a miss.
+float RayVSSelectedTriangle(int index, Ray r, WatertightRay wr, out float bu, out float bv)
+{
+	STAT_ADD(triangleTests, 1);
+	if (gTriangleTest == TRIANGLE_TEST_WOOP)
+		return RayVSTriangleWoop(gPrecomputedTriangles[index], r, bu, bv);
+	if (gTriangleTest == TRIANGLE_TEST_WATERTIGHT)
+		return RayVSTriangleWatertight(gPrecomputedTriangles[index], wr, bu, bv);
+	return RayVSTriangleMoller(gTriangles[index], r, bu, bv);
+}
+
+//Only a closer hit loads the whole triangle for its vertex attributes
+void RayVSTriangle(int index, Ray r, WatertightRay wr, inout float dist, inout float u, inout float v, inout float3 normal, out float4 tangent)
+{
+	float bu, bv;
+	float ttt = RayVSSelectedTriangle(index, r, wr, bu, bv);
 	if (ttt > 0.0f && (ttt < dist || dist < 0))
 	{
+		Triangle t = gTriangles[index];
 		dist = ttt;
 		u = bu * t.v2.u + bv * t.v3.u + (1.0f - bv - bu) * t.v1.u;
 		v = bu * t.v2.v + bv * t.v3.v + (1.0f - bv - bu) * t.v1.v;
@@ -184,91 +351,132 @@ void RayVSTriangle(Triangle t, Ray r, inout float dist, inout float u, inout flo
 }
 
 //Used for checking occlusion of lights
-void RayVSTriangleDistance(Triangle t, Ray r, out float dist)
+void RayVSTriangleDistance(int index, Ray r, WatertightRay wr, out float dist)
 {
-	dist = -1.0f;
-	float3 e1 = t.v2.position - t.v1.position;
-	float3 e2 = t.v3.position - t.v1.position;
-	float3 q = cross(r.d, e2);
-	float a = dot(e1, q); //The determinant of the matrix (-direction e1 e2)
-	if (a < 0.0001f)
-		return; //avoid determinants close to zero since we will divide by this
-	float f = 1.0f / a;
-	float3 s = r.o - t.v1.position;
-	float bu = f * dot(s, q); //barycentric u coordinate
-	if (bu < 0.0f)
-		return;
-	float3 rr = cross(s, e1);
-	float bv = f*dot(r.d, rr); //barycentric v coordinate
-	if (bv < 0.0f || bu + bv > 1.0f)
-		return;
-	dist = f * dot(e2, rr);
+	float bu, bv;
+	dist = RayVSSelectedTriangle(index, r, wr, bu, bv);
 }
 
-bool RayVSBox(Ray r, float3 rcpDir, Box b)
+//Returns -1 on a miss
+float RayVSPlaneDistance(Plane p, Ray r)
 {
-	float tx1 = (b.min.x - r.o.x)*rcpDir.x;
-	float tx2 = (b.max.x - r.o.x)*rcpDir.x;
-	float tmin = min(tx1, tx2);
-	float tmax = max(tx1, tx2);
+	float facing = dot(p.normal, r.d);
+	if (facing > -0.0001f)
+		return -1.0f; //Parallel or seen from behind
+	float t = (p.d - dot(p.normal, r.o)) / facing;
+	float3 hit = r.o + r.d * t;
+	if (t <= 0.0f || any(hit < p.min) || any(hit > p.max))
+		return -1.0f;
+	return t;
+}
 
-	float ty1 = (b.min.y - r.o.y)*rcpDir.y;
-	float ty2 = (b.max.y - r.o.y)*rcpDir.y;
-	tmin = min(ty1, ty2);
-	tmax = max(ty1, ty2);
+//Planes are kept out of the bvh, every ray tests all of them after it
+void IntersectPlanes(Ray r, inout float dist, inout int planeIndex, inout float3 normal)
+{
+	for (int i = 0; i < gPlaneCount; i++)
+	{
+		float t = RayVSPlaneDistance(gPlanes[i], r);
+		if (t > 0.0f && (t < dist || dist < 0.0f))
+		{
+			dist = t;
+			planeIndex = i;
+			normal = gPlanes[i].normal;
+		}
+	}
+}
 
-	float tz1 = (b.min.z - r.o.z)*rcpDir.z;
-	float tz2 = (b.max.z - r.o.z)*rcpDir.z;
-	tmin = min(tz1, tz2);
-	tmax = max(tz1, tz2);
+bool PlanesOcclude(Ray r, float dist)
+{
+	for (int i = 0; i < gPlaneCount; i++)
+	{
+		float t = RayVSPlaneDistance(gPlanes[i], r);
+		if (t > 0.0f && t < dist)
+			return true;
+	}
+	return false;
+}
+
+//Checked on the bits, the compiler may fold x != x away
+bool IsNaN(float x)
+{
+	return (asuint(x) & 0x7fffffff) > 0x7f800000;
+}
+
+//A ray running in one of the planes of a slab gets 0 * inf = NaN for it. It never leaves the slab, so that axis
+//is skipped instead of leaving the NaN to min and max, like ClipSlab in RayKernels.h.
+void ClipSlab(float t1, float t2, inout float tmin, inout float tmax)
+{
+	if (IsNaN(t1) || IsNaN(t2))
+		return;
+	tmin = max(tmin, min(t1, t2));
+	tmax = min(tmax, max(t1, t2));
+}
+
+bool RayVSBox(Ray r, float3 rcpDir, Box b)
+{
+	float tmin = -asfloat(0x7f800000);
+	float tmax = asfloat(0x7f800000);
+	ClipSlab((b.min.x - r.o.x)*rcpDir.x, (b.max.x - r.o.x)*rcpDir.x, tmin, tmax);
+	ClipSlab((b.min.y - r.o.y)*rcpDir.y, (b.max.y - r.o.y)*rcpDir.y, tmin, tmax);
+	ClipSlab((b.min.z - r.o.z)*rcpDir.z, (b.max.z - r.o.z)*rcpDir.z, tmin, tmax);
 
 	return tmax >= max(tmin, 0.0f);
 }
 
-void TraverseOctTree(Ray r, inout float dist, inout float u, inout float v, inout int triangleIndex, inout float3 normal, out float4 tangent, float3 rcpDir)
+//The bvh build stops splitting at BVH_MAX_DEPTH (48), a depth first walk never holds more nodes than that plus one
+#define BVH_STACK_SIZE 49
+
+void TraverseBVH(Ray r, inout float dist, inout float u, inout float v, inout int triangleIndex, inout float3 normal, out float4 tangent, float3 rcpDir)
 {
+	WatertightRay wr = MakeWatertightRay(r);
 
 	float previous = dist;
 	for (int i = 0; i < gMeshIndexCount; i++)
 	{
 		if (gMeshIndices[i].rootPartition >= 0)
 		{
-			//We have an octtree to traverse
+			//We have a bvh to traverse
 			//No recursion in hlsl, we'll have to use a stack
-			int stack[73];
+			int stack[BVH_STACK_SIZE];
 			int stackPtr = 0;
-			int nodeIndex = gMeshIndices[i].rootPartition;
-			
 
-			stack[stackPtr] = nodeIndex;
+			stack[stackPtr] = gMeshIndices[i].rootPartition;
 			stackPtr++;
 
 			while (stackPtr)
 			{
-				nodeIndex = stack[stackPtr - 1];
+				BVHNode node = gBVHNodes[stack[stackPtr - 1]];
 				stackPtr--;
+				STAT_ADD(nodeVisits, 1);
 
 				Box b;
-				b.min = gMeshPartitions[nodeIndex].position - gMeshPartitions[nodeIndex].halflengths;
-				b.max = gMeshPartitions[nodeIndex].position + gMeshPartitions[nodeIndex].halflengths;
+				b.min = node.min;
+				b.max = node.max;
 
 				if (RayVSBox(r, rcpDir, b))
 				{
-					if (gMeshIndices[i].partitionCount >= (nodeIndex - gMeshIndices[i].rootPartition) * 8 + 8 + 1)
+					if (node.count == 0)
 					{
-						[unroll]
-						for (int c = 1; c < 9; c++)
+						stack[stackPtr++] = node.leftFirst + 1;
+						stack[stackPtr++] = node.leftFirst;
+					}
+					for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+					{
+						int t = gTriangleIndices[c];
+						previous = dist;
+						RayVSTriangle(t, r, wr, dist, u, v, normal, tangent);
+						if (dist < previous)
 						{
-							stack[stackPtr++] = ((nodeIndex - gMeshIndices[i].rootPartition) * 8) + c;
+							triangleIndex = t;
 						}
 					}
-					for (int c = gMeshPartitions[nodeIndex].lowerIndex; c < gMeshPartitions[nodeIndex].upperIndex; c++)
+					for (c = node.leftFirst; c < node.leftFirst - node.count; c++)
 					{
 						previous = dist;
-						RayVSTriangle(gTriangles[c], r, dist, u, v, normal, tangent);
+						RayVSSphere(gSpheres[gTriangleIndices[c]], r, dist, normal);
 						if (dist < previous)
 						{
-							triangleIndex = c;
+							triangleIndex = -1; //Spheres have no material
 						}
 					}
 				}
@@ -280,7 +488,7 @@ void TraverseOctTree(Ray r, inout float dist, inout float u, inout float v, inou
 			for (int j = gMeshIndices[i].lowerIndex; j < gMeshIndices[i].upperIndex; j++)
 			{
 				previous = dist;
-				RayVSTriangle(gTriangles[j], r, dist, u, v, normal, tangent);
+				RayVSTriangle(j, r, wr, dist, u, v, normal, tangent);
 				if (dist < previous)
 				{
 					triangleIndex = j;
@@ -290,8 +498,9 @@ void TraverseOctTree(Ray r, inout float dist, inout float u, inout float v, inou
 	}
 }
 
-bool TraverseOctTreeForShadows(Ray r, float dist, float3 rcpDir)
+bool TraverseBVHForShadows(Ray r, float dist, float3 rcpDir)
 {
+	WatertightRay wr = MakeWatertightRay(r);
 
 	
 	float comp = -1.0f;
@@ -299,38 +508,42 @@ bool TraverseOctTreeForShadows(Ray r, float dist, float3 rcpDir)
 	{
 		if (gMeshIndices[i].rootPartition >= 0)
 		{
-			//We have an octtree to traverse
+			//We have a bvh to traverse
 			//No recursion in hlsl, we'll have to use a stack
-			int stack[73];
+			int stack[BVH_STACK_SIZE];
 			int stackPtr = 0;
-			int nodeIndex = gMeshIndices[i].rootPartition;
-			
 
-			stack[stackPtr] = nodeIndex;
+			stack[stackPtr] = gMeshIndices[i].rootPartition;
 			stackPtr++;
 
 			while (stackPtr)
 			{
-				nodeIndex = stack[stackPtr - 1];
+				BVHNode node = gBVHNodes[stack[stackPtr - 1]];
 				stackPtr--;
+				STAT_ADD(nodeVisits, 1);
 
 				Box b;
-				b.min = gMeshPartitions[nodeIndex].position - gMeshPartitions[nodeIndex].halflengths;
-				b.max = gMeshPartitions[nodeIndex].position + gMeshPartitions[nodeIndex].halflengths;
+				b.min = node.min;
+				b.max = node.max;
 
 				if (RayVSBox(r, rcpDir, b))
 				{
-					if (gMeshIndices[i].partitionCount >= (nodeIndex - gMeshIndices[i].rootPartition) * 8 + 8 + 1)
+					if (node.count == 0)
+					{
+						stack[stackPtr++] = node.leftFirst + 1;
+						stack[stackPtr++] = node.leftFirst;
+					}
+					for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
 					{
-						[unroll]
-						for (int c = 1; c < 9; c++)
+						RayVSTriangleDistance(gTriangleIndices[c], r, wr, comp);
+						if (comp < dist && comp > 0.0f)
 						{
-							stack[stackPtr++] = ((nodeIndex - gMeshIndices[i].rootPartition) * 8) + c;
+							return true;
 						}
 					}
-					for (int c = gMeshPartitions[nodeIndex].lowerIndex; c < gMeshPartitions[nodeIndex].upperIndex; c++)
+					for (c = node.leftFirst; c < node.leftFirst - node.count; c++)
 					{
-						RayVSTriangleDistance(gTriangles[c], r, comp);
+						RayVSSphereDistance(gSpheres[gTriangleIndices[c]], r, comp);
 						if (comp < dist && comp > 0.0f)
 						{
 							return true;
@@ -341,10 +554,10 @@ bool TraverseOctTreeForShadows(Ray r, float dist, float3 rcpDir)
 		}
 		else
 		{
-			//We check the triangles that arent partitioned into an octtree
+			//We check the triangles that arent partitioned into a bvh
 			for (int j = gMeshIndices[i].lowerIndex; j < gMeshIndices[i].upperIndex; j++)
 			{
-				RayVSTriangleDistance(gTriangles[j], r, comp);
+				RayVSTriangleDistance(j, r, wr, comp);
 				if (comp < dist && comp > 0.0f)
 				{
 					return true;
@@ -365,24 +578,14 @@ void SpotLightContribution(float3 rayOrigin, float3 origin, float3 normal, SpotL
 		return;
 
 	//Check if light source is occluded
+	STAT_ADD(shadowRays, 1);
 	Ray r;
 	r.o = origin;
 	r.d = toLight;
 	r.o += 0.0001f * r.d;
-	float t0;
-	for (int i = 0; i < gSphereCount; i++)
-	{
-		RayVSSphereDistance(gSpheres[i], r, t0);
-		if (t0 > 0.0f && t0 < dist)
-			return;
-	}
-	t0 = -1.0f;
-	for (i = 0; i < gTriangleCount; i++)
-	{
-		RayVSTriangleDistance(gTriangles[i], r, t0);
-		if (t0 > 0.0f && t0 < dist)
-			return;
-	}
+	float3 rcpDir = rcp(r.d);
+	if (PlanesOcclude(r, dist) || TraverseBVHForShadows(r, dist, rcpDir))
+		return;
 
 	float divby = (dist / spotlight.range) + 1.0f;
 	float attenuation = pow(max(dot(-toLight, spotlight.dir), 0.0f),spotlight.cone) * spotlight.intensity / (divby * divby);
@@ -406,21 +609,14 @@ void PointLightContribution(float3 rayOrigin, float3 origin, float3 normal, Poin
 	if (NdL < 0.0f)
 		return; //No contribution at all, return
 	//Check for occlusion (shadows)
-
+	STAT_ADD(shadowRays, 1);
 	Ray r;
 	r.o = origin;
 	r.d = toLight;
 	r.o += 0.0001f * r.d;
 	
-	float t0;
-	for (int i = 0; i < gSphereCount; i++)
-	{
-		RayVSSphereDistance(gSpheres[i], r, t0);
-		if (t0 > 0.0f && t0 < dist)
-			return;
-	}
 	float3 rcpDir = rcp(r.d);
-	if (TraverseOctTreeForShadows(r, dist, rcpDir))
+	if (PlanesOcclude(r, dist) || TraverseBVHForShadows(r, dist, rcpDir))
 		return;
 
 
@@ -436,17 +632,25 @@ void PointLightContribution(float3 rayOrigin, float3 origin, float3 normal, Poin
 
 
 
-RWTexture2D<float4> output : register(u0);
+//Linear radiance summed over the accumulated frames, with the frame count in w. Shaders/tonemap.hlsl turns it into the frame.
+//A structured buffer since typed uav loads of float4 textures are optional in d3d11.
+RWStructuredBuffer<float4> gAccumulation : register(u0);
+//First hit of every pixel averaged over its samples, see Denoiser.h
+RWStructuredBuffer<float4> gNormalDepth : register(u2);
+RWStructuredBuffer<float4> gAlbedo : register(u3);
 
 [numthreads(32, 32, 1)]
 void main( uint3 threadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID )
 {
-	if (threadID.x > gWidth || threadID.y > gHeight)
+	if (threadID.x >= gWidth || threadID.y >= gHeight)
 		return;
+#ifdef RAY_STATS
+	gStats = (RayStats)0;
+#endif
 
 	float3 rayPos = gCamPos + gCamDir * gCamFar;
-	float nx = (threadID.x - gWidth / 2.0f) / gWidth;
-	float ny = (threadID.y - gHeight / 2.0f) / gHeight;
+	float nx = (threadID.x - gWidth / 2.0f) / gWidth + gJitter.x / gWidth;
+	float ny = (threadID.y - gHeight / 2.0f) / gHeight + gJitter.y / gHeight;
 
 	float dx = 0.5f / gWidth; //Used to offset ray directions for super sampling
 	float dy = 0.5f / gHeight;
@@ -478,61 +682,85 @@ void main( uint3 threadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupT
 
 	float3 accumulatedDiff = float3(0.0f, 0.0f, 0.0f);
 	float3 accumulatedSpec = float3(0.0f, 0.0f, 0.0f);
+	float3 guideNormal = float3(0.0f, 0.0f, 0.0f);
+	float3 guideAlbedo = float3(0.0f, 0.0f, 0.0f);
+	float guideDepth = 0.0f;
+	int hits = 0;
 
 	for (int samples = 0; samples < 9; samples++)
 	{
+		if (!(gSampleMask & (1 << samples)))
+			continue;
 		r.d = rayDirections[samples];
 		r.o = gCamPos;
 		for (int bounces = 0; bounces < gBounceCount + 1; bounces++)
 		{
+			if (bounces == 0)
+				STAT_ADD(primaryRays, 1);
+			else
+				STAT_ADD(bounceRays, 1);
 			float3 rcpDir = rcp(r.d);
 			float3 intersectionNormal = r.d;
 			float3 intersectionPoint = r.o;
 			float4 intersectionTangent;
 			float intersectionDistance = 9999.0f;
-			for (int i = 0; i < gSphereCount; i++)
-			{
-				RayVSSphere(gSpheres[i], r, intersectionDistance, intersectionNormal);
-			}
 
 			float dduu = 0.0f;
 			float ddvv = 0.0f;
 			int triangleIndex = -1;
 
-			TraverseOctTree(r, intersectionDistance, dduu, ddvv, triangleIndex, intersectionNormal, intersectionTangent, rcpDir);
+			TraverseBVH(r, intersectionDistance, dduu, ddvv, triangleIndex, intersectionNormal, intersectionTangent, rcpDir);
+			int planeIndex = -1;
+			IntersectPlanes(r, intersectionDistance, planeIndex, intersectionNormal);
 
 			if (intersectionDistance < 0.0f)
 				break;
 
 			intersectionPoint += r.d * intersectionDistance;
 
+			//Triangles without a material range map to material 0, which has no textures, spheres have none at all
+			int materialIndex = -1;
+			if (planeIndex >= 0)
+			{
+				Plane plane = gPlanes[planeIndex];
+				materialIndex = plane.material;
+				dduu = dot(plane.uAxis.xyz, intersectionPoint) + plane.uAxis.w;
+				ddvv = dot(plane.vAxis.xyz, intersectionPoint) + plane.vAxis.w;
+				intersectionTangent = float4(normalize(plane.uAxis.xyz), 1.0f);
+			}
+			else if (triangleIndex >= 0)
+				materialIndex = gTriangleMaterials[triangleIndex];
+
 			float3 texColor = float3(1.0f, 1.0f, 1.0f);
-			if (triangleIndex >= 0)
+			if (materialIndex >= 0)
 			{
-				for (i = 0; i < gTextureCount; i++)
+				Material material = gMaterials[materialIndex];
+				if (material.diffuseIndex >= 0)
+					texColor = gMeshTextures.SampleLevel(gSampleLinear, float3(dduu, ddvv, material.diffuseIndex), 0).xyz;
+				if (material.normalIndex >= 0)
 				{
-					if (triangleIndex >= gTriangleTextureIndices[i].lowerIndex && triangleIndex <= gTriangleTextureIndices[i].upperIndex)
-					{
-						texColor = gMeshTextures.SampleLevel(gSampleLinear, float3(dduu, ddvv, gTriangleTextureIndices[i].diffuseIndex), 0).xyz;
-						if (gTriangleTextureIndices[i].normalIndex >= 0)
-						{
-							float3 sampledNormal = gMeshTextures.SampleLevel(gSampleLinear, float3(dduu, ddvv, gTriangleTextureIndices[i].normalIndex), 0).xyz;
-							sampledNormal = sampledNormal * 2.0f - 1.0f;
-							float3 bitan = intersectionTangent.w * cross(intersectionNormal, intersectionTangent.xyz);
-							float3x3 tbn;
-							tbn[2] = intersectionTangent.xyz;
-							tbn[1] = bitan;
-							tbn[0] = intersectionNormal;
-							intersectionNormal = normalize(mul(sampledNormal, tbn));
-						}
-						break;
-					}
+					float3 sampledNormal = gMeshTextures.SampleLevel(gSampleLinear, float3(dduu, ddvv, material.normalIndex), 0).xyz;
+					sampledNormal = sampledNormal * 2.0f - 1.0f;
+					float3 bitan = intersectionTangent.w * cross(intersectionNormal, intersectionTangent.xyz);
+					float3x3 tbn;
+					tbn[2] = intersectionTangent.xyz;
+					tbn[1] = bitan;
+					tbn[0] = intersectionNormal;
+					intersectionNormal = normalize(mul(sampledNormal, tbn));
 				}
 			}
 
+			if (bounces == 0)
+			{
+				guideNormal += intersectionNormal;
+				guideAlbedo += texColor;
+				guideDepth += intersectionDistance;
+				hits++;
+			}
+
 			float3 ldiffuse = float3(0.0f, 0.0f, 0.0f);
 			float3 lspec = float3(0.0f, 0.0f, 0.0f);
-			for (i = 0; i < gPointLightCount; i++)
+			for (int i = 0; i < gPointLightCount; i++)
 			{
 				PointLightContribution(r.o, intersectionPoint, intersectionNormal, gPointLights[i], lspec, ldiffuse);
 			}
@@ -550,7 +778,20 @@ void main( uint3 threadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupT
 		}
 	}
 
-	accumulatedDiff /= 9.0f;
-	accumulatedSpec /= 9.0f;
-	output[threadID.xy] = saturate(float4((accumulatedDiff + accumulatedSpec), 1.0f));
+	float sampleCount = (float)countbits(gSampleMask);
+	accumulatedDiff /= sampleCount;
+	accumulatedSpec /= sampleCount;
+	uint pixel = threadID.y * gWidth + threadID.x;
+	if (gWriteGuides)
+	{
+		//Misses count as black albedo like they count as black radiance, but leave the depth alone
+		float normalLength = length(guideNormal);
+		gNormalDepth[pixel] = float4(normalLength > 0.0f ? guideNormal / normalLength : guideNormal, hits ? guideDepth / hits : 0.0f);
+		gAlbedo[pixel] = float4(guideAlbedo / sampleCount, 1.0f);
+	}
+	float4 previous = gAccumulate ? gAccumulation[pixel] : float4(0.0f, 0.0f, 0.0f, 0.0f);
+	gAccumulation[pixel] = previous + float4(accumulatedDiff + accumulatedSpec, 1.0f);
+#ifdef RAY_STATS
+	gRayStats[threadID.y * gWidth + threadID.x] = gStats;
+#endif
 }
\ No newline at end of file
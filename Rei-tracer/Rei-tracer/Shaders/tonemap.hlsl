@@ -0,0 +1,51 @@
+
+//Same values as ToneMapOperator in ToneMap.h
+#define TONEMAP_CLAMP 0
+#define TONEMAP_REINHARD 1
+#define TONEMAP_ACES 2
+
+cbuffer ToneMapBuffer : register(b0)
+{
+	uint gWidth;
+	uint gHeight;
+	int gOperator;
+	float gExposure;
+	int gSrgb;
+	int3 toneMapPad;
+};
+
+//Written by Shaders/raytracer.hlsl, radiance sums with the number of frames in w
+StructuredBuffer<float4> gAccumulation : register(t0);
+RWTexture2D<float4> output : register(u0);
+
+float3 ApplyOperator(float3 c)
+{
+	if (gOperator == TONEMAP_REINHARD)
+	{
+		c = max(c, 0.0f);
+		return c / (c + 1.0f);
+	}
+	if (gOperator == TONEMAP_ACES)
+		return saturate((c * (2.51f * c + 0.03f)) / (c * (2.43f * c + 0.59f) + 0.14f));
+	return saturate(c);
+}
+
+float3 LinearToSrgb(float3 c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+[numthreads(32, 32, 1)]
+void main(uint3 threadID : SV_DispatchThreadID)
+{
+	if (threadID.x >= gWidth || threadID.y >= gHeight)
+		return;
+
+	float4 sum = gAccumulation[threadID.y * gWidth + threadID.x];
+	float3 color = float3(0.0f, 0.0f, 0.0f);
+	if (sum.w > 0.0f)
+		color = ApplyOperator(sum.rgb * (gExposure / sum.w));
+	if (gSrgb)
+		color = LinearToSrgb(color);
+	output[threadID.xy] = float4(color, 1.0f);
+}
@@ -0,0 +1,124 @@
+#include "SimdIsa.h"
+#include <stdint.h>
+
+#if REI_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+static void Cpuid(int info[4], int leaf, int subleaf)
+{
+	__cpuidex(info, leaf, subleaf);
+}
+static uint64_t Xgetbv()
+{
+	return _xgetbv(0);
+}
+#else
+#include <cpuid.h>
+static void Cpuid(int info[4], int leaf, int subleaf)
+{
+	__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+}
+static uint64_t Xgetbv()
+{
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+}
+#endif
+
+struct CpuFeatures
+{
+	bool sse2 = false;
+	bool avx2 = false;
+	bool avx512 = false;
+
+	CpuFeatures()
+	{
+		int info[4];
+		Cpuid(info, 0, 0);
+		int maxLeaf = info[0];
+
+		Cpuid(info, 1, 0);
+		sse2 = (info[3] & (1 << 26)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || maxLeaf < 7)
+			return;
+
+		uint64_t xcr0 = Xgetbv();
+		bool ymmSaved = (xcr0 & 0x6) == 0x6;
+		bool zmmSaved = (xcr0 & 0xE6) == 0xE6;
+
+		Cpuid(info, 7, 0);
+		avx2 = ymmSaved && (info[1] & (1 << 5)) != 0;
+		avx512 = zmmSaved && (info[1] & (1 << 16)) != 0;
+	}
+};
+
+static const CpuFeatures& GetCpuFeatures()
+{
+	static const CpuFeatures features;
+	return features;
+}
+#endif
+
+bool IsSimdIsaSupported(SimdIsa isa)
+{
+	switch (isa)
+	{
+	case ISA_SCALAR:
+		return true;
+#if REI_X86
+	case ISA_SSE:
+		return GetCpuFeatures().sse2;
+	case ISA_AVX2:
+		return GetCpuFeatures().avx2;
+	case ISA_AVX512:
+		return GetCpuFeatures().avx512;
+#endif
+	default:
+		return false;
+	}
+}
+
+SimdIsa GetBestSimdIsa()
+{
+	for (int isa = ISA_COUNT - 1; isa > ISA_SCALAR; isa--)
+	{
+		if (IsSimdIsaSupported((SimdIsa)isa))
+			return (SimdIsa)isa;
+	}
+	return ISA_SCALAR;
+}
+
+const char* GetSimdIsaName(SimdIsa isa)
+{
+	switch (isa)
+	{
+	case ISA_SCALAR:
+		return "scalar";
+	case ISA_SSE:
+		return "sse";
+	case ISA_AVX2:
+		return "avx2";
+	case ISA_AVX512:
+		return "avx512";
+	default:
+		return "unknown";
+	}
+}
+
+unsigned GetSimdIsaWidth(SimdIsa isa)
+{
+	switch (isa)
+	{
+	case ISA_SSE:
+		return 4;
+	case ISA_AVX2:
+		return 8;
+	case ISA_AVX512:
+		return 16;
+	default:
+		return 1;
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef _SIMD_ISA_H_
+#define _SIMD_ISA_H_
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define REI_X86 1
+#else
+#define REI_X86 0
+#endif
+
+enum SimdIsa
+{
+	ISA_SCALAR,
+	ISA_SSE,    //SSE2, 4 lanes
+	ISA_AVX2,   //8 lanes
+	ISA_AVX512, //AVX-512F, 16 lanes
+	ISA_COUNT
+};
+
+//Checks both the cpu and that the os saves the wider registers
+bool IsSimdIsaSupported(SimdIsa isa);
+SimdIsa GetBestSimdIsa();
+const char* GetSimdIsaName(SimdIsa isa);
+unsigned GetSimdIsaWidth(SimdIsa isa);
+
+#endif
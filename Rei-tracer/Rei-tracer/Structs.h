@@ -1,7 +1,9 @@
 #ifndef _STRUCTS_H_
 #define _STRUCTS_H_
 
-#include <DirectXMath.h>
+#include "VectorMath.h"
+#include <cfloat>
+#include <stdint.h>
 #include <vector>
 #include <unordered_map>
 
@@ -16,15 +18,33 @@ struct Sphere
 	float radius;
 };
 
+//The points p with dot((x, y, z), p) = d. Planes stay out of the bvh, every ray tests all of them, and like
+//triangles they are only hit from the side the normal points to. Hits outside [min, max] miss, which the
+//constructor sets to the whole float range for an infinite plane. Textures are mapped with
+//u = dot(uAxis, p) + uOffset and v the same way, uAxis is also the tangent.
 struct Plane
 {
 	Plane() {};
 	Plane(float x, float y, float z, float d)
 	{
 		this->x = x; this->y = y; this->z = z; this->d = d;
+		minx = miny = minz = -FLT_MAX;
+		maxx = maxy = maxz = FLT_MAX;
+		material = 0;
+		pad = 0.0f;
+		ux = uy = uz = uOffset = 0.0f;
+		vx = vy = vz = vOffset = 0.0f;
 	}
 	float x, y, z;
 	float d;
+	float minx, miny, minz;
+	int material; //Set by the graphics from PreparePlaneTextures, 0 is the untextured default
+	float maxx, maxy, maxz;
+	float pad;
+	float ux, uy, uz;
+	float uOffset;
+	float vx, vy, vz;
+	float vOffset;
 };
 
 struct PointLight
@@ -65,7 +85,7 @@ struct TriangleVertex
 	{
 		posx = px; posy = py; posz = pz; this->u = u; norx = nx; nory = ny; norz = nz, this->v = v; tanx = tx; tany = ty; tanz = tz; handedness = handed;
 	};
-	TriangleVertex(const DirectX::XMFLOAT3& pos, const DirectX::XMFLOAT3& nor, const DirectX::XMFLOAT4& tan, const DirectX::XMFLOAT2& tex)
+	TriangleVertex(const VectorMath::Float3& pos, const VectorMath::Float3& nor, const VectorMath::Float4& tan, const VectorMath::Float2& tex)
 	{
 		posx = pos.x; posy = pos.y; posz = pos.z; norx = nor.x, nory = nor.y; norz = nor.z; tanx = tan.x; tany = tan.y; tanz = tan.z; handedness = tan.w; u = tex.x; v = tex.y;
 	};
@@ -90,6 +110,36 @@ struct Triangle
 	TriangleVertex v3;
 };
 
+//How rays are tested against triangles, picked when the scene is built
+enum TriangleTest
+{
+	TRIANGLE_TEST_MOLLER_TRUMBORE, //Straight from the vertices of the whole Triangle
+	TRIANGLE_TEST_WOOP,            //An affine transform into the space of the unit triangle, the fewest instructions per test
+	TRIANGLE_TEST_WATERTIGHT,      //Sheared into ray space (Woop, Benthin, Wald 2013), no ray slips through a shared edge
+	TRIANGLE_TEST_COUNT
+};
+
+//How the cpu traversal stores the mesh bvhs, see WideBVH.h. The gpu always reads the binary BVHNode tables.
+enum BVHLayout
+{
+	BVH_LAYOUT_BINARY, //The BVHNode tables as the gpu gets them
+	BVH_LAYOUT_WIDE4,
+	BVH_LAYOUT_WIDE8,
+	BVH_LAYOUT_QUANTIZED8, //BVH_LAYOUT_WIDE8 with BVHNodeQ8 nodes
+	BVH_LAYOUT_BINARY_BLOCKS, //The BVHNode tables with their leaves packed into triangle blocks, see TriangleBlocks.h
+	BVH_LAYOUT_COUNT
+};
+
+//What the triangle tests read instead of a whole Triangle, 48 bytes against 144. For TRIANGLE_TEST_WOOP the rows of the
+//transform that moves the triangle to (0, 0, 0), (1, 0, 0), (0, 1, 0) with its normal along z, for TRIANGLE_TEST_WATERTIGHT
+//the positions of v1, v2 and v3 in xyz. Filled in by PrecomputeTriangle in RayKernels.h.
+struct PrecomputedTriangle
+{
+	float r0[4];
+	float r1[4];
+	float r2[4];
+};
+
 //A box along with the index of the first and last triangle inside of it.
 struct OctNode
 {
@@ -99,6 +149,19 @@ struct OctNode
 	unsigned upper = 0;
 };
 
+//A node of a mesh bvh. Inner nodes have count 0 and their two children at leftFirst and leftFirst + 1,
+//leaves test the count triangles listed from leftFirst on in the triangle index table. In the tables the
+//gpu gets, a leaf with a negative count lists -count spheres there instead.
+struct BVHNode
+{
+	float minx, miny, minz;
+	int leftFirst = 0;
+	float maxx, maxy, maxz;
+	int count = 0;
+};
+
+//A range of triangles and, if rootPartition >= 0, the partitionCount nodes of its bvh starting at rootPartition.
+//For the bvh over the spheres of a scene it is the range of spheres instead.
 struct MeshIndices
 {
 	int lowerIndex;
@@ -129,45 +192,53 @@ struct Material
 	float metallic = 1.0f;
 };
 
+//Indexed per triangle through the triangle material table. Material 0 is always the untextured default,
+//an index of -1 means that texture is missing.
+struct MeshMaterial
+{
+	int diffuseIndex;
+	int normalIndex;
+};
+
 
 struct Camera
 {
-	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT3 forward;
-	DirectX::XMFLOAT3 up;
+	VectorMath::Float3 position;
+	VectorMath::Float3 forward;
+	VectorMath::Float3 up;
 	float fov;
 	float aspectRatio;
 	float nearPlane;
 	float farPlane;
 
-	DirectX::XMFLOAT3 GetRight() const
+	VectorMath::Float3 GetRight() const
 	{
 		 
-		DirectX::XMVECTOR f = DirectX::XMLoadFloat3(&forward);
-		DirectX::XMVECTOR u = DirectX::XMLoadFloat3(&up);
-		DirectX::XMFLOAT3 right;
-		DirectX::XMStoreFloat3(&right, DirectX::XMVector3Cross(u, f));
+		VectorMath::Vector f = VectorMath::LoadFloat3(&forward);
+		VectorMath::Vector u = VectorMath::LoadFloat3(&up);
+		VectorMath::Float3 right;
+		VectorMath::StoreFloat3(&right, VectorMath::Vector3Cross(u, f));
 		return right;
 	}
 };
 
 struct PerFrameBuffer
 {
-	DirectX::XMFLOAT4X4 View;
-	DirectX::XMFLOAT4X4 Proj;
-	DirectX::XMFLOAT4X4 ViewProj;
-	DirectX::XMFLOAT4X4 InvView;
-	DirectX::XMFLOAT4X4 InvViewProj;
-	DirectX::XMFLOAT4X4 InvProj;
-	DirectX::XMFLOAT4 CamPos;
+	VectorMath::Float4x4 View;
+	VectorMath::Float4x4 Proj;
+	VectorMath::Float4x4 ViewProj;
+	VectorMath::Float4x4 InvView;
+	VectorMath::Float4x4 InvViewProj;
+	VectorMath::Float4x4 InvProj;
+	VectorMath::Float4 CamPos;
 };
 
 struct PerObjectBuffer
 {
-	DirectX::XMFLOAT4X4 WVP;
-	DirectX::XMFLOAT4X4 WorldViewInvTrp;
-	DirectX::XMFLOAT4X4 World;
-	DirectX::XMFLOAT4X4 WorldView;
+	VectorMath::Float4x4 WVP;
+	VectorMath::Float4x4 WorldViewInvTrp;
+	VectorMath::Float4x4 World;
+	VectorMath::Float4x4 WorldView;
 };
 
 
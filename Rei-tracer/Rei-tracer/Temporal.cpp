@@ -0,0 +1,233 @@
+#include "Temporal.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "VectorMath.h"
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+using namespace VectorMath;
+
+#define TEMPORAL_MIN_WEIGHT 0.01f //Bilinear weight the valid taps need together, less is a disocclusion
+
+//The range of average radiance the history is clamped to, the mean of the new frame around the pixel give or take
+//gamma standard deviations, but no wider than its smallest and largest value
+static void NeighborhoodBounds(const Float4* current, unsigned width, unsigned height, unsigned x, unsigned y, float gamma, Vector& low, Vector& high)
+{
+	Vector minimum = VectorReplicate(FLT_MAX);
+	Vector maximum = VectorReplicate(-FLT_MAX);
+	Vector mean = VectorReplicate(0.0f);
+	Vector meanSquare = VectorReplicate(0.0f);
+	float count = 0.0f;
+	unsigned y0 = y > 0 ? y - 1 : y;
+	unsigned y1 = y + 1 < height ? y + 1 : y;
+	unsigned x0 = x > 0 ? x - 1 : x;
+	unsigned x1 = x + 1 < width ? x + 1 : x;
+	for (unsigned ny = y0; ny <= y1; ny++)
+	{
+		for (unsigned nx = x0; nx <= x1; nx++)
+		{
+			Vector sum = LoadFloat4(&current[(size_t)ny * width + nx]);
+			float weight = VectorGetW(sum);
+			if (weight <= 0.0f)
+				continue;
+			Vector average = sum * (1.0f / weight);
+			minimum = VectorMin(minimum, average);
+			maximum = VectorMax(maximum, average);
+			mean = mean + average;
+			meanSquare = VectorMultiplyAdd(average, average, meanSquare);
+			count += 1.0f;
+		}
+	}
+	mean = mean * (1.0f / count);
+	Vector deviation = VectorSqrt(VectorMax(meanSquare * (1.0f / count) - mean * mean, VectorReplicate(0.0f))) * gamma;
+	low = VectorMax(mean - deviation, minimum);
+	high = VectorMin(mean + deviation, maximum);
+}
+
+//Weights of the four taps around a point t of the way from the second to the third
+static void CatmullRomWeights(float t, float weights[4])
+{
+	weights[0] = t * (-0.5f + t * (1.0f - 0.5f * t));
+	weights[1] = 1.0f + t * t * (-2.5f + 1.5f * t);
+	weights[2] = t * (0.5f + t * (2.0f - 1.5f * t));
+	weights[3] = t * t * (-0.5f + 0.5f * t);
+}
+
+//Where the first hit of every pixel was seen from the previous camera: the history pixel coordinates in xy, the
+//distance to the old camera position in z, 0 for pixels that missed everything, and whether it was in front of it in w
+static void Reproject(const Float4* guides, const PerFrameBuffer& previous, const PerFrameBuffer& view, unsigned width,
+	unsigned height, Float4* reprojected)
+{
+	//The buffers hold the matrices transposed for the shaders
+	Matrix invViewProj = MatrixTranspose(LoadFloat4x4(&view.InvViewProj));
+	Matrix previousViewProj = MatrixTranspose(LoadFloat4x4(&previous.ViewProj));
+	Vector position = LoadFloat4(&view.CamPos);
+	Vector previousPosition = LoadFloat4(&previous.CamPos);
+
+	ParallelFor(height, 16, [&](size_t begin, size_t end, unsigned)
+	{
+		for (size_t y = begin; y < end; y++)
+		{
+			for (unsigned x = 0; x < width; x++)
+			{
+				size_t p = y * width + x;
+				float depth = guides[p].w;
+				//The pixel center is followed back, not the jittered samples, so a still camera maps every pixel onto
+				//itself and the history does not blur. The first hit is depth along the ray through the far plane,
+				//pixels that missed are followed by the far plane point.
+				float ndcX = 2.0f * x / width - 1.0f;
+				float ndcY = 1.0f - 2.0f * y / height;
+				Vector hit = Vector4Transform(VectorSet(ndcX, ndcY, 1.0f, 1.0f), invViewProj);
+				hit = hit * (1.0f / VectorGetW(hit));
+				float expectedDepth = 0.0f;
+				if (depth > 0.0f)
+				{
+					hit = VectorMultiplyAdd(Vector3Normalize(hit - position), VectorReplicate(depth), position);
+					hit = VectorSet(VectorGetX(hit), VectorGetY(hit), VectorGetZ(hit), 1.0f);
+					expectedDepth = VectorGetX(Vector3Length(hit - previousPosition));
+				}
+				Vector clip = Vector4Transform(hit, previousViewProj);
+				float clipW = VectorGetW(clip);
+				if (clipW <= 0.0f)
+				{
+					reprojected[p] = Float4(0.0f, 0.0f, 0.0f, 0.0f);
+					continue;
+				}
+				reprojected[p] = Float4((VectorGetX(clip) / clipW + 1.0f) * 0.5f * width,
+					(1.0f - VectorGetY(clip) / clipW) * 0.5f * height, expectedDepth, 1.0f);
+			}
+		}
+	});
+}
+
+//Whether the history pixel with the guide historyGuide saw one of the surfaces of the 3x3 pixels around x, y. A single
+//sample per pixel lands on either side of an edge from frame to frame, so the pixel itself is not enough there.
+static bool SameSurface(Vector historyGuide, const Float4* guides, const Float4* reprojected, unsigned width, unsigned height,
+	unsigned x, unsigned y, const TemporalSettings& settings)
+{
+	static const int offsets[9][2] = { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+	float historyDepth = VectorGetW(historyGuide);
+	for (int i = 0; i < 9; i++)
+	{
+		long long nx = (long long)x + offsets[i][0];
+		long long ny = (long long)y + offsets[i][1];
+		if (nx < 0 || ny < 0 || nx >= (long long)width || ny >= (long long)height)
+			continue;
+		size_t n = (size_t)ny * width + (size_t)nx;
+		float expectedDepth = reprojected[n].z;
+		if (historyDepth <= 0.0f || expectedDepth <= 0.0f)
+		{
+			if (historyDepth <= 0.0f && expectedDepth <= 0.0f && guides[n].w <= 0.0f)
+				return true;
+			continue;
+		}
+		if (std::fabs(historyDepth - expectedDepth) <= settings.depthTolerance * expectedDepth &&
+			VectorGetX(Vector3Dot(LoadFloat4(&guides[n]), historyGuide)) >= settings.normalTolerance)
+			return true;
+	}
+	return false;
+}
+
+size_t TemporalReproject(const float * history, const float * historyNormalDepth, const PerFrameBuffer & previous,
+	const float * current, const float * normalDepth, const PerFrameBuffer & view, unsigned width, unsigned height,
+	const TemporalSettings & settings, float * out)
+{
+	PROFILE_ZONE("Temporal reprojection");
+	const Float4* historySums = (const Float4*)history;
+	const Float4* historyGuides = (const Float4*)historyNormalDepth;
+	const Float4* currentSums = (const Float4*)current;
+	const Float4* guides = (const Float4*)normalDepth;
+	Float4* resolved = (Float4*)out;
+	std::vector<Float4> reprojected((size_t)width * height);
+	Reproject(guides, previous, view, width, height, reprojected.data());
+	std::vector<size_t> rejected(GetWorkerCount(), 0);
+
+	ParallelFor(height, 8, [&](size_t begin, size_t end, unsigned worker)
+	{
+		for (size_t y = begin; y < end; y++)
+		{
+			for (unsigned x = 0; x < width; x++)
+			{
+				size_t p = y * width + x;
+				Vector sum = LoadFloat4(&currentSums[p]);
+				Vector historySum = VectorReplicate(0.0f);
+				float historyWeight = 0.0f;
+				if (reprojected[p].w > 0.0f)
+				{
+					float px = reprojected[p].x;
+					float py = reprojected[p].y;
+					long long fx = (long long)std::floor(px);
+					long long fy = (long long)std::floor(py);
+					float weightsX[4], weightsY[4];
+					CatmullRomWeights(px - (float)fx, weightsX);
+					CatmullRomWeights(py - (float)fy, weightsY);
+					//The 4x4 taps around the point, the middle 2x2 are the bilinear ones
+					bool valid[4][4];
+					bool allValid = true;
+					for (int ty = 0; ty < 4; ty++)
+					{
+						for (int tx = 0; tx < 4; tx++)
+						{
+							long long qx = fx + tx - 1;
+							long long qy = fy + ty - 1;
+							valid[ty][tx] = qx >= 0 && qy >= 0 && qx < (long long)width && qy < (long long)height &&
+								SameSurface(LoadFloat4(&historyGuides[(size_t)qy * width + (size_t)qx]), guides, reprojected.data(),
+									width, height, x, (unsigned)y, settings);
+							allValid = allValid && valid[ty][tx];
+						}
+					}
+					for (int ty = 0; ty < 4; ty++)
+					{
+						for (int tx = 0; tx < 4; tx++)
+						{
+							//Catmull-Rom keeps the history sharp where every tap saw the surface, the bilinear taps
+							//that did fill in along edges, where the negative lobes would pull in the other side
+							float weight;
+							if (allValid)
+								weight = weightsX[tx] * weightsY[ty];
+							else if (tx >= 1 && tx <= 2 && ty >= 1 && ty <= 2 && valid[ty][tx])
+								weight = (tx == 1 ? 1.0f - (px - (float)fx) : px - (float)fx) * (ty == 1 ? 1.0f - (py - (float)fy) : py - (float)fy);
+							else
+								continue;
+							size_t q = (size_t)(fy + ty - 1) * width + (size_t)(fx + tx - 1);
+							historySum = VectorMultiplyAdd(LoadFloat4(&historySums[q]), VectorReplicate(weight), historySum);
+							historyWeight += weight;
+						}
+					}
+				}
+				if (historyWeight < TEMPORAL_MIN_WEIGHT)
+				{
+					rejected[worker]++;
+					StoreFloat4(&resolved[p], sum);
+					continue;
+				}
+
+				//Renormalized over the taps that were kept, w is then a fractional frame count. The negative lobes
+				//can overshoot below zero next to bright pixels.
+				historySum = VectorMax(historySum * (1.0f / historyWeight), VectorReplicate(0.0f));
+				float frames = VectorGetW(historySum);
+				if (frames > settings.maxHistory)
+				{
+					historySum = historySum * (settings.maxHistory / frames);
+					frames = settings.maxHistory;
+				}
+				if (settings.clampHistory && frames > 0.0f)
+				{
+					Vector low, high;
+					NeighborhoodBounds(currentSums, width, height, x, (unsigned)y, settings.clampGamma, low, high);
+					Vector average = VectorMin(VectorMax(historySum * (1.0f / frames), low), high);
+					historySum = average * frames;
+				}
+				historySum = VectorSet(VectorGetX(historySum), VectorGetY(historySum), VectorGetZ(historySum), frames);
+				StoreFloat4(&resolved[p], historySum + sum);
+			}
+		}
+	});
+
+	size_t total = 0;
+	for (size_t count : rejected)
+		total += count;
+	PROFILE_COUNTER("Disoccluded pixels", (double)total);
+	return total;
+}
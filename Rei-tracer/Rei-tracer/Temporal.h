@@ -0,0 +1,31 @@
+#ifndef _TEMPORAL_H_
+#define _TEMPORAL_H_
+
+#include <stddef.h>
+#include "Structs.h"
+
+#define TEMPORAL_JITTER_PHASES 16 //Frames before the sample grid offsets of GetAccumulationJitter repeat
+
+struct TemporalSettings
+{
+	bool enabled = false;
+	float maxHistory = 4.0f;      //Frames of history kept at most. Every surface is a mirror, and reflections do not move
+	                              //with the first hit, so a short history follows the camera better than a long one.
+	float depthTolerance = 0.05f; //Relative difference between the expected and the stored hit distance of the same surface
+	float normalTolerance = 0.8f; //Smallest cosine between the normals of the same surface
+	bool clampHistory = true;     //Clamps the history to the colors around the pixel in the new frame, so reflections
+	                              //and highlights do not smear
+	float clampGamma = 0.5f;      //Standard deviations of those colors the history may be away from their mean
+};
+
+//Adds the history of earlier frames to the samples of a new one. history is the out of the last call, sums with the
+//number of frames in w like an accumulation buffer, and historyNormalDepth the Denoise guides it was traced with.
+//The first hit of every pixel of current is moved from view, the PerFrameBuffer of CameraManager::FillPerFrameBuffer,
+//into previous, and the history there is sampled with a Catmull-Rom filter, or bilinearly from the taps that saw one
+//of the surfaces around the pixel where some did not. Where none did, the surface was hidden or off screen before and
+//the pixel starts over from current. out must not alias the inputs. Returns the number of pixels that lost their history.
+size_t TemporalReproject(const float* history, const float* historyNormalDepth, const PerFrameBuffer& previous,
+	const float* current, const float* normalDepth, const PerFrameBuffer& view, unsigned width, unsigned height,
+	const TemporalSettings& settings, float* out);
+
+#endif
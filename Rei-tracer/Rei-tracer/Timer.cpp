@@ -1,14 +1,11 @@
+
 #include "Timer.h"
 
 Timer::Timer()
 {
-	__int64 countsPerSec;
-	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
-	_secondsPerCount = 1.0 / (double)countsPerSec;
-
 	_deltaTime = 0;
-	_prevTime = 0;
-	_currTime = 0;
+	_prevTime = std::chrono::steady_clock::now();
+	_currTime = _prevTime;
 }
 
 Timer::~Timer()
@@ -17,10 +14,8 @@ Timer::~Timer()
 
 void Timer::Update()
 {
-	__int64 curTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&curTime);
-	_currTime = curTime;
-	_deltaTime = (_currTime - _prevTime) * _secondsPerCount;
+	_currTime = std::chrono::steady_clock::now();
+	_deltaTime = std::chrono::duration<double>(_currTime - _prevTime).count();
 	_prevTime = _currTime;
 
 
@@ -33,8 +28,5 @@ float Timer::GetDeltaTime() const
 
 uint64_t Timer::GetTimeStamp() const
 {
-	uint64_t timestamp;
-	QueryPerformanceCounter((LARGE_INTEGER*)&timestamp);
-	return timestamp;
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
-
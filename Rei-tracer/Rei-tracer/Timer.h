@@ -1,27 +1,27 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
-#include <Windows.h>
 #include <stdint.h>
+#include <chrono>
 class Timer
 {
 public:
 	Timer();
 	~Timer();
 	void Update();
+	//Seconds between the last two Updates, or since the Timer was created
 	float GetDeltaTime() const;
+	//Nanoseconds on a clock that never goes backwards, only differences mean anything
 	uint64_t GetTimeStamp() const;
 
 
 private:
-	double _secondsPerCount;
 	double _deltaTime;
 
-	__int64 _prevTime;
-	__int64 _currTime;
+	std::chrono::steady_clock::time_point _prevTime;
+	std::chrono::steady_clock::time_point _currTime;
 
 
 };
 
 #endif
-
@@ -0,0 +1,90 @@
+#include "ToneMap.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "VectorMath.h"
+#include <cmath>
+#include <vector>
+
+using namespace VectorMath;
+
+#define SRGB_TABLE_SIZE 65536 //Steps of linear input, fine enough to stay within rounding of the exact curve near black
+
+const char * GetToneMapName(ToneMapOperator op)
+{
+	switch (op)
+	{
+	case TONEMAP_CLAMP: return "clamp";
+	case TONEMAP_REINHARD: return "reinhard";
+	case TONEMAP_ACES: return "aces";
+	default: return "unknown";
+	}
+}
+
+static std::vector<uint8_t> MakeSrgbTable()
+{
+	std::vector<uint8_t> table(SRGB_TABLE_SIZE);
+	for (size_t i = 0; i < table.size(); i++)
+	{
+		double linear = (double)i / (SRGB_TABLE_SIZE - 1);
+		double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+		table[i] = (uint8_t)(encoded * 255.0 + 0.5);
+	}
+	return table;
+}
+
+static inline Vector ApplyOperator(Vector c, ToneMapOperator op)
+{
+	switch (op)
+	{
+	case TONEMAP_REINHARD:
+		c = VectorMax(c, VectorReplicate(0.0f));
+		return c / (c + VectorReplicate(1.0f));
+	case TONEMAP_ACES:
+	{
+		Vector numerator = c * VectorMultiplyAdd(c, VectorReplicate(2.51f), VectorReplicate(0.03f));
+		Vector denominator = VectorMultiplyAdd(c, VectorMultiplyAdd(c, VectorReplicate(2.43f), VectorReplicate(0.59f)), VectorReplicate(0.14f));
+		return VectorSaturate(numerator / denominator);
+	}
+	default:
+		return VectorSaturate(c);
+	}
+}
+
+void ToneMap(const float * rgbw, unsigned width, unsigned height, const ToneMapSettings & settings, uint8_t * rgba)
+{
+	PROFILE_ZONE("ToneMap");
+	static const std::vector<uint8_t> srgbTable = MakeSrgbTable();
+	ParallelFor(height, 16, [&](size_t begin, size_t end, unsigned)
+	{
+		//The srgb table is indexed with the same multiply add the linear values are rounded with
+		Vector scale = VectorReplicate(settings.srgb ? (float)(SRGB_TABLE_SIZE - 1) : 255.0f);
+		Vector half = VectorReplicate(0.5f);
+		for (size_t i = begin * width; i < end * width; i++)
+		{
+			Vector sum = LoadFloat4((const Float4*)&rgbw[i * 4]);
+			float weight = VectorGetW(sum);
+			Float4 out;
+			if (weight > 0.0f)
+			{
+				Vector c = ApplyOperator(sum * (settings.exposure / weight), settings.op);
+				StoreFloat4(&out, VectorMultiplyAdd(c, scale, half));
+			}
+			else
+				out = Float4(0.0f, 0.0f, 0.0f, 0.0f);
+			uint8_t* pixel = &rgba[i * 4];
+			if (settings.srgb)
+			{
+				pixel[0] = srgbTable[(size_t)out.x];
+				pixel[1] = srgbTable[(size_t)out.y];
+				pixel[2] = srgbTable[(size_t)out.z];
+			}
+			else
+			{
+				pixel[0] = (uint8_t)out.x;
+				pixel[1] = (uint8_t)out.y;
+				pixel[2] = (uint8_t)out.z;
+			}
+			pixel[3] = 255;
+		}
+	});
+}
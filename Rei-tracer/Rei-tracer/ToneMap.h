@@ -0,0 +1,30 @@
+#ifndef _TONE_MAP_H_
+#define _TONE_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Matches the defines in Shaders/tonemap.hlsl
+enum ToneMapOperator
+{
+	TONEMAP_CLAMP,    //Saturates, what the tracer wrote before it had an accumulation buffer
+	TONEMAP_REINHARD, //x / (1 + x) per channel
+	TONEMAP_ACES,     //Narkowicz's fit of the ACES filmic curve
+	TONEMAP_COUNT
+};
+
+struct ToneMapSettings
+{
+	ToneMapOperator op = TONEMAP_CLAMP;
+	float exposure = 1.0f; //Scales the radiance before the operator
+	bool srgb = false;     //Encode with the srgb transfer function instead of writing the linear values
+};
+
+const char* GetToneMapName(ToneMapOperator op);
+
+//rgbw holds sums of linear radiance with the number of frames summed in w, the layout of the accumulation
+//buffers. Writes tightly packed 8 bit rgba, pixels without samples come out black. The rows are spread
+//over the worker threads and every pixel is one VectorMath vector.
+void ToneMap(const float* rgbw, unsigned width, unsigned height, const ToneMapSettings& settings, uint8_t* rgba);
+
+#endif
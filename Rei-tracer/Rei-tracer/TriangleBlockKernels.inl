@@ -0,0 +1,267 @@
+//Triangle block tests for the blocks in TriangleBlocks.h, written once against the same SIMD wrapper as RayPacketKernels.inl.
+//The lanes are the triangles of one block tested against a single ray, so a block of N triangles takes N / WIDTH
+//instruction sequences and a kernel only exists where WIDTH divides N.
+
+//Masks the lanes [c, c + WIDTH) hit in front of the ray by the test T, doing what RayVSSelectedTriangle does for each
+//of them in the same order of operations, so the distances match the scalar traversal to the bit
+template<unsigned N, TriangleTest T>
+static VMask BlockLanesVSRay(const TriangleBlock<N>& block, unsigned c, const Ray& r, const WatertightRay& wr, VFloat& ttt, VFloat& bu, VFloat& bv)
+{
+	if (T == TRIANGLE_TEST_WOOP)
+	{
+		VFloat ox = Set1(r.o.x), oy = Set1(r.o.y), oz = Set1(r.o.z);
+		VFloat dx = Set1(r.d.x), dy = Set1(r.d.y), dz = Set1(r.d.z);
+		VFloat r0x = Load(block.a[0] + c), r0y = Load(block.a[1] + c), r0z = Load(block.a[2] + c);
+		VFloat r1x = Load(block.b[0] + c), r1y = Load(block.b[1] + c), r1z = Load(block.b[2] + c);
+		VFloat r2x = Load(block.c[0] + c), r2y = Load(block.c[1] + c), r2z = Load(block.c[2] + c);
+
+		VFloat localDz = r2x * dx + r2y * dy + r2z * dz;
+		VMask valid = Lt(localDz, Set1(0.0f));
+		VFloat localOz = r2x * ox + r2y * oy + r2z * oz + Load(block.d[2] + c);
+		ttt = (Set1(0.0f) - localOz) / localDz;
+		valid = valid & Gt(ttt, Set1(0.0f));
+		bu = r0x * ox + r0y * oy + r0z * oz + Load(block.d[0] + c) + ttt * (r0x * dx + r0y * dy + r0z * dz);
+		bv = r1x * ox + r1y * oy + r1z * oz + Load(block.d[1] + c) + ttt * (r1x * dx + r1y * dy + r1z * dz);
+		return valid & Ge(bu, Set1(0.0f)) & Ge(bv, Set1(0.0f)) & Le(bu + bv, Set1(1.0f));
+	}
+	if (T == TRIANGLE_TEST_WATERTIGHT)
+	{
+		VFloat okx = Set1(Component(wr.o, wr.kx)), oky = Set1(Component(wr.o, wr.ky)), okz = Set1(Component(wr.o, wr.kz));
+		VFloat sx = Set1(wr.sx), sy = Set1(wr.sy);
+		VFloat az = Load(block.a[wr.kz] + c) - okz;
+		VFloat bz = Load(block.b[wr.kz] + c) - okz;
+		VFloat cz = Load(block.c[wr.kz] + c) - okz;
+		VFloat ax = (Load(block.a[wr.kx] + c) - okx) - sx * az;
+		VFloat ay = (Load(block.a[wr.ky] + c) - oky) - sy * az;
+		VFloat bx = (Load(block.b[wr.kx] + c) - okx) - sx * bz;
+		VFloat by = (Load(block.b[wr.ky] + c) - oky) - sy * bz;
+		VFloat cx = (Load(block.c[wr.kx] + c) - okx) - sx * cz;
+		VFloat cy = (Load(block.c[wr.ky] + c) - oky) - sy * cz;
+
+		VFloat eu = cx * by - cy * bx;
+		VFloat ev = ax * cy - ay * cx;
+		VFloat ew = bx * ay - by * ax;
+		VMask valid = Ge(eu, Set1(0.0f)) & Ge(ev, Set1(0.0f)) & Ge(ew, Set1(0.0f));
+		//All three are >= 0, so this is the det != 0 of the scalar test
+		VFloat det = eu + ev + ew;
+		valid = valid & Gt(det, Set1(0.0f));
+		VFloat tScaled = (eu * az + ev * bz + ew * cz) * Set1(wr.sz);
+		valid = valid & Gt(tScaled, Set1(0.0f));
+		VFloat rcpDet = Set1(1.0f) / det;
+		bu = ev * rcpDet;
+		bv = ew * rcpDet;
+		ttt = tScaled * rcpDet;
+		return valid & Gt(ttt, Set1(0.0f));
+	}
+
+	VFloat dx = Set1(r.d.x), dy = Set1(r.d.y), dz = Set1(r.d.z);
+	VFloat e1x = Load(block.b[0] + c), e1y = Load(block.b[1] + c), e1z = Load(block.b[2] + c);
+	VFloat e2x = Load(block.c[0] + c), e2y = Load(block.c[1] + c), e2z = Load(block.c[2] + c);
+
+	VFloat qx = dy * e2z - dz * e2y;
+	VFloat qy = dz * e2x - dx * e2z;
+	VFloat qz = dx * e2y - dy * e2x;
+	VFloat a = e1x * qx + e1y * qy + e1z * qz;
+	VMask valid = Ge(a, Set1(0.0001f));
+	VFloat f = Set1(1.0f) / a;
+
+	VFloat sx = Set1(r.o.x) - Load(block.a[0] + c), sy = Set1(r.o.y) - Load(block.a[1] + c), sz = Set1(r.o.z) - Load(block.a[2] + c);
+	bu = f * (sx * qx + sy * qy + sz * qz);
+	valid = valid & Ge(bu, Set1(0.0f));
+
+	VFloat rx = sy * e1z - sz * e1y;
+	VFloat ry = sz * e1x - sx * e1z;
+	VFloat rz = sx * e1y - sy * e1x;
+	bv = f * (dx * rx + dy * ry + dz * rz);
+	valid = valid & Ge(bv, Set1(0.0f)) & Le(bu + bv, Set1(1.0f));
+
+	ttt = f * (e2x * rx + e2y * ry + e2z * rz);
+	return valid & Gt(ttt, Set1(0.0f));
+}
+
+//dist < 0 means no hit so far. Updates dist, u, v and triangleIndex on a closer hit like IsCloserHit and returns whether there was one.
+template<unsigned N, TriangleTest T>
+static bool BlockRayVSTriangle(const TriangleBlock<N>& block, const Ray& r, const WatertightRay& wr, float& dist, float& u, float& v, int& triangleIndex)
+{
+	bool hit = false;
+	for (unsigned c = 0; c < N; c += WIDTH)
+	{
+		VFloat ttt, bu, bv;
+		VMask valid = BlockLanesVSRay<N, T>(block, c, r, wr, ttt, bu, bv);
+		unsigned hits = Bits(valid & (Le(ttt, Set1(dist)) | Lt(Set1(dist), Set1(0.0f))));
+		if (!hits)
+			continue;
+
+		//The lanes in order with the test of the scalar loop, so ties go to the lower triangle index there too
+		float t[WIDTH], bus[WIDTH], bvs[WIDTH];
+		Store(t, ttt);
+		Store(bus, bu);
+		Store(bvs, bv);
+		for (unsigned l = 0; l < WIDTH; l++)
+		{
+			if (hits >> l & 1 && IsCloserHit(t[l], block.triangle[c + l], dist, triangleIndex))
+			{
+				dist = t[l];
+				u = bus[l];
+				v = bvs[l];
+				triangleIndex = block.triangle[c + l];
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+
+//Whether any lane is hit in front of the ray closer than dist
+template<unsigned N, TriangleTest T>
+static bool BlockRayVSTriangleAny(const TriangleBlock<N>& block, const Ray& r, const WatertightRay& wr, float dist)
+{
+	for (unsigned c = 0; c < N; c += WIDTH)
+	{
+		VFloat ttt, bu, bv;
+		VMask valid = BlockLanesVSRay<N, T>(block, c, r, wr, ttt, bu, bv);
+		if (Bits(valid & Lt(ttt, Set1(dist))))
+			return true;
+	}
+	return false;
+}
+
+template<unsigned N>
+static bool BlockRayVSTriangle(const TriangleBlock<N>& block, TriangleTest test, const Ray& r, const WatertightRay& wr, float& dist, float& u, float& v,
+	int& triangleIndex)
+{
+	if (test == TRIANGLE_TEST_WOOP)
+		return BlockRayVSTriangle<N, TRIANGLE_TEST_WOOP>(block, r, wr, dist, u, v, triangleIndex);
+	if (test == TRIANGLE_TEST_WATERTIGHT)
+		return BlockRayVSTriangle<N, TRIANGLE_TEST_WATERTIGHT>(block, r, wr, dist, u, v, triangleIndex);
+	return BlockRayVSTriangle<N, TRIANGLE_TEST_MOLLER_TRUMBORE>(block, r, wr, dist, u, v, triangleIndex);
+}
+
+template<unsigned N>
+static bool BlockRayVSTriangleAny(const TriangleBlock<N>& block, TriangleTest test, const Ray& r, const WatertightRay& wr, float dist)
+{
+	if (test == TRIANGLE_TEST_WOOP)
+		return BlockRayVSTriangleAny<N, TRIANGLE_TEST_WOOP>(block, r, wr, dist);
+	if (test == TRIANGLE_TEST_WATERTIGHT)
+		return BlockRayVSTriangleAny<N, TRIANGLE_TEST_WATERTIGHT>(block, r, wr, dist);
+	return BlockRayVSTriangleAny<N, TRIANGLE_TEST_MOLLER_TRUMBORE>(block, r, wr, dist);
+}
+
+//TraverseBVH with the leaves and mesh ranges pointing into the block table
+template<unsigned N, TriangleTest T>
+static int TraverseBVHBlocks(const Ray& r, const Vec3& rcpDir, const TriangleBlock<N>* blocks, const BVHNode* nodes,
+	const MeshIndices* meshes, int meshCount, float& dist, float& u, float& v, RayStats* stats)
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	int triangleIndex = -1;
+	auto hit = [&](int b)
+	{
+		KERNEL_STAT_ADD(stats, triangleTests, N);
+		BlockRayVSTriangle<N, T>(blocks[b], r, wr, dist, u, v, triangleIndex);
+	};
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = nodes[stack[--stackPtr]];
+				KERNEL_STAT_ADD(stats, nodeVisits, 1);
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+					hit(c);
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+				hit(j);
+		}
+	}
+	return triangleIndex;
+}
+
+template<unsigned N, TriangleTest T>
+static bool TraverseBVHBlocksForShadows(const Ray& r, const Vec3& rcpDir, float dist, const TriangleBlock<N>* blocks, const BVHNode* nodes,
+	const MeshIndices* meshes, int meshCount, RayStats* stats)
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	auto occludes = [&](int b)
+	{
+		KERNEL_STAT_ADD(stats, triangleTests, N);
+		return BlockRayVSTriangleAny<N, T>(blocks[b], r, wr, dist);
+	};
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[RAY_KERNELS_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+
+			while (stackPtr)
+			{
+				const BVHNode& node = nodes[stack[--stackPtr]];
+				KERNEL_STAT_ADD(stats, nodeVisits, 1);
+				if (!RayVSBox(r, rcpDir, BVHNodeBox(node)))
+					continue;
+
+				if (node.count == 0)
+				{
+					stack[stackPtr++] = node.leftFirst + 1;
+					stack[stackPtr++] = node.leftFirst;
+				}
+				for (int c = node.leftFirst; c < node.leftFirst + node.count; c++)
+				{
+					if (occludes(c))
+						return true;
+				}
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				if (occludes(j))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+//The test is picked once per ray instead of once per block
+template<unsigned N>
+static int TraverseBVHBlocks(const Ray& r, const Vec3& rcpDir, TriangleTest test, const TriangleBlock<N>* blocks, const BVHNode* nodes,
+	const MeshIndices* meshes, int meshCount, float& dist, float& u, float& v, RayStats* stats)
+{
+	if (test == TRIANGLE_TEST_WOOP)
+		return TraverseBVHBlocks<N, TRIANGLE_TEST_WOOP>(r, rcpDir, blocks, nodes, meshes, meshCount, dist, u, v, stats);
+	if (test == TRIANGLE_TEST_WATERTIGHT)
+		return TraverseBVHBlocks<N, TRIANGLE_TEST_WATERTIGHT>(r, rcpDir, blocks, nodes, meshes, meshCount, dist, u, v, stats);
+	return TraverseBVHBlocks<N, TRIANGLE_TEST_MOLLER_TRUMBORE>(r, rcpDir, blocks, nodes, meshes, meshCount, dist, u, v, stats);
+}
+
+template<unsigned N>
+static bool TraverseBVHBlocksForShadows(const Ray& r, const Vec3& rcpDir, float dist, TriangleTest test, const TriangleBlock<N>* blocks, const BVHNode* nodes,
+	const MeshIndices* meshes, int meshCount, RayStats* stats)
+{
+	if (test == TRIANGLE_TEST_WOOP)
+		return TraverseBVHBlocksForShadows<N, TRIANGLE_TEST_WOOP>(r, rcpDir, dist, blocks, nodes, meshes, meshCount, stats);
+	if (test == TRIANGLE_TEST_WATERTIGHT)
+		return TraverseBVHBlocksForShadows<N, TRIANGLE_TEST_WATERTIGHT>(r, rcpDir, dist, blocks, nodes, meshes, meshCount, stats);
+	return TraverseBVHBlocksForShadows<N, TRIANGLE_TEST_MOLLER_TRUMBORE>(r, rcpDir, dist, blocks, nodes, meshes, meshCount, stats);
+}
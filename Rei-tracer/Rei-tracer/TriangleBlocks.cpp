@@ -0,0 +1,188 @@
+#include "TriangleBlocks.h"
+#include "RayKernels.h"
+#include <string.h>
+
+template<unsigned N>
+static void SetLane(TriangleBlock<N>& block, unsigned lane, const Triangle& t, int index, TriangleTest test)
+{
+	block.triangle[lane] = index;
+	if (test == TRIANGLE_TEST_MOLLER_TRUMBORE)
+	{
+		const float v1[3] = { t.v1.posx, t.v1.posy, t.v1.posz };
+		const float v2[3] = { t.v2.posx, t.v2.posy, t.v2.posz };
+		const float v3[3] = { t.v3.posx, t.v3.posy, t.v3.posz };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			block.a[axis][lane] = v1[axis];
+			block.b[axis][lane] = v2[axis] - v1[axis];
+			block.c[axis][lane] = v3[axis] - v1[axis];
+		}
+		return;
+	}
+	PrecomputedTriangle p = PrecomputeTriangle(t, test);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		block.a[axis][lane] = p.r0[axis];
+		block.b[axis][lane] = p.r1[axis];
+		block.c[axis][lane] = p.r2[axis];
+	}
+	block.d[0][lane] = p.r0[3];
+	block.d[1][lane] = p.r1[3];
+	block.d[2][lane] = p.r2[3];
+}
+
+//Appends the blocks for count triangles, read through indices unless that is null, and returns the first of them
+template<unsigned N>
+static int PackTriangles(const Triangle* triangles, TriangleTest test, const uint32_t* indices, int first, int count, std::vector<TriangleBlock<N>>& blocks)
+{
+	int firstBlock = (int)blocks.size();
+	for (int i = 0; i < count; i += N)
+	{
+		TriangleBlock<N> block;
+		memset(&block, 0, sizeof(block));
+		for (unsigned lane = 0; lane < N; lane++)
+		{
+			block.triangle[lane] = -1;
+			if (i + (int)lane >= count)
+				continue;
+			int index = indices ? (int)indices[first + i + lane] : first + i + (int)lane;
+			SetLane(block, lane, triangles[index], index, test);
+		}
+		blocks.push_back(block);
+	}
+	return firstBlock;
+}
+
+//The triangles under a node in the order the traversal meets them, the left child first
+static void GatherTriangles(const std::vector<BVHNode>& nodes, const uint32_t* triangleIndices, int nodeIndex, std::vector<uint32_t>& triangles)
+{
+	const BVHNode& node = nodes[nodeIndex];
+	if (node.count > 0)
+	{
+		triangles.insert(triangles.end(), triangleIndices + node.leftFirst, triangleIndices + node.leftFirst + node.count);
+		return;
+	}
+	GatherTriangles(nodes, triangleIndices, node.leftFirst, triangles);
+	GatherTriangles(nodes, triangleIndices, node.leftFirst + 1, triangles);
+}
+
+//A subtree with no more triangles than fit a block becomes one leaf over a single block. The sah stops splitting
+//at a triangle or two, so packing the leaves as they are would leave most lanes empty.
+template<unsigned N>
+static void PackNode(const Triangle* triangles, TriangleTest test, const uint32_t* triangleIndices, std::vector<BVHNode>& nodes, int nodeIndex,
+	std::vector<uint32_t>& gathered, std::vector<TriangleBlock<N>>& blocks)
+{
+	gathered.clear();
+	GatherTriangles(nodes, triangleIndices, nodeIndex, gathered);
+	BVHNode& node = nodes[nodeIndex];
+	if (node.count == 0 && gathered.size() > N)
+	{
+		int left = node.leftFirst;
+		PackNode(triangles, test, triangleIndices, nodes, left, gathered, blocks);
+		PackNode(triangles, test, triangleIndices, nodes, left + 1, gathered, blocks);
+		return;
+	}
+	node.leftFirst = PackTriangles(triangles, test, gathered.data(), 0, (int)gathered.size(), blocks);
+	node.count = (int)blocks.size() - node.leftFirst;
+}
+
+template<unsigned N>
+static void PackScene(const Triangle* triangles, TriangleTest test, const uint32_t* triangleIndices, std::vector<BVHNode>& nodes,
+	std::vector<MeshIndices>& meshes, std::vector<TriangleBlock<N>>& blocks, size_t& triangleCount)
+{
+	blocks.clear();
+	triangleCount = 0;
+	std::vector<uint32_t> gathered;
+	for (MeshIndices& mesh : meshes)
+	{
+		if (mesh.rootPartition < 0)
+		{
+			int count = mesh.upperIndex - mesh.lowerIndex;
+			mesh.lowerIndex = PackTriangles(triangles, test, nullptr, mesh.lowerIndex, count, blocks);
+			mesh.upperIndex = (int)blocks.size();
+			triangleCount += count;
+			continue;
+		}
+		GatherTriangles(nodes, triangleIndices, mesh.rootPartition, gathered);
+		triangleCount += gathered.size();
+		PackNode(triangles, test, triangleIndices, nodes, mesh.rootPartition, gathered, blocks);
+	}
+}
+
+TriangleBlocks::TriangleBlocks()
+{
+}
+
+TriangleBlocks::~TriangleBlocks()
+{
+}
+
+void TriangleBlocks::Set(unsigned width, TriangleTest test, const Triangle * triangles, const BVHNode * nodes, size_t nodeCount, const uint32_t * triangleIndices,
+	const MeshIndices * meshes, size_t meshCount)
+{
+	_width = width <= 4 ? 4 : width <= 8 ? 8 : 16;
+	_test = test;
+	_nodes.assign(nodes, nodes + nodeCount);
+	_meshes.assign(meshes, meshes + meshCount);
+
+	_blocks4.clear();
+	_blocks8.clear();
+	_blocks16.clear();
+	if (_width == 4)
+		PackScene(triangles, test, triangleIndices, _nodes, _meshes, _blocks4, _triangleCount);
+	else if (_width == 8)
+		PackScene(triangles, test, triangleIndices, _nodes, _meshes, _blocks8, _triangleCount);
+	else
+		PackScene(triangles, test, triangleIndices, _nodes, _meshes, _blocks16, _triangleCount);
+}
+
+unsigned TriangleBlocks::GetWidth() const
+{
+	return _width;
+}
+
+TriangleTest TriangleBlocks::GetTriangleTest() const
+{
+	return _test;
+}
+
+const BVHNode * TriangleBlocks::GetNodes() const
+{
+	return _nodes.data();
+}
+
+const MeshIndices * TriangleBlocks::GetMeshes() const
+{
+	return _meshes.data();
+}
+
+int TriangleBlocks::GetMeshCount() const
+{
+	return (int)_meshes.size();
+}
+
+const TriangleBlock4 * TriangleBlocks::GetBlocks4() const
+{
+	return _blocks4.data();
+}
+
+const TriangleBlock8 * TriangleBlocks::GetBlocks8() const
+{
+	return _blocks8.data();
+}
+
+const TriangleBlock16 * TriangleBlocks::GetBlocks16() const
+{
+	return _blocks16.data();
+}
+
+size_t TriangleBlocks::GetBlockCount() const
+{
+	return _blocks4.size() + _blocks8.size() + _blocks16.size();
+}
+
+float TriangleBlocks::GetOccupancy() const
+{
+	size_t lanes = GetBlockCount() * _width;
+	return lanes ? (float)_triangleCount / lanes : 1.0f;
+}
@@ -0,0 +1,75 @@
+#ifndef _TRIANGLE_BLOCKS_H_
+#define _TRIANGLE_BLOCKS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "Structs.h"
+
+#define TRIANGLE_BLOCK_MAX_WIDTH 16
+//What BVH_LAYOUT_BINARY_BLOCKS packs the leaves into, sse runs it on any x64 cpu
+#define TRIANGLE_BLOCK_BVH_WIDTH 4
+
+//Up to N triangles in structure of arrays layout with what the triangle test of the scene reads, so one SIMD
+//instruction sequence tests a ray against all of them:
+//TRIANGLE_TEST_MOLLER_TRUMBORE  a = v1, b = v2 - v1 and c = v3 - v1, the edges RayVSTriangle subtracts
+//TRIANGLE_TEST_WOOP             a, b and c the rows r0, r1 and r2 of PrecomputedTriangle, d their fourth column
+//TRIANGLE_TEST_WATERTIGHT       a = v1, b = v2 and c = v3
+//The rows are indexed by axis so the watertight test can pick the components of its ray space.
+//Unused lanes are all zero, which every test rejects, and have triangle -1.
+template<unsigned N>
+struct TriangleBlock
+{
+	float a[3][N];
+	float b[3][N];
+	float c[3][N];
+	float d[3][N];
+	int triangle[N];
+};
+
+typedef TriangleBlock<4> TriangleBlock4;
+typedef TriangleBlock<8> TriangleBlock8;
+typedef TriangleBlock<16> TriangleBlock16;
+
+//The leaves of the mesh bvhs of a scene stored as triangle blocks of one width. Set copies the shared BVHNode table
+//and packs the triangles every leaf references through the triangle index table into blocks of their own, moving
+//its leftFirst and count to that range of blocks. A subtree that fits a single block becomes one leaf, its triangles
+//in the order the traversal met them. Meshes without a bvh get blocks for their range of triangles.
+//Only triangle meshes may be given, the sphere bvh is not packed. Triangles are copied, so after moving them,
+//refitting the nodes or picking another test the blocks are simply set again.
+class TriangleBlocks
+{
+public:
+	TriangleBlocks();
+	~TriangleBlocks();
+
+	//width is 4, 8 or 16, anything else is rounded up to the next of those
+	void Set(unsigned width, TriangleTest test, const Triangle* triangles, const BVHNode* nodes, size_t nodeCount, const uint32_t* triangleIndices,
+		const MeshIndices* meshes, size_t meshCount);
+
+	unsigned GetWidth() const;
+	TriangleTest GetTriangleTest() const;
+	//Same node table as given to Set with the leaves of the meshes moved into the block table
+	const BVHNode* GetNodes() const;
+	//Same ranges as the meshes given to Set, lowerIndex and upperIndex of the meshes without a bvh moved into the block table
+	const MeshIndices* GetMeshes() const;
+	int GetMeshCount() const;
+	const TriangleBlock4* GetBlocks4() const;
+	const TriangleBlock8* GetBlocks8() const;
+	const TriangleBlock16* GetBlocks16() const;
+	size_t GetBlockCount() const;
+	//Lanes in use over all lanes
+	float GetOccupancy() const;
+
+private:
+	unsigned _width = 4;
+	TriangleTest _test = TRIANGLE_TEST_MOLLER_TRUMBORE;
+	size_t _triangleCount = 0;
+	std::vector<BVHNode> _nodes;
+	std::vector<MeshIndices> _meshes;
+	std::vector<TriangleBlock4> _blocks4;
+	std::vector<TriangleBlock8> _blocks8;
+	std::vector<TriangleBlock16> _blocks16;
+};
+
+#endif
@@ -0,0 +1,431 @@
+#ifndef _VECTOR_MATH_H_
+#define _VECTOR_MATH_H_
+
+#include <cmath>
+#include <algorithm>
+#include "SimdIsa.h"
+
+//The parts of DirectXMath the cpu side uses, without the Windows headers. The names are the DirectXMath ones
+//without the XM prefix and they follow the same conventions: row vectors, v * M, left handed, Vector3 functions
+//ignore w, Vector3Dot splats the result into every lane.
+//The backend is picked when compiling: AVX2 (SSE with fused multiply add), SSE2, NEON, or plain floats
+//everywhere else or when VECTOR_MATH_SCALAR is defined. Float2/3/4 and Float4x4 are the storage types for
+//structs and buffers, Vector and Matrix the register types to compute with.
+
+#if defined(VECTOR_MATH_SCALAR)
+#define VECTOR_MATH_BACKEND "scalar"
+#elif REI_X86
+#include <emmintrin.h>
+#define VECTOR_MATH_SSE 1
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VECTOR_MATH_BACKEND "avx2"
+#else
+#define VECTOR_MATH_BACKEND "sse2"
+#endif
+//-mavx2 alone does not enable fma in gcc and clang, /arch:AVX2 does in msvc
+#if defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define VECTOR_MATH_FMA 1
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define VECTOR_MATH_NEON 1
+#define VECTOR_MATH_BACKEND "neon"
+#else
+#define VECTOR_MATH_BACKEND "scalar"
+#endif
+
+#define MATH_PI 3.141592654f
+#define MATH_2PI 6.283185307f
+
+namespace VectorMath
+{
+
+struct Float2
+{
+	Float2() {};
+	Float2(float x, float y) : x(x), y(y) {};
+	float x, y;
+};
+
+struct Float3
+{
+	Float3() {};
+	Float3(float x, float y, float z) : x(x), y(y), z(z) {};
+	float x, y, z;
+};
+
+struct Float4
+{
+	Float4() {};
+	Float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {};
+	float x, y, z, w;
+};
+
+struct Float4x4
+{
+	Float4x4() {};
+	float m[4][4];
+};
+
+struct Vector
+{
+#if defined(VECTOR_MATH_SSE)
+	__m128 v;
+#elif defined(VECTOR_MATH_NEON)
+	float32x4_t v;
+#else
+	float v[4];
+#endif
+};
+
+struct Matrix
+{
+	Vector r[4];
+};
+
+//The backend primitives, everything after them is written on top of these
+
+#if defined(VECTOR_MATH_SSE)
+
+inline Vector VectorSet(float x, float y, float z, float w) { Vector r; r.v = _mm_setr_ps(x, y, z, w); return r; }
+inline Vector VectorReplicate(float s) { Vector r; r.v = _mm_set1_ps(s); return r; }
+inline Vector VectorAdd(Vector a, Vector b) { Vector r; r.v = _mm_add_ps(a.v, b.v); return r; }
+inline Vector VectorSubtract(Vector a, Vector b) { Vector r; r.v = _mm_sub_ps(a.v, b.v); return r; }
+inline Vector VectorMultiply(Vector a, Vector b) { Vector r; r.v = _mm_mul_ps(a.v, b.v); return r; }
+inline Vector VectorDivide(Vector a, Vector b) { Vector r; r.v = _mm_div_ps(a.v, b.v); return r; }
+inline Vector VectorSqrt(Vector a) { Vector r; r.v = _mm_sqrt_ps(a.v); return r; }
+inline Vector VectorMin(Vector a, Vector b) { Vector r; r.v = _mm_min_ps(a.v, b.v); return r; }
+inline Vector VectorMax(Vector a, Vector b) { Vector r; r.v = _mm_max_ps(a.v, b.v); return r; }
+//a * b + c
+inline Vector VectorMultiplyAdd(Vector a, Vector b, Vector c)
+{
+	Vector r;
+#if defined(VECTOR_MATH_FMA)
+	r.v = _mm_fmadd_ps(a.v, b.v, c.v);
+#else
+	r.v = _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v);
+#endif
+	return r;
+}
+inline float VectorGetX(Vector a) { return _mm_cvtss_f32(a.v); }
+inline float VectorGetY(Vector a) { return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1))); }
+inline float VectorGetZ(Vector a) { return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2))); }
+inline float VectorGetW(Vector a) { return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3))); }
+inline Vector VectorSplatX(Vector a) { Vector r; r.v = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(0, 0, 0, 0)); return r; }
+inline Vector VectorSplatY(Vector a) { Vector r; r.v = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1)); return r; }
+inline Vector VectorSplatZ(Vector a) { Vector r; r.v = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2)); return r; }
+inline Vector VectorSplatW(Vector a) { Vector r; r.v = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3)); return r; }
+//(y, z, x, w) and (z, x, y, w) for the cross product
+inline Vector VectorSwizzleYZXW(Vector a) { Vector r; r.v = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1)); return r; }
+inline Vector VectorSwizzleZXYW(Vector a) { Vector r; r.v = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 1, 0, 2)); return r; }
+inline Vector LoadFloat4(const Float4* source) { Vector r; r.v = _mm_loadu_ps(&source->x); return r; }
+inline void StoreFloat4(Float4* destination, Vector a) { _mm_storeu_ps(&destination->x, a.v); }
+
+#elif defined(VECTOR_MATH_NEON)
+
+inline Vector VectorSet(float x, float y, float z, float w) { float f[4] = { x, y, z, w }; Vector r; r.v = vld1q_f32(f); return r; }
+inline Vector VectorReplicate(float s) { Vector r; r.v = vdupq_n_f32(s); return r; }
+inline Vector VectorAdd(Vector a, Vector b) { Vector r; r.v = vaddq_f32(a.v, b.v); return r; }
+inline Vector VectorSubtract(Vector a, Vector b) { Vector r; r.v = vsubq_f32(a.v, b.v); return r; }
+inline Vector VectorMultiply(Vector a, Vector b) { Vector r; r.v = vmulq_f32(a.v, b.v); return r; }
+inline Vector VectorMin(Vector a, Vector b) { Vector r; r.v = vminq_f32(a.v, b.v); return r; }
+inline Vector VectorMax(Vector a, Vector b) { Vector r; r.v = vmaxq_f32(a.v, b.v); return r; }
+#if defined(__aarch64__) || defined(_M_ARM64)
+inline Vector VectorDivide(Vector a, Vector b) { Vector r; r.v = vdivq_f32(a.v, b.v); return r; }
+inline Vector VectorSqrt(Vector a) { Vector r; r.v = vsqrtq_f32(a.v); return r; }
+inline Vector VectorMultiplyAdd(Vector a, Vector b, Vector c) { Vector r; r.v = vfmaq_f32(c.v, a.v, b.v); return r; }
+#else
+//32 bit arm has neither a divide nor a square root instruction for vectors
+inline Vector VectorDivide(Vector a, Vector b)
+{
+	Vector r = a;
+	r.v = vsetq_lane_f32(vgetq_lane_f32(a.v, 0) / vgetq_lane_f32(b.v, 0), r.v, 0);
+	r.v = vsetq_lane_f32(vgetq_lane_f32(a.v, 1) / vgetq_lane_f32(b.v, 1), r.v, 1);
+	r.v = vsetq_lane_f32(vgetq_lane_f32(a.v, 2) / vgetq_lane_f32(b.v, 2), r.v, 2);
+	r.v = vsetq_lane_f32(vgetq_lane_f32(a.v, 3) / vgetq_lane_f32(b.v, 3), r.v, 3);
+	return r;
+}
+inline Vector VectorSqrt(Vector a)
+{
+	Vector r = a;
+	r.v = vsetq_lane_f32(std::sqrt(vgetq_lane_f32(a.v, 0)), r.v, 0);
+	r.v = vsetq_lane_f32(std::sqrt(vgetq_lane_f32(a.v, 1)), r.v, 1);
+	r.v = vsetq_lane_f32(std::sqrt(vgetq_lane_f32(a.v, 2)), r.v, 2);
+	r.v = vsetq_lane_f32(std::sqrt(vgetq_lane_f32(a.v, 3)), r.v, 3);
+	return r;
+}
+inline Vector VectorMultiplyAdd(Vector a, Vector b, Vector c) { Vector r; r.v = vmlaq_f32(c.v, a.v, b.v); return r; }
+#endif
+inline float VectorGetX(Vector a) { return vgetq_lane_f32(a.v, 0); }
+inline float VectorGetY(Vector a) { return vgetq_lane_f32(a.v, 1); }
+inline float VectorGetZ(Vector a) { return vgetq_lane_f32(a.v, 2); }
+inline float VectorGetW(Vector a) { return vgetq_lane_f32(a.v, 3); }
+inline Vector VectorSplatX(Vector a) { Vector r; r.v = vdupq_lane_f32(vget_low_f32(a.v), 0); return r; }
+inline Vector VectorSplatY(Vector a) { Vector r; r.v = vdupq_lane_f32(vget_low_f32(a.v), 1); return r; }
+inline Vector VectorSplatZ(Vector a) { Vector r; r.v = vdupq_lane_f32(vget_high_f32(a.v), 0); return r; }
+inline Vector VectorSplatW(Vector a) { Vector r; r.v = vdupq_lane_f32(vget_high_f32(a.v), 1); return r; }
+inline Vector VectorSwizzleYZXW(Vector a)
+{
+	float32x2_t xy = vget_low_f32(a.v), zw = vget_high_f32(a.v);
+	Vector r;
+	r.v = vcombine_f32(vext_f32(xy, zw, 1), vset_lane_f32(vget_lane_f32(xy, 0), zw, 0));
+	return r;
+}
+inline Vector VectorSwizzleZXYW(Vector a)
+{
+	float32x2_t xy = vget_low_f32(a.v), zw = vget_high_f32(a.v);
+	Vector r;
+	r.v = vcombine_f32(vset_lane_f32(vget_lane_f32(xy, 0), zw, 1), vset_lane_f32(vget_lane_f32(xy, 1), zw, 0));
+	return r;
+}
+inline Vector LoadFloat4(const Float4* source) { Vector r; r.v = vld1q_f32(&source->x); return r; }
+inline void StoreFloat4(Float4* destination, Vector a) { vst1q_f32(&destination->x, a.v); }
+
+#else
+
+inline Vector VectorSet(float x, float y, float z, float w) { Vector r; r.v[0] = x; r.v[1] = y; r.v[2] = z; r.v[3] = w; return r; }
+inline Vector VectorReplicate(float s) { return VectorSet(s, s, s, s); }
+inline Vector VectorAdd(Vector a, Vector b) { return VectorSet(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]); }
+inline Vector VectorSubtract(Vector a, Vector b) { return VectorSet(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]); }
+inline Vector VectorMultiply(Vector a, Vector b) { return VectorSet(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]); }
+inline Vector VectorDivide(Vector a, Vector b) { return VectorSet(a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]); }
+inline Vector VectorSqrt(Vector a) { return VectorSet(std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3])); }
+inline Vector VectorMin(Vector a, Vector b) { return VectorSet((std::min)(a.v[0], b.v[0]), (std::min)(a.v[1], b.v[1]), (std::min)(a.v[2], b.v[2]), (std::min)(a.v[3], b.v[3])); }
+inline Vector VectorMax(Vector a, Vector b) { return VectorSet((std::max)(a.v[0], b.v[0]), (std::max)(a.v[1], b.v[1]), (std::max)(a.v[2], b.v[2]), (std::max)(a.v[3], b.v[3])); }
+inline Vector VectorMultiplyAdd(Vector a, Vector b, Vector c) { return VectorAdd(VectorMultiply(a, b), c); }
+inline float VectorGetX(Vector a) { return a.v[0]; }
+inline float VectorGetY(Vector a) { return a.v[1]; }
+inline float VectorGetZ(Vector a) { return a.v[2]; }
+inline float VectorGetW(Vector a) { return a.v[3]; }
+inline Vector VectorSplatX(Vector a) { return VectorReplicate(a.v[0]); }
+inline Vector VectorSplatY(Vector a) { return VectorReplicate(a.v[1]); }
+inline Vector VectorSplatZ(Vector a) { return VectorReplicate(a.v[2]); }
+inline Vector VectorSplatW(Vector a) { return VectorReplicate(a.v[3]); }
+inline Vector VectorSwizzleYZXW(Vector a) { return VectorSet(a.v[1], a.v[2], a.v[0], a.v[3]); }
+inline Vector VectorSwizzleZXYW(Vector a) { return VectorSet(a.v[2], a.v[0], a.v[1], a.v[3]); }
+inline Vector LoadFloat4(const Float4* source) { return VectorSet(source->x, source->y, source->z, source->w); }
+inline void StoreFloat4(Float4* destination, Vector a) { *destination = Float4(a.v[0], a.v[1], a.v[2], a.v[3]); }
+
+#endif
+
+inline Vector operator+(Vector a, Vector b) { return VectorAdd(a, b); }
+inline Vector operator-(Vector a, Vector b) { return VectorSubtract(a, b); }
+inline Vector operator*(Vector a, Vector b) { return VectorMultiply(a, b); }
+inline Vector operator/(Vector a, Vector b) { return VectorDivide(a, b); }
+inline Vector operator*(Vector a, float s) { return VectorMultiply(a, VectorReplicate(s)); }
+inline Vector operator*(float s, Vector a) { return VectorMultiply(VectorReplicate(s), a); }
+inline Vector operator-(Vector a) { return VectorSubtract(VectorReplicate(0.0f), a); }
+
+//Clamps every lane to [0, 1]
+inline Vector VectorSaturate(Vector a) { return VectorMin(VectorMax(a, VectorReplicate(0.0f)), VectorReplicate(1.0f)); }
+
+//w is 0 after loading a Float3 or Float2
+inline Vector LoadFloat3(const Float3* source) { return VectorSet(source->x, source->y, source->z, 0.0f); }
+inline Vector LoadFloat2(const Float2* source) { return VectorSet(source->x, source->y, 0.0f, 0.0f); }
+inline void StoreFloat3(Float3* destination, Vector a) { *destination = Float3(VectorGetX(a), VectorGetY(a), VectorGetZ(a)); }
+inline void StoreFloat2(Float2* destination, Vector a) { *destination = Float2(VectorGetX(a), VectorGetY(a)); }
+
+inline Vector Vector3Dot(Vector a, Vector b)
+{
+	Vector m = a * b;
+	return VectorSplatX(m) + VectorSplatY(m) + VectorSplatZ(m);
+}
+
+inline Vector Vector3Cross(Vector a, Vector b)
+{
+	Vector r = VectorSwizzleYZXW(a) * VectorSwizzleZXYW(b) - VectorSwizzleZXYW(a) * VectorSwizzleYZXW(b);
+	return VectorSet(VectorGetX(r), VectorGetY(r), VectorGetZ(r), 0.0f);
+}
+
+inline Vector Vector3Length(Vector a)
+{
+	return VectorSqrt(Vector3Dot(a, a));
+}
+
+//The zero vector stays zero
+inline Vector Vector3Normalize(Vector a)
+{
+	Vector length = Vector3Length(a);
+	return VectorGetX(length) > 0.0f ? a / length : VectorReplicate(0.0f);
+}
+
+//x * r[0] + y * r[1] + z * r[2] + r[3], w is taken as 1
+inline Vector Vector3Transform(Vector a, const Matrix& m)
+{
+	Vector r = VectorMultiplyAdd(VectorSplatZ(a), m.r[2], m.r[3]);
+	r = VectorMultiplyAdd(VectorSplatY(a), m.r[1], r);
+	return VectorMultiplyAdd(VectorSplatX(a), m.r[0], r);
+}
+
+inline Vector Vector4Transform(Vector a, const Matrix& m)
+{
+	Vector r = VectorMultiply(VectorSplatW(a), m.r[3]);
+	r = VectorMultiplyAdd(VectorSplatZ(a), m.r[2], r);
+	r = VectorMultiplyAdd(VectorSplatY(a), m.r[1], r);
+	return VectorMultiplyAdd(VectorSplatX(a), m.r[0], r);
+}
+
+//The uniform Catmull-Rom spline through p1 at t = 0 and p2 at t = 1
+inline Vector VectorCatmullRom(Vector p0, Vector p1, Vector p2, Vector p3, float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return p0 * (0.5f * (-t3 + 2.0f * t2 - t)) + p1 * (0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f))
+		+ p2 * (0.5f * (-3.0f * t3 + 4.0f * t2 + t)) + p3 * (0.5f * (t3 - t2));
+}
+
+inline Matrix MatrixSet(float m00, float m01, float m02, float m03, float m10, float m11, float m12, float m13,
+	float m20, float m21, float m22, float m23, float m30, float m31, float m32, float m33)
+{
+	Matrix m;
+	m.r[0] = VectorSet(m00, m01, m02, m03);
+	m.r[1] = VectorSet(m10, m11, m12, m13);
+	m.r[2] = VectorSet(m20, m21, m22, m23);
+	m.r[3] = VectorSet(m30, m31, m32, m33);
+	return m;
+}
+
+inline Matrix MatrixIdentity()
+{
+	return MatrixSet(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+inline Matrix LoadFloat4x4(const Float4x4* source)
+{
+	Matrix m;
+	for (int i = 0; i < 4; i++)
+		m.r[i] = LoadFloat4(reinterpret_cast<const Float4*>(source->m[i]));
+	return m;
+}
+
+inline void StoreFloat4x4(Float4x4* destination, const Matrix& m)
+{
+	for (int i = 0; i < 4; i++)
+		StoreFloat4(reinterpret_cast<Float4*>(destination->m[i]), m.r[i]);
+}
+
+//a applied first, then b
+inline Matrix MatrixMultiply(const Matrix& a, const Matrix& b)
+{
+	Matrix m;
+	for (int i = 0; i < 4; i++)
+		m.r[i] = Vector4Transform(a.r[i], b);
+	return m;
+}
+
+inline Matrix operator*(const Matrix& a, const Matrix& b) { return MatrixMultiply(a, b); }
+
+inline Matrix MatrixTranspose(const Matrix& m)
+{
+#if defined(VECTOR_MATH_SSE)
+	Matrix t = m;
+	_MM_TRANSPOSE4_PS(t.r[0].v, t.r[1].v, t.r[2].v, t.r[3].v);
+	return t;
+#else
+	Float4x4 f, t;
+	StoreFloat4x4(&f, m);
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			t.m[i][j] = f.m[j][i];
+	return LoadFloat4x4(&t);
+#endif
+}
+
+//Cofactor expansion on the stored floats, only called once per frame. Writes the determinant
+//splatted to determinant if it is not null. A singular matrix gives infinities like DirectXMath.
+inline Matrix MatrixInverse(Vector* determinant, const Matrix& m)
+{
+	Float4x4 f;
+	StoreFloat4x4(&f, m);
+	const float* a = &f.m[0][0];
+	float inv[16];
+	inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+	inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+	inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+	inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+	inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+	inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+	inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+	inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+	inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+	inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+	inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+	inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+	inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+	inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+	inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+	inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+	float det = a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12];
+	if (determinant)
+		*determinant = VectorReplicate(det);
+	float rcp = 1.0f / det;
+	Float4x4 r;
+	for (int i = 0; i < 16; i++)
+		(&r.m[0][0])[i] = inv[i] * rcp;
+	return LoadFloat4x4(&r);
+}
+
+inline Matrix MatrixRotationX(float angle)
+{
+	float s = std::sin(angle), c = std::cos(angle);
+	return MatrixSet(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, c, s, 0.0f, 0.0f, -s, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+inline Matrix MatrixRotationY(float angle)
+{
+	float s = std::sin(angle), c = std::cos(angle);
+	return MatrixSet(c, 0.0f, -s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, s, 0.0f, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+inline Matrix MatrixRotationZ(float angle)
+{
+	float s = std::sin(angle), c = std::cos(angle);
+	return MatrixSet(c, s, 0.0f, 0.0f, -s, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+//Roll around z first, then pitch around x, then yaw around y
+inline Matrix MatrixRotationRollPitchYaw(float pitch, float yaw, float roll)
+{
+	return MatrixRotationZ(roll) * MatrixRotationX(pitch) * MatrixRotationY(yaw);
+}
+
+inline Matrix MatrixRotationAxis(Vector axis, float angle)
+{
+	Vector n = Vector3Normalize(axis);
+	float x = VectorGetX(n), y = VectorGetY(n), z = VectorGetZ(n);
+	float s = std::sin(angle), c = std::cos(angle), t = 1.0f - c;
+	return MatrixSet(
+		c + x * x * t, x * y * t + z * s, x * z * t - y * s, 0.0f,
+		x * y * t - z * s, c + y * y * t, y * z * t + x * s, 0.0f,
+		x * z * t + y * s, y * z * t - x * s, c + z * z * t, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+inline Matrix MatrixLookToLH(Vector eye, Vector direction, Vector up)
+{
+	Vector r2 = Vector3Normalize(direction);
+	Vector r0 = Vector3Normalize(Vector3Cross(up, r2));
+	Vector r1 = Vector3Cross(r2, r0);
+	Vector negEye = -eye;
+	Matrix m;
+	m.r[0] = VectorSet(VectorGetX(r0), VectorGetY(r0), VectorGetZ(r0), VectorGetX(Vector3Dot(r0, negEye)));
+	m.r[1] = VectorSet(VectorGetX(r1), VectorGetY(r1), VectorGetZ(r1), VectorGetX(Vector3Dot(r1, negEye)));
+	m.r[2] = VectorSet(VectorGetX(r2), VectorGetY(r2), VectorGetZ(r2), VectorGetX(Vector3Dot(r2, negEye)));
+	m.r[3] = VectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	return MatrixTranspose(m);
+}
+
+//Depth goes from 0 at nearZ to 1 at farZ
+inline Matrix MatrixPerspectiveFovLH(float fovAngleY, float aspectRatio, float nearZ, float farZ)
+{
+	float height = std::cos(0.5f * fovAngleY) / std::sin(0.5f * fovAngleY);
+	float width = height / aspectRatio;
+	float range = farZ / (farZ - nearZ);
+	return MatrixSet(width, 0.0f, 0.0f, 0.0f, 0.0f, height, 0.0f, 0.0f, 0.0f, 0.0f, range, 1.0f, 0.0f, 0.0f, -range * nearZ, 0.0f);
+}
+
+}
+
+#endif
@@ -0,0 +1,328 @@
+#include "WideBVH.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static float NodeHalfArea(const BVHNode& n)
+{
+	float x = n.maxx - n.minx, y = n.maxy - n.miny, z = n.maxz - n.minz;
+	return x * y + y * z + z * x;
+}
+
+//Appends the wide node for binary node binary and, depth first, everything below it. Returns its index.
+template<unsigned N>
+static int Collapse(const BVHNode* nodes, int binary, std::vector<WideBVHNode<N>>& wide)
+{
+	int children[N];
+	unsigned childCount = 0;
+	if (nodes[binary].count > 0)
+		children[childCount++] = binary; //A tree that is a single leaf
+	else
+	{
+		children[childCount++] = nodes[binary].leftFirst;
+		children[childCount++] = nodes[binary].leftFirst + 1;
+	}
+
+	//Open the biggest inner child, it is the one most rays would have to test the children of next
+	while (childCount < N)
+	{
+		int open = -1;
+		float openArea = -1.0f;
+		for (unsigned c = 0; c < childCount; c++)
+		{
+			const BVHNode& n = nodes[children[c]];
+			if (n.count == 0 && NodeHalfArea(n) > openArea)
+			{
+				open = (int)c;
+				openArea = NodeHalfArea(n);
+			}
+		}
+		if (open < 0)
+			break;
+		int opened = children[open];
+		children[open] = nodes[opened].leftFirst;
+		children[childCount++] = nodes[opened].leftFirst + 1;
+	}
+
+	int index = (int)wide.size();
+	wide.push_back(WideBVHNode<N>());
+	WideBVHNode<N> node = {};
+	node.childCount = (int)childCount;
+	for (unsigned c = 0; c < childCount; c++)
+	{
+		const BVHNode& n = nodes[children[c]];
+		node.minx[c] = n.minx;
+		node.miny[c] = n.miny;
+		node.minz[c] = n.minz;
+		node.maxx[c] = n.maxx;
+		node.maxy[c] = n.maxy;
+		node.maxz[c] = n.maxz;
+		node.count[c] = n.count;
+		node.child[c] = n.count > 0 ? n.leftFirst : Collapse(nodes, children[c], wide);
+	}
+	wide[index] = node;
+	return index;
+}
+
+template<unsigned N>
+static void CollapseMeshes(const BVHNode* nodes, std::vector<MeshIndices>& meshes, std::vector<WideBVHNode<N>>& wide)
+{
+	wide.clear();
+	for (MeshIndices& mesh : meshes)
+	{
+		if (mesh.rootPartition < 0)
+			continue;
+		size_t first = wide.size();
+		mesh.rootPartition = Collapse(nodes, mesh.rootPartition, wide);
+		mesh.partitionCount = (int)(wide.size() - first);
+	}
+}
+
+//A child of a quantized node before it is written: an inner node of the BVHNode8 tree, or a leaf. A leaf with more
+//triangles than a count byte holds becomes an inner node whose children are chunks of it, all with the leaf's bounds.
+struct QuantizedChild
+{
+	float min[3];
+	float max[3];
+	int node8; //-1 for leaves
+	int first;
+	int count;
+};
+
+#define QUANTIZED_MAX_LEAF_SIZE 255
+
+static bool IsQuantizedInner(const QuantizedChild& c)
+{
+	return c.node8 >= 0 || c.count > QUANTIZED_MAX_LEAF_SIZE;
+}
+
+static void GetQuantizedChildren(const std::vector<BVHNode8>& wide, const QuantizedChild& parent, std::vector<QuantizedChild>& children)
+{
+	children.clear();
+	if (parent.node8 < 0)
+	{
+		int chunk = (parent.count + 7) / 8;
+		for (int first = parent.first; first < parent.first + parent.count; first += chunk)
+		{
+			QuantizedChild c = parent;
+			c.first = first;
+			c.count = (std::min)(chunk, parent.first + parent.count - first);
+			children.push_back(c);
+		}
+		return;
+	}
+	const BVHNode8& n = wide[parent.node8];
+	for (int i = 0; i < n.childCount; i++)
+	{
+		QuantizedChild c = { { n.minx[i], n.miny[i], n.minz[i] }, { n.maxx[i], n.maxy[i], n.maxz[i] }, -1, 0, 0 };
+		if (n.count[i] > 0)
+		{
+			c.first = n.child[i];
+			c.count = n.count[i];
+		}
+		else
+			c.node8 = n.child[i];
+		children.push_back(c);
+	}
+}
+
+//Finds the smallest power of two cell that puts every child on a 256 step grid starting at origin,
+//rounding each bound outwards until the decoded value contains it
+static int8_t QuantizeAxis(const std::vector<QuantizedChild>& children, int axis, float origin, uint8_t* qmin, uint8_t* qmax)
+{
+	float extent = 0.0f;
+	for (const QuantizedChild& c : children)
+		extent = (std::max)(extent, c.max[axis] - origin);
+	int exponent = 0;
+	std::frexp(extent / 255.0f, &exponent);
+	for (exponent = (std::max)(exponent, -126); ; exponent++)
+	{
+		float cell = QuantizedCellSize((int8_t)exponent);
+		bool fits = true;
+		for (size_t i = 0; i < children.size() && fits; i++)
+		{
+			float lo = std::floor((children[i].min[axis] - origin) / cell);
+			while (lo > 0.0f && origin + lo * cell > children[i].min[axis])
+				lo -= 1.0f;
+			float hi = std::ceil((children[i].max[axis] - origin) / cell);
+			while (origin + hi * cell < children[i].max[axis])
+				hi += 1.0f;
+			fits = hi <= 255.0f;
+			qmin[i] = (uint8_t)(std::max)(0.0f, lo);
+			qmax[i] = (uint8_t)(std::min)(255.0f, hi);
+		}
+		if (fits)
+			return (int8_t)exponent;
+	}
+}
+
+//Writes the node at index for children, then recursively the inner children it allocates after the end of the table
+static void EmitQuantizedNode(const std::vector<BVHNode8>& wide, const std::vector<QuantizedChild>& children, const uint32_t* triangleIndices,
+	int index, std::vector<BVHNodeQ8>& nodes, std::vector<uint32_t>& indices)
+{
+	BVHNodeQ8 node = {};
+	node.childCount = (uint8_t)children.size();
+	float origin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	for (const QuantizedChild& c : children)
+		for (int axis = 0; axis < 3; axis++)
+			origin[axis] = (std::min)(origin[axis], c.min[axis]);
+	node.originx = origin[0];
+	node.originy = origin[1];
+	node.originz = origin[2];
+	node.exponentx = QuantizeAxis(children, 0, origin[0], node.qminx, node.qmaxx);
+	node.exponenty = QuantizeAxis(children, 1, origin[1], node.qminy, node.qmaxy);
+	node.exponentz = QuantizeAxis(children, 2, origin[2], node.qminz, node.qmaxz);
+
+	node.childBase = (int)nodes.size();
+	node.triangleBase = (int)indices.size();
+	unsigned innerCount = 0;
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		if (IsQuantizedInner(children[i]))
+		{
+			innerCount++;
+			continue;
+		}
+		node.count[i] = (uint8_t)children[i].count;
+		indices.insert(indices.end(), triangleIndices + children[i].first, triangleIndices + children[i].first + children[i].count);
+	}
+	nodes.resize(nodes.size() + innerCount);
+	nodes[index] = node;
+
+	std::vector<QuantizedChild> grandchildren;
+	int inner = node.childBase;
+	for (const QuantizedChild& c : children)
+	{
+		if (!IsQuantizedInner(c))
+			continue;
+		GetQuantizedChildren(wide, c, grandchildren);
+		EmitQuantizedNode(wide, grandchildren, triangleIndices, inner++, nodes, indices);
+	}
+}
+
+static void QuantizeMeshes(const std::vector<BVHNode8>& wide, const std::vector<MeshIndices>& wideMeshes, const uint32_t* triangleIndices,
+	std::vector<MeshIndices>& meshes, std::vector<BVHNodeQ8>& nodes, std::vector<uint32_t>& indices)
+{
+	nodes.clear();
+	indices.clear();
+	std::vector<QuantizedChild> children;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		if (wideMeshes[m].rootPartition < 0)
+			continue;
+		QuantizedChild root = {};
+		root.node8 = wideMeshes[m].rootPartition;
+		GetQuantizedChildren(wide, root, children);
+		meshes[m].rootPartition = (int)nodes.size();
+		nodes.push_back(BVHNodeQ8());
+		EmitQuantizedNode(wide, children, triangleIndices, meshes[m].rootPartition, nodes, indices);
+		meshes[m].partitionCount = (int)nodes.size() - meshes[m].rootPartition;
+	}
+}
+
+const char* GetBVHLayoutName(BVHLayout layout)
+{
+	switch (layout)
+	{
+	case BVH_LAYOUT_BINARY:
+		return "BVH2";
+	case BVH_LAYOUT_WIDE4:
+		return "BVH4";
+	case BVH_LAYOUT_WIDE8:
+		return "BVH8";
+	case BVH_LAYOUT_QUANTIZED8:
+		return "BVH8Q";
+	case BVH_LAYOUT_BINARY_BLOCKS:
+		return "BVH2Blocks";
+	default:
+		return "unknown";
+	}
+}
+
+WideBVH::WideBVH()
+{
+}
+
+WideBVH::~WideBVH()
+{
+}
+
+void WideBVH::Set(BVHLayout layout, const BVHNode* nodes, size_t nodeCount, const uint32_t* triangleIndices, size_t triangleIndexCount,
+	const MeshIndices* meshes, size_t meshCount)
+{
+	_layout = layout;
+	_triangleIndices.assign(triangleIndices, triangleIndices + triangleIndexCount);
+	_meshes.assign(meshes, meshes + meshCount);
+	_nodes.clear();
+	_nodes4.clear();
+	_nodes8.clear();
+	_nodesQ8.clear();
+	if (layout == BVH_LAYOUT_WIDE4)
+		CollapseMeshes(nodes, _meshes, _nodes4);
+	else if (layout == BVH_LAYOUT_WIDE8)
+		CollapseMeshes(nodes, _meshes, _nodes8);
+	else if (layout == BVH_LAYOUT_QUANTIZED8)
+	{
+		std::vector<BVHNode8> wide;
+		std::vector<MeshIndices> wideMeshes = _meshes;
+		CollapseMeshes(nodes, wideMeshes, wide);
+		QuantizeMeshes(wide, wideMeshes, triangleIndices, _meshes, _nodesQ8, _triangleIndices);
+	}
+	else
+		_nodes.assign(nodes, nodes + nodeCount);
+}
+
+BVHLayout WideBVH::GetLayout() const
+{
+	return _layout;
+}
+
+const MeshIndices * WideBVH::GetMeshes() const
+{
+	return _meshes.data();
+}
+
+int WideBVH::GetMeshCount() const
+{
+	return (int)_meshes.size();
+}
+
+const BVHNode * WideBVH::GetNodes() const
+{
+	return _nodes.data();
+}
+
+const BVHNode4 * WideBVH::GetNodes4() const
+{
+	return _nodes4.data();
+}
+
+const BVHNode8 * WideBVH::GetNodes8() const
+{
+	return _nodes8.data();
+}
+
+const BVHNodeQ8 * WideBVH::GetNodesQ8() const
+{
+	return _nodesQ8.data();
+}
+
+const uint32_t * WideBVH::GetTriangleIndices() const
+{
+	return _triangleIndices.data();
+}
+
+size_t WideBVH::GetNodeCount() const
+{
+	return _nodes.size() + _nodes4.size() + _nodes8.size() + _nodesQ8.size();
+}
+
+size_t WideBVH::GetNodeBytes() const
+{
+	return _nodes.size() * sizeof(BVHNode) + _nodes4.size() * sizeof(BVHNode4) + _nodes8.size() * sizeof(BVHNode8) + _nodesQ8.size() * sizeof(BVHNodeQ8);
+}
+
+size_t WideBVH::GetTriangleIndexBytes() const
+{
+	return _triangleIndices.size() * sizeof(uint32_t);
+}
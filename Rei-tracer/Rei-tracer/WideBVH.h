@@ -0,0 +1,104 @@
+#ifndef _WIDE_BVH_H_
+#define _WIDE_BVH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "Structs.h"
+#include "BVH.h"
+
+#define WIDE_BVH_MAX_WIDTH 8
+//Collapsing never makes a path longer, and a node pushes at most all but one of its children
+#define WIDE_BVH_STACK_SIZE ((WIDE_BVH_MAX_WIDTH - 1) * BVH_MAX_DEPTH + 1)
+
+//Up to N children with their bounds in structure of arrays layout, so one SIMD instruction sequence
+//tests a ray against all of them. The used children come first. count[i] == 0 makes child[i] an
+//inner node, otherwise it is a leaf over triangle index table entries [child[i], child[i] + count[i]).
+template<unsigned N>
+struct WideBVHNode
+{
+	float minx[N];
+	float miny[N];
+	float minz[N];
+	float maxx[N];
+	float maxy[N];
+	float maxz[N];
+	int child[N];
+	int count[N];
+	int childCount;
+};
+
+typedef WideBVHNode<4> BVHNode4;
+typedef WideBVHNode<8> BVHNode8;
+
+//Eight children with their bounds stored as 8 bit offsets on a grid over the node, 80 bytes instead of the 260 of a BVHNode8.
+//A cell is 2^exponent wide on each axis, so decoding origin + q * cell is exact, and the offsets are rounded outwards
+//so the decoded boxes always contain the real ones. Inner children follow each other in the node table from
+//childBase and the triangles of the leaf children follow each other in the triangle index table from triangleBase,
+//both in slot order, so only the leaf triangle counts (0 for inner children) are stored per child.
+struct BVHNodeQ8
+{
+	float originx, originy, originz;
+	int8_t exponentx, exponenty, exponentz;
+	uint8_t childCount;
+	int childBase;
+	int triangleBase;
+	uint8_t count[8];
+	uint8_t qminx[8];
+	uint8_t qminy[8];
+	uint8_t qminz[8];
+	uint8_t qmaxx[8];
+	uint8_t qmaxy[8];
+	uint8_t qmaxz[8];
+};
+
+//2^exponent, built from the bits since exponents stay within the normal range. Static like the RayKernels.h helpers.
+static inline float QuantizedCellSize(int8_t exponent)
+{
+	uint32_t bits = (uint32_t)(exponent + 127) << 23;
+	float cell;
+	memcpy(&cell, &bits, sizeof(cell));
+	return cell;
+}
+
+const char* GetBVHLayoutName(BVHLayout layout);
+
+//The mesh bvhs of a scene in the layout the cpu traversal should use. Set copies the shared binary tables and
+//for a wide layout collapses each tree, pulling the grandchildren of the biggest inner children up into a
+//node until it holds 4 or 8 children. Leaves are kept as they are and still point into the triangle index table.
+//The quantized layout also reorders the triangle index table to match its nodes.
+//Collapsing is O(n), so after a refit the tables are simply set again.
+class WideBVH
+{
+public:
+	WideBVH();
+	~WideBVH();
+
+	void Set(BVHLayout layout, const BVHNode* nodes, size_t nodeCount, const uint32_t* triangleIndices, size_t triangleIndexCount,
+		const MeshIndices* meshes, size_t meshCount);
+
+	BVHLayout GetLayout() const;
+	//Same ranges as the meshes given to Set, with rootPartition and partitionCount moved into the node table of the layout
+	const MeshIndices* GetMeshes() const;
+	int GetMeshCount() const;
+	const BVHNode* GetNodes() const;
+	const BVHNode4* GetNodes4() const;
+	const BVHNode8* GetNodes8() const;
+	const BVHNodeQ8* GetNodesQ8() const;
+	const uint32_t* GetTriangleIndices() const;
+	size_t GetNodeCount() const;
+	size_t GetNodeBytes() const;
+	size_t GetTriangleIndexBytes() const;
+
+private:
+	BVHLayout _layout = BVH_LAYOUT_BINARY;
+	std::vector<BVHNode> _nodes;
+	std::vector<BVHNode4> _nodes4;
+	std::vector<BVHNode8> _nodes8;
+	std::vector<BVHNodeQ8> _nodesQ8;
+	std::vector<uint32_t> _triangleIndices;
+	std::vector<MeshIndices> _meshes;
+};
+
+#endif
@@ -0,0 +1,212 @@
+//Wide bvh traversal for the nodes in WideBVH.h, written once against the same SIMD wrapper as RayPacketKernels.inl
+//plus LoadBytes, which widens WIDTH bytes to floats. Here the lanes are the children of one node instead of rays,
+//so a node with N children is tested in N / WIDTH instruction sequences and a kernel only exists where WIDTH divides N.
+
+//Returns a bit per child whose box the ray enters before tfar and writes where it enters each box to tnear
+template<unsigned N>
+static unsigned WideNodeVSRay(const WideBVHNode<N>& node, const Ray& r, const Vec3& rcpDir, float tfar, float* tnear)
+{
+	VFloat ox = Set1(r.o.x), oy = Set1(r.o.y), oz = Set1(r.o.z);
+	VFloat rx = Set1(rcpDir.x), ry = Set1(rcpDir.y), rz = Set1(rcpDir.z);
+	unsigned hits = 0;
+	for (unsigned c = 0; c < N; c += WIDTH)
+	{
+		VFloat tmin = Set1(-INFINITY);
+		VFloat tmax = Set1(INFINITY);
+		ClipSlab((Load(node.minx + c) - ox) * rx, (Load(node.maxx + c) - ox) * rx, tmin, tmax);
+		ClipSlab((Load(node.miny + c) - oy) * ry, (Load(node.maxy + c) - oy) * ry, tmin, tmax);
+		ClipSlab((Load(node.minz + c) - oz) * rz, (Load(node.maxz + c) - oz) * rz, tmin, tmax);
+
+		Store(tnear + c, tmin);
+		hits |= Bits(Ge(tmax, Max(tmin, Set1(0.0f))) & Le(tmin, Set1(tfar))) << c;
+	}
+	return hits & ((1U << node.childCount) - 1);
+}
+
+//Same test against the children of a quantized node, decoded to the conservative boxes first
+inline unsigned WideNodeVSRay(const BVHNodeQ8& node, const Ray& r, const Vec3& rcpDir, float tfar, float* tnear)
+{
+	VFloat ox = Set1(node.originx), oy = Set1(node.originy), oz = Set1(node.originz);
+	VFloat cx = Set1(QuantizedCellSize(node.exponentx)), cy = Set1(QuantizedCellSize(node.exponenty)), cz = Set1(QuantizedCellSize(node.exponentz));
+	VFloat rox = Set1(r.o.x), roy = Set1(r.o.y), roz = Set1(r.o.z);
+	VFloat rx = Set1(rcpDir.x), ry = Set1(rcpDir.y), rz = Set1(rcpDir.z);
+	unsigned hits = 0;
+	for (unsigned c = 0; c < 8; c += WIDTH)
+	{
+		VFloat tmin = Set1(-INFINITY);
+		VFloat tmax = Set1(INFINITY);
+		ClipSlab((ox + LoadBytes(node.qminx + c) * cx - rox) * rx, (ox + LoadBytes(node.qmaxx + c) * cx - rox) * rx, tmin, tmax);
+		ClipSlab((oy + LoadBytes(node.qminy + c) * cy - roy) * ry, (oy + LoadBytes(node.qmaxy + c) * cy - roy) * ry, tmin, tmax);
+		ClipSlab((oz + LoadBytes(node.qminz + c) * cz - roz) * rz, (oz + LoadBytes(node.qmaxz + c) * cz - roz) * rz, tmin, tmax);
+
+		Store(tnear + c, tmin);
+		hits |= Bits(Ge(tmax, Max(tmin, Set1(0.0f))) & Le(tmin, Set1(tfar))) << c;
+	}
+	return hits & ((1U << node.childCount) - 1);
+}
+
+//Tests the leaves among the hit children right away and pushes the inner ones farthest first,
+//so the nearest is popped next and its hits shrink tfar for the rest
+template<unsigned N, typename LeafTest>
+static bool VisitWideNode(const WideBVHNode<N>& node, unsigned hits, const float* tnear, int* stack, int& stackPtr, LeafTest leaf)
+{
+	int inner[N];
+	unsigned innerCount = 0;
+	for (unsigned c = 0; c < N; c++)
+	{
+		if (!(hits >> c & 1))
+			continue;
+		if (node.count[c] > 0)
+		{
+			if (leaf(node.child[c], node.count[c]))
+				return true;
+			continue;
+		}
+		unsigned i = innerCount++;
+		for (; i > 0 && tnear[inner[i - 1]] < tnear[c]; i--)
+			inner[i] = inner[i - 1];
+		inner[i] = (int)c;
+	}
+	for (unsigned i = 0; i < innerCount; i++)
+		stack[stackPtr++] = node.child[inner[i]];
+	return false;
+}
+
+//Same for a quantized node, where the children are found by counting the inner and leaf slots before them
+template<typename LeafTest>
+static bool VisitWideNode(const BVHNodeQ8& node, unsigned hits, const float* tnear, int* stack, int& stackPtr, LeafTest leaf)
+{
+	int inner[8];
+	int innerNode[8];
+	unsigned innerCount = 0;
+	int child = node.childBase;
+	int first = node.triangleBase;
+	for (unsigned c = 0; c < node.childCount; c++)
+	{
+		if (node.count[c] > 0)
+		{
+			if (hits >> c & 1 && leaf(first, node.count[c]))
+				return true;
+			first += node.count[c];
+			continue;
+		}
+		if (hits >> c & 1)
+		{
+			unsigned i = innerCount++;
+			for (; i > 0 && tnear[inner[i - 1]] < tnear[c]; i--)
+			{
+				inner[i] = inner[i - 1];
+				innerNode[i] = innerNode[i - 1];
+			}
+			inner[i] = (int)c;
+			innerNode[i] = child;
+		}
+		child++;
+	}
+	for (unsigned i = 0; i < innerCount; i++)
+		stack[stackPtr++] = innerNode[i];
+	return false;
+}
+
+//The triangles are tested with test like RayVSSelectedTriangle, precomputed is only read by the woop and watertight tests
+template<typename Node>
+static int TraverseWideBVH(const Ray& r, const Vec3& rcpDir, TriangleTest test, const Triangle* triangles, const PrecomputedTriangle* precomputed,
+	const Node* nodes, const uint32_t* triangleIndices, const MeshIndices* meshes, int meshCount, float& dist, float& u, float& v, RayStats* stats)
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	int triangleIndex = -1;
+	auto triangleHit = [&](int index)
+	{
+		KERNEL_STAT_ADD(stats, triangleTests, 1);
+		float bu = 0.0f, bv = 0.0f;
+		float ttt = RayVSSelectedTriangle(test, triangles, precomputed, index, r, wr, bu, bv);
+		if (IsCloserHit(ttt, index, dist, triangleIndex))
+		{
+			dist = ttt;
+			u = bu;
+			v = bv;
+			triangleIndex = index;
+		}
+	};
+	auto leaf = [&](int first, int count)
+	{
+		for (int c = first; c < first + count; c++)
+			triangleHit((int)triangleIndices[c]);
+		return false;
+	};
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[WIDE_BVH_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+			while (stackPtr)
+			{
+				const Node& node = nodes[stack[--stackPtr]];
+				KERNEL_STAT_ADD(stats, nodeVisits, 1);
+				float tnear[WIDE_BVH_MAX_WIDTH];
+				unsigned hits = WideNodeVSRay(node, r, rcpDir, dist < 0.0f ? FLT_MAX : dist, tnear);
+				VisitWideNode(node, hits, tnear, stack, stackPtr, leaf);
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+				triangleHit(j);
+		}
+	}
+	return triangleIndex;
+}
+
+template<typename Node>
+static bool TraverseWideBVHForShadows(const Ray& r, const Vec3& rcpDir, float dist, TriangleTest test, const Triangle* triangles,
+	const PrecomputedTriangle* precomputed, const Node* nodes, const uint32_t* triangleIndices, const MeshIndices* meshes, int meshCount, RayStats* stats)
+{
+	WatertightRay wr = MakeWatertightRay(r);
+	auto occludes = [&](int index)
+	{
+		KERNEL_STAT_ADD(stats, triangleTests, 1);
+		float bu = 0.0f, bv = 0.0f;
+		float comp = RayVSSelectedTriangle(test, triangles, precomputed, index, r, wr, bu, bv);
+		return comp < dist && comp > 0.0f;
+	};
+	auto leaf = [&](int first, int count)
+	{
+		for (int c = first; c < first + count; c++)
+		{
+			if (occludes((int)triangleIndices[c]))
+				return true;
+		}
+		return false;
+	};
+	for (int i = 0; i < meshCount; i++)
+	{
+		const MeshIndices& mesh = meshes[i];
+		if (mesh.rootPartition >= 0)
+		{
+			int stack[WIDE_BVH_STACK_SIZE];
+			int stackPtr = 0;
+			stack[stackPtr++] = mesh.rootPartition;
+			while (stackPtr)
+			{
+				const Node& node = nodes[stack[--stackPtr]];
+				KERNEL_STAT_ADD(stats, nodeVisits, 1);
+				float tnear[WIDE_BVH_MAX_WIDTH];
+				unsigned hits = WideNodeVSRay(node, r, rcpDir, dist, tnear);
+				if (VisitWideNode(node, hits, tnear, stack, stackPtr, leaf))
+					return true;
+			}
+		}
+		else
+		{
+			for (int j = mesh.lowerIndex; j < mesh.upperIndex; j++)
+			{
+				if (occludes(j))
+					return true;
+			}
+		}
+	}
+	return false;
+}
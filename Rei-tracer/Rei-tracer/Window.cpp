@@ -1,7 +1,7 @@
 #include "Window.h"
 #include <exception>
 #include <SDL_syswm.h>
-Window::Window(uint32_t width, uint32_t height, bool fullscreen)
+Window::Window(uint32_t width, uint32_t height, bool fullscreen, bool hidden)
 {
 	_width = width;
 	_height = height;
@@ -10,7 +10,7 @@ Window::Window(uint32_t width, uint32_t height, bool fullscreen)
 	_surface = nullptr;
 	if (SDL_Init(SDL_INIT_VIDEO) < 0)
 		throw std::exception("Could not initialize SDL");
-	_window = SDL_CreateWindow("Assignment 2", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_SHOWN);
+	_window = SDL_CreateWindow("Assignment 2", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, hidden ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN);
 	if (_window == nullptr)
 		throw std::exception("Failed to create window");
 	SDL_SysWMinfo info;
@@ -39,7 +39,7 @@ bool Window::GetWindowedMode() const
 	return !fullScreen;
 }
 
-HWND Window::GetHandle() const
+void * Window::GetNativeHandle() const
 {
 	return _hwnd;
 }
@@ -64,6 +64,16 @@ void Window::ToggleLockMouseToScreen()
 
 }
 
+void Window::Present(const uint8_t * rgba)
+{
+	SDL_Surface* surface = SDL_GetWindowSurface(_window);
+	if (!surface)
+		return;
+	//ABGR8888 is r, g, b, a in memory on little endian
+	SDL_ConvertPixels(_width, _height, SDL_PIXELFORMAT_ABGR8888, rgba, _width * 4, surface->format->format, surface->pixels, surface->pitch);
+	SDL_UpdateWindowSurface(_window);
+}
+
 //void Window::KeepMouseCentered(bool center)
 //{
 //	
@@ -1,9 +1,10 @@
 #ifndef _WINDOW_H_
 #define _WINDOW_H_
 #include <SDL.h>
-#include <d3d11.h>
 #include <string>
-class Window
+#include "IWindow.h"
+
+class Window : public IWindow
 {
 private:
 	uint32_t _width;
@@ -11,21 +12,25 @@ private:
 	bool fullScreen;
 	SDL_Window* _window;
 	SDL_Surface* _surface;
-	HWND _hwnd;
+	void* _hwnd;
 
 public:
-	Window(uint32_t width = 800, uint32_t height = 600, bool fullscreen = false);
+	//A hidden window still backs a swap chain, for runs that only read the frames back
+	Window(uint32_t width = 800, uint32_t height = 600, bool fullscreen = false, bool hidden = false);
 	~Window();
 
 	uint32_t GetWidth() const;
 	uint32_t GetHeight() const;
 	bool GetWindowedMode() const;
-	HWND GetHandle() const;
+	void* GetNativeHandle() const;
 
 	void SetTitle(const std::string& title);
 
 	void LockMouseToScreen(bool lock);
 	void ToggleLockMouseToScreen();
+
+	//Only for the cpu backend, Direct3D11 presents through its own swap chain
+	void Present(const uint8_t* rgba);
 	//void KeepMouseCentered(bool center);
 	
 